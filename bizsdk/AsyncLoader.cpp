@@ -0,0 +1,506 @@
+/*****************************************************************************
+ * Filename			AsyncLoader.cpp
+ *
+ * License			GPLv3
+ *
+ * Author			Andrea Bizzotto (bizz84@gmail.com)
+ *
+ * Platform			LinuxX11 / OpenGL
+ *
+ * Description		Textures decoded in the background and uploaded per frame
+ *
+ *****************************************************************************/
+
+#include "AsyncLoader.h"
+#include "GLStateCache.h"
+#include "Misc.h"
+
+#include <stdio.h>
+#include <assert.h>
+
+// Default upload budget, about the size of two 1024x1024 RGBA textures
+static const size_t DefaultBudget = 8 * 1024 * 1024;
+
+AsyncLoader::AsyncLoader() : bInit(false), bQuit(false), bCompression(false),
+	uiWorkers(0),
+	pPendingLock(NULL), pPendingCount(NULL), pDoneLock(NULL),
+	pDoneSignal(NULL), uiInFlight(0), uiBudget(DefaultBudget), uiUploaded(0)
+{
+
+}
+
+AsyncLoader::~AsyncLoader()
+{
+	Release();
+}
+
+AsyncLoader &AsyncLoader::Instance()
+{
+	static AsyncLoader instance;
+	return instance;
+}
+
+bool AsyncLoader::Init()
+{
+	if (bInit)
+		return true;
+
+	SDL_Surface *screen = SDL_GetVideoSurface();
+	if (!screen)
+	{
+		printf("AsyncLoader: no video surface\n");
+		return false;
+	}
+	// Copied since the workers can't call SDL_DisplayFormat()
+	format = *screen->format;
+	bCompression = TextureFile::CompressionSupported();
+
+	pPendingLock = SDL_CreateMutex();
+	pPendingCount = SDL_CreateSemaphore(0);
+	pDoneLock = SDL_CreateMutex();
+	pDoneSignal = SDL_CreateSemaphore(0);
+	bQuit = false;
+	for (uiWorkers = 0; uiWorkers < NUM_WORKERS; uiWorkers++)
+	{
+		apWorker[uiWorkers] = SDL_CreateThread(WorkerMain, this);
+		if (apWorker[uiWorkers] == NULL)
+		{
+			// Jobs are decoded by Submit() if there are no workers
+			printf("AsyncLoader: unable to create worker thread %d\n",
+				uiWorkers);
+			break;
+		}
+	}
+	if (Verbose(VerboseInfo))
+		printf("AsyncLoader: %d worker threads\n", uiWorkers);
+	return (bInit = true);
+}
+
+int AsyncLoader::WorkerMain(void *data)
+{
+	AsyncLoader *loader = (AsyncLoader *)data;
+	while (true)
+	{
+		SDL_SemWait(loader->pPendingCount);
+		if (loader->bQuit)
+			break;
+
+		// The job may have been taken by Wait() already
+		Job *job = NULL;
+		SDL_LockMutex(loader->pPendingLock);
+		if (!loader->aPending.empty())
+		{
+			job = loader->aPending.front();
+			loader->aPending.pop_front();
+		}
+		SDL_UnlockMutex(loader->pPendingLock);
+		if (!job)
+			continue;
+
+		job->bDecoded = loader->Decode(job);
+
+		SDL_LockMutex(loader->pDoneLock);
+		loader->aDone.push_back(job);
+		SDL_UnlockMutex(loader->pDoneLock);
+		SDL_SemPost(loader->pDoneSignal);
+	}
+	return 0;
+}
+
+/*****************************************************************************
+ * Decoding (any thread)
+ *****************************************************************************/
+
+unsigned int AsyncLoader::Job::NumLevels(unsigned int face) const
+{
+	if (!apContainer.empty())
+		return bMipmaps ? apContainer[face].NumLevels() : 1;
+	return aFaces[face].NumLevels();
+}
+
+bool AsyncLoader::OpenContainers(Job *job) const
+{
+	for (unsigned int i = 0; i < job->asFile.size(); i++)
+	{
+		const char *file = job->asFile[i].c_str();
+		string path = TextureFile::PathOf(file);
+		TextureFile *container = new TextureFile();
+		job->apContainer.push_back(container);
+		if (!container->Open(path.c_str()))
+			break;
+
+		// Containers can be shipped without their sources
+		unsigned long long hash = HashFile(file);
+		if (hash && hash != container->SourceHash())
+		{
+			printf("%s is older than %s, not used\n", path.c_str(), file);
+			break;
+		}
+		if (container->IsCompressed() && !bCompression)
+		{
+			printf("%s is compressed, S3TC is not supported\n", path.c_str());
+			break;
+		}
+		// All the faces of a cube map must match the first one
+		const TextureFile &first = job->apContainer[0];
+		if (container->InternalFormat() != first.InternalFormat())
+			break;
+
+		if (i + 1 == job->asFile.size())
+		{
+			for (unsigned int face = 0; face < job->asFile.size(); face++)
+			{
+				job->uiBytes += job->apContainer[face].Bytes(
+					job->NumLevels(face));
+			}
+			return true;
+		}
+	}
+	job->apContainer.clear();
+	return false;
+}
+
+bool AsyncLoader::Decode(Job *job) const
+{
+	job->uiBytes = 0;
+	if (OpenContainers(job))
+		return true;
+
+	job->aFaces.resize(job->asFile.size());
+	for (unsigned int i = 0; i < job->asFile.size(); i++)
+	{
+		if (!DecodeFace(job, i))
+			return false;
+	}
+	return true;
+}
+
+bool AsyncLoader::DecodeFace(Job *job, unsigned int face) const
+{
+	const char *file = job->asFile[face].c_str();
+	MipChain &chain = job->aFaces[face];
+
+	SDL_Surface *loaded = SDL_LoadBMP(file);
+	if (!loaded)
+	{
+		printf("SDL could not load %s: %s\n", file, SDL_GetError());
+		return false;
+	}
+	// Same conversion as SDL_DisplayFormat()
+	SDL_PixelFormat displayFormat = format;
+	SDL_Surface *surface = SDL_ConvertSurface(loaded, &displayFormat,
+		SDL_SWSURFACE);
+	SDL_FreeSurface(loaded);
+	if (!surface)
+	{
+		printf("SDL could not convert %s: %s\n", file, SDL_GetError());
+		return false;
+	}
+
+	Image &base = chain.Base();
+	bool converted = base.FromSurface(surface);
+	SDL_FreeSurface(surface);
+	if (!converted)
+	{
+		printf("%s is not truecolor\n", file);
+		return false;
+	}
+	// All the faces of a cube map must match the first one
+	const Image &first = job->aFaces[0].Level(0);
+	if (base.Components() != first.Components())
+	{
+		printf("%s has a different format than %s\n", file,
+			job->asFile[0].c_str());
+		return false;
+	}
+
+	// Not from the ThreadPool: workers run concurrently with the GL thread
+	if (job->bMipmaps)
+		chain.Build(Image::SRGB);
+	job->uiBytes += chain.Bytes();
+	return true;
+}
+
+/*****************************************************************************
+ * Requests and uploads (GL thread)
+ *****************************************************************************/
+
+AsyncTexture *AsyncLoader::LoadTexture(const char *file, GLint minFilter,
+	GLint magFilter, AsyncListener *listener/* = NULL*/)
+{
+	AsyncTexture *texture = new AsyncTexture(GL_TEXTURE_2D);
+	apTexture.push_back(texture);
+	if (Acquire(texture, file, listener))
+		return texture;
+
+	Job *job = new Job();
+	job->pTexture = texture;
+	job->pListener = listener;
+	job->sKey = file;
+	job->asFile.push_back(file);
+	job->iMinFilter = minFilter;
+	job->iMagFilter = magFilter;
+	job->bMipmaps = minFilter == GL_NEAREST_MIPMAP_NEAREST ||
+		minFilter == GL_LINEAR_MIPMAP_NEAREST ||
+		minFilter == GL_NEAREST_MIPMAP_LINEAR ||
+		minFilter == GL_LINEAR_MIPMAP_LINEAR;
+	job->bDecoded = false;
+	return Submit(job);
+}
+
+AsyncTexture *AsyncLoader::LoadCubeMap(const char *files[],
+	AsyncListener *listener/* = NULL*/, GLint minFilter/* = GL_NEAREST*/,
+	GLint magFilter/* = GL_NEAREST*/)
+{
+	AsyncTexture *texture = new AsyncTexture(GL_TEXTURE_CUBE_MAP);
+	apTexture.push_back(texture);
+
+	Job *job = new Job();
+	job->pTexture = texture;
+	job->pListener = listener;
+	for (unsigned int i = 0; i < 6; i++)
+	{
+		job->asFile.push_back(files[i]);
+		// Key with all the faces, files can't contain new lines
+		job->sKey += i ? "\n" : "";
+		job->sKey += files[i];
+	}
+	if (Acquire(texture, job->sKey, listener))
+	{
+		delete job;
+		return texture;
+	}
+	job->iMinFilter = minFilter;
+	job->iMagFilter = magFilter;
+	job->bMipmaps = false;
+	job->bDecoded = false;
+	return Submit(job);
+}
+
+bool AsyncLoader::Acquire(AsyncTexture *texture, const string &key,
+	AsyncListener *listener) const
+{
+	// Already loaded, nothing to do in the background
+	GLResourceManager &loader = GLResourceManager::Instance();
+	TextureHandle handle = loader.AcquireTexture(key.c_str());
+	if (!handle.IsValid())
+		return false;
+
+	texture->eState = AsyncTexture::READY;
+	texture->handle = handle;
+	texture->uiTexture = loader.GetTexture(handle);
+	if (listener)
+		listener->Loaded(*texture);
+	return true;
+}
+
+AsyncTexture *AsyncLoader::Submit(Job *job)
+{
+	uiInFlight++;
+	if (!Init() || uiWorkers == 0)
+	{
+		// Synchronous fallback, uploaded by the next Update() or Wait()
+		job->bDecoded = bInit && Decode(job);
+		aReady.push_back(job);
+		return job->pTexture;
+	}
+
+	SDL_LockMutex(pPendingLock);
+	aPending.push_back(job);
+	SDL_UnlockMutex(pPendingLock);
+	SDL_SemPost(pPendingCount);
+	return job->pTexture;
+}
+
+void AsyncLoader::Collect()
+{
+	if (!pDoneLock)
+		return;
+
+	// The lock is only held to swap the vectors, never while decoding
+	vector<Job *> done;
+	SDL_LockMutex(pDoneLock);
+	done.swap(aDone);
+	SDL_UnlockMutex(pDoneLock);
+
+	aReady.insert(aReady.end(), done.begin(), done.end());
+}
+
+void AsyncLoader::Upload(Job *job)
+{
+	GLResourceManager &loader = GLResourceManager::Instance();
+	AsyncTexture *texture = job->pTexture;
+
+	// The same file may have been loaded meanwhile
+	TextureHandle handle = loader.AcquireTexture(job->sKey.c_str());
+	if (!handle.IsValid() && job->bDecoded)
+	{
+		const GLenum target = texture->eTarget;
+		GLuint name;
+		glGenTextures(1, &name);
+		GLStateCache::Instance().BindTexture(target, name);
+		glTexParameteri(target, GL_TEXTURE_MIN_FILTER, job->iMinFilter);
+		glTexParameteri(target, GL_TEXTURE_MAG_FILTER, job->iMagFilter);
+		if (target == GL_TEXTURE_CUBE_MAP)
+		{
+			glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+			glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+			glTexParameteri(target, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+		}
+
+		for (unsigned int face = 0; face < job->asFile.size(); face++)
+		{
+			const GLenum faceTarget = target == GL_TEXTURE_CUBE_MAP ?
+				GL_TEXTURE_CUBE_MAP_POSITIVE_X + face : target;
+			// Mapped files are uploaded as they are
+			if (!job->apContainer.empty())
+				job->apContainer[face].Upload(faceTarget, job->NumLevels(face));
+			else
+				job->aFaces[face].Upload(faceTarget);
+		}
+
+		handle = loader.AddTexture(job->sKey.c_str(), name, job->uiBytes);
+		uiUploaded += job->uiBytes;
+	}
+
+	if (handle.IsValid())
+	{
+		texture->eState = AsyncTexture::READY;
+		texture->handle = handle;
+		texture->uiTexture = loader.GetTexture(handle);
+	}
+	else
+	{
+		texture->eState = AsyncTexture::FAILED;
+		printf("Unable to load texture %s\n", job->asFile[0].c_str());
+	}
+
+	if (texture->bReleased)
+		Release(texture);
+	else if (job->pListener)
+		job->pListener->Loaded(*texture);
+	delete job;
+	uiInFlight--;
+}
+
+void AsyncLoader::Update()
+{
+	Collect();
+
+	size_t uploaded = 0;
+	while (!aReady.empty() && (uploaded == 0 || uploaded < uiBudget))
+	{
+		Job *job = aReady.front();
+		aReady.pop_front();
+		// Failed jobs count as nothing
+		uploaded += job->bDecoded ? job->uiBytes : 1;
+		Upload(job);
+	}
+}
+
+AsyncLoader::Job *AsyncLoader::Remove(deque<Job *> &queue,
+	const AsyncTexture *texture)
+{
+	for (deque<Job *>::iterator iter = queue.begin(); iter != queue.end();
+		++iter)
+	{
+		if ((*iter)->pTexture == texture)
+		{
+			Job *job = *iter;
+			queue.erase(iter);
+			return job;
+		}
+	}
+	return NULL;
+}
+
+bool AsyncLoader::Wait(AsyncTexture *texture)
+{
+	assert(texture);
+	while (!texture->IsDone())
+	{
+		Collect();
+		Job *job = Remove(aReady, texture);
+		if (job)
+		{
+			Upload(job);
+			break;
+		}
+
+		// Not started yet: faster to decode it here than to wait
+		if (pPendingLock)
+		{
+			SDL_LockMutex(pPendingLock);
+			job = Remove(aPending, texture);
+			SDL_UnlockMutex(pPendingLock);
+		}
+		if (job)
+		{
+			job->bDecoded = Decode(job);
+			Upload(job);
+			break;
+		}
+
+		// Being decoded by a worker. pDoneSignal may count jobs collected
+		// already, which only costs another iteration
+		assert(pDoneSignal);
+		SDL_SemWait(pDoneSignal);
+	}
+	return texture->IsReady();
+}
+
+void AsyncLoader::Release(AsyncTexture *texture)
+{
+	assert(texture);
+	if (!texture->IsDone())
+	{
+		texture->bReleased = true;
+		return;
+	}
+	if (texture->IsReady())
+		GLResourceManager::Instance().Release(texture->handle);
+
+	for (ptr_vector<AsyncTexture>::iterator iter = apTexture.begin();
+		iter != apTexture.end(); ++iter)
+	{
+		if (&*iter == texture)
+		{
+			apTexture.erase(iter);
+			return;
+		}
+	}
+	assert(!"texture not owned by AsyncLoader");
+}
+
+void AsyncLoader::Release()
+{
+	if (bInit)
+	{
+		bQuit = true;
+		for (unsigned int i = 0; i < uiWorkers; i++)
+			SDL_SemPost(pPendingCount);
+		for (unsigned int i = 0; i < uiWorkers; i++)
+			SDL_WaitThread(apWorker[i], NULL);
+		uiWorkers = 0;
+		Collect();
+	}
+
+	aReady.insert(aReady.end(), aPending.begin(), aPending.end());
+	for (unsigned int i = 0; i < aReady.size(); i++)
+		delete aReady[i];
+	aPending.clear();
+	aReady.clear();
+	uiInFlight = 0;
+	apTexture.clear();
+
+	if (!bInit)
+		return;
+
+	SDL_DestroyMutex(pPendingLock);
+	SDL_DestroySemaphore(pPendingCount);
+	SDL_DestroyMutex(pDoneLock);
+	SDL_DestroySemaphore(pDoneSignal);
+	pPendingLock = pDoneLock = NULL;
+	pPendingCount = pDoneSignal = NULL;
+	bInit = false;
+}
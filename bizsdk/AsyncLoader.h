@@ -0,0 +1,226 @@
+/*****************************************************************************
+ * Filename			AsyncLoader.h
+ *
+ * License			GPLv3
+ *
+ * Author			Andrea Bizzotto (bizz84@gmail.com)
+ *
+ * Platform			LinuxX11 / OpenGL
+ *
+ * Description		Textures decoded in the background and uploaded per frame
+ *
+ *****************************************************************************/
+
+#ifndef _ASYNC_LOADER_H_
+#define _ASYNC_LOADER_H_
+
+#include "Extensions.h"
+#include "GLResourceManager.h"
+#include "Image.h"
+#include "TextureFile.h"
+
+#ifdef __linux__
+#include <SDL/SDL_thread.h>
+#else
+#include <SDL_thread.h>
+#endif
+
+#include "boost/ptr_container/ptr_vector.hpp"
+using namespace boost;
+
+#include <deque>
+#include <string>
+#include <vector>
+using namespace std;
+
+class AsyncTexture;
+
+//! Notified by AsyncLoader when a texture is done, on the GL thread
+class AsyncListener
+{
+public:
+	virtual ~AsyncListener() { }
+	//! Called once, whether the texture is ready or it failed to load
+	virtual void Loaded(const AsyncTexture &texture) = 0;
+};
+
+//! Texture being loaded by AsyncLoader (future)
+/*!
+ The state only changes on the GL thread, in AsyncLoader::Update() or
+ AsyncLoader::Wait(), so it can be tested freely while rendering.
+ */
+class AsyncTexture
+{
+	friend class AsyncLoader;
+
+	enum State { PENDING, READY, FAILED };
+
+	State eState;
+	GLenum eTarget;
+	TextureHandle handle;
+	GLuint uiTexture;
+	//! Set by AsyncLoader::Release() while pending
+	bool bReleased;
+
+	AsyncTexture(GLenum target) : eState(PENDING), eTarget(target),
+		uiTexture(0), bReleased(false) { }
+public:
+	bool IsReady() const { return eState == READY; }
+	bool Failed() const { return eState == FAILED; }
+	bool IsDone() const { return eState != PENDING; }
+
+	//! GL_TEXTURE_2D or GL_TEXTURE_CUBE_MAP
+	GLenum GetTarget() const { return eTarget; }
+	//! Texture name, 0 until the texture is ready
+	GLuint Get() const { return uiTexture; }
+	//! Handle of the texture in GLResourceManager, which owns it
+	TextureHandle GetHandle() const { return handle; }
+};
+
+//! Loads textures on worker threads and uploads them on the GL thread
+/*!
+ Workers decode the images, convert them to the display format and build
+ their mipmaps. Finished images are handed to the GL thread, which uploads
+ them in Update() within a budget of bytes per frame, so that the first
+ frames can render while the remaining textures stream in. Wait() completes
+ a texture immediately when it is needed.
+
+ Uploaded textures are stored in GLResourceManager (keyed by file as with
+ LoadTexture()), the AsyncTexture objects are owned by the loader and are
+ deleted by Release(). Requests for textures still resident there, even if
+ released, are ready at once.
+ All the methods must be called from the GL thread.
+ */
+class AsyncLoader
+{
+	struct Job
+	{
+		AsyncTexture *pTexture;
+		AsyncListener *pListener;
+		string sKey;
+		//! One file for 2D textures, six for cube maps
+		vector<string> asFile;
+		GLint iMinFilter;
+		GLint iMagFilter;
+		bool bMipmaps;
+
+		// Results of the decoding
+		bool bDecoded;
+		//! Containers of all the faces if they are up to date, or the
+		//! mipmap levels decoded from the images
+		ptr_vector<TextureFile> apContainer;
+		vector<MipChain> aFaces;
+		size_t uiBytes;
+
+		unsigned int NumLevels(unsigned int face) const;
+	};
+
+	enum { NUM_WORKERS = 2 };
+
+	bool bInit;
+	bool bQuit;
+	//! Format images are converted to (as SDL_DisplayFormat() does)
+	SDL_PixelFormat format;
+	//! Whether compressed containers can be used (queried on the GL thread)
+	bool bCompression;
+
+	SDL_Thread *apWorker[NUM_WORKERS];
+	unsigned int uiWorkers;
+
+	// Jobs waiting for a worker, counted by pPendingCount
+	deque<Job *> aPending;
+	SDL_mutex *pPendingLock;
+	SDL_sem *pPendingCount;
+
+	// Jobs decoded by the workers, posted to pDoneSignal
+	vector<Job *> aDone;
+	SDL_mutex *pDoneLock;
+	SDL_sem *pDoneSignal;
+
+	// GL thread only: decoded jobs waiting to be uploaded
+	deque<Job *> aReady;
+	unsigned int uiInFlight;
+	size_t uiBudget;
+	size_t uiUploaded;
+
+	ptr_vector<AsyncTexture> apTexture;
+
+	//! Starts the workers if they don't exist already
+	bool Init();
+
+	//! Worker thread entry point
+	static int WorkerMain(void *data);
+
+	//! Reads, converts and mipmaps the files of job (any thread)
+	bool Decode(Job *job) const;
+	//! Maps the containers of the files of job, false if any is missing,
+	//! stale or unusable
+	bool OpenContainers(Job *job) const;
+	bool DecodeFace(Job *job, unsigned int face) const;
+
+	//! Completes texture if key is resident in GLResourceManager
+	bool Acquire(AsyncTexture *texture, const string &key,
+		AsyncListener *listener) const;
+	AsyncTexture *Submit(Job *job);
+	//! Moves the jobs done by the workers to aReady
+	void Collect();
+	//! Creates the texture of job, notifies and deletes it
+	void Upload(Job *job);
+	//! Removes the job of texture from queue, NULL if it isn't there
+	static Job *Remove(deque<Job *> &queue, const AsyncTexture *texture);
+
+	AsyncLoader();
+	AsyncLoader(const AsyncLoader &);
+	AsyncLoader &operator=(const AsyncLoader &);
+public:
+	~AsyncLoader();
+
+	static AsyncLoader &Instance();
+
+	//! Requests a 2D texture, mipmapped if minFilter needs it
+	/*!
+	 Textures already in GLResourceManager are ready at once, and listener
+	 (if given) is then called before returning. Failures are reported by
+	 the AsyncTexture
+	 */
+	AsyncTexture *LoadTexture(const char *file, GLint minFilter,
+		GLint magFilter, AsyncListener *listener = NULL);
+
+	//! Requests a cube map from six files, in GL_TEXTURE_CUBE_MAP_POSITIVE_X
+	//! order
+	AsyncTexture *LoadCubeMap(const char *files[],
+		AsyncListener *listener = NULL, GLint minFilter = GL_NEAREST,
+		GLint magFilter = GL_NEAREST);
+
+	//! Uploads decoded textures, until the budget of the frame is used
+	/*!
+	 At least one texture is uploaded per call, even if larger than the
+	 budget. Call once per frame
+	 */
+	void Update();
+
+	//! Completes texture (decoding it on this thread if no worker has
+	//! started yet). False if it failed to load
+	bool Wait(AsyncTexture *texture);
+
+	//! Drops the reference of texture to its GL texture and deletes it
+	/*!
+	 The GL texture stays in GLResourceManager until evicted (see
+	 GLResourceManager::SetTextureBudget()). A pending texture is deleted
+	 once uploaded, without notifying its listener
+	 */
+	void Release(AsyncTexture *texture);
+
+	//! Bytes uploaded per frame by Update()
+	void SetUploadBudget(size_t bytes) { uiBudget = bytes; }
+
+	//! Number of requested textures not uploaded yet
+	unsigned int NumPending() const { return uiInFlight; }
+	//! Bytes uploaded since startup
+	size_t GetUploadedBytes() const { return uiUploaded; }
+
+	//! Stops the workers and drops the textures not uploaded yet
+	void Release();
+};
+
+#endif
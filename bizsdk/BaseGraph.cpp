@@ -13,6 +13,7 @@
 
 #include "BaseGraph.h"
 #include "GLResourceManager.h"
+#include "GLStateCache.h"
 
 
 static const float red[] = { 1.0f, 0.0f, 0.0f, 1.0f };
@@ -159,6 +160,9 @@ bool BaseGraph::Init(float timeFrame, unsigned int samples,
 	afVertexAttribsAxis[2] = x1;
 	afVertexAttribsAxis[3] = 0.5f * (y1 + y0);
 
+	pStream = auto_ptr<StreamingVBO>(new StreamingVBO(sizeof(afVertexAttribs)
+		+ sizeof(afVertexAttribsAxis) + sizeof(GraphSample) * uiSamples));
+
 	return true;
 }
 
@@ -217,14 +221,32 @@ void BaseGraph::Input(float value, float time/* = 0.0f*/)
 
 void BaseGraph::Draw() const
 {
+	GLStateCache &state = GLStateCache::Instance();
+
+	// Upload border, axis and samples at once
+	char *data = (char *)pStream->Map(sizeof(afVertexAttribs) +
+		sizeof(afVertexAttribsAxis) + sizeof(GraphSample) * uiCurSamples);
+	memcpy(data, afVertexAttribs, sizeof(afVertexAttribs));
+	data += sizeof(afVertexAttribs);
+	memcpy(data, afVertexAttribsAxis, sizeof(afVertexAttribsAxis));
+	data += sizeof(afVertexAttribsAxis);
+	memcpy(data, pvSamples, sizeof(GraphSample) * uiCurSamples);
+
+	const char *border = (const char *)pStream->Unmap();
+	if (pStream->ContentsLost())
+		return;
+	const char *axis = border + sizeof(afVertexAttribs);
+	const char *samples = axis + sizeof(afVertexAttribsAxis);
+
+	pStream->Bind();
 	glEnableVertexAttribArray(0);
 
 	// Draw Border
-	glUseProgram(sBorderGraphShader.uiID);
+	state.UseProgram(sBorderGraphShader.uiID);
 
 	glUniform4fv(sBorderGraphShader.uiColourLoc, 1, red);
 
-	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, &afVertexAttribs);
+	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, border);
 
 	glDrawArrays(GL_LINE_LOOP, 0, 4);
 
@@ -233,14 +255,13 @@ void BaseGraph::Draw() const
 	{
 		glUniform4fv(sBorderGraphShader.uiColourLoc, 1, white);		
 
-		glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0,
-			&afVertexAttribsAxis);
+		glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, axis);
 
 		glDrawArrays(GL_LINE_STRIP, 0, 2);
 	}
 
 	// Draw data
-	glUseProgram(sGraphShader.uiID);
+	state.UseProgram(sGraphShader.uiID);
 
 	glUniform4fv(sGraphShader.uiColourLoc, 1, yellow);
 
@@ -254,9 +275,10 @@ void BaseGraph::Draw() const
 	glUniform2fv(sGraphShader.uiScaleLoc, 1, afScale);
 	glUniform2fv(sGraphShader.uiTransitionLoc, 1, afTransition);
 
-	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, &pvSamples[0].x);
+	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, samples);
 
 	glDrawArrays(GL_LINE_STRIP, 0, uiCurSamples);
 
 	glDisableVertexAttribArray(0);
+	pStream->Unbind();
 }	
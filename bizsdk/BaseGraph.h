@@ -15,6 +15,7 @@
 #define _BASE_GRAPH_H_
 
 #include "Extensions.h"
+#include "VBO.h"
 
 class BaseGraph
 {
@@ -58,6 +59,9 @@ protected:
 	float afVertexAttribs[8];
 	float afVertexAttribsAxis[4];
 
+	// Border, axis and samples are uploaded together when drawing
+	auto_ptr<StreamingVBO> pStream;
+
 	unsigned int uiCurrentSample;
 	unsigned int uiLastSample;
 
@@ -14,6 +14,7 @@
 #include "CameraController.h"
 #include "Extensions.h"
 #include "Keys.h"
+#include "Misc.h"
 
 #define _USE_MATH_DEFINES
 #include <math.h>
@@ -124,6 +125,12 @@ void FPSCamera::LoadMatrix() const
 }
 
 
+Matrix4 FPSCamera::GetViewMatrix() const
+{
+	Matrix4 rot = AlphaBetaRotation(alpha * M_1_RAD, beta * M_1_RAD);
+	return rot * Matrix4::Translation(translation);
+}
+
 void FPSCamera::LoadMatrixNoXZ() const
 {
 	// load identity matrix
@@ -53,6 +53,9 @@ public:
 	const float GetBeta() const { return beta; }
 	const Vector3 &GetTranslation() const { return translation; }
 	const Vector3 GetPosition() const { return -translation; }
+
+	// Row major version of the matrix set by LoadMatrix()
+	Matrix4 GetViewMatrix() const;
 };
 
 class SpinCamera : public CameraController
@@ -12,6 +12,7 @@
  *****************************************************************************/
  
 #include "FBO.h"
+#include "GLStateCache.h"
 #include <assert.h>
 
 FBO::FBO(GLenum internalFormat, GLenum format, unsigned int width,
@@ -27,7 +28,7 @@ FBO::FBO(GLenum internalFormat, GLenum format, unsigned int width,
 	glGenTextures(1, &uiTexture);
 
 	// Binds this texture handle so we can load the data into it
-	glBindTexture(GL_TEXTURE_2D, uiTexture);
+	GLStateCache::Instance().BindTexture(GL_TEXTURE_2D, uiTexture);
 	glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, uiWidth,
 		uiHeight, 0, internalFormat, format, 0);
 
@@ -70,7 +71,7 @@ FBO::FBO(GLenum internalFormat, GLenum format, unsigned int width,
 FBO::~FBO()
 {
 	// Delete texture
-	glDeleteTextures(1, &uiTexture);
+	GLStateCache::Instance().DeleteTextures(1, &uiTexture);
 
 	// Delete buffer objects
 	glDeleteFramebuffers(1, &uiFBO);
@@ -105,12 +106,12 @@ void FBO::UnbindBuffer() const
 
 void FBO::BindTexture() const
 {
-	glBindTexture(GL_TEXTURE_2D, uiTexture);
+	GLStateCache::Instance().BindTexture(GL_TEXTURE_2D, uiTexture);
 }
 
 void FBO::UnbindTexture() const
 {
-	glBindTexture(GL_TEXTURE_2D, 0);
+	GLStateCache::Instance().BindTexture(GL_TEXTURE_2D, 0);
 }
 
 
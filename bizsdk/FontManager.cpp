@@ -13,6 +13,7 @@
 
 #include "FontManager.h"
 #include "GLResourceManager.h"
+#include "GLStateCache.h"
 
 FontManager::FontManager(const char *file, bool fixed)
 	: textureFile(file), fixedWidth(fixed)
@@ -38,7 +39,7 @@ bool FontManager::LoadShaders()
 	if (!loader.LoadShaderFromMemory(vertexShader, FragmentShader(), program))
 		return false;
 	
-	glUseProgram(program);
+	GLStateCache::Instance().UseProgram(program);
 	glUniform1i(GetUniLoc(program, "sTexture"), 0);
 	locColor = GetUniLoc(program, "Color");
 
@@ -62,6 +63,9 @@ bool FontManager::Init()
 	if (!LoadTexture())
 		return false;
 
+	// Enough for a few hundred glyphs per frame
+	pStream = auto_ptr<StreamingVBO>(new StreamingVBO(16384));
+
 	GenerateGlyphs();
 	return true;
 }
@@ -69,8 +73,10 @@ bool FontManager::Init()
 
 void FontManager::Bind() const
 {
-	glBindTexture(GL_TEXTURE_2D, texture);
-	glUseProgram(program);	
+	GLStateCache &state = GLStateCache::Instance();
+
+	state.BindTexture(GL_TEXTURE_2D, texture);
+	state.UseProgram(program);	
 }
 
 const float FontManager::Width(const char *str, float height) const
@@ -119,8 +125,9 @@ void FontManager::Render(float posX, float posY, float height, float *color,
 		
 	// each vertex = [x,y,u,v], 4 vertices per glyph
 	int len = strlen(str);
-	float *attribs = new float[4 * 4 * len];
-	float *a = attribs;	
+	if (!len)
+		return;
+	float *a = (float *)pStream->Map(sizeof(float) * 4 * 4 * len);
 	
 	unsigned int i;
 	for (i = 0; i < len; i++)
@@ -151,10 +158,16 @@ void FontManager::Render(float posX, float posY, float height, float *color,
 		startX += w;
 	}
 	
+	const float *attribs = (const float *)pStream->Unmap();
+	if (pStream->ContentsLost())
+		return;
+
 	glUniform4fv(locColor, 1, color);
 
+	pStream->Bind();
 	glVertexPointer(2, GL_FLOAT, sizeof(float) * 4, attribs);
 	glTexCoordPointer(2, GL_FLOAT, sizeof(float) * 4, attribs + 2);
+	pStream->Unbind();
 	glDrawArrays(GL_QUADS, 0, len * 4);
 }
 
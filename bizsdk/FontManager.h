@@ -15,13 +15,14 @@
 #define _FONT_MANAGER_H_
 
 #include "Extensions.h"
+#include "VBO.h"
 
 #include <string>
 using namespace std;
 
 // Simple font manager class. Not particularly well designed, supports only
 // one Font type stored in a texture
-// No caching or other techiques are used to increase efficiency
+// Glyph quads are written to a StreamingVBO, no other caching is used
 class FontManager
 {
 protected:
@@ -56,6 +57,8 @@ protected:
 	GLuint texture;
 	GLint locColor;
 
+	auto_ptr<StreamingVBO> pStream;
+
 	virtual void GenerateGlyphs() = 0;
 	virtual float FontAspect() const { return 1.0f; }
 	bool LoadShaders();
@@ -74,8 +77,8 @@ public:
 
 	enum HorzAlign { LeftAlign, CenterAlign, RightAlign };
 	enum VertAlign { TopAlign, MiddleAlign, BottomAlign };
-	//! Render: this function formats the input string via va_list, creates a
-	// a vertex buffer and passes it to GL for rendering
+	//! Render: this function formats the input string via va_list, writes
+	// the vertices to the stream and passes them to GL for rendering
 	void Render(float posX, float posY, float height, float *color,
 		HorzAlign halign, VertAlign valign, const char *text, ...) const;
 
@@ -0,0 +1,165 @@
+/*****************************************************************************
+ * Filename			FrameGovernor.cpp
+ *
+ * License			GPLv3
+ *
+ * Author			Andrea Bizzotto (bizz84@gmail.com)
+ *
+ * Platform			LinuxX11 / OpenGL
+ *
+ * Description		Keeps a frame time budget by driving quality settings
+ *					through a PID controller
+ *
+ *****************************************************************************/
+
+#include "FrameGovernor.h"
+
+#include <math.h>
+
+/*****************************************************************************
+ * GovernorKnob implementation
+ *****************************************************************************/
+
+float GovernorKnob::Get() const
+{
+	if (fStep <= 0.0f)
+		return fValue;
+	float v = fMin + floor((fValue - fMin) / fStep + 0.5f) * fStep;
+	return v > fMax ? fMax : v;
+}
+
+/*****************************************************************************
+ * FrameGovernor implementation
+ *****************************************************************************/
+
+FrameGovernor::FrameGovernor() :
+	fBand(0.0f),
+	fHoldTime(0.0f),
+	fOutsideTime(0.0f),
+	fSmoothing(0.0f),
+	fMeasured(0.0f),
+	bFirst(true)
+{
+
+}
+
+void FrameGovernor::Init(float target, float kp, float ki, float kd,
+	float kg/* = 1.0f*/)
+{
+	controller.Init(target, kp, ki, kd, kg);
+	controller.Reset();
+	fOutsideTime = 0.0f;
+	bFirst = true;
+}
+
+void FrameGovernor::SetHysteresis(float band, float holdTime)
+{
+	fBand = band;
+	fHoldTime = holdTime;
+}
+
+void FrameGovernor::SetSmoothing(float smoothing)
+{
+	fSmoothing = smoothing;
+}
+
+unsigned int FrameGovernor::AddKnob(const char *name, float value, float min,
+	float max, float gain, int priority, float step/* = 0.0f*/)
+{
+	GovernorKnob knob;
+	knob.szName = name;
+	knob.fMin = min;
+	knob.fMax = max;
+	knob.fValue = value < min ? min : value > max ? max : value;
+	knob.fGain = gain;
+	knob.fStep = step;
+	knob.iPriority = priority;
+	knob.bChanged = false;
+
+	unsigned int index = aKnob.size();
+	aKnob.push_back(knob);
+
+	// Insert after all knobs with the same or lower priority
+	vector<unsigned int>::iterator iter = aOrder.begin();
+	while (iter != aOrder.end() && aKnob[*iter].iPriority <= priority)
+		iter++;
+	aOrder.insert(iter, index);
+
+	return index;
+}
+
+void FrameGovernor::Set(unsigned int knob, float value)
+{
+	GovernorKnob &k = aKnob[knob];
+	k.fValue = value < k.fMin ? k.fMin : value > k.fMax ? k.fMax : value;
+}
+
+float FrameGovernor::Distribute(float out)
+{
+	const unsigned int n = aOrder.size();
+	for (unsigned int i = 0; i < n && out != 0.0f; i++)
+	{
+		// Degrade from the lowest priority, restore from the highest
+		GovernorKnob &k = aKnob[out < 0.0f ? aOrder[i] : aOrder[n - 1 - i]];
+		if (k.fGain <= 0.0f)
+			continue;
+
+		float prev = k.Get();
+		float value = k.fValue + out * k.fGain;
+		if (value < k.fMin)
+			value = k.fMin;
+		else if (value > k.fMax)
+			value = k.fMax;
+
+		out -= (value - k.fValue) / k.fGain;
+		k.fValue = value;
+		if (k.Get() != prev)
+			k.bChanged = true;
+
+		// Remainder due to rounding only
+		if (fabs(out) < 1e-6f)
+			out = 0.0f;
+	}
+	return out;
+}
+
+bool FrameGovernor::Update(float dt, float measured)
+{
+	for (unsigned int i = 0; i < aKnob.size(); i++)
+		aKnob[i].bChanged = false;
+
+	if (bFirst)
+	{
+		fMeasured = measured;
+		bFirst = false;
+	}
+	else
+	{
+		fMeasured = fSmoothing * fMeasured + (1.0f - fSmoothing) * measured;
+	}
+
+	// Do nothing inside the dead band
+	float target = controller.fTarget;
+	if (fabs(fMeasured - target) <= fBand * target)
+	{
+		fOutsideTime = 0.0f;
+		return false;
+	}
+	if ((fOutsideTime += dt) < fHoldTime)
+		return false;
+
+	float out = controller.Update(dt, fMeasured);
+	if (out == 0.0f)
+		return false;
+
+	// All knobs are at their bounds: avoid integral windup
+	if (Distribute(out) == out)
+		controller.Reset();
+
+	for (unsigned int i = 0; i < aKnob.size(); i++)
+	{
+		if (aKnob[i].bChanged)
+			return true;
+	}
+	return false;
+}
@@ -0,0 +1,110 @@
+/*****************************************************************************
+ * Filename			FrameGovernor.h
+ *
+ * License			GPLv3
+ *
+ * Author			Andrea Bizzotto (bizz84@gmail.com)
+ *
+ * Platform			LinuxX11 / OpenGL
+ *
+ * Description		Keeps a frame time budget by driving quality settings
+ *					through a PID controller
+ *
+ *****************************************************************************/
+
+#ifndef _FRAME_GOVERNOR_H_
+#define _FRAME_GOVERNOR_H_
+
+#include "PIDController.h"
+
+#include <vector>
+using namespace std;
+
+//! Quality setting driven by FrameGovernor
+class GovernorKnob
+{
+public:
+	const char *szName;
+	//! Current value, always in [fMin, fMax]
+	float fValue;
+	float fMin;
+	float fMax;
+	//! Knob units per unit of controller output
+	float fGain;
+	//! Reported values are multiples of fStep (0 means continuous)
+	float fStep;
+	//! Lower priority knobs are degraded first and restored last
+	int iPriority;
+	//! Set when the reported value changed in the last Update()
+	bool bChanged;
+
+	//! Value snapped to fStep
+	float Get() const;
+};
+
+//! Frame budget governor
+/*!
+ Compares a measured time (usually the frame time, or the time of a single
+ subsystem) against the target of a PIDControllerGain. When the measure is
+ outside a dead band for longer than a hold time, the controller output is
+ spent on the registered knobs: when over budget the lowest priority knobs are
+ lowered first, when under budget the highest priority ones are raised first.
+ Each knob only passes on to the next one the part of the output it couldn't
+ absorb because of its bounds.
+ */
+class FrameGovernor
+{
+	PIDControllerGain controller;
+
+	vector<GovernorKnob> aKnob;
+	//! Knob indices sorted by ascending priority
+	vector<unsigned int> aOrder;
+
+	//! Half width of the dead band, relative to the target
+	float fBand;
+	//! Time the measure must stay out of the band before acting
+	float fHoldTime;
+	float fOutsideTime;
+	//! Exponential smoothing of the measure (0 = no smoothing)
+	float fSmoothing;
+	float fMeasured;
+	bool bFirst;
+
+	//! Spends controller output on the knobs. Returns the unused part
+	float Distribute(float out);
+public:
+	FrameGovernor();
+
+	//! Sets the target time (seconds) and the controller parameters
+	void Init(float target, float kp, float ki, float kd, float kg = 1.0f);
+	//! Sets the dead band (fraction of target) and the hold time (seconds)
+	void SetHysteresis(float band, float holdTime);
+	//! Sets the smoothing factor of the measure, in [0, 1)
+	void SetSmoothing(float smoothing);
+
+	//! Registers a knob, returns its index
+	unsigned int AddKnob(const char *name, float value, float min, float max,
+		float gain, int priority, float step = 0.0f);
+
+	//! Feeds a new measure. Returns true if any knob has changed
+	bool Update(float dt, float measured);
+
+	//! Knob values (snapped to their step)
+	float Get(unsigned int knob) const { return aKnob[knob].Get(); }
+	bool Changed(unsigned int knob) const { return aKnob[knob].bChanged; }
+	//! Overrides the value of a knob (clamped to its bounds)
+	void Set(unsigned int knob, float value);
+
+	unsigned int NumKnobs() const { return aKnob.size(); }
+	const GovernorKnob &GetKnob(unsigned int knob) const { return aKnob[knob]; }
+
+	//! Access to the controller for tuning
+	PIDControllerGain &GetController() { return controller; }
+	const PIDControllerGain &GetController() const { return controller; }
+
+	//! Smoothed measure
+	float GetMeasured() const { return fMeasured; }
+	float GetTarget() const { return controller.fTarget; }
+};
+
+#endif
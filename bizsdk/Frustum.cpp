@@ -0,0 +1,364 @@
+/*****************************************************************************
+ * Filename			Frustum.cpp
+ *
+ * License			GPLv3
+ *
+ * Author			Andrea Bizzotto (bizz84@gmail.com)
+ *
+ * Platform			LinuxX11 / OpenGL
+ *
+ * Description		View frustum culling of spheres and bounding boxes
+ *
+ *****************************************************************************/
+
+#include "Frustum.h"
+
+#include <math.h>
+#include <string.h>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define FRUSTUM_SSE
+#include <xmmintrin.h>
+#endif
+
+/*****************************************************************************
+ * Frustum implementation
+ *****************************************************************************/
+
+Frustum::Frustum() : uiNumPlanes(0), bValid(false)
+{
+
+}
+
+bool Frustum::Extract(const Matrix4 &viewProj)
+{
+	// Planes only change with the camera or the projection
+	if (bValid && memcmp(viewProj.data(), mViewProj.data(),
+		sizeof(float) * 16) == 0)
+	{
+		return false;
+	}
+	mViewProj = viewProj;
+	bValid = true;
+
+	const float *r0 = viewProj[0];
+	const float *r1 = viewProj[1];
+	const float *r2 = viewProj[2];
+	const float *r3 = viewProj[3];
+
+	// A point is inside if -w <= x, y, z <= w in clip space
+	// (Gribb & Hartmann), i.e. (row3 +- rowi) . p >= 0
+	float planes[MAX_PLANES][4];
+	for (unsigned int j = 0; j < 4; j++)
+	{
+		planes[PLANE_LEFT][j]   = r3[j] + r0[j];
+		planes[PLANE_RIGHT][j]  = r3[j] - r0[j];
+		planes[PLANE_BOTTOM][j] = r3[j] + r1[j];
+		planes[PLANE_TOP][j]    = r3[j] - r1[j];
+		planes[PLANE_NEAR][j]   = r3[j] + r2[j];
+		planes[PLANE_FAR][j]    = r3[j] - r2[j];
+	}
+
+	uiNumPlanes = 0;
+	for (unsigned int i = 0; i < MAX_PLANES; i++)
+	{
+		float *p = planes[i];
+		float len = sqrt(p[0] * p[0] + p[1] * p[1] + p[2] * p[2]);
+		// Infinite projection: far plane has null normal
+		if (len < 1e-6f)
+			continue;
+		float *q = aPlane[uiNumPlanes];
+		for (unsigned int j = 0; j < 4; j++)
+			q[j] = p[j] / len;
+		for (unsigned int j = 0; j < 3; j++)
+			aAbsNormal[uiNumPlanes][j] = fabs(q[j]);
+		uiNumPlanes++;
+	}
+	return true;
+}
+
+float Frustum::Distance(unsigned int i, const AABB &box) const
+{
+	// Distance of the center plus projected half extent
+	const float *n = aAbsNormal[i];
+	float c[3], r = 0.0f;
+	for (unsigned int j = 0; j < 3; j++)
+	{
+		c[j] = 0.5f * (box.vMin[j] + box.vMax[j]);
+		r += n[j] * 0.5f * (box.vMax[j] - box.vMin[j]);
+	}
+	return Distance(i, c) + r;
+}
+
+/*****************************************************************************
+ * Single object tests
+ *****************************************************************************/
+
+bool Frustum::SphereVisible(const Vector3 &c, const float radius) const
+{
+	for (unsigned int i = 0; i < uiNumPlanes; i++)
+	{
+		if (Distance(i, &c[0]) < -radius)
+			return false;
+	}
+	return true;
+}
+
+bool Frustum::SphereVisible(const Vector3 &c, const float radius,
+	unsigned char &hint) const
+{
+	// Test the plane that rejected the sphere last time first
+	const unsigned int first = hint;
+	if (first < uiNumPlanes && Distance(first, &c[0]) < -radius)
+		return false;
+
+	for (unsigned int i = 0; i < uiNumPlanes; i++)
+	{
+		if (i != first && Distance(i, &c[0]) < -radius)
+		{
+			hint = (unsigned char)i;
+			return false;
+		}
+	}
+	hint = VISIBLE;
+	return true;
+}
+
+bool Frustum::BoxVisible(const AABB &box) const
+{
+	for (unsigned int i = 0; i < uiNumPlanes; i++)
+	{
+		if (Distance(i, box) < 0.0f)
+			return false;
+	}
+	return true;
+}
+
+bool Frustum::BoxVisible(const AABB &box, unsigned char &hint) const
+{
+	const unsigned int first = hint;
+	if (first < uiNumPlanes && Distance(first, box) < 0.0f)
+		return false;
+
+	for (unsigned int i = 0; i < uiNumPlanes; i++)
+	{
+		if (i != first && Distance(i, box) < 0.0f)
+		{
+			hint = (unsigned char)i;
+			return false;
+		}
+	}
+	hint = VISIBLE;
+	return true;
+}
+
+/*****************************************************************************
+ * Four objects tests
+ *****************************************************************************/
+
+unsigned int Frustum::SphereMask4(const Vector4 *s, const float *radius) const
+{
+#ifdef FRUSTUM_SSE
+	// Transpose to x, y, z, r of the four spheres
+	__m128 x = _mm_loadu_ps(&s[0][0]);
+	__m128 y = _mm_loadu_ps(&s[1][0]);
+	__m128 z = _mm_loadu_ps(&s[2][0]);
+	__m128 r = _mm_loadu_ps(&s[3][0]);
+	_MM_TRANSPOSE4_PS(x, y, z, r);
+	if (radius)
+		r = _mm_set1_ps(*radius);
+	__m128 negR = _mm_sub_ps(_mm_setzero_ps(), r);
+
+	__m128 inside = _mm_cmpeq_ps(r, r);
+	for (unsigned int i = 0; i < uiNumPlanes; i++)
+	{
+		const float *p = aPlane[i];
+		__m128 d = _mm_add_ps(
+			_mm_add_ps(_mm_mul_ps(_mm_set1_ps(p[0]), x),
+				_mm_mul_ps(_mm_set1_ps(p[1]), y)),
+			_mm_add_ps(_mm_mul_ps(_mm_set1_ps(p[2]), z),
+				_mm_set1_ps(p[3])));
+		inside = _mm_and_ps(inside, _mm_cmpge_ps(d, negR));
+	}
+	return (unsigned int)_mm_movemask_ps(inside);
+#else
+	unsigned int mask = 0;
+	for (unsigned int k = 0; k < 4; k++)
+	{
+		const float *c = &s[k][0];
+		if (SphereVisible(Vector3(c), radius ? *radius : c[3]))
+			mask |= 1 << k;
+	}
+	return mask;
+#endif
+}
+
+unsigned int Frustum::BoxMask4(const AABB *b) const
+{
+#ifdef FRUSTUM_SSE
+	// Centers and half extents of the four boxes
+	__m128 half = _mm_set1_ps(0.5f);
+	__m128 lo[3], hi[3], c[3], e[3];
+	for (unsigned int j = 0; j < 3; j++)
+	{
+		lo[j] = _mm_set_ps(b[3].vMin[j], b[2].vMin[j], b[1].vMin[j], b[0].vMin[j]);
+		hi[j] = _mm_set_ps(b[3].vMax[j], b[2].vMax[j], b[1].vMax[j], b[0].vMax[j]);
+		c[j] = _mm_mul_ps(_mm_add_ps(lo[j], hi[j]), half);
+		e[j] = _mm_mul_ps(_mm_sub_ps(hi[j], lo[j]), half);
+	}
+
+	__m128 zero = _mm_setzero_ps();
+	__m128 inside = _mm_cmpeq_ps(zero, zero);
+	for (unsigned int i = 0; i < uiNumPlanes; i++)
+	{
+		const float *p = aPlane[i];
+		const float *n = aAbsNormal[i];
+		__m128 d = _mm_add_ps(
+			_mm_add_ps(_mm_mul_ps(_mm_set1_ps(p[0]), c[0]),
+				_mm_mul_ps(_mm_set1_ps(p[1]), c[1])),
+			_mm_add_ps(_mm_mul_ps(_mm_set1_ps(p[2]), c[2]),
+				_mm_set1_ps(p[3])));
+		__m128 r = _mm_add_ps(
+			_mm_add_ps(_mm_mul_ps(_mm_set1_ps(n[0]), e[0]),
+				_mm_mul_ps(_mm_set1_ps(n[1]), e[1])),
+			_mm_mul_ps(_mm_set1_ps(n[2]), e[2]));
+		inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(d, r), zero));
+	}
+	return (unsigned int)_mm_movemask_ps(inside);
+#else
+	unsigned int mask = 0;
+	for (unsigned int k = 0; k < 4; k++)
+	{
+		if (BoxVisible(b[k]))
+			mask |= 1 << k;
+	}
+	return mask;
+#endif
+}
+
+/*****************************************************************************
+ * Batch tests
+ *****************************************************************************/
+
+void Frustum::CullSpheres(const Vector4 *spheres, unsigned int n,
+	unsigned char *mask) const
+{
+	unsigned int i = 0;
+	for (; i + 4 <= n; i += 4)
+	{
+		unsigned int bits = SphereMask4(spheres + i, NULL);
+		for (unsigned int k = 0; k < 4; k++)
+			mask[i + k] = (bits >> k) & 1;
+	}
+	for (; i < n; i++)
+	{
+		const float *c = &spheres[i][0];
+		mask[i] = SphereVisible(Vector3(c), c[3]) ? 1 : 0;
+	}
+}
+
+unsigned int Frustum::CullSpheres(const Vector4 *spheres, unsigned int n,
+	unsigned int *indices) const
+{
+	unsigned int count = 0;
+	unsigned int i = 0;
+	for (; i + 4 <= n; i += 4)
+	{
+		unsigned int bits = SphereMask4(spheres + i, NULL);
+		for (unsigned int k = 0; k < 4; k++)
+		{
+			indices[count] = i + k;
+			count += (bits >> k) & 1;
+		}
+	}
+	for (; i < n; i++)
+	{
+		const float *c = &spheres[i][0];
+		if (SphereVisible(Vector3(c), c[3]))
+			indices[count++] = i;
+	}
+	return count;
+}
+
+unsigned int Frustum::CullSpheres(const Vector4 *spheres, unsigned int n,
+	unsigned char *hints, unsigned int *indices) const
+{
+	unsigned int count = 0;
+	for (unsigned int i = 0; i < n; i++)
+	{
+		const float *c = &spheres[i][0];
+		if (SphereVisible(Vector3(c), c[3], hints[i]))
+			indices[count++] = i;
+	}
+	return count;
+}
+
+unsigned int Frustum::CullPoints(const Vector4 *points, unsigned int n,
+	const float radius, unsigned int *indices) const
+{
+	unsigned int count = 0;
+	unsigned int i = 0;
+	for (; i + 4 <= n; i += 4)
+	{
+		unsigned int bits = SphereMask4(points + i, &radius);
+		for (unsigned int k = 0; k < 4; k++)
+		{
+			indices[count] = i + k;
+			count += (bits >> k) & 1;
+		}
+	}
+	for (; i < n; i++)
+	{
+		if (SphereVisible(Vector3(&points[i][0]), radius))
+			indices[count++] = i;
+	}
+	return count;
+}
+
+void Frustum::CullBoxes(const AABB *boxes, unsigned int n,
+	unsigned char *mask) const
+{
+	unsigned int i = 0;
+	for (; i + 4 <= n; i += 4)
+	{
+		unsigned int bits = BoxMask4(boxes + i);
+		for (unsigned int k = 0; k < 4; k++)
+			mask[i + k] = (bits >> k) & 1;
+	}
+	for (; i < n; i++)
+		mask[i] = BoxVisible(boxes[i]) ? 1 : 0;
+}
+
+unsigned int Frustum::CullBoxes(const AABB *boxes, unsigned int n,
+	unsigned int *indices) const
+{
+	unsigned int count = 0;
+	unsigned int i = 0;
+	for (; i + 4 <= n; i += 4)
+	{
+		unsigned int bits = BoxMask4(boxes + i);
+		for (unsigned int k = 0; k < 4; k++)
+		{
+			indices[count] = i + k;
+			count += (bits >> k) & 1;
+		}
+	}
+	for (; i < n; i++)
+	{
+		if (BoxVisible(boxes[i]))
+			indices[count++] = i;
+	}
+	return count;
+}
+
+unsigned int Frustum::CullBoxes(const AABB *boxes, unsigned int n,
+	unsigned char *hints, unsigned int *indices) const
+{
+	unsigned int count = 0;
+	for (unsigned int i = 0; i < n; i++)
+	{
+		if (BoxVisible(boxes[i], hints[i]))
+			indices[count++] = i;
+	}
+	return count;
+}
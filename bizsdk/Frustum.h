@@ -0,0 +1,141 @@
+/*****************************************************************************
+ * Filename			Frustum.h
+ *
+ * License			GPLv3
+ *
+ * Author			Andrea Bizzotto (bizz84@gmail.com)
+ *
+ * Platform			LinuxX11 / OpenGL
+ *
+ * Description		View frustum culling of spheres and bounding boxes
+ *
+ *****************************************************************************/
+
+#ifndef _FRUSTUM_H_
+#define _FRUSTUM_H_
+
+#include "Matrix.h"
+#include "Vector.h"
+
+//! Axis aligned bounding box
+struct AABB
+{
+	Vector3 vMin;
+	Vector3 vMax;
+};
+
+//! View frustum defined by the planes of a view-projection matrix
+/*!
+ Planes are stored normalized, with normals pointing inside the frustum, so
+ that the plane equation gives the signed distance of a point.
+ Planes that degenerate (like the far plane of ProjectionRHInfinite()) are
+ discarded.
+
+ Batch tests process four objects at a time with SSE when available and
+ produce either a visibility mask (one byte per object) or a compacted list
+ of the indices of visible objects.
+
+ Coherent tests take one hint byte per object, which stores the plane that
+ rejected the object in the previous test (or VISIBLE). That plane is tested
+ first, since objects tend to stay outside of the same plane across frames.
+ */
+class Frustum
+{
+public:
+	enum {
+		PLANE_LEFT,
+		PLANE_RIGHT,
+		PLANE_BOTTOM,
+		PLANE_TOP,
+		PLANE_NEAR,
+		PLANE_FAR,
+		MAX_PLANES
+	};
+	//! Hint value of objects that passed the last test (initial hint value)
+	enum { VISIBLE = 0xFF };
+
+protected:
+	//! Plane equations (a, b, c, d)
+	float aPlane[MAX_PLANES][4];
+	//! Absolute values of the plane normals (box tests)
+	float aAbsNormal[MAX_PLANES][3];
+	unsigned int uiNumPlanes;
+
+	//! Matrix the planes were extracted from
+	Matrix4 mViewProj;
+	bool bValid;
+
+	//! Signed distance of point from plane i
+	float Distance(unsigned int i, const float *p) const
+	{
+		const float *q = aPlane[i];
+		return q[0] * p[0] + q[1] * p[1] + q[2] * p[2] + q[3];
+	}
+	//! Distance of box from plane i (positive if at least partially inside)
+	float Distance(unsigned int i, const AABB &box) const;
+
+	//! Visibility bits of spheres[0..3]. If radius is not NULL it overrides
+	//! the w component of all spheres
+	unsigned int SphereMask4(const Vector4 *spheres, const float *radius) const;
+	//! Visibility bits of boxes[0..3]
+	unsigned int BoxMask4(const AABB *boxes) const;
+
+public:
+	//! Constructor (no planes, everything is visible)
+	Frustum();
+
+	//! Extracts the planes of a row major view-projection matrix
+	/*!
+	 Returns false if the matrix is the same as in the last call, in which
+	 case the cached planes are kept
+	 */
+	bool Extract(const Matrix4 &viewProj);
+
+	//! Returns true if the sphere is at least partially inside
+	bool SphereVisible(const Vector3 &center, const float radius) const;
+	//! Coherent version of SphereVisible()
+	bool SphereVisible(const Vector3 &center, const float radius,
+		unsigned char &hint) const;
+
+	//! Returns true if the box is at least partially inside
+	/*!
+	 Conservative: boxes outside of the frustum but not fully outside of any
+	 single plane are reported as visible
+	 */
+	bool BoxVisible(const AABB &box) const;
+	//! Coherent version of BoxVisible()
+	bool BoxVisible(const AABB &box, unsigned char &hint) const;
+
+	//! Tests n spheres (x, y, z, radius). Sets mask[i] to 1 if visible, 0
+	//! otherwise
+	void CullSpheres(const Vector4 *spheres, unsigned int n,
+		unsigned char *mask) const;
+	//! Tests n spheres (x, y, z, radius). Writes the indices of the visible
+	//! ones to indices (n elements max) and returns their number
+	unsigned int CullSpheres(const Vector4 *spheres, unsigned int n,
+		unsigned int *indices) const;
+	//! Coherent version of CullSpheres() (scalar), hints has n elements
+	unsigned int CullSpheres(const Vector4 *spheres, unsigned int n,
+		unsigned char *hints, unsigned int *indices) const;
+
+	//! Tests n points sharing the same radius (w is ignored). Writes the
+	//! indices of the visible ones and returns their number
+	unsigned int CullPoints(const Vector4 *points, unsigned int n,
+		const float radius, unsigned int *indices) const;
+
+	//! Tests n boxes. Sets mask[i] to 1 if visible, 0 otherwise
+	void CullBoxes(const AABB *boxes, unsigned int n,
+		unsigned char *mask) const;
+	//! Tests n boxes. Writes the indices of the visible ones and returns
+	//! their number
+	unsigned int CullBoxes(const AABB *boxes, unsigned int n,
+		unsigned int *indices) const;
+	//! Coherent version of CullBoxes() (scalar), hints has n elements
+	unsigned int CullBoxes(const AABB *boxes, unsigned int n,
+		unsigned char *hints, unsigned int *indices) const;
+
+	unsigned int NumPlanes() const { return uiNumPlanes; }
+	const float *GetPlane(unsigned int i) const { return aPlane[i]; }
+};
+
+#endif
@@ -15,10 +15,15 @@
 #include "GLResourceManager.h"
 #include "Misc.h"
 #include "Mesh.h"
+#include "GLStateCache.h"
+#include "Timer.h"
+#include "Image.h"
+#include "TextureFile.h"
 
 #include <stdio.h>
 #include <malloc.h>
 #include <string.h>
+#include <assert.h>
 
 #ifdef __linux__
 #include <SDL/SDL.h>
@@ -31,6 +36,102 @@
 #include <lib3ds/mesh.h>
 #include <lib3ds/vector.h>
 
+/*****************************************************************************
+ * UniformHandle implementation
+ *****************************************************************************/
+
+static bool IsIntType(GLenum type)
+{
+	switch (type)
+	{
+	case GL_INT:
+	case GL_BOOL:
+	case GL_SAMPLER_1D:
+	case GL_SAMPLER_2D:
+	case GL_SAMPLER_3D:
+	case GL_SAMPLER_CUBE:
+	case GL_SAMPLER_1D_SHADOW:
+	case GL_SAMPLER_2D_SHADOW:
+		return true;
+	default:
+		return false;
+	}
+}
+
+bool UniformHandle::Changed(const GLfloat *v, unsigned int n) const
+{
+	if (pInfo->bSet && memcmp(pInfo->afValue, v, n * sizeof(GLfloat)) == 0)
+		return false;
+	memcpy(pInfo->afValue, v, n * sizeof(GLfloat));
+	pInfo->bSet = true;
+	return true;
+}
+
+void UniformHandle::Set1i(GLint i) const
+{
+	if (!pInfo)
+		return;
+	assert(IsIntType(pInfo->eType));
+	GLfloat v;
+	memcpy(&v, &i, sizeof(v));
+	if (Changed(&v, 1))
+		glUniform1i(pInfo->iLocation, i);
+}
+
+void UniformHandle::Set1f(GLfloat f) const
+{
+	if (!pInfo)
+		return;
+	assert(pInfo->eType == GL_FLOAT);
+	if (Changed(&f, 1))
+		glUniform1f(pInfo->iLocation, f);
+}
+
+void UniformHandle::Set2fv(const GLfloat *v, GLsizei count/* = 1*/) const
+{
+	if (!pInfo)
+		return;
+	assert(pInfo->eType == GL_FLOAT_VEC2 && count <= pInfo->iSize);
+	// Arrays are not remembered
+	if (count > 1)
+		pInfo->bSet = false;
+	if (count > 1 || Changed(v, 2))
+		glUniform2fv(pInfo->iLocation, count, v);
+}
+
+void UniformHandle::Set3fv(const GLfloat *v, GLsizei count/* = 1*/) const
+{
+	if (!pInfo)
+		return;
+	assert(pInfo->eType == GL_FLOAT_VEC3 && count <= pInfo->iSize);
+	if (count > 1)
+		pInfo->bSet = false;
+	if (count > 1 || Changed(v, 3))
+		glUniform3fv(pInfo->iLocation, count, v);
+}
+
+void UniformHandle::Set4fv(const GLfloat *v, GLsizei count/* = 1*/) const
+{
+	if (!pInfo)
+		return;
+	assert(pInfo->eType == GL_FLOAT_VEC4 && count <= pInfo->iSize);
+	if (count > 1)
+		pInfo->bSet = false;
+	if (count > 1 || Changed(v, 4))
+		glUniform4fv(pInfo->iLocation, count, v);
+}
+
+void UniformHandle::SetMatrix4fv(const GLfloat *m, GLsizei count/* = 1*/) const
+{
+	if (!pInfo)
+		return;
+	assert(pInfo->eType == GL_FLOAT_MAT4 && count <= pInfo->iSize);
+	if (count > 1)
+		pInfo->bSet = false;
+	if (count > 1 || Changed(m, 16))
+		glUniformMatrix4fv(pInfo->iLocation, count, GL_FALSE, m);
+}
+
 
 /*****************************************************************************
  * GLResourceManager::Shader implementation
@@ -39,9 +140,10 @@
 
 
 GLResourceManager::Shader::Shader(const char *vertexShader,
-	const char *fragmentShader, GLuint vs, GLuint fs, GLuint program)
+	const char *fragmentShader, const char *defines, GLuint vs, GLuint fs,
+	GLuint program)
 	: sVertShader(vertexShader), sFragShader(fragmentShader),
-	  uiVS(vs), uiFS(fs), uiProgram(program)
+	  sDefines(defines ? defines : ""), uiVS(vs), uiFS(fs), uiProgram(program)
 {
 	
 }
@@ -52,14 +154,129 @@ GLResourceManager::Shader::~Shader()
 	//glDetachShader(uiProgram, uiFS);
 	glDeleteShader(uiVS);
 	glDeleteShader(uiFS);
-	glDeleteProgram(uiProgram);
+	GLStateCache::Instance().DeleteProgram(uiProgram);
+}
+
+string GLResourceManager::Shader::Key(const char *vertexShader,
+	const char *fragmentShader, const char *defines)
+{
+	// Names can't contain the separator
+	string key(vertexShader);
+	key += '\n';
+	key += fragmentShader;
+	key += '\n';
+	if (defines)
+		key += defines;
+	return key;
+}
+
+void GLResourceManager::Shader::Reflect()
+{
+	GLint count = 0, length = 0;
+
+	// Uniforms. Members of uniform blocks have no location and are skipped
+	glGetProgramiv(uiProgram, GL_ACTIVE_UNIFORMS, &count);
+	glGetProgramiv(uiProgram, GL_ACTIVE_UNIFORM_MAX_LENGTH, &length);
+	vector<GLchar> name(length + 1);
+	for (GLint i = 0; i < count; i++)
+	{
+		GLint size;
+		GLenum type;
+		glGetActiveUniform(uiProgram, i, name.size(), NULL, &size, &type,
+			&name[0]);
+		GLint loc = glGetUniformLocation(uiProgram, &name[0]);
+		if (loc == -1)
+			continue;
+
+		UniformInfo *info = new UniformInfo;
+		info->sName = &name[0];
+		// Arrays are reported as name[0]
+		string::size_type bracket = info->sName.find('[');
+		if (bracket != string::npos)
+			info->sName.erase(bracket);
+		info->iLocation = loc;
+		info->eType = type;
+		info->iSize = size;
+		info->bSet = false;
+		apUniform.push_back(info);
+	}
+
+	// Attributes. Built in ones (gl_Vertex...) have no location
+	glGetProgramiv(uiProgram, GL_ACTIVE_ATTRIBUTES, &count);
+	glGetProgramiv(uiProgram, GL_ACTIVE_ATTRIBUTE_MAX_LENGTH, &length);
+	name.resize(length + 1);
+	for (GLint i = 0; i < count; i++)
+	{
+		GLint size;
+		GLenum type;
+		glGetActiveAttrib(uiProgram, i, name.size(), NULL, &size, &type,
+			&name[0]);
+		GLint loc = glGetAttribLocation(uiProgram, &name[0]);
+		if (loc != -1)
+			aAttrib.push_back(make_pair(string(&name[0]), loc));
+	}
+
+	// Uniform blocks
+	if (UniformBuffer::IsSupported())
+	{
+		glGetProgramiv(uiProgram, GL_ACTIVE_UNIFORM_BLOCKS, &count);
+		glGetProgramiv(uiProgram, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH,
+			&length);
+		name.resize(length + 1);
+		for (GLint i = 0; i < count; i++)
+		{
+			Block block;
+			glGetActiveUniformBlockName(uiProgram, i, name.size(), NULL,
+				&name[0]);
+			block.sName = &name[0];
+			block.uiIndex = i;
+			glGetActiveUniformBlockiv(uiProgram, i,
+				GL_UNIFORM_BLOCK_DATA_SIZE, &block.iSize);
+			aBlock.push_back(block);
+		}
+	}
+
+	if (Verbose(VerboseAll))
+	{
+		printf("%s %s [%s]: %d uniforms, %d attributes, %d blocks\n",
+			sVertShader.c_str(), sFragShader.c_str(), sDefines.c_str(),
+			(int)apUniform.size(),
+			(int)aAttrib.size(), (int)aBlock.size());
+	}
+}
+
+UniformInfo *GLResourceManager::Shader::FindUniform(const char *name)
+{
+	ptr_vector<UniformInfo>::iterator iter;
+	for (iter = apUniform.begin(); iter != apUniform.end(); iter++)
+	{
+		if (iter->sName == name)
+			return &*iter;
+	}
+	return NULL;
 }
 
-bool GLResourceManager::Shader::SameAs(const char *vertexShader,
-	const char *fragmentShader) const
+GLint GLResourceManager::Shader::FindAttrib(const char *name) const
 {
-	return sVertShader == vertexShader &&
-	       sFragShader == fragmentShader;
+	vector<pair<string, GLint> >::const_iterator iter;
+	for (iter = aAttrib.begin(); iter != aAttrib.end(); iter++)
+	{
+		if (iter->first == name)
+			return iter->second;
+	}
+	return -1;
+}
+
+const GLResourceManager::Shader::Block *
+GLResourceManager::Shader::FindBlock(const char *name) const
+{
+	vector<Block>::const_iterator iter;
+	for (iter = aBlock.begin(); iter != aBlock.end(); iter++)
+	{
+		if (iter->sName == name)
+			return &*iter;
+	}
+	return NULL;
 }
 
 /*****************************************************************************
@@ -74,13 +291,9 @@ GLResourceManager::Texture::Texture(const char *textureFile, GLuint texture)
 
 GLResourceManager::Texture::~Texture()
 {
-	glDeleteTextures(1, &uiTexture);
+	GLStateCache::Instance().DeleteTextures(1, &uiTexture);
 }
 
-bool GLResourceManager::Texture::SameAs(const char *textureFile) const
-{
-	return sTextureFile == textureFile;
-}
 
 /*****************************************************************************
  * GLResourceManager::File3DS implementation
@@ -98,9 +311,16 @@ GLResourceManager::File3DS::~File3DS()
 	lib3ds_file_free(f);
 }
 
-bool GLResourceManager::File3DS::SameAs(const char *file) const
+size_t GLResourceManager::File3DS::Bytes() const
 {
-	return s3DSFile == file;
+	size_t bytes = 0;
+	for (Lib3dsMesh *mesh = f->meshes; mesh; mesh = mesh->next)
+	{
+		bytes += mesh->points * sizeof(Lib3dsPoint) +
+			mesh->texels * sizeof(Lib3dsTexel) +
+			mesh->faces * sizeof(Lib3dsFace);
+	}
+	return bytes;
 }
 
 
@@ -172,136 +392,182 @@ GLenum GLResourceManager::PrintShaderError(GLuint obj, bool bCompile)
 	return err;
 }
 
-bool GLResourceManager::LoadShaderFromMemory(const char *vertexShader,
-	const char *fragmentShader, GLuint &program)
+string GLResourceManager::AddDefines(const char *source, const char *defines)
 {
-	ptr_vector<Shader>::const_iterator iter;
-	for (iter = apShader.begin(); iter != apShader.end(); iter++)
+	string result(source);
+	if (!defines || !*defines)
+		return result;
+
+	string block;
+	const char *p = defines;
+	while (*p)
 	{
-		if (iter->SameAs(vertexShader, fragmentShader))
+		if (*p == ' ')
 		{
-			program = iter->GetProgram();
-			return true;
+			p++;
+			continue;
 		}
+		const char *end = strchr(p, ' ');
+		if (!end)
+			end = p + strlen(p);
+		string symbol(p, end);
+		string::size_type equal = symbol.find('=');
+		if (equal == string::npos)
+			block += "#define " + symbol + " 1\n";
+		else
+			block += "#define " + symbol.substr(0, equal) + " " +
+				symbol.substr(equal + 1) + "\n";
+		p = end;
 	}
 
-	GLint vertCompiled, fragCompiled;//, linked;
-	GLuint uiVS, uiFS;
+	// #version must come before anything else but comments
+	string::size_type pos = 0;
+	string::size_type version = result.find("#version");
+	if (version != string::npos)
+	{
+		pos = result.find('\n', version);
+		if (pos == string::npos)
+		{
+			result += '\n';
+			pos = result.size();
+		}
+		else
+			pos++;
+	}
+	result.insert(pos, block);
+	return result;
+}
 
-    uiVS = glCreateShader(GL_VERTEX_SHADER);
-    uiFS = glCreateShader(GL_FRAGMENT_SHADER);
+bool GLResourceManager::LoadShaderFromMemory(const char *vertexShader,
+	const char *fragmentShader, GLuint &program,
+	const char *defines/* = NULL*/)
+{
+	program = GetProgram(LoadProgramFromMemory(vertexShader, fragmentShader,
+		defines));
+	return program != 0;
+}
 
-	const char *vs = vertexShader;
-	const char *fs = fragmentShader;
-    
-    glShaderSource(uiVS, 1, &vs, NULL);
-    if (PrintShaderError(uiVS, true)
-		!= GL_NO_ERROR)
-		return false;
+bool GLResourceManager::LoadShaderFromFile(const char *vertexShader,
+	const char *fragmentShader, GLuint &program,
+	const char *defines/* = NULL*/)
+{
+	program = GetProgram(LoadProgramFromFile(vertexShader, fragmentShader,
+		defines));
+	return program != 0;
+}
 
+ProgramHandle GLResourceManager::LoadProgramFromMemory(
+	const char *vertexShader, const char *fragmentShader,
+	const char *defines/* = NULL*/)
+{
+	string key = Shader::Key(vertexShader, fragmentShader, defines);
+	ProgramHandle handle = shaders.Acquire(key);
+	if (handle.IsValid())
+		return handle;
+
+	GLuint uiVS, uiFS, program;
+	if (!BuildProgram(vertexShader, fragmentShader, vertexShader,
+		fragmentShader, defines, uiVS, uiFS, program))
+		return ProgramHandle();
+
+	return AddShader(key, new Shader(vertexShader, fragmentShader, defines,
+		uiVS, uiFS, program));
+}
 
-    glShaderSource(uiFS, 1, &fs, NULL);
-    if (PrintShaderError(uiFS, true)
-		!= GL_NO_ERROR)
-		return false;
+ProgramHandle GLResourceManager::LoadProgramFromFile(const char *vertexShader,
+	const char *fragmentShader, const char *defines/* = NULL*/)
+{
+	string key = Shader::Key(vertexShader, fragmentShader, defines);
+	ProgramHandle handle = shaders.Acquire(key);
+	if (handle.IsValid())
+		return handle;
 
-	if (Verbose(VerboseInfo))
-		printf("Compiling vertex shader %s... ", vertexShader);
+	char *pszVertShader = NULL;
+	char *pszFragShader = NULL;
 
-	glCompileShader(uiVS);
-	glGetShaderiv(uiVS, GL_COMPILE_STATUS, &vertCompiled);
-	if (!vertCompiled)
-	{
-		printf("\nUnable to compile %s\n", vertexShader);
-		return false;
+	if (LoadFileIntoMemory(vertexShader, &pszVertShader) <= 0)
+    {
+		printf("Unable to load shader %s!\n", vertexShader);
+		return ProgramHandle();
 	}
-   	if (PrintShaderError(uiVS, true)
-		!= GL_NO_ERROR)
-		return false;
 
-	if (Verbose(VerboseInfo))
-		printf("and fragment shader %s... ", fragmentShader);
-
-    glCompileShader(uiFS);
-	glGetShaderiv(uiVS, GL_COMPILE_STATUS, &fragCompiled);
-	if (!fragCompiled)
-	{
-		printf("\nUnable to compile %s\n", fragmentShader);
-		return false;
+	if (LoadFileIntoMemory(fragmentShader, &pszFragShader) <= 0)
+    {
+		printf("Unable to load shader %s!\n", fragmentShader);
+		FreeFileMemory(&pszVertShader);
+		return ProgramHandle();
 	}
-    if (PrintShaderError(uiFS, true)
-		!= GL_NO_ERROR)
-		return false;
 
-    program = glCreateProgram();
+	GLuint uiVS, uiFS, program;
+	bool built = BuildProgram(vertexShader, fragmentShader, pszVertShader,
+		pszFragShader, defines, uiVS, uiFS, program);
 
-    glAttachObjectARB(program, uiVS);
-	PrintShaderError(uiVS, true);
-    glAttachObjectARB(program, uiFS);
-	PrintShaderError(uiFS, true);
+	FreeFileMemory(&pszVertShader);
+	FreeFileMemory(&pszFragShader);
 
-	if (Verbose(VerboseInfo))
-		printf("linking... ");
+	if (!built)
+		return ProgramHandle();
 
-    glLinkProgram(program);
-    if (PrintShaderError(program, false)
-		!= GL_NO_ERROR)
-		return false;
-	//glGetShaderiv(program, GL_LINK_STATUS, &linked);
-	//if (!linked)
-	//{
-	//	printf("\nUnable to link %s %s\n", vertexShader, fragmentShader);
-	//	return false;
-	//}
+	return AddShader(key, new Shader(vertexShader, fragmentShader, defines,
+		uiVS, uiFS, program));
+}
 
-	// Clear errors
-	glGetError();
+ProgramHandle GLResourceManager::AddShader(const string &key, Shader *shader)
+{
+	shader->Reflect();
 
-	if (Verbose(VerboseInfo))
-		printf("Done\n");
-	
-	apShader.push_back(new Shader(vertexShader, fragmentShader, uiVS, uiFS,
-		program));
+	// The driver's copy of the program is the closest measure available
+	GLint bytes = 0;
+	if (ProgramBinarySupported())
+	{
+		glGetProgramiv(shader->GetProgram(), GL_PROGRAM_BINARY_LENGTH,
+			&bytes);
+	}
 
-    return true;	
+	ProgramHandle handle = shaders.Add(key, shader, bytes);
+	mPrograms[shader->GetProgram()] = handle;
+	return handle;
 }
 
+GLuint GLResourceManager::GetProgram(ProgramHandle handle) const
+{
+	const Shader *shader = shaders.Get(handle);
+	return shader ? shader->GetProgram() : 0;
+}
 
-bool GLResourceManager::LoadShaderFromFile(const char *vertexShader,
-	const char *fragmentShader, GLuint &program)
+bool GLResourceManager::BuildProgram(const char *vertexName,
+	const char *fragmentName, const char *vertexSource,
+	const char *fragmentSource, const char *defines, GLuint &uiVS,
+	GLuint &uiFS, GLuint &program)
 {
-	ptr_vector<Shader>::const_iterator iter;
-	for (iter = apShader.begin(); iter != apShader.end(); iter++)
+	Timer timer;
+
+	string vertSource = AddDefines(vertexSource, defines);
+	string fragSource = AddDefines(fragmentSource, defines);
+
+	// The final sources include the defines
+	unsigned long long key = 0;
+	if (ProgramCacheAvailable())
 	{
-		if (iter->SameAs(vertexShader, fragmentShader))
+		key = ProgramKey(vertSource, fragSource);
+		if (LoadProgramBinary(key, program))
 		{
-			program = iter->GetProgram();
+			// The program doesn't need the shader objects
+			uiVS = uiFS = 0;
+			uiProgramsBuilt++;
+			uiProgramsCached++;
+			fProgramTime += timer.Update();
 			return true;
 		}
 	}
-	char *pszVertShader = NULL;
-	char *pszFragShader = NULL;
 
-	if (LoadFileIntoMemory(vertexShader, &pszVertShader) <= 0)
-    {
-		printf("Unable to load shader %s!\n", vertexShader);
-		return false;
-	}
-
-	if (LoadFileIntoMemory(fragmentShader, &pszFragShader) <= 0)
-    {
-		printf("Unable to load shader %s!\n", fragmentShader);
-		return false;
-	}
-
-	GLint vertCompiled, fragCompiled;//, linked;
-	GLuint uiVS, uiFS;
+	GLint vertCompiled, fragCompiled, linked;
 
     uiVS = glCreateShader(GL_VERTEX_SHADER);
     uiFS = glCreateShader(GL_FRAGMENT_SHADER);
 
-	const char *vs = pszVertShader;
-	const char *fs = pszFragShader;
+	const char *vs = vertSource.c_str();
+	const char *fs = fragSource.c_str();
     
     glShaderSource(uiVS, 1, &vs, NULL);
     if (PrintShaderError(uiVS, true)
@@ -314,17 +580,17 @@ bool GLResourceManager::LoadShaderFromFile(const char *vertexShader,
 		!= GL_NO_ERROR)
 		return false;
 
-	FreeFileMemory(&pszVertShader);
-	FreeFileMemory(&pszFragShader);
-
 	if (Verbose(VerboseInfo))
-		printf("Compiling vertex shader %s... ", vertexShader);
+	{
+		printf("Compiling vertex shader %s%s%s... ", vertexName,
+			defines ? " with " : "", defines ? defines : "");
+	}
 
 	glCompileShader(uiVS);
 	glGetShaderiv(uiVS, GL_COMPILE_STATUS, &vertCompiled);
 	if (!vertCompiled)
 	{
-		printf("\nUnable to compile %s\n", vertexShader);
+		printf("\nUnable to compile %s\n", vertexName);
 		PrintShaderError(uiVS, true);
 		return false;
 	}
@@ -333,14 +599,14 @@ bool GLResourceManager::LoadShaderFromFile(const char *vertexShader,
 		return false;
 
 	if (Verbose(VerboseInfo))
-		printf("and fragment shader %s... ", fragmentShader);
+		printf("and fragment shader %s... ", fragmentName);
 
     glCompileShader(uiFS);
-	glGetShaderiv(uiVS, GL_COMPILE_STATUS, &fragCompiled);
+	glGetShaderiv(uiFS, GL_COMPILE_STATUS, &fragCompiled);
 	if (!fragCompiled)
 	{
-		printf("\nUnable to compile %s\n", fragmentShader);
-		PrintShaderError(uiVS, true);
+		printf("\nUnable to compile %s\n", fragmentName);
+		PrintShaderError(uiFS, true);
 		return false;
 	}
     if (PrintShaderError(uiFS, true)
@@ -354,6 +620,13 @@ bool GLResourceManager::LoadShaderFromFile(const char *vertexShader,
     glAttachObjectARB(program, uiFS);
 	PrintShaderError(uiFS, true);
 
+	if (key)
+	{
+		// Tell the driver the binary will be retrieved
+		glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT,
+			GL_TRUE);
+	}
+
 	if (Verbose(VerboseInfo))
 		printf("linking... ");
 
@@ -361,30 +634,232 @@ bool GLResourceManager::LoadShaderFromFile(const char *vertexShader,
     if (PrintShaderError(program, false)
 		!= GL_NO_ERROR)
 		return false;
-	//glGetShaderiv(program, GL_LINK_STATUS, &linked);
-	//if (!linked)
-	//{
-	//	printf("\nUnable to link %s %s\n", vertexShader, fragmentShader);
-	//	return false;
-	//}
+	glGetProgramiv(program, GL_LINK_STATUS, &linked);
 
 	// Clear errors
 	glGetError();
 
 	if (Verbose(VerboseInfo))
 		printf("Done\n");
-	
-	apShader.push_back(new Shader(vertexShader, fragmentShader, uiVS, uiFS,
-		program));
 
-    return true;		
+	if (key && linked)
+		SaveProgramBinary(key, program);
+
+	uiProgramsBuilt++;
+	fProgramTime += timer.Update();
+    return true;
+}
+
+/*****************************************************************************
+ * Program binary cache
+ *****************************************************************************/
+
+// Cache file layout: header followed by the binary returned by the driver
+struct ProgramBinaryHeader
+{
+	char acMagic[4];
+	unsigned int uiVersion;
+	unsigned long long ullKey;
+	GLenum eFormat;
+	GLint iLength;
+};
+
+static const char ProgramBinaryMagic[4] = { 'B', 'Z', 'P', 'B' };
+static const unsigned int ProgramBinaryVersion = 1;
+
+static unsigned long long HashString(const char *s, unsigned long long hash)
+{
+	// The terminator separates consecutive strings
+	return s ? Hash64(s, strlen(s) + 1, hash) : Hash64("", 1, hash);
+}
+
+void GLResourceManager::SetProgramCache(bool enable,
+	const char *directory/* = "cache"*/)
+{
+	bProgramCache = enable;
+	sCacheDir = directory;
+}
+
+bool GLResourceManager::ProgramBinarySupported()
+{
+	if (iBinarySupported < 0)
+	{
+		// Needs a context, so it can't be checked earlier
+		GLint formats = 0;
+		if (IsExtensionSupported("GL_ARB_get_program_binary"))
+			glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+		iBinarySupported = formats > 0;
+		if (Verbose(VerboseInfo) && bProgramCache)
+		{
+			printf("Program binary cache %s\n", iBinarySupported ?
+				sCacheDir.c_str() : "not supported");
+		}
+	}
+	return iBinarySupported > 0;
+}
+
+bool GLResourceManager::ProgramCacheAvailable()
+{
+	return bProgramCache && ProgramBinarySupported();
 }
 
+unsigned long long GLResourceManager::ProgramKey(const string &vertexSource,
+	const string &fragmentSource)
+{
+	// Binaries are only valid for the driver that produced them
+	unsigned long long key = HashString(vertexSource.c_str(),
+		14695981039346656037ULL);
+	key = HashString(fragmentSource.c_str(), key);
+	key = HashString((const char *)glGetString(GL_VENDOR), key);
+	key = HashString((const char *)glGetString(GL_RENDERER), key);
+	key = HashString((const char *)glGetString(GL_VERSION), key);
+	// 0 means no key
+	return key ? key : 1;
+}
+
+string GLResourceManager::ProgramCacheFile(unsigned long long key) const
+{
+	char name[32];
+	sprintf(name, "/%08x%08x.bin", (unsigned int)(key >> 32),
+		(unsigned int)key);
+	return sCacheDir + name;
+}
+
+bool GLResourceManager::LoadProgramBinary(unsigned long long key,
+	GLuint &program)
+{
+	string file = ProgramCacheFile(key);
+	FILE *f = fopen(file.c_str(), "rb");
+	if (!f)
+		return false;
+
+	ProgramBinaryHeader header;
+	vector<char> binary;
+	bool valid = fread(&header, sizeof(header), 1, f) == 1 &&
+		memcmp(header.acMagic, ProgramBinaryMagic, 4) == 0 &&
+		header.uiVersion == ProgramBinaryVersion &&
+		header.ullKey == key && header.iLength > 0;
+	if (valid)
+	{
+		binary.resize(header.iLength);
+		valid = fread(&binary[0], header.iLength, 1, f) == 1;
+	}
+	fclose(f);
+	if (!valid)
+	{
+		printf("Invalid program binary %s\n", file.c_str());
+		return false;
+	}
+
+	program = glCreateProgram();
+	glProgramBinary(program, header.eFormat, &binary[0], header.iLength);
+	GLint linked = 0;
+	glGetProgramiv(program, GL_LINK_STATUS, &linked);
+	// Clear errors
+	glGetError();
+	if (!linked)
+	{
+		// Rejected by the driver (e.g. after an update), built from source
+		if (Verbose(VerboseInfo))
+			printf("Program binary %s rejected\n", file.c_str());
+		GLStateCache::Instance().DeleteProgram(program);
+		return false;
+	}
+	return true;
+}
+
+void GLResourceManager::SaveProgramBinary(unsigned long long key,
+	GLuint program)
+{
+	ProgramBinaryHeader header;
+	memcpy(header.acMagic, ProgramBinaryMagic, 4);
+	header.uiVersion = ProgramBinaryVersion;
+	header.ullKey = key;
+	header.iLength = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &header.iLength);
+	if (header.iLength <= 0)
+		return;
+
+	vector<char> binary(header.iLength);
+	glGetProgramBinary(program, header.iLength, NULL, &header.eFormat,
+		&binary[0]);
+	if (glGetError() != GL_NO_ERROR)
+		return;
+
+	MakeDirectory(sCacheDir.c_str());
+	string file = ProgramCacheFile(key);
+	FILE *f = fopen(file.c_str(), "wb");
+	if (!f)
+	{
+		printf("Unable to write program binary %s\n", file.c_str());
+		return;
+	}
+	bool written = fwrite(&header, sizeof(header), 1, f) == 1 &&
+		fwrite(&binary[0], header.iLength, 1, f) == 1;
+	fclose(f);
+	if (!written)
+	{
+		printf("Unable to write program binary %s\n", file.c_str());
+		// A truncated file would be rejected, but it's a waste of a read
+		remove(file.c_str());
+	}
+}
 
 
 bool GLResourceManager::ReleaseShaders()
 {
-	apShader.clear();
+	shaders.Clear();
+	mPrograms.clear();
+	return true;
+}
+
+GLResourceManager::Shader *GLResourceManager::FindShader(GLuint program)
+{
+	// Entries of evicted programs are stale until their name is reused
+	boost::unordered_map<GLuint, ProgramHandle>::const_iterator iter =
+		mPrograms.find(program);
+	Shader *shader = iter != mPrograms.end() ?
+		shaders.Get(iter->second) : NULL;
+	if (!shader)
+		printf("Program %d not loaded by GLResourceManager\n", program);
+	return shader;
+}
+
+UniformHandle GLResourceManager::GetUniform(GLuint program, const char *name)
+{
+	Shader *shader = FindShader(program);
+	UniformInfo *info = shader ? shader->FindUniform(name) : NULL;
+	if (!info && Verbose(VerboseAll))
+		printf("No such uniform named \"%s\"\n", name);
+	return UniformHandle(info);
+}
+
+GLint GLResourceManager::GetAttrib(GLuint program, const char *name)
+{
+	Shader *shader = FindShader(program);
+	GLint loc = shader ? shader->FindAttrib(name) : -1;
+	if (loc == -1 && Verbose(VerboseAll))
+		printf("No such attribute named \"%s\"\n", name);
+	return loc;
+}
+
+bool GLResourceManager::BindUniformBlock(GLuint program, const char *name,
+	GLuint binding, GLsizeiptr size)
+{
+	Shader *shader = FindShader(program);
+	const Shader::Block *block = shader ? shader->FindBlock(name) : NULL;
+	if (!block)
+	{
+		printf("No such uniform block named \"%s\"\n", name);
+		return false;
+	}
+	if (block->iSize > size)
+	{
+		printf("Uniform block %s is %d bytes, %d expected\n", name,
+			block->iSize, (int)size);
+		return false;
+	}
+	glUniformBlockBinding(program, block->uiIndex, binding);
 	return true;
 }
 
@@ -396,81 +871,147 @@ bool GLResourceManager::ReleaseShaders()
 bool GLResourceManager::LoadTextureFromFile(const char *textureFile,
 	GLuint &texture, GLint minFilter, GLint magFilter)
 {
-	ptr_vector<Texture>::const_iterator iter;
-	for (iter = apTexture.begin(); iter != apTexture.end(); iter++)
+	texture = GetTexture(LoadTexture(textureFile, minFilter, magFilter));
+	return texture != 0;
+}
+
+TextureHandle GLResourceManager::LoadTexture(const char *textureFile,
+	GLint minFilter, GLint magFilter)
+{
+	TextureHandle handle = textures.Acquire(textureFile);
+	if (handle.IsValid())
 	{
-		if (iter->SameAs(textureFile))
-		{
-			texture = iter->GetTexture();
-			if (Verbose(VerboseAll))
-				printf("Texture %s already loaded\n", textureFile);
-			return true;
-		}
+		if (Verbose(VerboseAll))
+			printf("Texture %s already loaded\n", textureFile);
+		return handle;
 	}
 
+	GLuint texture;
     SDL_Surface *surface;
     GLenum texture_format;
 	GLint  nOfColors;
 
+	size_t bytes;
+	if (LoadTextureContainer(textureFile, minFilter, magFilter, texture, bytes))
+	{
+		return textures.Add(textureFile, new Texture(textureFile, texture),
+			bytes);
+	}
+
 	if (LoadImage(textureFile, surface, texture_format, nOfColors))
 	{
- 
-		// Check that the image's width is a power of 2
-		if ( (surface->w & (surface->w - 1)) != 0 )
-		{
-			printf("warning: %s's width is not a power of 2\n", textureFile);
-		}
-	
-		// Also check if the height is a power of 2
-		if ( (surface->h & (surface->h - 1)) != 0 )
+		// Swizzled to RGB(A) and tightly packed
+		MipChain chain;
+		bool converted = chain.Base().FromSurface(surface);
+		SDL_FreeSurface( surface );
+		if (!converted)
 		{
-			printf("warning: %s's height is not a power of 2\n", textureFile);
+			printf("%s is not truecolor\n", textureFile);
+			return TextureHandle();
 		}
-	 
+
 		// Have OpenGL generate a texture object handle for us
 		glGenTextures( 1, &texture );
 	 
 		// Bind the texture object
-		glBindTexture( GL_TEXTURE_2D, texture );
+		GLStateCache::Instance().BindTexture( GL_TEXTURE_2D, texture );
 	 
 		// Set the texture's stretching properties
 		glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, minFilter );
 		glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, magFilter );
 
-		// If mipmaps are required, generated mipmapped version, otherwise
-		// load normal texture
+		// If mipmaps are required, generate them (filtered in linear space,
+		// sizes are kept even if not a power of 2), otherwise load only the
+		// base level
 		if (minFilter == GL_LINEAR_MIPMAP_LINEAR ||
 			magFilter == GL_LINEAR_MIPMAP_LINEAR)
 		{
-			// Generate fully mipmapped texture
-			gluBuild2DMipmaps( GL_TEXTURE_2D, nOfColors, surface->w, surface->h,
-				texture_format, GL_UNSIGNED_BYTE, surface->pixels );
-		}
-		else
-		{
-			// Edit the texture object's image data using the information
-			// SDL_Surface gives us
-			glTexImage2D( GL_TEXTURE_2D, 0, nOfColors, surface->w, surface->h,
-				0, texture_format, GL_UNSIGNED_BYTE, surface->pixels );
+			chain.Build(Image::SRGB | Image::PARALLEL);
 		}
+		chain.Upload(GL_TEXTURE_2D);
 
+		return textures.Add(textureFile, new Texture(textureFile, texture),
+			chain.Bytes());
+		
+	}
+	return TextureHandle();
+}
 
-		SDL_FreeSurface( surface );
-	
-		apTexture.push_back(new Texture(textureFile, texture));
+bool GLResourceManager::LoadTextureContainer(const char *textureFile,
+	GLint minFilter, GLint magFilter, GLuint &texture, size_t &bytes)
+{
+	string path = TextureFile::PathOf(textureFile);
+	TextureFile container;
+	if (!container.Open(path.c_str()))
+		return false;
 
-		return true;
-		
+	// Containers can be shipped without their sources
+	unsigned long long hash = HashFile(textureFile);
+	if (hash && hash != container.SourceHash())
+	{
+		printf("%s is older than %s, not used\n", path.c_str(), textureFile);
+		return false;
 	}
-	return false;
+	if (container.IsCompressed() && !TextureFile::CompressionSupported())
+	{
+		printf("%s is compressed, S3TC is not supported\n", path.c_str());
+		return false;
+	}
+
+	glGenTextures( 1, &texture );
+	GLStateCache::Instance().BindTexture( GL_TEXTURE_2D, texture );
+	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, minFilter );
+	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, magFilter );
+
+	// Same test as LoadTexture(): without mipmaps only the base is needed
+	unsigned int levels = minFilter == GL_LINEAR_MIPMAP_LINEAR ||
+		magFilter == GL_LINEAR_MIPMAP_LINEAR ? container.NumLevels() : 1;
+	container.Upload(GL_TEXTURE_2D, levels);
+	bytes = container.Bytes(levels);
+
+	if (Verbose(VerboseAll))
+		printf("Texture %s loaded from %s\n", textureFile, path.c_str());
+	return true;
+}
+
+GLuint GLResourceManager::GetTexture(TextureHandle handle) const
+{
+	const Texture *texture = textures.Get(handle);
+	return texture ? texture->GetTexture() : 0;
+}
+
+TextureHandle GLResourceManager::AcquireTexture(const char *key)
+{
+	return textures.Acquire(key);
+}
+
+TextureHandle GLResourceManager::AddTexture(const char *key, GLuint texture,
+	size_t bytes)
+{
+	return textures.Add(key, new Texture(key, texture), bytes);
 }
 
 bool GLResourceManager::ReleaseTextures()
 {
-	apTexture.clear();
+	textures.Clear();
 	return true;
 }
 
+void GLResourceManager::UpdateResidency()
+{
+	textures.SetClock(++uiFrame);
+	if (!uiTextureBudget)
+		return;
+
+	unsigned int evicted = textures.EvictLRU(uiTextureBudget);
+	uiTexturesEvicted += evicted;
+	if (evicted && Verbose(VerboseInfo))
+	{
+		printf("Frame %d: %d textures evicted, %.1f KB loaded\n", uiFrame,
+			evicted, textures.Bytes() / 1024.0f);
+	}
+}
+
 /*****************************************************************************
  * 3DS files methods
  *****************************************************************************/
@@ -478,35 +1019,48 @@ bool GLResourceManager::ReleaseTextures()
 
 bool GLResourceManager::Load3DSFile(const char *file, unsigned int &index)
 {
-	unsigned int i = 0;
-	ptr_vector<File3DS>::const_iterator iter;
-	for (iter = ap3DS.begin(); iter != ap3DS.end(); iter++, i++)
+	File3DSHandle handle = Load3DS(file);
+	index = handle.Value();
+	return handle.IsValid();
+}
+
+File3DSHandle GLResourceManager::Load3DS(const char *file)
+{
+	File3DSHandle handle = files3DS.Acquire(file);
+	if (handle.IsValid())
 	{
-		if (iter->SameAs(file))
-		{
-			if (Verbose(VerboseAll))
-				printf("3DS file %s already loaded\n", file);
-			index = i;
-			return true;
-		}
+		if (Verbose(VerboseAll))
+			printf("3DS file %s already loaded\n", file);
+		return handle;
 	}
 
 	Lib3dsFile *f = lib3ds_file_load(file);
 	if (f == NULL)
 	{
 		printf("Unable to load %s\n", file);
-		return false;
+		return File3DSHandle();
 	}
 
-	ap3DS.push_back(new File3DS(file, f));
-	index = ap3DS.size() - 1;
+	File3DS *file3DS = new File3DS(file, f);
+	return files3DS.Add(file, file3DS, file3DS->Bytes());
+}
 
-	return true;
+Lib3dsFile *GLResourceManager::Get3DSFile(unsigned int index3DS) const
+{
+	const File3DS *file = files3DS.Get(File3DSHandle::FromValue(index3DS));
+	if (!file)
+	{
+		printf("3DS file %d not loaded by GLResourceManager\n", index3DS);
+		return NULL;
+	}
+	return file->GetFile();
 }
 
 void GLResourceManager::ListMeshNames(unsigned int index3DS)
 {
-	Lib3dsFile *f = ap3DS[index3DS].GetFile();
+	Lib3dsFile *f = Get3DSFile(index3DS);
+	if (!f)
+		return;
 	Lib3dsMesh *mesh = f->meshes;
 	printf("Listing meshes:\n");
 	while (mesh)
@@ -518,7 +1072,9 @@ void GLResourceManager::ListMeshNames(unsigned int index3DS)
 
 Lib3dsMesh *GLResourceManager::FindMesh(unsigned int index3DS, const char *name)
 {
-	Lib3dsFile *f = ap3DS[index3DS].GetFile();
+	Lib3dsFile *f = Get3DSFile(index3DS);
+	if (!f)
+		return NULL;
 	Lib3dsMesh *mesh = f->meshes;
 
 	while (mesh)
@@ -584,8 +1140,86 @@ float GLResourceManager::MeshSize(unsigned int index3DS, const char *name)
 
 bool GLResourceManager::Release3DSFiles()
 {
-	ap3DS.clear();
+	files3DS.Clear();
 	return true;
 }
 
+/*****************************************************************************
+ * Reference counting and memory accounting
+ *****************************************************************************/
+
+bool GLResourceManager::Release(ProgramHandle handle)
+{
+	return shaders.Release(handle);
+}
+
+bool GLResourceManager::Release(TextureHandle handle)
+{
+	return textures.Release(handle);
+}
+
+bool GLResourceManager::Release(File3DSHandle handle)
+{
+	return files3DS.Release(handle);
+}
+
+unsigned int GLResourceManager::EvictUnused(ResourceType type)
+{
+	switch (type)
+	{
+	case RESOURCE_PROGRAM:	return shaders.EvictUnused();
+	case RESOURCE_TEXTURE:	return textures.EvictUnused();
+	case RESOURCE_3DS:		return files3DS.EvictUnused();
+	default:				return 0;
+	}
+}
+
+unsigned int GLResourceManager::EvictUnused()
+{
+	unsigned int evicted = 0;
+	for (unsigned int i = 0; i < NUM_RESOURCE_TYPES; i++)
+		evicted += EvictUnused((ResourceType)i);
+	return evicted;
+}
+
+unsigned int GLResourceManager::GetResourceCount(ResourceType type) const
+{
+	switch (type)
+	{
+	case RESOURCE_PROGRAM:	return shaders.Size();
+	case RESOURCE_TEXTURE:	return textures.Size();
+	case RESOURCE_3DS:		return files3DS.Size();
+	default:				return 0;
+	}
+}
+
+size_t GLResourceManager::GetMemoryUsage(ResourceType type) const
+{
+	switch (type)
+	{
+	case RESOURCE_PROGRAM:	return shaders.Bytes();
+	case RESOURCE_TEXTURE:	return textures.Bytes();
+	case RESOURCE_3DS:		return files3DS.Bytes();
+	default:				return 0;
+	}
+}
+
+void GLResourceManager::PrintMemoryUsage() const
+{
+	static const char *names[NUM_RESOURCE_TYPES] = {
+		"Programs", "Textures", "3DS files"
+	};
+	for (unsigned int i = 0; i < NUM_RESOURCE_TYPES; i++)
+	{
+		printf("%-10s %3d, %8.1f KB\n", names[i],
+			GetResourceCount((ResourceType)i),
+			GetMemoryUsage((ResourceType)i) / 1024.0f);
+	}
+	if (uiTextureBudget)
+	{
+		printf("Texture budget %.1f KB, %d textures evicted\n",
+			uiTextureBudget / 1024.0f, uiTexturesEvicted);
+	}
+}
+
 
@@ -17,17 +17,100 @@
 #include "Extensions.h"
 #include "Misc.h"
 #include "VBO.h"
+#include "ResourceRegistry.h"
 
 #include <lib3ds/file.h>
 
 #include "boost/ptr_container/ptr_vector.hpp"
 using namespace boost;
 
-//#include <vector>
-//using namespace std;
+#include <vector>
+using namespace std;
 
+/*****************************************************************************
+ * Uniform reflection
+ *****************************************************************************/
+
+//! Active uniform of a program, found by reflection after linking
+struct UniformInfo
+{
+	//! Name without the [0] suffix of arrays
+	string sName;
+	GLint iLocation;
+	GLenum eType;
+	//! Number of elements (1 if not an array)
+	GLint iSize;
+	//! Last value set through a handle (single values only)
+	GLfloat afValue[16];
+	bool bSet;
+};
+
+//! Typed handle of a uniform (see GLResourceManager::GetUniform())
+/*!
+ Handles are cheap to copy and are valid as long as the program is loaded.
+ Setters act on the program in use, which must be the one of the handle.
+ The last value set is remembered per program and setting it again doesn't
+ call GL, so the uniform must only be changed through handles.
+ A handle to a uniform that is not active ignores all calls.
+ */
+class UniformHandle
+{
+	UniformInfo *pInfo;
+
+	//! Stores n values, returns true if they differ from the last ones
+	bool Changed(const GLfloat *v, unsigned int n) const;
+public:
+	UniformHandle(UniformInfo *info = NULL) : pInfo(info) { }
+
+	bool IsValid() const { return pInfo != NULL; }
+	GLint GetLocation() const { return pInfo ? pInfo->iLocation : -1; }
+
+	//! int, bool and sampler uniforms
+	void Set1i(GLint i) const;
+	void Set1f(GLfloat f) const;
+	void Set2fv(const GLfloat *v, GLsizei count = 1) const;
+	void Set3fv(const GLfloat *v, GLsizei count = 1) const;
+	void Set4fv(const GLfloat *v, GLsizei count = 1) const;
+	//! Column major matrices
+	void SetMatrix4fv(const GLfloat *m, GLsizei count = 1) const;
+};
+
+/*****************************************************************************
+ * Resource handles
+ *****************************************************************************/
+
+struct ProgramTag;
+struct TextureTag;
+struct File3DSTag;
+
+//! Typed handles of the resources loaded by GLResourceManager
+typedef ResourceHandle<ProgramTag> ProgramHandle;
+typedef ResourceHandle<TextureTag> TextureHandle;
+typedef ResourceHandle<File3DSTag> File3DSHandle;
+
+//! Loads and owns shaders, textures and 3DS files (singleton)
+/*!
+ Resources are stored in registries keyed by their content (files and
+ defines), so that loading the same resource twice returns the same object.
+ Each load adds a reference to the resource, dropped with Release(handle).
+ Unreferenced resources stay loaded until EvictUnused() is called: handles
+ (and GL names) to them must not be used afterwards. UniformHandles of an
+ evicted program become dangling.
+
+ The functions returning GL names count a reference that can't be released,
+ so their resources live until the global Release().
+ */
 class GLResourceManager
 {
+public:
+	enum ResourceType {
+		RESOURCE_PROGRAM,
+		RESOURCE_TEXTURE,
+		RESOURCE_3DS,
+		NUM_RESOURCE_TYPES
+	};
+
+private:
 
 	/*************************************************************************
 	 * Shader definition
@@ -37,20 +120,47 @@ class GLResourceManager
 	private:
 		string sVertShader;
 		string sFragShader;
+		//! Preprocessor symbols the program was specialized with
+		string sDefines;
 
 		GLuint uiVS;
 		GLuint uiFS;
 		GLuint uiProgram;
+
 	public:
-		Shader(const char *vertexShader, const char *fragmentShader, GLuint vs,
-			GLuint fs, GLuint program);
+		//! Active uniform block: name, index and size in bytes
+		struct Block
+		{
+			string sName;
+			GLuint uiIndex;
+			GLint iSize;
+		};
+	private:
+		//! Active uniforms, attributes and uniform blocks
+		ptr_vector<UniformInfo> apUniform;
+		vector<pair<string, GLint> > aAttrib;
+		vector<Block> aBlock;
+	public:
+		Shader(const char *vertexShader, const char *fragmentShader,
+			const char *defines, GLuint vs, GLuint fs, GLuint program);
 		~Shader();
 
-		bool SameAs(const char *vertexShader, const char *fragmentShader) const;
+		//! Registry key of a program
+		static string Key(const char *vertexShader,
+			const char *fragmentShader, const char *defines);
 		GLuint GetProgram() const { return uiProgram; }
+
+		//! Queries the active uniforms, attributes and blocks (after linking)
+		void Reflect();
+
+		UniformInfo *FindUniform(const char *name);
+		GLint FindAttrib(const char *name) const;
+		const Block *FindBlock(const char *name) const;
 	};
 
-	ptr_vector<Shader> apShader;
+	ResourceRegistry<Shader, ProgramTag> shaders;
+	//! Handles of the programs by GL name
+	boost::unordered_map<GLuint, ProgramHandle> mPrograms;
 	
 	/*************************************************************************
 	 * Texture definition
@@ -67,12 +177,10 @@ class GLResourceManager
 		Texture(const char *textureFile, GLuint texture);
 		~Texture();
 
-		bool SameAs(const char *textureFile) const;
-
 		GLuint GetTexture() const { return uiTexture; }
 	};
 
-	ptr_vector<Texture> apTexture;
+	ResourceRegistry<Texture, TextureTag> textures;
 
 	/*************************************************************************
 	 * 3DS files definition
@@ -86,26 +194,81 @@ class GLResourceManager
 		File3DS(const char *file, Lib3dsFile *obj);
 		~File3DS();
 
-		bool SameAs(const char *file) const;
-
 		Lib3dsFile *GetFile() const { return f; }
+
+		//! Memory used by the meshes
+		size_t Bytes() const;
 	};
 
-	ptr_vector<File3DS> ap3DS;
+	ResourceRegistry<File3DS, File3DSTag> files3DS;
+
+	/*************************************************************************
+	 * Program binary cache
+	 *************************************************************************/
+	bool bProgramCache;
+	string sCacheDir;
+	//! 1 if GL_ARB_get_program_binary is usable, 0 if not, -1 if unknown
+	int iBinarySupported;
+
+	//! Programs built (compiled or read from the cache) and time spent
+	unsigned int uiProgramsBuilt;
+	unsigned int uiProgramsCached;
+	float fProgramTime;
+
+	/*************************************************************************
+	 * Texture residency
+	 *************************************************************************/
+	//! Bytes of textures kept loaded, 0 for no limit
+	size_t uiTextureBudget;
+	unsigned int uiFrame;
+	unsigned int uiTexturesEvicted;
 
 protected:
-	GLResourceManager() { }
+	GLResourceManager() : bProgramCache(false), iBinarySupported(-1),
+		uiProgramsBuilt(0), uiProgramsCached(0), fProgramTime(0.0f),
+		uiTextureBudget(0), uiFrame(0), uiTexturesEvicted(0) { }
 
 	/* Shader related members */
 	static GLenum PrintShaderError(GLuint obj, bool bCompile);
+	//! Source with a #define line for each of the defines (see below)
+	static string AddDefines(const char *source, const char *defines);
+	//! Reads the program from the cache or compiles and links the sources
+	/*!
+	 The names only appear in messages. vs and fs are 0 if the program was
+	 read from the cache
+	 */
+	bool BuildProgram(const char *vertexName, const char *fragmentName,
+		const char *vertexSource, const char *fragmentSource,
+		const char *defines, GLuint &vs, GLuint &fs, GLuint &program);
+
+	/* Program binary cache related members */
+	bool ProgramBinarySupported();
+	bool ProgramCacheAvailable();
+	//! Hash of the final sources and of the driver identification strings
+	static unsigned long long ProgramKey(const string &vertexSource,
+		const string &fragmentSource);
+	string ProgramCacheFile(unsigned long long key) const;
+	//! False if there is no valid binary for key (program is not created)
+	bool LoadProgramBinary(unsigned long long key, GLuint &program);
+	void SaveProgramBinary(unsigned long long key, GLuint program);
+
+	Shader *FindShader(GLuint program);
+	//! Stores a shader just built, with one reference
+	ProgramHandle AddShader(const string &key, Shader *shader);
 
 	bool ReleaseShaders();
 
 	/* Texture related members */
 	bool ReleaseTextures();
+	//! Creates texture from the .btx container of textureFile, if there is
+	//! one made from the current version of the file (see TextureFile)
+	bool LoadTextureContainer(const char *textureFile, GLint minFilter,
+		GLint magFilter, GLuint &texture, size_t &bytes);
 
 	/* 3DS files related members */
 	bool Release3DSFiles();
+	//! File with handle value index, NULL (and a message) if stale
+	Lib3dsFile *Get3DSFile(unsigned int index3DS) const;
 
 
 
@@ -115,25 +278,121 @@ public:
 
 	bool Release();
 
-	// TODO: Add defines to shaders
 	/* Shader related members */
+	//! Compiles and links a program, or returns the one already loaded
+	/*!
+	 defines is a space separated list of NAME or NAME=VALUE symbols, defined
+	 (to 1 if no value is given) at the top of both shaders, after #version.
+	 Programs are keyed by sources and defines: each set of defines produces a
+	 separate specialized program (see ShaderVariants)
+	 */
 	bool LoadShaderFromMemory(const char *vertexShader,
-		const char *fragmentShader, GLuint &program);
+		const char *fragmentShader, GLuint &program,
+		const char *defines = NULL);
 
 	bool LoadShaderFromFile(const char *vertexShader,
-		const char *fragmentShader, GLuint &program);
+		const char *fragmentShader, GLuint &program,
+		const char *defines = NULL);
+
+	//! Handle based versions of the above, invalid handle on failure
+	ProgramHandle LoadProgramFromMemory(const char *vertexShader,
+		const char *fragmentShader, const char *defines = NULL);
+	ProgramHandle LoadProgramFromFile(const char *vertexShader,
+		const char *fragmentShader, const char *defines = NULL);
+	//! Program of handle, 0 if the handle is stale
+	GLuint GetProgram(ProgramHandle handle) const;
+
+	//! Reads and writes linked programs in directory, if supported
+	/*!
+	 Binaries are keyed by sources, defines and driver, and programs are
+	 built from source if their binary is missing or rejected by the driver
+	 */
+	void SetProgramCache(bool enable, const char *directory = "cache");
+
+	//! Number of programs built since startup, how many came from the cache
+	//! and the time spent (seconds)
+	unsigned int GetProgramsBuilt() const { return uiProgramsBuilt; }
+	unsigned int GetProgramsCached() const { return uiProgramsCached; }
+	float GetProgramTime() const { return fProgramTime; }
+
+	/* Reflection related members (programs loaded by this class only) */
+	//! Handle of uniform name. Invalid if it isn't active in program
+	UniformHandle GetUniform(GLuint program, const char *name);
+	//! Location of attribute name, -1 if it isn't active in program
+	GLint GetAttrib(GLuint program, const char *name);
+	//! Attaches uniform block name of program to a binding point
+	/*!
+	 Fails if the block isn't active or if it is larger than size, the size
+	 of the CPU struct backing it
+	 */
+	bool BindUniformBlock(GLuint program, const char *name, GLuint binding,
+		GLsizeiptr size);
 
 	/* Texture related members */
+	//! Loads the .btx container made by TexturePack if it is up to date,
+	//! otherwise the image itself
 	bool LoadTextureFromFile(const char *textureFile, GLuint &program,
 		GLint minFilter, GLint magFilter);
 
+	//! Handle based version of the above, invalid handle on failure
+	TextureHandle LoadTexture(const char *textureFile, GLint minFilter,
+		GLint magFilter);
+	//! Texture of handle, 0 if the handle is stale
+	GLuint GetTexture(TextureHandle handle) const;
+
+	//! Texture stored with key (usually its file), with a new reference.
+	//! Invalid handle if it isn't loaded
+	TextureHandle AcquireTexture(const char *key);
+	//! Takes ownership of a texture created elsewhere (see AsyncLoader)
+	//! and stores it with key (not loaded yet) and one reference
+	TextureHandle AddTexture(const char *key, GLuint texture, size_t bytes);
+
+	/* Texture residency related members */
+	//! Limits the memory of loaded textures
+	/*!
+	 Textures without references are kept for reuse while the total fits
+	 in bytes, and the least recently used ones (acquired or released in
+	 the oldest frame) are evicted first. Referenced textures are never
+	 evicted, even over budget. 0 disables the limit
+	 */
+	void SetTextureBudget(size_t bytes) { uiTextureBudget = bytes; }
+	size_t GetTextureBudget() const { return uiTextureBudget; }
+	//! Starts a new frame and evicts textures over budget. Called by the
+	//! shell once per frame
+	void UpdateResidency();
+	//! Number of textures evicted by the budget since startup
+	unsigned int GetTexturesEvicted() const { return uiTexturesEvicted; }
+
 	/* Geometry related members */
+	//! index is the value of the File3DSHandle of the file
 	bool Load3DSFile(const char *file, unsigned int &index);
 
+	File3DSHandle Load3DS(const char *file);
+
 	void ListMeshNames(unsigned int index3DS);
 
 	Lib3dsMesh *FindMesh(unsigned int index3DS, const char *name);
 	float MeshSize(unsigned int index3DS, const char *name);
+
+	/* Reference counting and memory accounting */
+	//! Drop a reference added by a load. False if the handle is stale
+	bool Release(ProgramHandle handle);
+	bool Release(TextureHandle handle);
+	bool Release(File3DSHandle handle);
+
+	//! Deletes the resources of type without references, returns how many
+	unsigned int EvictUnused(ResourceType type);
+	//! All types
+	unsigned int EvictUnused();
+
+	//! Number of loaded resources of type and their size in bytes
+	/*!
+	 Textures count all mipmap levels, programs the size of their binary
+	 (0 without GL_ARB_get_program_binary) and 3DS files their meshes
+	 */
+	unsigned int GetResourceCount(ResourceType type) const;
+	size_t GetMemoryUsage(ResourceType type) const;
+	void PrintMemoryUsage() const;
 };
 
 #endif
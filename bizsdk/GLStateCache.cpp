@@ -0,0 +1,305 @@
+/*****************************************************************************
+ * Filename			GLStateCache.cpp
+ *
+ * License			GPLv3
+ *
+ * Author			Andrea Bizzotto (bizz84@gmail.com)
+ *
+ * Platform			LinuxX11 / OpenGL
+ *
+ * Description		Shadow copy of the GL state used to skip redundant calls
+ *
+ *****************************************************************************/
+
+#include "GLStateCache.h"
+
+// Value of the unknown state. It is neither a valid name nor a valid enum
+static const GLuint Unknown = ~0U;
+
+GLStateCache::GLStateCache()
+	: bFiltering(false), uiSubmitted(0), uiFiltered(0), uiLastSubmitted(0),
+	uiLastFiltered(0)
+{
+	// No GL calls here, the context may not exist yet
+	Reset();
+}
+
+void GLStateCache::Reset()
+{
+	uiProgram = Unknown;
+	uiActiveUnit = Unknown;
+	for (unsigned int i = 0; i < MAX_TEXTURE_UNITS; i++)
+		for (unsigned int j = 0; j < NUM_TARGETS; j++)
+			auiTexture[i][j] = Unknown;
+	for (unsigned int i = 0; i < NUM_BUFFERS; i++)
+		auiBuffer[i] = Unknown;
+	uiVertexArray = Unknown;
+	for (unsigned int i = 0; i < NUM_CAPS; i++)
+		acCaps[i] = -1;
+	eBlendSrc = eBlendDst = Unknown;
+	eDepthFunc = Unknown;
+	uiDepthMask = Unknown;
+	eCullFace = Unknown;
+	eStencilFunc = Unknown;
+	iStencilRef = 0;
+	uiStencilMask = 0;
+	aeStencilOp[0] = aeStencilOp[1] = aeStencilOp[2] = Unknown;
+	uiColorMask = Unknown;
+}
+
+GLStateCache &GLStateCache::Instance()
+{
+	static GLStateCache instance;
+	return instance;
+}
+
+int GLStateCache::CapIndex(GLenum cap)
+{
+	switch (cap)
+	{
+	case GL_BLEND:			return CAP_BLEND;
+	case GL_DEPTH_TEST:		return CAP_DEPTH_TEST;
+	case GL_STENCIL_TEST:	return CAP_STENCIL_TEST;
+	case GL_CULL_FACE:		return CAP_CULL_FACE;
+	default:				return -1;
+	}
+}
+
+int GLStateCache::TargetIndex(GLenum target)
+{
+	switch (target)
+	{
+	case GL_TEXTURE_2D:			return TARGET_2D;
+	case GL_TEXTURE_CUBE_MAP:	return TARGET_CUBE_MAP;
+	default:					return -1;
+	}
+}
+
+int GLStateCache::BufferIndex(GLenum target)
+{
+	switch (target)
+	{
+	case GL_ARRAY_BUFFER_ARB:			return BUFFER_ARRAY;
+	case GL_ELEMENT_ARRAY_BUFFER_ARB:	return BUFFER_ELEMENT_ARRAY;
+	default:							return -1;
+	}
+}
+
+void GLStateCache::Invalidate()
+{
+	Reset();
+	// A known unit is needed to track texture bindings
+	ActiveTexture(0);
+}
+
+void GLStateCache::NewFrame()
+{
+	uiLastSubmitted = uiSubmitted;
+	uiLastFiltered = uiFiltered;
+	uiSubmitted = uiFiltered = 0;
+	Invalidate();
+}
+
+void GLStateCache::UseProgram(GLuint program)
+{
+	if (Changed(program != uiProgram))
+	{
+		glUseProgram(program);
+		uiProgram = program;
+	}
+}
+
+void GLStateCache::ActiveTexture(unsigned int unit)
+{
+	if (Changed(unit != uiActiveUnit))
+	{
+		glActiveTexture(GL_TEXTURE0 + unit);
+		uiActiveUnit = unit;
+	}
+}
+
+void GLStateCache::BindTexture(GLenum target, GLuint texture)
+{
+	int index = TargetIndex(target);
+	if (index < 0 || uiActiveUnit >= MAX_TEXTURE_UNITS)
+	{
+		Changed(true);
+		glBindTexture(target, texture);
+		return;
+	}
+	GLuint &bound = auiTexture[uiActiveUnit][index];
+	if (Changed(texture != bound))
+	{
+		glBindTexture(target, texture);
+		bound = texture;
+	}
+}
+
+void GLStateCache::BindBuffer(GLenum target, GLuint buffer)
+{
+	int index = BufferIndex(target);
+	if (index < 0)
+	{
+		Changed(true);
+		glBindBuffer(target, buffer);
+		return;
+	}
+	if (Changed(buffer != auiBuffer[index]))
+	{
+		glBindBuffer(target, buffer);
+		auiBuffer[index] = buffer;
+	}
+}
+
+void GLStateCache::BindVertexArray(GLuint array)
+{
+	if (Changed(array != uiVertexArray))
+	{
+		glBindVertexArray(array);
+		uiVertexArray = array;
+		// The element array buffer binding is part of the VAO state
+		auiBuffer[BUFFER_ELEMENT_ARRAY] = Unknown;
+	}
+}
+
+void GLStateCache::Enable(GLenum cap)
+{
+	int index = CapIndex(cap);
+	if (Changed(index < 0 || acCaps[index] != 1))
+	{
+		glEnable(cap);
+		if (index >= 0)
+			acCaps[index] = 1;
+	}
+}
+
+void GLStateCache::Disable(GLenum cap)
+{
+	int index = CapIndex(cap);
+	if (Changed(index < 0 || acCaps[index] != 0))
+	{
+		glDisable(cap);
+		if (index >= 0)
+			acCaps[index] = 0;
+	}
+}
+
+void GLStateCache::BlendFunc(GLenum src, GLenum dst)
+{
+	if (Changed(src != eBlendSrc || dst != eBlendDst))
+	{
+		glBlendFunc(src, dst);
+		eBlendSrc = src;
+		eBlendDst = dst;
+	}
+}
+
+void GLStateCache::DepthFunc(GLenum func)
+{
+	if (Changed(func != eDepthFunc))
+	{
+		glDepthFunc(func);
+		eDepthFunc = func;
+	}
+}
+
+void GLStateCache::DepthMask(GLboolean mask)
+{
+	GLuint value = mask ? 1 : 0;
+	if (Changed(value != uiDepthMask))
+	{
+		glDepthMask(mask);
+		uiDepthMask = value;
+	}
+}
+
+void GLStateCache::CullFace(GLenum mode)
+{
+	if (Changed(mode != eCullFace))
+	{
+		glCullFace(mode);
+		eCullFace = mode;
+	}
+}
+
+void GLStateCache::StencilFunc(GLenum func, GLint ref, GLuint mask)
+{
+	if (Changed(func != eStencilFunc || ref != iStencilRef ||
+		mask != uiStencilMask))
+	{
+		glStencilFunc(func, ref, mask);
+		eStencilFunc = func;
+		iStencilRef = ref;
+		uiStencilMask = mask;
+	}
+}
+
+void GLStateCache::StencilOp(GLenum sfail, GLenum dpfail, GLenum dppass)
+{
+	if (Changed(sfail != aeStencilOp[0] || dpfail != aeStencilOp[1] ||
+		dppass != aeStencilOp[2]))
+	{
+		glStencilOp(sfail, dpfail, dppass);
+		aeStencilOp[0] = sfail;
+		aeStencilOp[1] = dpfail;
+		aeStencilOp[2] = dppass;
+	}
+}
+
+void GLStateCache::StencilOpSeparate(GLenum face, GLenum sfail, GLenum dpfail,
+	GLenum dppass)
+{
+	Changed(true);
+	glStencilOpSeparate(face, sfail, dpfail, dppass);
+	aeStencilOp[0] = aeStencilOp[1] = aeStencilOp[2] = Unknown;
+}
+
+void GLStateCache::ColorMask(GLboolean r, GLboolean g, GLboolean b,
+	GLboolean a)
+{
+	GLuint mask = (r ? 1 : 0) | (g ? 2 : 0) | (b ? 4 : 0) | (a ? 8 : 0);
+	if (Changed(mask != uiColorMask))
+	{
+		glColorMask(r, g, b, a);
+		uiColorMask = mask;
+	}
+}
+
+void GLStateCache::DeleteProgram(GLuint program)
+{
+	glDeleteProgram(program);
+	if (program == uiProgram)
+		uiProgram = Unknown;
+}
+
+void GLStateCache::DeleteTextures(GLsizei n, const GLuint *textures)
+{
+	glDeleteTextures(n, textures);
+	for (GLsizei k = 0; k < n; k++)
+		for (unsigned int i = 0; i < MAX_TEXTURE_UNITS; i++)
+			for (unsigned int j = 0; j < NUM_TARGETS; j++)
+				if (auiTexture[i][j] == textures[k])
+					auiTexture[i][j] = Unknown;
+}
+
+void GLStateCache::DeleteBuffers(GLsizei n, const GLuint *buffers)
+{
+	glDeleteBuffers(n, buffers);
+	for (GLsizei k = 0; k < n; k++)
+		for (unsigned int i = 0; i < NUM_BUFFERS; i++)
+			if (auiBuffer[i] == buffers[k])
+				auiBuffer[i] = Unknown;
+}
+
+void GLStateCache::DeleteVertexArrays(GLsizei n, const GLuint *arrays)
+{
+	glDeleteVertexArrays(n, arrays);
+	for (GLsizei k = 0; k < n; k++)
+	{
+		if (uiVertexArray == arrays[k])
+		{
+			uiVertexArray = Unknown;
+			auiBuffer[BUFFER_ELEMENT_ARRAY] = Unknown;
+		}
+	}
+}
@@ -0,0 +1,141 @@
+/*****************************************************************************
+ * Filename			GLStateCache.h
+ *
+ * License			GPLv3
+ *
+ * Author			Andrea Bizzotto (bizz84@gmail.com)
+ *
+ * Platform			LinuxX11 / OpenGL
+ *
+ * Description		Shadow copy of the GL state used to skip redundant calls
+ *
+ *****************************************************************************/
+
+#ifndef _GL_STATE_CACHE_H_
+#define _GL_STATE_CACHE_H_
+
+#include "Extensions.h"
+
+//! Tracks the GL state changed through it and filters out no-op changes
+//! (singleton)
+/*!
+ Covers the bound program, textures per unit (2D and cube map), array and
+ element array buffers, vertex array object, the blend, depth test, stencil
+ test and cull face capabilities and the functions configuring them.
+ Other targets and capabilities are passed through.
+
+ The cache only knows the changes made through it: the state is forgotten
+ with Invalidate(), which the shell calls at the beginning of each frame,
+ and code changing the same state directly must call it afterwards.
+ Objects must be deleted through the cache, since GL resets the bindings of
+ deleted names.
+
+ Filtering is disabled by default: all calls are issued (and counted) so that
+ applications still changing the state directly keep working. Applications
+ going through the cache for all the tracked state enable it in InitGL().
+ */
+class GLStateCache
+{
+public:
+	enum { MAX_TEXTURE_UNITS = 8 };
+
+private:
+	enum { CAP_BLEND, CAP_DEPTH_TEST, CAP_STENCIL_TEST, CAP_CULL_FACE,
+		NUM_CAPS };
+	enum { TARGET_2D, TARGET_CUBE_MAP, NUM_TARGETS };
+	enum { BUFFER_ARRAY, BUFFER_ELEMENT_ARRAY, NUM_BUFFERS };
+
+	GLuint uiProgram;
+	unsigned int uiActiveUnit;
+	GLuint auiTexture[MAX_TEXTURE_UNITS][NUM_TARGETS];
+	GLuint auiBuffer[NUM_BUFFERS];
+	GLuint uiVertexArray;
+
+	//! 1 if enabled, 0 if disabled, -1 if unknown
+	signed char acCaps[NUM_CAPS];
+
+	GLenum eBlendSrc, eBlendDst;
+	GLenum eDepthFunc;
+	GLuint uiDepthMask;
+	GLenum eCullFace;
+	GLenum eStencilFunc;
+	GLint iStencilRef;
+	GLuint uiStencilMask;
+	GLenum aeStencilOp[3];
+	GLuint uiColorMask;
+
+	//! If false all calls are issued, the state is still tracked
+	bool bFiltering;
+
+	//! Calls issued to GL and skipped in the current and last frame
+	unsigned int uiSubmitted, uiFiltered;
+	unsigned int uiLastSubmitted, uiLastFiltered;
+
+	//! Sets all the state to unknown
+	void Reset();
+
+	//! Indices in the tables above, -1 if not tracked
+	static int CapIndex(GLenum cap);
+	static int TargetIndex(GLenum target);
+	static int BufferIndex(GLenum target);
+
+	//! Counts a call, returns true if it has to be issued
+	bool Changed(bool changed)
+	{
+		changed = changed || !bFiltering;
+		if (changed)
+			uiSubmitted++;
+		else
+			uiFiltered++;
+		return changed;
+	}
+
+	GLStateCache();
+	GLStateCache(const GLStateCache &);
+	GLStateCache &operator=(const GLStateCache &);
+public:
+	static GLStateCache &Instance();
+
+	//! Forgets all the state. The active texture unit is reset to 0
+	void Invalidate();
+	//! Invalidates the state and starts counting calls for a new frame
+	void NewFrame();
+
+	void SetFiltering(bool enable) { bFiltering = enable; }
+	bool IsFiltering() const { return bFiltering; }
+
+	void UseProgram(GLuint program);
+
+	//! Selects the unit used by BindTexture (index, not GL_TEXTUREi)
+	void ActiveTexture(unsigned int unit);
+	void BindTexture(GLenum target, GLuint texture);
+	void BindBuffer(GLenum target, GLuint buffer);
+	void BindVertexArray(GLuint array);
+
+	void Enable(GLenum cap);
+	void Disable(GLenum cap);
+	void Set(GLenum cap, bool enable) { enable ? Enable(cap) : Disable(cap); }
+
+	void BlendFunc(GLenum src, GLenum dst);
+	void DepthFunc(GLenum func);
+	void DepthMask(GLboolean mask);
+	void CullFace(GLenum mode);
+	void StencilFunc(GLenum func, GLint ref, GLuint mask);
+	void StencilOp(GLenum sfail, GLenum dpfail, GLenum dppass);
+	//! Not cached, invalidates StencilOp()
+	void StencilOpSeparate(GLenum face, GLenum sfail, GLenum dpfail,
+		GLenum dppass);
+	void ColorMask(GLboolean r, GLboolean g, GLboolean b, GLboolean a);
+
+	//! Delete the objects and forget their bindings
+	void DeleteProgram(GLuint program);
+	void DeleteTextures(GLsizei n, const GLuint *textures);
+	void DeleteBuffers(GLsizei n, const GLuint *buffers);
+	void DeleteVertexArrays(GLsizei n, const GLuint *arrays);
+
+	//! Calls issued to GL and skipped in the last complete frame
+	unsigned int GetSubmitted() const { return uiLastSubmitted; }
+	unsigned int GetFiltered() const { return uiLastFiltered; }
+};
+
+#endif
@@ -0,0 +1,408 @@
+/*****************************************************************************
+ * Filename			Image.cpp
+ *
+ * License			GPLv3
+ *
+ * Author			Andrea Bizzotto (bizz84@gmail.com)
+ *
+ * Platform			LinuxX11 / OpenGL
+ *
+ * Description		CPU images and mipmap generation for texture uploads
+ *
+ *****************************************************************************/
+
+#include "Image.h"
+#include "ThreadPool.h"
+#include "Misc.h"
+
+#include <stdio.h>
+#include <math.h>
+#include <string.h>
+#include <assert.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define IMAGE_SSE2
+#include <emmintrin.h>
+#endif
+
+// Minimum number of destination pixels worth filtering across threads
+static const unsigned int ParallelThreshold = 128 * 128;
+// Destination pixels filtered at a time in sRGB (RGBA only)
+static const unsigned int SRGBBlock = 64;
+
+/*****************************************************************************
+ * sRGB conversion tables
+ *****************************************************************************/
+
+// Linear values are stored with 12 bits: converting to linear and back is
+// within one step of the exact result
+enum { LINEAR_BITS = 12, LINEAR_MAX = (1 << LINEAR_BITS) - 1 };
+
+// Built before main() so that worker threads never race to initialize them
+static struct SRGBTables
+{
+	unsigned short toLinear[256];
+	unsigned char toSRGB[LINEAR_MAX + 1];
+
+	SRGBTables()
+	{
+		for (unsigned int i = 0; i < 256; i++)
+		{
+			double c = i / 255.0;
+			double l = c <= 0.04045 ? c / 12.92 : pow((c + 0.055) / 1.055, 2.4);
+			toLinear[i] = (unsigned short)(l * LINEAR_MAX + 0.5);
+		}
+		for (unsigned int i = 0; i <= LINEAR_MAX; i++)
+		{
+			double l = (double)i / LINEAR_MAX;
+			double c = l <= 0.0031308 ? l * 12.92 :
+				1.055 * pow(l, 1.0 / 2.4) - 0.055;
+			toSRGB[i] = (unsigned char)(c * 255.0 + 0.5);
+		}
+	}
+} tables;
+
+// Splits the first 2 * pixels of a row into even and odd pixels, colors
+// converted to linear (alpha is kept as is). The last pixel is repeated if
+// the row is 1 pixel wide
+template <unsigned int c>
+static void Linearize(const unsigned char *row, unsigned int width,
+	unsigned int pixels, unsigned short *even, unsigned short *odd)
+{
+	const unsigned short *toLinear = tables.toLinear;
+	// Only the last pixel of a 1 pixel wide row has no odd neighbor
+	const unsigned int pairs = 2 * pixels <= width ? pixels : pixels - 1;
+	unsigned int x;
+	for (x = 0; x < pairs; x++, row += 2 * c, even += c, odd += c)
+	{
+		even[0] = toLinear[row[0]];
+		even[1] = toLinear[row[1]];
+		even[2] = toLinear[row[2]];
+		odd[0] = toLinear[row[c]];
+		odd[1] = toLinear[row[c + 1]];
+		odd[2] = toLinear[row[c + 2]];
+		if (c == 4)
+		{
+			even[3] = row[3];
+			odd[3] = row[7];
+		}
+	}
+	if (x < pixels)
+	{
+		for (unsigned int k = 0; k < c; k++)
+			even[k] = odd[k] = k < 3 ? toLinear[row[k]] : row[k];
+	}
+}
+
+// Rounded average of the four arrays of n values at sums (even and odd
+// pixels of the two rows), written over the first
+static void Average4(unsigned short *sums, unsigned int n)
+{
+	const unsigned short *odd0 = sums + n, *even1 = sums + 2 * n;
+	const unsigned short *odd1 = sums + 3 * n;
+	unsigned int i = 0;
+#ifdef IMAGE_SSE2
+	// 4 * LINEAR_MAX fits 16 bits
+	const __m128i two = _mm_set1_epi16(2);
+	for (; i + 8 <= n; i += 8)
+	{
+		__m128i a = _mm_add_epi16(_mm_loadu_si128((const __m128i *)(sums + i)),
+			_mm_loadu_si128((const __m128i *)(odd0 + i)));
+		__m128i b = _mm_add_epi16(_mm_loadu_si128((const __m128i *)(even1 + i)),
+			_mm_loadu_si128((const __m128i *)(odd1 + i)));
+		__m128i sum = _mm_add_epi16(_mm_add_epi16(a, b), two);
+		_mm_storeu_si128((__m128i *)(sums + i), _mm_srli_epi16(sum, 2));
+	}
+#endif
+	for (; i < n; i++)
+	{
+		sums[i] = (unsigned short)((sums[i] + odd0[i] + even1[i] +
+			odd1[i] + 2) >> 2);
+	}
+}
+
+/*****************************************************************************
+ * DownsampleTask implementation
+ *****************************************************************************/
+
+// Filters a range of rows of a mipmap level
+class DownsampleTask : public ThreadTask
+{
+public:
+	const Image *src;
+	Image *dst;
+	bool srgb;
+
+	virtual void Run(unsigned int index, unsigned int count)
+	{
+		unsigned int begin, end;
+		ThreadPool::Range(dst->Height(), index, count, begin, end);
+		src->DownsampleRows(*dst, begin, end, srgb);
+	}
+};
+
+/*****************************************************************************
+ * Image implementation
+ *****************************************************************************/
+
+Image::Image(unsigned int width, unsigned int height, unsigned int components)
+	: uiWidth(0), uiHeight(0), uiComponents(0)
+{
+	Resize(width, height, components);
+}
+
+void Image::Resize(unsigned int width, unsigned int height,
+	unsigned int components)
+{
+	assert(components == 3 || components == 4);
+	uiWidth = width;
+	uiHeight = height;
+	uiComponents = components;
+	aPixels.resize(width * height * components);
+}
+
+bool Image::FromSurface(const SDL_Surface *surface)
+{
+	const unsigned int components = surface->format->BytesPerPixel;
+	if (components != 3 && components != 4)
+		return false;
+
+	Resize(surface->w, surface->h, components);
+	const unsigned int row = uiWidth * components;
+	// Same test as SurfaceFormat(): otherwise the surface is BGR(A)
+	const bool rgb = surface->format->Rmask == 0x000000ff;
+	for (unsigned int y = 0; y < uiHeight; y++)
+	{
+		// Rows of the surface may be padded
+		const unsigned char *in = (const unsigned char *)surface->pixels +
+			y * surface->pitch;
+		unsigned char *out = &aPixels[y * row];
+		if (rgb)
+		{
+			memcpy(out, in, row);
+			continue;
+		}
+		for (unsigned int x = 0; x < row; x += components)
+		{
+			out[x] = in[x + 2];
+			out[x + 1] = in[x + 1];
+			out[x + 2] = in[x];
+			if (components == 4)
+				out[x + 3] = in[x + 3];
+		}
+	}
+	return true;
+}
+
+void Image::DownsampleRows(Image &dst, unsigned int begin, unsigned int end,
+	bool srgb) const
+{
+	const unsigned int c = uiComponents;
+	const unsigned int srcRow = uiWidth * c;
+	const unsigned int dstRow = dst.uiWidth * c;
+	// Color components, alpha is always filtered linearly
+	const unsigned int colors = srgb ? 3 : 0;
+	const unsigned short *toLinear = tables.toLinear;
+	const unsigned char *toSRGB = tables.toSRGB;
+	// Blocks of both source rows in linear space, even and odd pixels apart
+	// so that the 2x2 sums are taken lane by lane (sRGB RGBA only). Blocks
+	// are small enough to stay in the L1 cache
+	unsigned short linear[4 * SRGBBlock * 4];
+
+	for (unsigned int y = begin; y < end; y++)
+	{
+		// 1 pixel high (or wide) sources are clamped
+		const unsigned int y0 = 2 * y;
+		const unsigned int y1 = y0 + 1 < uiHeight ? y0 + 1 : y0;
+		const unsigned char *row0 = &aPixels[y0 * srcRow];
+		const unsigned char *row1 = &aPixels[y1 * srcRow];
+		unsigned char *out = &dst.aPixels[y * dstRow];
+
+		// With RGB the gathers to linear space cost as much as they save:
+		// the scalar loop below is as fast
+		if (srgb && c == 4)
+		{
+			for (unsigned int x = 0; x < dst.uiWidth; x += SRGBBlock)
+			{
+				const unsigned int pixels = dst.uiWidth - x < SRGBBlock ?
+					dst.uiWidth - x : SRGBBlock;
+				const unsigned int n = pixels * 4;
+				const unsigned int offset = 8 * x;
+				unsigned short *sums = linear;
+				Linearize<4>(row0 + offset, uiWidth - 2 * x, pixels, sums,
+					sums + n);
+				Linearize<4>(row1 + offset, uiWidth - 2 * x, pixels,
+					sums + 2 * n, sums + 3 * n);
+				Average4(sums, n);
+				unsigned char *p = out + 4 * x;
+				for (unsigned int i = 0; i < n; i += 4)
+				{
+					p[i] = toSRGB[sums[i]];
+					p[i + 1] = toSRGB[sums[i + 1]];
+					p[i + 2] = toSRGB[sums[i + 2]];
+					p[i + 3] = (unsigned char)sums[i + 3];
+				}
+			}
+			continue;
+		}
+
+		unsigned int x = 0;
+#ifdef IMAGE_SSE2
+		// Two RGBA pixels per iteration, from four of each source row
+		if (!srgb && c == 4 && uiWidth > 1)
+		{
+			const __m128i zero = _mm_setzero_si128();
+			const __m128i two = _mm_set1_epi16(2);
+			for (; x + 2 <= dst.uiWidth; x += 2)
+			{
+				__m128i a = _mm_loadu_si128((const __m128i *)(row0 + 8 * x));
+				__m128i b = _mm_loadu_si128((const __m128i *)(row1 + 8 * x));
+				// Vertical sums of pixels 0, 1 and of pixels 2, 3
+				__m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(a, zero),
+					_mm_unpacklo_epi8(b, zero));
+				__m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(a, zero),
+					_mm_unpackhi_epi8(b, zero));
+				// Horizontal sums: 0 + 1, 2 + 3
+				__m128i sum = _mm_add_epi16(_mm_unpacklo_epi64(lo, hi),
+					_mm_unpackhi_epi64(lo, hi));
+				sum = _mm_srli_epi16(_mm_add_epi16(sum, two), 2);
+				_mm_storel_epi64((__m128i *)(out + 4 * x),
+					_mm_packus_epi16(sum, sum));
+			}
+		}
+#endif
+		for (; x < dst.uiWidth; x++)
+		{
+			const unsigned int x0 = 2 * x * c;
+			const unsigned int x1 = 2 * x + 1 < uiWidth ? x0 + c : x0;
+			unsigned char *p = out + x * c;
+			for (unsigned int k = 0; k < colors; k++)
+			{
+				unsigned int sum = toLinear[row0[x0 + k]] +
+					toLinear[row0[x1 + k]] + toLinear[row1[x0 + k]] +
+					toLinear[row1[x1 + k]];
+				p[k] = toSRGB[(sum + 2) >> 2];
+			}
+			// 2x2 box filter, rounded
+			for (unsigned int k = colors; k < c; k++)
+			{
+				p[k] = (unsigned char)((row0[x0 + k] + row0[x1 + k] +
+					row1[x0 + k] + row1[x1 + k] + 2) >> 2);
+			}
+		}
+	}
+}
+
+void Image::Downsample(Image &dst, unsigned int flags/* = SRGB*/) const
+{
+	assert(uiWidth && uiHeight);
+	dst.Resize(uiWidth > 1 ? uiWidth / 2 : 1, uiHeight > 1 ? uiHeight / 2 : 1,
+		uiComponents);
+
+	const bool srgb = (flags & SRGB) != 0;
+	if ((flags & PARALLEL) &&
+		dst.uiWidth * dst.uiHeight >= ParallelThreshold)
+	{
+		DownsampleTask task;
+		task.src = this;
+		task.dst = &dst;
+		task.srgb = srgb;
+		ThreadPool::Instance().Execute(task);
+	}
+	else
+		DownsampleRows(dst, 0, dst.uiHeight, srgb);
+}
+
+/*****************************************************************************
+ * MipChain implementation
+ *****************************************************************************/
+
+static bool IsPowerOfTwo(unsigned int x)
+{
+	return (x & (x - 1)) == 0;
+}
+
+Image &MipChain::Base()
+{
+	if (aLevels.empty())
+	{
+		// Build() must not move the levels
+		aLevels.reserve(MAX_LEVELS);
+		aLevels.resize(1);
+	}
+	return aLevels[0];
+}
+
+void MipChain::Build(unsigned int flags/* = Image::SRGB*/)
+{
+	assert(!aLevels.empty());
+	unsigned int size = aLevels[0].Width() > aLevels[0].Height() ?
+		aLevels[0].Width() : aLevels[0].Height();
+	unsigned int levels = 1;
+	while (size > 1)
+	{
+		size /= 2;
+		levels++;
+	}
+	assert(levels <= MAX_LEVELS);
+
+	aLevels.resize(levels);
+	for (unsigned int i = 1; i < levels; i++)
+		aLevels[i - 1].Downsample(aLevels[i], flags);
+}
+
+size_t MipChain::Bytes() const
+{
+	size_t bytes = 0;
+	for (unsigned int i = 0; i < aLevels.size(); i++)
+		bytes += aLevels[i].Bytes();
+	return bytes;
+}
+
+void MipChain::Upload(GLenum target) const
+{
+	// Rows are tightly packed
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	const Image &base = aLevels[0];
+	if (!IsPowerOfTwo(base.Width()) || !IsPowerOfTwo(base.Height()))
+	{
+		if (!IsExtensionSupported("GL_ARB_texture_non_power_of_two"))
+		{
+			UploadScaled(target);
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+			return;
+		}
+	}
+	for (unsigned int i = 0; i < aLevels.size(); i++)
+	{
+		const Image &level = aLevels[i];
+		glTexImage2D(target, i, level.Components(), level.Width(),
+			level.Height(), 0, level.Format(), GL_UNSIGNED_BYTE, level.Data());
+	}
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+}
+
+void MipChain::UploadScaled(GLenum target) const
+{
+	const Image &base = aLevels[0];
+	const unsigned int width = NextPowerOfTwo(base.Width());
+	const unsigned int height = NextPowerOfTwo(base.Height());
+	if (Verbose(VerboseInfo))
+	{
+		printf("MipChain: %dx%d texture scaled to %dx%d\n", base.Width(),
+			base.Height(), width, height);
+	}
+	// GLU scales and filters in gamma space, as before MipChain
+	if (aLevels.size() > 1)
+	{
+		gluBuild2DMipmaps(target, base.Components(), base.Width(),
+			base.Height(), base.Format(), GL_UNSIGNED_BYTE, base.Data());
+		return;
+	}
+	vector<unsigned char> scaled(width * height * base.Components());
+	gluScaleImage(base.Format(), base.Width(), base.Height(),
+		GL_UNSIGNED_BYTE, base.Data(), width, height, GL_UNSIGNED_BYTE,
+		&scaled[0]);
+	glTexImage2D(target, 0, base.Components(), width, height, 0,
+		base.Format(), GL_UNSIGNED_BYTE, &scaled[0]);
+}
@@ -0,0 +1,119 @@
+/*****************************************************************************
+ * Filename			Image.h
+ *
+ * License			GPLv3
+ *
+ * Author			Andrea Bizzotto (bizz84@gmail.com)
+ *
+ * Platform			LinuxX11 / OpenGL
+ *
+ * Description		CPU images and mipmap generation for texture uploads
+ *
+ *****************************************************************************/
+
+#ifndef _IMAGE_H_
+#define _IMAGE_H_
+
+#ifdef __linux__
+#include <SDL/SDL.h>
+#else
+#include <SDL.h>
+#endif
+#include "Extensions.h"
+
+#include <vector>
+using namespace std;
+
+//! Image with one byte per component, rows tightly packed
+/*!
+ Images with three components are RGB, with four RGBA: surfaces in BGR(A)
+ order are swizzled when copied, so that the GL upload needs no conversion.
+ */
+class Image
+{
+	unsigned int uiWidth;
+	unsigned int uiHeight;
+	unsigned int uiComponents;
+	vector<unsigned char> aPixels;
+
+	//! Filters rows [begin, end) of dst from this image (see Downsample())
+	void DownsampleRows(Image &dst, unsigned int begin, unsigned int end,
+		bool srgb) const;
+
+	friend class DownsampleTask;
+public:
+	//! Flags of Downsample() and MipChain::Build()
+	enum {
+		//! Filters color components in linear space (alpha is linear)
+		SRGB = 1,
+		//! Splits rows across the ThreadPool (GL thread only, see below)
+		PARALLEL = 2
+	};
+
+	Image() : uiWidth(0), uiHeight(0), uiComponents(0) { }
+	Image(unsigned int width, unsigned int height, unsigned int components);
+
+	void Resize(unsigned int width, unsigned int height,
+		unsigned int components);
+
+	//! Copies a truecolor surface. False if it has a palette
+	bool FromSurface(const SDL_Surface *surface);
+
+	unsigned int Width() const { return uiWidth; }
+	unsigned int Height() const { return uiHeight; }
+	unsigned int Components() const { return uiComponents; }
+	//! GL_RGB or GL_RGBA
+	GLenum Format() const { return uiComponents == 4 ? GL_RGBA : GL_RGB; }
+	size_t Bytes() const { return aPixels.size(); }
+
+	unsigned char *Data() { return aPixels.empty() ? NULL : &aPixels[0]; }
+	const unsigned char *Data() const
+	{
+		return aPixels.empty() ? NULL : &aPixels[0];
+	}
+
+	//! Next mipmap level with a 2x2 box filter
+	/*!
+	 Sizes are halved and rounded down as GL expects (odd rows and columns
+	 are dropped). PARALLEL must not be used from threads other than the
+	 one using the ThreadPool
+	 */
+	void Downsample(Image &dst, unsigned int flags = SRGB) const;
+};
+
+//! Image and all its mipmap levels down to 1x1
+class MipChain
+{
+public:
+	//! Enough for 32768x32768
+	enum { MAX_LEVELS = 16 };
+
+private:
+	vector<Image> aLevels;
+
+	//! Upload() of a base level that is not a power of 2 in size, without
+	//! GL_ARB_texture_non_power_of_two: GLU scales it up (and builds the
+	//! levels, if there are any)
+	void UploadScaled(GLenum target) const;
+
+public:
+	//! Level 0, to be filled before Build()
+	Image &Base();
+
+	//! Generates levels 1 to n from level 0, with the flags of Downsample()
+	void Build(unsigned int flags = Image::SRGB);
+
+	unsigned int NumLevels() const { return aLevels.size(); }
+	const Image &Level(unsigned int i) const { return aLevels[i]; }
+	//! Total size of the levels
+	size_t Bytes() const;
+
+	//! glTexImage2D() of each level to target (may be a cube map face).
+	//! Sizes that are not powers of 2 need GL_ARB_texture_non_power_of_two,
+	//! otherwise the texture is scaled up to the next ones
+	void Upload(GLenum target) const;
+
+	void Clear() { aLevels.clear(); }
+};
+
+#endif
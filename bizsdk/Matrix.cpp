@@ -164,8 +164,8 @@ Matrix4 Matrix4::operator*(const Matrix4 &m) const
 {
 	Vector4 mx(m.s[0], m.s[4], m.s[8], m.s[12]);
 	Vector4 my(m.s[1], m.s[5], m.s[9], m.s[13]);
-	Vector4 mz(m.s[3], m.s[6], m.s[10], m.s[14]);
-	Vector4 mw(m.s[4], m.s[7], m.s[11], m.s[15]);
+	Vector4 mz(m.s[2], m.s[6], m.s[10], m.s[14]);
+	Vector4 mw(m.s[3], m.s[7], m.s[11], m.s[15]);
 	float f[] = {
 		mx.dot(s+0), my.dot(s+0), mz.dot(s+0), mw.dot(s+0),
 		mx.dot(s+4), my.dot(s+4), mz.dot(s+4), mw.dot(s+4),
@@ -12,17 +12,257 @@
  *****************************************************************************/
 
 #include "Mesh.h"
+#include "MeshFile.h"
+#include "MeshOptimizer.h"
+#include "Reader3DS.h"
+#include "ThreadPool.h"
 #include <lib3ds/vector.h>
 #include "assert.h"
 #include "Timer.h"
 
+#include <stdio.h>
+
 const int permutation[3] = { 1, 2, 0 };
 
+// Arrays of an imported mesh before and after Optimize()
+struct MeshArrays
+{
+	vector<float> attribs;
+	// Floats per vertex
+	unsigned int uiStride;
+	vector<unsigned int> indices;
+	// Vertices left and cache miss ratios before and after
+	unsigned int uiCount;
+	float afACMR[2];
+	// Indices as uploaded, packed if 16 bits
+	GLenum eIndexType;
+	vector<unsigned short> aPacked;
+
+	const void *Indices() const
+	{
+		return eIndexType == GL_UNSIGNED_SHORT ?
+			(const void *)&aPacked[0] : (const void *)&indices[0];
+	}
+};
+
+// Reorders triangles and vertices for the post-transform and fetch caches,
+// and packs the indices in 16 bits if the vertices allow it
+static void Optimize(MeshArrays &mesh)
+{
+	const unsigned int elements = mesh.indices.size();
+	const unsigned int count = mesh.attribs.size() / mesh.uiStride;
+	mesh.afACMR[0] = CacheMissRatio(&mesh.indices[0], elements, count);
+	OptimizeTriangleOrder(&mesh.indices[0], elements, count);
+	mesh.uiCount = OptimizeVertexOrder(&mesh.attribs[0], mesh.uiStride,
+		count, &mesh.indices[0], elements);
+	mesh.attribs.resize(mesh.uiCount * mesh.uiStride);
+	mesh.afACMR[1] = CacheMissRatio(&mesh.indices[0], elements,
+		mesh.uiCount);
+
+	mesh.eIndexType = IndexedVBO::IndexType(mesh.uiCount);
+	if (mesh.eIndexType == GL_UNSIGNED_SHORT)
+		mesh.aPacked.assign(mesh.indices.begin(), mesh.indices.end());
+}
+
+static void Report(const char *name, const MeshArrays &mesh)
+{
+	if (!Verbose(VerboseInfo))
+		return;
+	const unsigned int saved = mesh.indices.size() *
+		(sizeof(GLuint) - IndexedVBO::IndexSize(mesh.eIndexType));
+	printf("Mesh %s: ACMR %.3f -> %.3f, %d index bytes saved\n", name,
+		mesh.afACMR[0], mesh.afACMR[1], saved);
+}
+
+// Optimizes a range of the meshes on each thread
+class OptimizeTask : public ThreadTask
+{
+public:
+	MeshArrays *meshes;
+	unsigned int n;
+
+	virtual void Run(unsigned int index, unsigned int count)
+	{
+		unsigned int begin, end;
+		ThreadPool::Range(n, index, count, begin, end);
+		for (unsigned int i = begin; i < end; i++)
+			Optimize(meshes[i]);
+	}
+};
+
 Mesh::Mesh(Lib3dsMesh *mesh, float scale/* = 1.0f*/,
 		   bool flipNormals/* = false*/, int *permutation/* = NULL*/)
 	: pVBO(NULL), pMesh(mesh), fScale(scale), bFlipNormals(flipNormals)
 {
 	assert(mesh != NULL);
+	SetPermutation(permutation);
+
+	MeshArrays arrays;
+	Build(mesh, arrays.attribs, arrays.indices);
+	arrays.uiStride = arrays.attribs.size() / mesh->points;
+	Optimize(arrays);
+	Report(mesh->name, arrays);
+	Upload(&arrays.attribs[0], sizeof(float) * arrays.uiStride,
+		arrays.uiCount, arrays.Indices(), arrays.eIndexType,
+		arrays.indices.size());
+}
+
+Mesh::Mesh(const char *file3DS, const char *name, float scale/* = 1.0f*/,
+		   bool flipNormals/* = false*/, int *permutation/* = NULL*/)
+	: pVBO(NULL), pMesh(NULL), fScale(scale), bFlipNormals(flipNormals)
+{
+	SetPermutation(permutation);
+
+	Mesh *mesh = this;
+	const bool imported = Import(file3DS, &name, 1, &mesh);
+	assert(imported);
+}
+
+Mesh::Mesh(float scale, bool flipNormals, const int *permutation)
+	: pVBO(NULL), pMesh(NULL), fScale(scale), bFlipNormals(flipNormals)
+{
+	SetPermutation(permutation);
+}
+
+bool Mesh::Load(const char *file3DS, const char *const *names,
+				unsigned int count, Mesh **meshes, float scale/* = 1.0f*/,
+				bool flipNormals/* = false*/, int *permutation/* = NULL*/)
+{
+	unsigned int i;
+	for (i = 0; i < count; i++)
+		meshes[i] = new Mesh(scale, flipNormals, permutation);
+	if (Import(file3DS, names, count, meshes))
+		return true;
+
+	for (i = 0; i < count; i++)
+	{
+		delete meshes[i];
+		meshes[i] = NULL;
+	}
+	return false;
+}
+
+bool Mesh::ReadCache(const char *path, unsigned long long hash)
+{
+	MeshFile cache;
+	if (!cache.Open(path) ||
+		!cache.Matches(hash, fScale, bFlipNormals, iPermutation))
+		return false;
+
+	// Arrays are uploaded as stored, without per vertex work
+	const MeshFileHeader &header = cache.Header();
+	for (unsigned int i = 0; i < 3; i++)
+	{
+		afMin[i] = header.afMin[i];
+		afMax[i] = header.afMax[i];
+	}
+	Upload(cache.Vertices(), header.uiStride, header.uiVertices,
+		cache.Indices(), header.uiIndexSize == sizeof(GLushort) ?
+		GL_UNSIGNED_SHORT : GL_UNSIGNED_INT, header.uiIndices);
+	if (Verbose(VerboseInfo))
+		printf("Mesh loaded from %s\n", path);
+	return true;
+}
+
+bool Mesh::Import(const char *file3DS, const char *const *names,
+				  unsigned int count, Mesh **meshes)
+{
+	unsigned int i, k;
+	const unsigned long long hash = HashFile(file3DS);
+	vector<unsigned int> missing;
+	for (i = 0; i < count; i++)
+	{
+		string path = MeshFile::PathOf(file3DS, names[i]);
+		if (!meshes[i]->ReadCache(path.c_str(), hash))
+			missing.push_back(i);
+	}
+	if (missing.empty())
+		return true;
+
+	Reader3DS reader;
+	if (!reader.Open(file3DS))
+		return false;
+
+	// Each mesh is decoded straight into the arrays that are uploaded
+	vector<Decode3DSJob> jobs(missing.size());
+	vector<MeshArrays> arrays(missing.size());
+	for (k = 0; k < missing.size(); k++)
+	{
+		const Mesh *mesh = meshes[missing[k]];
+		const char *name = names[missing[k]];
+		const int index = reader.Find(name);
+		if (index < 0 || reader.NumIndices(index) == 0)
+		{
+			printf("Mesh %s not found in %s\n", name, file3DS);
+			return false;
+		}
+
+		Decode3DSJob &job = jobs[k];
+		job.uiMesh = index;
+		Layout3DS &layout = job.layout;
+		layout.uiStride = reader.HasTexCoords(index) ? 8 : 6;
+		layout.iPosition = 0;
+		layout.iNormal = 3;
+		layout.iTexCoord = layout.uiStride == 8 ? 6 : -1;
+		layout.fScale = mesh->fScale;
+		layout.fNormalSign = mesh->NormalsSign();
+		for (i = 0; i < 3; i++)
+			layout.aiPermutation[i] = mesh->iPermutation[i];
+
+		MeshArrays &a = arrays[k];
+		a.uiStride = layout.uiStride;
+		a.attribs.resize(layout.uiStride * reader.NumPoints(index));
+		a.indices.resize(reader.NumIndices(index));
+		job.pAttribs = &a.attribs[0];
+		job.pIndices = &a.indices[0];
+	}
+	if (!reader.Decode(&jobs[0], jobs.size()))
+		return false;
+
+	OptimizeTask task;
+	task.meshes = &arrays[0];
+	task.n = arrays.size();
+	if (arrays.size() > 1)
+		ThreadPool::Instance().Execute(task, arrays.size());
+	else
+		task.Run(0, 1);
+
+	// GL calls stay on this thread
+	for (k = 0; k < missing.size(); k++)
+	{
+		Mesh *mesh = meshes[missing[k]];
+		const MeshArrays &a = arrays[k];
+		const unsigned int elements = a.indices.size();
+		Report(names[missing[k]], a);
+		mesh->Bound(&a.attribs[0], a.uiStride, &a.indices[0], elements);
+		mesh->Upload(&a.attribs[0], sizeof(float) * a.uiStride, a.uiCount,
+			a.Indices(), a.eIndexType, elements);
+
+		// Not written if the file can't be read back to validate it
+		if (!hash)
+			continue;
+		MeshFileHeader header;
+		header.ullSourceHash = hash;
+		header.fScale = mesh->fScale;
+		header.uiFlipNormals = mesh->bFlipNormals ? 1 : 0;
+		header.uiVertices = a.uiCount;
+		header.uiStride = sizeof(float) * a.uiStride;
+		header.uiIndices = elements;
+		header.uiIndexSize = IndexedVBO::IndexSize(a.eIndexType);
+		for (i = 0; i < 3; i++)
+		{
+			header.aiPermutation[i] = mesh->iPermutation[i];
+			header.afMin[i] = mesh->afMin[i];
+			header.afMax[i] = mesh->afMax[i];
+		}
+		string path = MeshFile::PathOf(file3DS, names[missing[k]]);
+		MeshFile::Write(path.c_str(), header, &a.attribs[0], a.Indices());
+	}
+	return true;
+}
+
+void Mesh::SetPermutation(const int *permutation)
+{
 	if (permutation == NULL)
 	{
 		iPermutation[0] = 1;
@@ -35,39 +275,43 @@ Mesh::Mesh(Lib3dsMesh *mesh, float scale/* = 1.0f*/,
 		iPermutation[1] = permutation[1];
 		iPermutation[2] = permutation[2];
 	}
+}
 
+void Mesh::Build(Lib3dsMesh *mesh, vector<float> &attribs,
+				 vector<unsigned int> &indices)
+{
 	unsigned int i, j, p;
 
-	Lib3dsVector *normalL = new Lib3dsVector[3 * pMesh->faces];
+	Lib3dsVector *normalL = new Lib3dsVector[3 * mesh->faces];
 	lib3ds_mesh_calculate_normals(mesh, normalL);
 
-	int offset = pMesh->texels == pMesh->points ? 8 : 6;
+	int offset = mesh->texels == mesh->points ? 8 : 6;
 
 	// Bind all attributes in the same buffer
-	float *attribs = new float [offset * pMesh->points];
-	int *indices = new int[pMesh->faces * 3];
-	for (i = 0; i < pMesh->faces; i++)
+	attribs.assign(offset * mesh->points, 0.0f);
+	indices.resize(mesh->faces * 3);
+	for (i = 0; i < mesh->faces; i++)
 	{
-		indices[3 * i + 0] = pMesh->faceL[i].points[0];
-		indices[3 * i + 1] = pMesh->faceL[i].points[1];
-		indices[3 * i + 2] = pMesh->faceL[i].points[2];
+		indices[3 * i + 0] = mesh->faceL[i].points[0];
+		indices[3 * i + 1] = mesh->faceL[i].points[1];
+		indices[3 * i + 2] = mesh->faceL[i].points[2];
 	}
-	for (i = 0; i < pMesh->faces; i++)
+	for (i = 0; i < mesh->faces; i++)
 	{
 		for (j = 0; j < 3; j++)
 		{
-			p = pMesh->faceL[i].points[j];
+			p = mesh->faceL[i].points[j];
 			attribs[offset * p + 0] =
-				scale * pMesh->pointL[p].pos[iPermutation[0]];
+				fScale * mesh->pointL[p].pos[iPermutation[0]];
 			attribs[offset * p + 1] =
-				scale * pMesh->pointL[p].pos[iPermutation[1]];
+				fScale * mesh->pointL[p].pos[iPermutation[1]];
 			attribs[offset * p + 2] =
-				scale * pMesh->pointL[p].pos[iPermutation[2]];
+				fScale * mesh->pointL[p].pos[iPermutation[2]];
 
 			// one normal per face
-			//attribs[offset * p + 3] = pMesh->faceL[i].normal[iPermutation[0]];
-			//attribs[offset * p + 4] = pMesh->faceL[i].normal[iPermutation[1]];
-			//attribs[offset * p + 5] = pMesh->faceL[i].normal[iPermutation[2]];
+			//attribs[offset * p + 3] = mesh->faceL[i].normal[iPermutation[0]];
+			//attribs[offset * p + 4] = mesh->faceL[i].normal[iPermutation[1]];
+			//attribs[offset * p + 5] = mesh->faceL[i].normal[iPermutation[2]];
 			
 			// one normal per vertex
 			attribs[offset * p + 3] =
@@ -77,30 +321,51 @@ Mesh::Mesh(Lib3dsMesh *mesh, float scale/* = 1.0f*/,
 			attribs[offset * p + 5] =
 				NormalsSign() * normalL[3 * i + j][iPermutation[2]];
 
-			if (pMesh->texelL)
+			if (offset == 8)
 			{
-				attribs[offset * p + 6] = pMesh->texelL[p][0];
-				attribs[offset * p + 7] = pMesh->texelL[p][1];
+				attribs[offset * p + 6] = mesh->texelL[p][0];
+				attribs[offset * p + 7] = mesh->texelL[p][1];
 			}
 			//printf("u=%.2f,v=%.2f\n",
-			//	pMesh->texelL[p][0], pMesh->texelL[p][1]);
+			//	mesh->texelL[p][0], mesh->texelL[p][1]);
 		}
 	}
+	delete [] normalL;
 
+	Bound(&attribs[0], offset, &indices[0], indices.size());
+}
 
-	pVBO = auto_ptr<IndexedVBO>(new IndexedVBO(attribs, sizeof(float) * offset,
-		pMesh->points, indices, pMesh->faces * 3));
+void Mesh::Bound(const float *attribs, unsigned int stride,
+				 const unsigned int *indices, unsigned int elements)
+{
+	unsigned int i, j;
+	for (j = 0; j < 3; j++)
+	{
+		afMin[j] = elements ? attribs[stride * indices[0] + j] : 0.0f;
+		afMax[j] = afMin[j];
+	}
+	for (i = 0; i < elements; i++)
+	{
+		for (j = 0; j < 3; j++)
+		{
+			float v = attribs[stride * indices[i] + j];
+			afMin[j] = v < afMin[j] ? v : afMin[j];
+			afMax[j] = v > afMax[j] ? v : afMax[j];
+		}
+	}
+}
+
+void Mesh::Upload(const float *attribs, unsigned int stride,
+				  unsigned int count, const void *indices,
+				  GLenum indexType, unsigned int elements)
+{
+	uiNumTriangles = elements / 3;
+
+	pVBO = auto_ptr<IndexedVBO>(new IndexedVBO((void *)attribs, stride,
+		count, (void *)indices, elements, indexType));
 	pVBO->SetVertexData(0, 3);
 	pVBO->SetNormalData(sizeof(float) * 3);
-	if (pMesh->texelL)
+	if (stride == sizeof(float) * 8)
 		pVBO->SetTexCoordData(sizeof(float) * 6, 2);
 	//pVBO->AddEntry(glVertexPointer, 3, GL_FLOAT, 0);
-
-	delete [] indices;
-	delete [] attribs;
-	delete [] normalL;
 }
-
-
-
-
@@ -24,6 +24,7 @@
 #include "VBO.h"
 #include <lib3ds/mesh.h>
 
+#include <vector>
 using namespace std;
 
 // TODO: Find elegant solution for this
@@ -35,18 +36,63 @@ protected:
 	float fScale;
 	bool bFlipNormals;
 	int iPermutation[3];
+	// NULL if read from the cache
 	Lib3dsMesh *pMesh;
 
+	unsigned int uiNumTriangles;
+	// Bounding box of the scaled and permuted positions
+	float afMin[3];
+	float afMax[3];
+
 	auto_ptr<IndexedVBO> pVBO;
 
 	const float NormalsSign() const { return bFlipNormals ? -1.0f : 1.0f; }
+
+	void SetPermutation(const int *permutation);
+	// Interleaved vertices (position, normal and texcoords if any) and
+	// triangle indices of mesh, bounding box
+	void Build(Lib3dsMesh *mesh, vector<float> &attribs,
+		vector<unsigned int> &indices);
+	// Bounding box of the vertices used by indices (stride in floats)
+	void Bound(const float *attribs, unsigned int stride,
+		const unsigned int *indices, unsigned int elements);
+	// indices of indexType, stride in bytes
+	void Upload(const float *attribs, unsigned int stride,
+		unsigned int count, const void *indices, GLenum indexType,
+		unsigned int elements);
+
+private:
+	// Without vertices until read by Import()
+	Mesh(float scale, bool flipNormals, const int *permutation);
+
+	// Uploads the cache at path if it was made from the file with hash
+	bool ReadCache(const char *path, unsigned long long hash);
+	// Reads meshes from their caches, decodes the others from file3DS in
+	// parallel and rewrites their caches
+	static bool Import(const char *file3DS, const char *const *names,
+		unsigned int count, Mesh **meshes);
+
 public:
 	Mesh(Lib3dsMesh *mesh, float scale = 1.0f, bool flipNormals = false,
 		int *permutation = NULL);
+	// Mesh name of file3DS, read from its cache (see MeshFile) if it was
+	// made from the current file with the same parameters. Otherwise the
+	// mesh is decoded from the file (see Reader3DS) and the cache written
+	Mesh(const char *file3DS, const char *name, float scale = 1.0f,
+		bool flipNormals = false, int *permutation = NULL);
+
+	// Meshes names[0..count) of file3DS, like the constructor above, but the
+	// file is read once and the meshes decoded in parallel. On failure the
+	// meshes are NULL
+	static bool Load(const char *file3DS, const char *const *names,
+		unsigned int count, Mesh **meshes, float scale = 1.0f,
+		bool flipNormals = false, int *permutation = NULL);
 
 	const IndexedVBO *GetVBO() const { return pVBO.get(); }
 
-	const int GetNumTriangles() const { return pMesh->faces; }
+	const int GetNumTriangles() const { return uiNumTriangles; }
+	const float *GetMin() const { return afMin; }
+	const float *GetMax() const { return afMax; }
 };
 
 #endif
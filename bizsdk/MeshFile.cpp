@@ -0,0 +1,116 @@
+/*****************************************************************************
+ * Filename			MeshFile.cpp
+ *
+ * License			GPLv3
+ *
+ * Author			Andrea Bizzotto (bizz84@gmail.com)
+ *
+ * Platform			LinuxX11 / OpenGL
+ *
+ * Description		Cache of the vertex and index arrays built by Mesh
+ *
+ *****************************************************************************/
+
+#include "MeshFile.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static const char Magic[4] = { 'B', 'Z', 'M', 'S' };
+static const unsigned int Version = 2;
+static const unsigned int Alignment = 16;
+
+static unsigned int Align(unsigned int offset)
+{
+	return (offset + Alignment - 1) & ~(Alignment - 1);
+}
+
+bool MeshFile::Open(const char *filename)
+{
+	Close();
+	if (!file.Open(filename))
+		return false;
+
+	const size_t size = file.Size();
+	pHeader = (const MeshFileHeader *)file.Data();
+	bool valid = size >= sizeof(MeshFileHeader) &&
+		memcmp(pHeader->acMagic, Magic, sizeof(Magic)) == 0 &&
+		pHeader->uiVersion == Version && pHeader->uiStride > 0 &&
+		(pHeader->uiIndexSize == 2 || pHeader->uiIndexSize == 4) &&
+		pHeader->uiVertexOffset % Alignment == 0 &&
+		pHeader->uiIndexOffset % Alignment == 0 &&
+		(size_t)pHeader->uiVertexOffset +
+		(size_t)pHeader->uiVertices * pHeader->uiStride <= size &&
+		(size_t)pHeader->uiIndexOffset +
+		(size_t)pHeader->uiIndices * pHeader->uiIndexSize <= size;
+	if (!valid)
+	{
+		printf("%s is not a valid mesh file\n", filename);
+		Close();
+		return false;
+	}
+	return true;
+}
+
+void MeshFile::Close()
+{
+	file.Close();
+	pHeader = NULL;
+}
+
+bool MeshFile::Matches(unsigned long long sourceHash, float scale,
+	bool flipNormals, const int *permutation) const
+{
+	return pHeader->ullSourceHash == sourceHash &&
+		pHeader->fScale == scale &&
+		pHeader->uiFlipNormals == (flipNormals ? 1u : 0u) &&
+		memcmp(pHeader->aiPermutation, permutation,
+		sizeof(pHeader->aiPermutation)) == 0;
+}
+
+bool MeshFile::Write(const char *filename, MeshFileHeader header,
+	const float *vertices, const void *indices)
+{
+	memcpy(header.acMagic, Magic, sizeof(Magic));
+	header.uiVersion = Version;
+	const unsigned int vertexBytes = header.uiVertices * header.uiStride;
+	const unsigned int indexBytes = header.uiIndices * header.uiIndexSize;
+	const unsigned int headerBytes = (unsigned int)sizeof(MeshFileHeader);
+	header.uiVertexOffset = Align(headerBytes);
+	header.uiIndexOffset = Align(header.uiVertexOffset + vertexBytes);
+
+	FILE *fp = fopen(filename, "wb");
+	if (!fp)
+	{
+		printf("Unable to write %s\n", filename);
+		return false;
+	}
+	static const unsigned char padding[Alignment] = { 0 };
+	const unsigned int vertexPad = header.uiVertexOffset - headerBytes;
+	const unsigned int indexPad =
+		header.uiIndexOffset - header.uiVertexOffset - vertexBytes;
+	const unsigned int pad[2] = { vertexPad, indexPad };
+	bool ok = fwrite(&header, sizeof(header), 1, fp) == 1 &&
+		fwrite(padding, 1, pad[0], fp) == pad[0] &&
+		fwrite(vertices, 1, vertexBytes, fp) == vertexBytes &&
+		fwrite(padding, 1, pad[1], fp) == pad[1] &&
+		fwrite(indices, 1, indexBytes, fp) == indexBytes;
+	fclose(fp);
+	if (!ok)
+	{
+		printf("Error writing %s\n", filename);
+		// A truncated file would be rejected on load, but it's a waste of a read
+		remove(filename);
+	}
+	return ok;
+}
+
+string MeshFile::PathOf(const char *file3DS, const char *name)
+{
+	string path = file3DS;
+	size_t dot = path.find_last_of('.');
+	// A dot in a directory name isn't an extension
+	if (dot != string::npos && path.find_first_of("/\\", dot) == string::npos)
+		path.erase(dot);
+	return path + "." + name + ".bmsh";
+}
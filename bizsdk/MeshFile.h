@@ -0,0 +1,91 @@
+/*****************************************************************************
+ * Filename			MeshFile.h
+ *
+ * License			GPLv3
+ *
+ * Author			Andrea Bizzotto (bizz84@gmail.com)
+ *
+ * Platform			LinuxX11 / OpenGL
+ *
+ * Description		Cache of the vertex and index arrays built by Mesh
+ *
+ *****************************************************************************/
+
+#ifndef _MESH_FILE_H_
+#define _MESH_FILE_H_
+
+#include "Misc.h"
+
+#include <string>
+using namespace std;
+
+//! Header of a .bmsh file
+/*!
+ The header is followed by the interleaved vertices (position, normal and,
+ if uiStride allows it, texture coordinates, all floats) and by the indices
+ of the triangles, at 16 byte aligned offsets. Both are stored as uploaded,
+ after MeshOptimizer, with 16 bits indices when the vertices allow it.
+ Values are stored in the byte order of the machine that wrote the file.
+ */
+struct MeshFileHeader
+{
+	char acMagic[4];
+	unsigned int uiVersion;
+	//! Hash64() of the 3DS file the mesh was imported from
+	unsigned long long ullSourceHash;
+	//! Import parameters (see Mesh::Mesh())
+	float fScale;
+	unsigned int uiFlipNormals;
+	int aiPermutation[3];
+	unsigned int uiVertices;
+	//! Bytes per vertex
+	unsigned int uiStride;
+	unsigned int uiIndices;
+	//! Bytes per index, 2 or 4
+	unsigned int uiIndexSize;
+	//! Bounding box of the positions, scaled and permuted
+	float afMin[3];
+	float afMax[3];
+	unsigned int uiVertexOffset;
+	unsigned int uiIndexOffset;
+};
+
+//! Memory mapped .bmsh file, uploaded without per vertex work
+class MeshFile
+{
+	MappedFile file;
+	const MeshFileHeader *pHeader;
+
+public:
+	MeshFile() : pHeader(NULL) { }
+
+	//! Maps filename. False if it is missing, truncated or of another
+	//! version
+	bool Open(const char *filename);
+	void Close();
+
+	//! True if the file was made from the 3DS file with sourceHash and
+	//! with the same import parameters
+	bool Matches(unsigned long long sourceHash, float scale, bool flipNormals,
+		const int *permutation) const;
+
+	const MeshFileHeader &Header() const { return *pHeader; }
+	const float *Vertices() const
+	{
+		return (const float *)(file.Data() + pHeader->uiVertexOffset);
+	}
+	const void *Indices() const
+	{
+		return file.Data() + pHeader->uiIndexOffset;
+	}
+
+	//! Writes the arrays described by header (magic, version and offsets
+	//! are filled in)
+	static bool Write(const char *filename, MeshFileHeader header,
+		const float *vertices, const void *indices);
+
+	//! Cache of mesh name of a 3DS file: next to it, named after both
+	static string PathOf(const char *file3DS, const char *name);
+};
+
+#endif
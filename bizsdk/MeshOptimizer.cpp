@@ -0,0 +1,207 @@
+/*****************************************************************************
+ * Filename			MeshOptimizer.cpp
+ *
+ * License			GPLv3
+ *
+ * Author			Andrea Bizzotto (bizz84@gmail.com)
+ *
+ * Platform			LinuxX11 / OpenGL
+ *
+ * Description		Triangle and vertex reordering for the GPU vertex caches
+ *
+ *****************************************************************************/
+
+#include "MeshOptimizer.h"
+
+#include <math.h>
+#include <string.h>
+
+#include <vector>
+using namespace std;
+
+// Parameters of the scoring function, as tuned by Forsyth
+static const unsigned int CacheSize = 32;
+static const float CacheDecayPower = 1.5f;
+static const float LastTriangleScore = 0.75f;
+static const float ValenceBoostScale = 2.0f;
+static const float ValenceBoostPower = 0.5f;
+
+// Score of a vertex at position (-1 if not cached) in the LRU cache, with
+// remaining triangles still to emit
+static float VertexScore(int position, unsigned int remaining)
+{
+	if (remaining == 0)
+		return -1.0f;
+
+	float score = 0.0f;
+	if (position >= 0)
+	{
+		// The last triangle's vertices score the same, whatever the order
+		if (position < 3)
+			score = LastTriangleScore;
+		else
+		{
+			const float scale = 1.0f / (CacheSize - 3);
+			score = powf(1.0f - (position - 3) * scale, CacheDecayPower);
+		}
+	}
+	return score + ValenceBoostScale *
+		powf((float)remaining, -ValenceBoostPower);
+}
+
+void OptimizeTriangleOrder(unsigned int *indices, unsigned int elements,
+	unsigned int vertices)
+{
+	const unsigned int triangles = elements / 3;
+	if (triangles < 2)
+		return;
+	unsigned int i, j, k;
+
+	// Triangles of each vertex not emitted yet, in compressed rows
+	vector<unsigned int> first(vertices + 1, 0), remaining(vertices, 0);
+	for (i = 0; i < 3 * triangles; i++)
+		remaining[indices[i]]++;
+	for (i = 0; i < vertices; i++)
+		first[i + 1] = first[i] + remaining[i];
+	vector<unsigned int> around(3 * triangles);
+	vector<unsigned int> fill(first.begin(), first.end() - 1);
+	for (i = 0; i < 3 * triangles; i++)
+		around[fill[indices[i]]++] = i / 3;
+
+	vector<int> position(vertices, -1);
+	vector<float> score(vertices);
+	for (i = 0; i < vertices; i++)
+		score[i] = VertexScore(-1, remaining[i]);
+	vector<float> triangleScore(triangles);
+	vector<bool> emitted(triangles, false);
+	int best = -1;
+	float bestScore = -1.0f;
+	for (i = 0; i < triangles; i++)
+	{
+		const unsigned int *t = &indices[3 * i];
+		triangleScore[i] = score[t[0]] + score[t[1]] + score[t[2]];
+		if (triangleScore[i] > bestScore)
+		{
+			best = i;
+			bestScore = triangleScore[i];
+		}
+	}
+
+	// The cache holds 3 more entries while the new triangle is pushed
+	unsigned int cache[CacheSize + 3], cached = 0;
+	vector<unsigned int> output(3 * triangles);
+	unsigned int scan = 0;
+	for (unsigned int out = 0; out < triangles; out++)
+	{
+		// No cached vertex has triangles left: take the best of the rest
+		if (best < 0)
+		{
+			while (emitted[scan])
+				scan++;
+			best = scan;
+			for (i = scan + 1; i < triangles; i++)
+			{
+				if (!emitted[i] && triangleScore[i] > triangleScore[best])
+					best = i;
+			}
+		}
+
+		const unsigned int *t = &indices[3 * best];
+		memcpy(&output[3 * out], t, 3 * sizeof(unsigned int));
+		emitted[best] = true;
+		for (j = 0; j < 3; j++)
+		{
+			// Removes the triangle from the rows of its vertices
+			const unsigned int v = t[j];
+			unsigned int *row = &around[first[v]];
+			for (k = 0; row[k] != (unsigned int)best; k++)
+				;
+			row[k] = row[--remaining[v]];
+		}
+
+		// Moves the vertices of the triangle to the front of the cache
+		unsigned int next[CacheSize + 3];
+		unsigned int n = 0;
+		for (j = 0; j < 3; j++)
+			next[n++] = t[j];
+		for (i = 0; i < cached; i++)
+		{
+			const unsigned int v = cache[i];
+			if (v != t[0] && v != t[1] && v != t[2])
+				next[n++] = v;
+		}
+		for (i = 0; i < n; i++)
+			position[next[i]] = i < CacheSize ? (int)i : -1;
+		memcpy(cache, next, n * sizeof(unsigned int));
+		cached = n < CacheSize ? n : CacheSize;
+
+		// Only the triangles around vertices that moved change score
+		for (i = 0; i < n; i++)
+		{
+			const unsigned int v = cache[i];
+			score[v] = VertexScore(position[v], remaining[v]);
+		}
+		best = -1;
+		bestScore = -1.0f;
+		for (i = 0; i < n; i++)
+		{
+			const unsigned int v = cache[i];
+			for (k = 0; k < remaining[v]; k++)
+			{
+				const unsigned int tri = around[first[v] + k];
+				const unsigned int *u = &indices[3 * tri];
+				triangleScore[tri] = score[u[0]] + score[u[1]] + score[u[2]];
+				if (triangleScore[tri] > bestScore)
+				{
+					best = tri;
+					bestScore = triangleScore[tri];
+				}
+			}
+		}
+	}
+	memcpy(indices, &output[0], 3 * triangles * sizeof(unsigned int));
+}
+
+unsigned int OptimizeVertexOrder(float *attribs, unsigned int stride,
+	unsigned int vertices, unsigned int *indices, unsigned int elements)
+{
+	const unsigned int unused = ~0U;
+	vector<unsigned int> remap(vertices, unused);
+	unsigned int used = 0, i;
+	for (i = 0; i < elements; i++)
+	{
+		unsigned int &index = remap[indices[i]];
+		if (index == unused)
+			index = used++;
+		indices[i] = index;
+	}
+
+	vector<float> copy(attribs, attribs + vertices * stride);
+	for (i = 0; i < vertices; i++)
+	{
+		if (remap[i] != unused)
+		{
+			memcpy(attribs + remap[i] * stride, &copy[i * stride],
+				stride * sizeof(float));
+		}
+	}
+	return used;
+}
+
+float CacheMissRatio(const unsigned int *indices, unsigned int elements,
+	unsigned int vertices, unsigned int cacheSize/* = ACMRCacheSize*/)
+{
+	if (elements < 3)
+		return 0.0f;
+
+	// Time each vertex entered the cache, it is evicted cacheSize misses later
+	vector<unsigned int> entered(vertices, 0);
+	unsigned int misses = 0;
+	for (unsigned int i = 0; i < elements; i++)
+	{
+		unsigned int &time = entered[indices[i]];
+		if (time == 0 || misses - time >= cacheSize)
+			time = ++misses;
+	}
+	return (float)misses / (elements / 3);
+}
@@ -0,0 +1,42 @@
+/*****************************************************************************
+ * Filename			MeshOptimizer.h
+ *
+ * License			GPLv3
+ *
+ * Author			Andrea Bizzotto (bizz84@gmail.com)
+ *
+ * Platform			LinuxX11 / OpenGL
+ *
+ * Description		Triangle and vertex reordering for the GPU vertex caches
+ *
+ *****************************************************************************/
+
+#ifndef _MESH_OPTIMIZER_H_
+#define _MESH_OPTIMIZER_H_
+
+//! Size of the FIFO cache simulated by CacheMissRatio()
+const unsigned int ACMRCacheSize = 16;
+
+//! Reorders the triangles of an indexed triangle list to reuse the
+//! post-transform cache (Tom Forsyth's linear speed algorithm)
+/*!
+ Triangles are emitted greedily, choosing each time the one whose vertices
+ score best: recently used vertices score high, as do those with few
+ triangles left, so that no isolated triangles are left behind. The winding
+ of each triangle is kept.
+ */
+void OptimizeTriangleOrder(unsigned int *indices, unsigned int elements,
+	unsigned int vertices);
+
+//! Renumbers the vertices in the order they are first used by indices, for
+//! sequential fetches. stride is in floats. Vertices not used by any
+//! triangle are removed: returns how many are left
+unsigned int OptimizeVertexOrder(float *attribs, unsigned int stride,
+	unsigned int vertices, unsigned int *indices, unsigned int elements);
+
+//! Average cache miss ratio: vertices transformed per triangle with a FIFO
+//! cache of cacheSize entries (0.5 at best, 3 at worst)
+float CacheMissRatio(const unsigned int *indices, unsigned int elements,
+	unsigned int vertices, unsigned int cacheSize = ACMRCacheSize);
+
+#endif
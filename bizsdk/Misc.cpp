@@ -19,12 +19,22 @@
 
 #include <stdio.h>
 #include <assert.h>
+#include <string.h>
 
 #ifdef __linux__
 #include <SDL/SDL_image.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
 #else
 #include "SDL_image.h"
+#include <direct.h>
+#include <windows.h>
+// Clashes with LoadImage() below
+#undef LoadImage
 #endif
+#include <errno.h>
 
 static const float u = 1.0f;
 static const float z = 0.0f;
@@ -80,6 +90,123 @@ void FreeFileMemory(char **memory)
 	free(*memory);
 }
 
+bool MakeDirectory(const char *path)
+{
+#ifdef __linux__
+	int ret = mkdir(path, 0755);
+#else
+	int ret = _mkdir(path);
+#endif
+	return ret == 0 || errno == EEXIST;
+}
+
+unsigned long long Hash64(const void *data, size_t size,
+	unsigned long long hash/* = 14695981039346656037ULL*/)
+{
+	const unsigned char *p = (const unsigned char *)data;
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= p[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+#ifdef __linux__
+MappedFile::MappedFile() : pData(NULL), uiSize(0), iFile(-1)
+{
+
+}
+
+bool MappedFile::Open(const char *filename)
+{
+	Close();
+	iFile = open(filename, O_RDONLY);
+	if (iFile < 0)
+		return false;
+
+	struct stat info;
+	if (fstat(iFile, &info) == 0 && info.st_size > 0)
+	{
+		void *data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, iFile, 0);
+		if (data != MAP_FAILED)
+		{
+			pData = (const unsigned char *)data;
+			uiSize = info.st_size;
+			return true;
+		}
+	}
+	Close();
+	return false;
+}
+
+void MappedFile::Close()
+{
+	if (pData)
+		munmap((void *)pData, uiSize);
+	if (iFile >= 0)
+		close(iFile);
+	pData = NULL;
+	uiSize = 0;
+	iFile = -1;
+}
+#else
+MappedFile::MappedFile() : pData(NULL), uiSize(0),
+	hFile(INVALID_HANDLE_VALUE), hMapping(NULL)
+{
+
+}
+
+bool MappedFile::Open(const char *filename)
+{
+	Close();
+	hFile = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (hFile == INVALID_HANDLE_VALUE)
+		return false;
+
+	DWORD size = GetFileSize(hFile, NULL);
+	if (size != INVALID_FILE_SIZE && size > 0)
+	{
+		hMapping = CreateFileMappingA(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (hMapping)
+		{
+			pData = (const unsigned char *)MapViewOfFile(hMapping,
+				FILE_MAP_READ, 0, 0, 0);
+			if (pData)
+			{
+				uiSize = size;
+				return true;
+			}
+		}
+	}
+	Close();
+	return false;
+}
+
+void MappedFile::Close()
+{
+	if (pData)
+		UnmapViewOfFile(pData);
+	if (hMapping)
+		CloseHandle(hMapping);
+	if (hFile != INVALID_HANDLE_VALUE)
+		CloseHandle(hFile);
+	pData = NULL;
+	uiSize = 0;
+	hFile = INVALID_HANDLE_VALUE;
+	hMapping = NULL;
+}
+#endif
+
+unsigned long long HashFile(const char *filename)
+{
+	MappedFile file;
+	if (!file.Open(filename))
+		return 0;
+	return Hash64(file.Data(), file.Size());
+}
+
 
 
 bool LoadImage(const char *filename, SDL_Surface *&surface,
@@ -104,23 +231,7 @@ bool LoadImage(const char *filename, SDL_Surface *&surface,
 
 		if ( surface != NULL )
 		{
-		    // get the number of channels in the SDL surface
-			nOfColors = surface->format->BytesPerPixel;
-			if (nOfColors == 4)     // contains an alpha channel
-			{
-		        if (surface->format->Rmask == 0x000000ff)
-		                textureFormat = GL_RGBA;
-		        else
-		                textureFormat = GL_BGRA;
-			}
-			else if (nOfColors == 3)     // no alpha channel
-			{
-		        if (surface->format->Rmask == 0x000000ff)
-		                textureFormat = GL_RGB;
-		        else
-		                textureFormat = GL_BGR;
-			}
-			else
+			if (!SurfaceFormat(surface, textureFormat, nOfColors))
 			{
 		        printf("warning: the image is not truecolor..  "
 					"this will probably break\n");
@@ -137,6 +248,30 @@ bool LoadImage(const char *filename, SDL_Surface *&surface,
     return false;
 }
 
+bool SurfaceFormat(const SDL_Surface *surface, GLenum &textureFormat,
+				   GLint &nOfColors)
+{
+    // get the number of channels in the SDL surface
+	nOfColors = surface->format->BytesPerPixel;
+	if (nOfColors == 4)     // contains an alpha channel
+	{
+        if (surface->format->Rmask == 0x000000ff)
+                textureFormat = GL_RGBA;
+        else
+                textureFormat = GL_BGRA;
+	}
+	else if (nOfColors == 3)     // no alpha channel
+	{
+        if (surface->format->Rmask == 0x000000ff)
+                textureFormat = GL_RGB;
+        else
+                textureFormat = GL_BGR;
+	}
+	else
+		return false;
+	return true;
+}
+
 /*****************************************************************************
  * Simple mathematical utilities
  *****************************************************************************/
@@ -187,6 +322,28 @@ GLint GetUniLoc(GLuint program, const GLchar *name)
 	return loc;
 }
 
+bool IsExtensionSupported(const char *extension)
+{
+	const char *extensions = (const char *)glGetString(GL_EXTENSIONS);
+	if (extensions == NULL)
+		return false;
+
+	// Names can be prefixes of other names, so match whole tokens only
+	const size_t len = strlen(extension);
+	const char *start = extensions;
+	while ((start = strstr(start, extension)) != NULL)
+	{
+		const char *end = start + len;
+		if ((start == extensions || start[-1] == ' ') &&
+			(*end == ' ' || *end == '\0'))
+		{
+			return true;
+		}
+		start = end;
+	}
+	return false;
+}
+
 void RenderQuad2D(float x, float y, float w, float h,
 	float u0, float v0, float u1, float v1)
 {
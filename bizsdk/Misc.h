@@ -47,9 +47,50 @@ void DumpMemoryToFile(unsigned char *address, unsigned int size,
 
 void FreeFileMemory(char **memory);
 
+// Creates directory path (not its parents). True if it exists afterwards
+bool MakeDirectory(const char *path);
+
+// 64 bit FNV-1a hash of size bytes, hash can chain consecutive calls
+unsigned long long Hash64(const void *data, size_t size,
+						  unsigned long long hash = 14695981039346656037ULL);
+
+// Read only memory mapping of a whole file
+class MappedFile
+{
+	const unsigned char *pData;
+	size_t uiSize;
+#ifdef __linux__
+	int iFile;
+#else
+	// Windows HANDLEs
+	void *hFile;
+	void *hMapping;
+#endif
+	MappedFile(const MappedFile &);
+	MappedFile &operator=(const MappedFile &);
+public:
+	MappedFile();
+	~MappedFile() { Close(); }
+
+	// False if the file doesn't exist or is empty
+	bool Open(const char *filename);
+	void Close();
+
+	bool IsOpen() const { return pData != NULL; }
+	const unsigned char *Data() const { return pData; }
+	size_t Size() const { return uiSize; }
+};
+
+// Hash64() of the contents of filename, 0 if it can't be read
+unsigned long long HashFile(const char *filename);
+
 bool LoadImage(const char *filename, SDL_Surface *&surface,
 			   GLenum &textureFormat, GLint &nOfColors);
 
+// GL format and number of components of a truecolor surface
+bool SurfaceFormat(const SDL_Surface *surface, GLenum &textureFormat,
+				   GLint &nOfColors);
+
 /*****************************************************************************
  * Simple mathematical utilities
  *****************************************************************************/
@@ -73,6 +114,7 @@ float Inertia(float t, float tau);
  *****************************************************************************/
 void PrintOpenGLError();
 GLint GetUniLoc(GLuint program, const GLchar *name);
+bool IsExtensionSupported(const char *extension);
 void RenderQuad2D(float x, float y, float width, float height,
 				float u0, float v0, float u1, float v1);
 
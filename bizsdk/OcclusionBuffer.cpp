@@ -0,0 +1,593 @@
+/*****************************************************************************
+ * Filename			OcclusionBuffer.cpp
+ *
+ * License			GPLv3
+ *
+ * Author			Andrea Bizzotto (bizz84@gmail.com)
+ *
+ * Platform			LinuxX11 / OpenGL
+ *
+ * Description		Software occlusion culling with a low resolution CPU
+ *					depth buffer
+ *
+ *****************************************************************************/
+
+#include "OcclusionBuffer.h"
+#include "ThreadPool.h"
+#include "Timer.h"
+
+#include <math.h>
+#include <float.h>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define OCCLUSION_SSE
+#include <xmmintrin.h>
+#endif
+
+#ifdef OCCLUSION_SSE
+// Smallest and largest of the four components
+static inline float MinOf(__m128 v)
+{
+	v = _mm_min_ps(v, _mm_movehl_ps(v, v));
+	return _mm_cvtss_f32(_mm_min_ss(v, _mm_shuffle_ps(v, v, 1)));
+}
+
+static inline float MaxOf(__m128 v)
+{
+	v = _mm_max_ps(v, _mm_movehl_ps(v, v));
+	return _mm_cvtss_f32(_mm_max_ss(v, _mm_shuffle_ps(v, v, 1)));
+}
+#endif
+
+// Minimum number of occluder polygons worth rasterizing across threads
+static const unsigned int RasterParallelThreshold = 32;
+// Minimum number of objects worth testing across threads
+static const unsigned int TestParallelThreshold = 4096;
+
+/*****************************************************************************
+ * OcclusionTask implementation
+ *****************************************************************************/
+
+// Rasterizes a range of tile rows (first phase) or tests a range of spheres
+// (second phase)
+class OcclusionTask : public ThreadTask
+{
+public:
+	enum { MaxJobs = 16 };
+	enum Phase { RASTER, TEST };
+
+	Phase ePhase;
+	OcclusionBuffer *buffer;
+	// Test data
+	const Vector4 *spheres;
+	unsigned int n;
+	unsigned char *mask;
+	const float *radius;
+	// Counters of each job
+	unsigned int tested[MaxJobs];
+	unsigned int occluded[MaxJobs];
+
+	virtual void Run(unsigned int index, unsigned int count)
+	{
+		unsigned int begin, end;
+		if (ePhase == RASTER)
+		{
+			ThreadPool::Range(buffer->uiTilesY, index, count, begin, end);
+			buffer->RasterizeTiles(begin, end);
+			return;
+		}
+
+		ThreadPool::Range(n, index, count, begin, end);
+		unsigned int t = 0, o = 0;
+		for (unsigned int i = begin; i < end; i++)
+		{
+			if (!mask[i])
+				continue;
+			const float *s = &spheres[i][0];
+			t++;
+			if (buffer->Occluded(s, radius ? *radius : s[3]))
+			{
+				mask[i] = 0;
+				o++;
+			}
+		}
+		tested[index] = t;
+		occluded[index] = o;
+	}
+};
+
+/*****************************************************************************
+ * OcclusionBuffer implementation
+ *****************************************************************************/
+
+OcclusionBuffer::OcclusionBuffer(unsigned int width/* = 256*/,
+	unsigned int height/* = 128*/) :
+	uiTilesX((width + TILE_WIDTH - 1) / TILE_WIDTH),
+	uiTilesY((height + TILE_HEIGHT - 1) / TILE_HEIGHT),
+	fNear(1.0f),
+	bEmpty(true)
+{
+	uiWidth = uiTilesX * TILE_WIDTH;
+	uiHeight = uiTilesY * TILE_HEIGHT;
+	aDepth.resize(uiWidth * uiHeight, FLT_MAX);
+	aTileMax.resize(uiTilesX * uiTilesY, FLT_MAX);
+
+	Begin(Matrix4(), 1.0f);
+}
+
+void OcclusionBuffer::Begin(const Matrix4 &viewProj, const float zNear)
+{
+	mViewProj = viewProj;
+	fNear = zNear;
+	const float *m = viewProj.data();
+	afGradient[0] = sqrt(m[0] * m[0] + m[1] * m[1] + m[2] * m[2]);
+	afGradient[1] = sqrt(m[4] * m[4] + m[5] * m[5] + m[6] * m[6]);
+	afGradient[2] = sqrt(m[12] * m[12] + m[13] * m[13] + m[14] * m[14]);
+	aPolygons.clear();
+	bEmpty = true;
+
+	stats.uiTriangles = 0;
+	stats.uiRasterized = 0;
+	stats.uiTested = 0;
+	stats.uiOccluded = 0;
+	stats.fRasterTime = 0.0f;
+	stats.fTestTime = 0.0f;
+}
+
+bool OcclusionBuffer::Setup(const Vector3 *const *v, unsigned int n)
+{
+	const float *m = mViewProj.data();
+
+	// Screen coordinates in pixels and farthest w
+	float sx[4], sy[4], z = 0.0f;
+	for (unsigned int k = 0; k < n; k++)
+	{
+		const Vector3 &p = *v[k];
+		float w = m[12] * p[0] + m[13] * p[1] + m[14] * p[2] + m[15];
+		if (w < fNear)
+			return true;
+		float x = m[0] * p[0] + m[1] * p[1] + m[2] * p[2] + m[3];
+		float y = m[4] * p[0] + m[5] * p[1] + m[6] * p[2] + m[7];
+		sx[k] = (x / w + 1.0f) * 0.5f * uiWidth;
+		sy[k] = (y / w + 1.0f) * 0.5f * uiHeight;
+		if (w > z)
+			z = w;
+	}
+
+	// Twice the signed area. Polygons smaller than a pixel can't fully
+	// cover any
+	float area = 0.0f;
+	for (unsigned int k = 0; k < n; k++)
+	{
+		unsigned int j = k + 1 < n ? k + 1 : 0;
+		area += sx[k] * sy[j] - sx[j] * sy[k];
+	}
+	if (fabs(area) < 2.0f)
+		return true;
+
+	// Both windings are accepted (occluders can be seen from both sides)
+	const float sign = area > 0.0f ? 1.0f : -1.0f;
+	if (n == 4)
+	{
+		for (unsigned int k = 0; k < 4; k++)
+		{
+			unsigned int j = (k + 1) & 3, l = (k + 2) & 3;
+			float turn = (sx[j] - sx[k]) * (sy[l] - sy[j]) -
+				(sy[j] - sy[k]) * (sx[l] - sx[j]);
+			if (turn * sign < 0.0f)
+				return false;
+		}
+	}
+
+	Polygon t;
+	float minX = sx[0], maxX = sx[0], minY = sy[0], maxY = sy[0];
+	for (unsigned int k = 0; k < n; k++)
+	{
+		unsigned int j = k + 1 < n ? k + 1 : 0;
+		float a = (sy[k] - sy[j]) * sign;
+		float b = (sx[j] - sx[k]) * sign;
+		// Evaluated at the pixel center, the offset gives the value at the
+		// pixel corner where the edge function is smallest
+		t.a[k] = a;
+		t.b[k] = b;
+		t.c[k] = -(a * sx[k] + b * sy[k]) - 0.5f * (fabs(a) + fabs(b));
+
+		minX = sx[k] < minX ? sx[k] : minX;
+		maxX = sx[k] > maxX ? sx[k] : maxX;
+		minY = sy[k] < minY ? sy[k] : minY;
+		maxY = sy[k] > maxY ? sy[k] : maxY;
+	}
+	if (n == 3)
+		t.a[3] = t.b[3] = t.c[3] = 0.0f;
+	t.z = z;
+
+	// Clip bounding rectangle to the screen
+	t.minX = minX < 0.0f ? 0 : (int)minX;
+	t.minY = minY < 0.0f ? 0 : (int)minY;
+	t.maxX = maxX >= uiWidth ? uiWidth : (int)ceil(maxX);
+	t.maxY = maxY >= uiHeight ? uiHeight : (int)ceil(maxY);
+	if (t.minX >= t.maxX || t.minY >= t.maxY)
+		return true;
+
+	aPolygons.push_back(t);
+	stats.uiRasterized++;
+	return true;
+}
+
+void OcclusionBuffer::AddTriangles(const Vector3 *vertices,
+	unsigned int numTriangles)
+{
+	stats.uiTriangles += numTriangles;
+	for (unsigned int i = 0; i < numTriangles; i++, vertices += 3)
+	{
+		const Vector3 *v[] = { vertices, vertices + 1, vertices + 2 };
+		Setup(v, 3);
+	}
+}
+
+void OcclusionBuffer::AddTriangles(const Vector3 *vertices,
+	const unsigned int *indices, unsigned int numTriangles)
+{
+	stats.uiTriangles += numTriangles;
+	for (unsigned int i = 0; i < numTriangles; i++, indices += 3)
+	{
+		const Vector3 *v[] = { vertices + indices[0], vertices + indices[1],
+			vertices + indices[2] };
+		Setup(v, 3);
+	}
+}
+
+void OcclusionBuffer::AddQuad(const Vector3 &a, const Vector3 &b,
+	const Vector3 &c, const Vector3 &d)
+{
+	stats.uiTriangles += 2;
+	const Vector3 *v[] = { &a, &b, &c, &d };
+	if (Setup(v, 4))
+		return;
+
+	// Concave on screen: split it along the diagonal (a, c)
+	const Vector3 *v1[] = { &a, &b, &c };
+	const Vector3 *v2[] = { &a, &c, &d };
+	Setup(v1, 3);
+	Setup(v2, 3);
+}
+
+void OcclusionBuffer::RasterizePolygon(const Polygon &t, int y0, int y1)
+{
+	float *depth = &aDepth[0];
+#ifdef OCCLUSION_SSE
+	// Four pixels per iteration, starting from an aligned column. The buffer
+	// width is a multiple of four, so no pixel past the row end is touched
+	const int x0 = t.minX & ~3;
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 z = _mm_set1_ps(t.z);
+	const __m128 xs = _mm_set_ps(x0 + 3.5f, x0 + 2.5f, x0 + 1.5f, x0 + 0.5f);
+	__m128 ex[4], step[4];
+	for (unsigned int k = 0; k < 4; k++)
+	{
+		ex[k] = _mm_mul_ps(_mm_set1_ps(t.a[k]), xs);
+		step[k] = _mm_set1_ps(4.0f * t.a[k]);
+	}
+
+	for (int y = y0; y < y1; y++)
+	{
+		float *row = depth + y * uiWidth;
+		const float fy = y + 0.5f;
+		__m128 e0 = _mm_add_ps(ex[0], _mm_set1_ps(t.b[0] * fy + t.c[0]));
+		__m128 e1 = _mm_add_ps(ex[1], _mm_set1_ps(t.b[1] * fy + t.c[1]));
+		__m128 e2 = _mm_add_ps(ex[2], _mm_set1_ps(t.b[2] * fy + t.c[2]));
+		__m128 e3 = _mm_add_ps(ex[3], _mm_set1_ps(t.b[3] * fy + t.c[3]));
+		for (int x = x0; x < t.maxX; x += 4)
+		{
+			__m128 inside = _mm_and_ps(
+				_mm_and_ps(_mm_cmpge_ps(e0, zero), _mm_cmpge_ps(e1, zero)),
+				_mm_and_ps(_mm_cmpge_ps(e2, zero), _mm_cmpge_ps(e3, zero)));
+			if (_mm_movemask_ps(inside))
+			{
+				__m128 d = _mm_loadu_ps(row + x);
+				d = _mm_or_ps(_mm_and_ps(inside, _mm_min_ps(d, z)),
+					_mm_andnot_ps(inside, d));
+				_mm_storeu_ps(row + x, d);
+			}
+			e0 = _mm_add_ps(e0, step[0]);
+			e1 = _mm_add_ps(e1, step[1]);
+			e2 = _mm_add_ps(e2, step[2]);
+			e3 = _mm_add_ps(e3, step[3]);
+		}
+	}
+#else
+	for (int y = y0; y < y1; y++)
+	{
+		float *row = depth + y * uiWidth;
+		const float fy = y + 0.5f;
+		for (int x = t.minX; x < t.maxX; x++)
+		{
+			const float fx = x + 0.5f;
+			if (t.a[0] * fx + t.b[0] * fy + t.c[0] >= 0.0f &&
+				t.a[1] * fx + t.b[1] * fy + t.c[1] >= 0.0f &&
+				t.a[2] * fx + t.b[2] * fy + t.c[2] >= 0.0f &&
+				t.a[3] * fx + t.b[3] * fy + t.c[3] >= 0.0f &&
+				t.z < row[x])
+			{
+				row[x] = t.z;
+			}
+		}
+	}
+#endif
+}
+
+void OcclusionBuffer::RasterizeTiles(unsigned int first, unsigned int last)
+{
+	const int y0 = first * TILE_HEIGHT;
+	const int y1 = last * TILE_HEIGHT;
+	if (y0 >= y1)
+		return;
+
+	float *depth = &aDepth[0];
+	for (unsigned int i = y0 * uiWidth; i < y1 * uiWidth; i++)
+		depth[i] = FLT_MAX;
+
+	vector<Polygon>::const_iterator t;
+	for (t = aPolygons.begin(); t != aPolygons.end(); t++)
+	{
+		if (t->maxY <= y0 || t->minY >= y1)
+			continue;
+		RasterizePolygon(*t, t->minY > y0 ? t->minY : y0,
+			t->maxY < y1 ? t->maxY : y1);
+	}
+
+	// Farthest depth of each tile
+	for (unsigned int ty = first; ty < last; ty++)
+	{
+		for (unsigned int tx = 0; tx < uiTilesX; tx++)
+		{
+			const float *tile = depth + ty * TILE_HEIGHT * uiWidth +
+				tx * TILE_WIDTH;
+			float z = 0.0f;
+			for (unsigned int y = 0; y < TILE_HEIGHT; y++, tile += uiWidth)
+			{
+				for (unsigned int x = 0; x < TILE_WIDTH; x++)
+					z = tile[x] > z ? tile[x] : z;
+			}
+			aTileMax[ty * uiTilesX + tx] = z;
+		}
+	}
+}
+
+void OcclusionBuffer::Rasterize()
+{
+	Timer timer;
+
+	bEmpty = aPolygons.empty();
+	if (!bEmpty)
+	{
+		OcclusionTask task;
+		task.ePhase = OcclusionTask::RASTER;
+		task.buffer = this;
+
+		ThreadPool &pool = ThreadPool::Instance();
+		unsigned int jobs = aPolygons.size() >= RasterParallelThreshold ?
+			pool.NumThreads() : 1;
+		if (jobs > 1)
+			pool.Execute(task, jobs);
+		else
+			task.Run(0, 1);
+	}
+
+	stats.fRasterTime += timer.Update();
+}
+
+bool OcclusionBuffer::Project(const float *lo, const float *hi, int *rect,
+	float &depth) const
+{
+	const float *m = mViewProj.data();
+	float minX, maxX, minY, maxY;
+#ifdef OCCLUSION_SSE
+	// Four corners with the same z per register
+	const __m128 px = _mm_set_ps(hi[0], lo[0], hi[0], lo[0]);
+	const __m128 py = _mm_set_ps(hi[1], hi[1], lo[1], lo[1]);
+	const __m128 zNear = _mm_set1_ps(fNear);
+	__m128 x[2], y[2], w[2];
+	for (unsigned int k = 0; k < 2; k++)
+	{
+		const float pz = k ? hi[2] : lo[2];
+		x[k] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(m[0]), px),
+			_mm_mul_ps(_mm_set1_ps(m[1]), py)), _mm_set1_ps(m[2] * pz + m[3]));
+		y[k] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(m[4]), px),
+			_mm_mul_ps(_mm_set1_ps(m[5]), py)), _mm_set1_ps(m[6] * pz + m[7]));
+		w[k] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(m[12]), px),
+			_mm_mul_ps(_mm_set1_ps(m[13]), py)), _mm_set1_ps(m[14] * pz + m[15]));
+		if (_mm_movemask_ps(_mm_cmplt_ps(w[k], zNear)))
+			return false;
+		x[k] = _mm_div_ps(x[k], w[k]);
+		y[k] = _mm_div_ps(y[k], w[k]);
+	}
+	minX = MinOf(_mm_min_ps(x[0], x[1]));
+	maxX = MaxOf(_mm_max_ps(x[0], x[1]));
+	minY = MinOf(_mm_min_ps(y[0], y[1]));
+	maxY = MaxOf(_mm_max_ps(y[0], y[1]));
+	depth = MinOf(_mm_min_ps(w[0], w[1]));
+#else
+	minX = minY = depth = FLT_MAX;
+	maxX = maxY = -FLT_MAX;
+	for (unsigned int k = 0; k < 8; k++)
+	{
+		const float px = k & 1 ? hi[0] : lo[0];
+		const float py = k & 2 ? hi[1] : lo[1];
+		const float pz = k & 4 ? hi[2] : lo[2];
+		float w = m[12] * px + m[13] * py + m[14] * pz + m[15];
+		if (w < fNear)
+			return false;
+		float x = (m[0] * px + m[1] * py + m[2] * pz + m[3]) / w;
+		float y = (m[4] * px + m[5] * py + m[6] * pz + m[7]) / w;
+		minX = x < minX ? x : minX;
+		maxX = x > maxX ? x : maxX;
+		minY = y < minY ? y : minY;
+		maxY = y > maxY ? y : maxY;
+		depth = w < depth ? w : depth;
+	}
+#endif
+
+	ToPixels(minX, maxX, minY, maxY, rect);
+	return true;
+}
+
+void OcclusionBuffer::ToPixels(float minX, float maxX, float minY, float maxY,
+	int *rect) const
+{
+	// Pixels touched by the rectangle, clipped to the screen
+	minX = (minX + 1.0f) * 0.5f * uiWidth;
+	maxX = (maxX + 1.0f) * 0.5f * uiWidth;
+	minY = (minY + 1.0f) * 0.5f * uiHeight;
+	maxY = (maxY + 1.0f) * 0.5f * uiHeight;
+	rect[0] = minX < 0.0f ? 0 : (int)minX;
+	rect[1] = minY < 0.0f ? 0 : (int)minY;
+	rect[2] = maxX >= uiWidth ? uiWidth : (int)ceil(maxX);
+	rect[3] = maxY >= uiHeight ? uiHeight : (int)ceil(maxY);
+}
+
+bool OcclusionBuffer::RectOccluded(const int *rect, const float depth) const
+{
+	// Off screen objects are left to frustum culling
+	if (rect[0] >= rect[2] || rect[1] >= rect[3])
+		return false;
+
+	const float *buffer = &aDepth[0];
+	const int tx0 = rect[0] / TILE_WIDTH, tx1 = (rect[2] - 1) / TILE_WIDTH;
+	const int ty0 = rect[1] / TILE_HEIGHT, ty1 = (rect[3] - 1) / TILE_HEIGHT;
+#ifdef OCCLUSION_SSE
+	const __m128 z = _mm_set1_ps(depth);
+#endif
+	for (int ty = ty0; ty <= ty1; ty++)
+	{
+		for (int tx = tx0; tx <= tx1; tx++)
+		{
+			// Whole tile is nearer
+			if (aTileMax[ty * uiTilesX + tx] < depth)
+				continue;
+
+			// Part of the rectangle inside this tile
+			int x0 = tx * TILE_WIDTH, x1 = x0 + TILE_WIDTH;
+			int y0 = ty * TILE_HEIGHT, y1 = y0 + TILE_HEIGHT;
+			x0 = rect[0] > x0 ? rect[0] : x0;
+			x1 = rect[2] < x1 ? rect[2] : x1;
+			y0 = rect[1] > y0 ? rect[1] : y0;
+			y1 = rect[3] < y1 ? rect[3] : y1;
+			for (int y = y0; y < y1; y++)
+			{
+				const float *row = buffer + y * uiWidth;
+#ifdef OCCLUSION_SSE
+				for (int x = x0 & ~3; x < x1; x += 4)
+				{
+					// Only lanes inside [x0, x1)
+					unsigned int lanes = 0xF;
+					if (x < x0)
+						lanes &= 0xF << (x0 - x);
+					if (x + 4 > x1)
+						lanes &= 0xF >> (x + 4 - x1);
+					if (_mm_movemask_ps(_mm_cmpge_ps(_mm_loadu_ps(row + x), z))
+						& lanes)
+					{
+						return false;
+					}
+				}
+#else
+				for (int x = x0; x < x1; x++)
+				{
+					if (row[x] >= depth)
+						return false;
+				}
+#endif
+			}
+		}
+	}
+	return true;
+}
+
+bool OcclusionBuffer::Occluded(const float *center, const float radius) const
+{
+	if (bEmpty)
+		return false;
+
+	// Nearest w on the sphere (w is linear in the position)
+	const float *m = mViewProj.data();
+	const float *c = center;
+	float w = m[12] * c[0] + m[13] * c[1] + m[14] * c[2] + m[15];
+	float depth = w - radius * afGradient[2];
+	if (depth < fNear)
+		return false;
+
+	// Projected center. For any point of the sphere, the distance from it is
+	// at most radius * (|dX/dp| + |x / w| * |dw/dp|) / wMin (same for y)
+	const float invW = 1.0f / w, invDepth = radius / depth;
+	float x = (m[0] * c[0] + m[1] * c[1] + m[2] * c[2] + m[3]) * invW;
+	float y = (m[4] * c[0] + m[5] * c[1] + m[6] * c[2] + m[7]) * invW;
+	float dx = (afGradient[0] + fabs(x) * afGradient[2]) * invDepth;
+	float dy = (afGradient[1] + fabs(y) * afGradient[2]) * invDepth;
+
+	int rect[4];
+	ToPixels(x - dx, x + dx, y - dy, y + dy, rect);
+	return RectOccluded(rect, depth);
+}
+
+bool OcclusionBuffer::SphereOccluded(const Vector3 &center, const float radius)
+{
+	stats.uiTested++;
+	if (!Occluded(&center[0], radius))
+		return false;
+	stats.uiOccluded++;
+	return true;
+}
+
+bool OcclusionBuffer::BoxOccluded(const AABB &box)
+{
+	stats.uiTested++;
+	if (bEmpty)
+		return false;
+
+	int rect[4];
+	float depth;
+	if (!Project(&box.vMin[0], &box.vMax[0], rect, depth) ||
+		!RectOccluded(rect, depth))
+	{
+		return false;
+	}
+	stats.uiOccluded++;
+	return true;
+}
+
+unsigned int OcclusionBuffer::TestSpheres(const Vector4 *spheres,
+	unsigned int n, unsigned char *mask, const float *radius/* = NULL*/)
+{
+	if (n == 0)
+		return 0;
+
+	Timer timer;
+
+	OcclusionTask task;
+	task.ePhase = OcclusionTask::TEST;
+	task.buffer = this;
+	task.spheres = spheres;
+	task.n = n;
+	task.mask = mask;
+	task.radius = radius;
+
+	ThreadPool &pool = ThreadPool::Instance();
+	unsigned int jobs = n >= TestParallelThreshold ? pool.NumThreads() : 1;
+	if (jobs > OcclusionTask::MaxJobs)
+		jobs = OcclusionTask::MaxJobs;
+	if (jobs > 1)
+		pool.Execute(task, jobs);
+	else
+		task.Run(0, 1);
+
+	unsigned int occluded = 0;
+	for (unsigned int j = 0; j < jobs; j++)
+	{
+		stats.uiTested += task.tested[j];
+		occluded += task.occluded[j];
+	}
+	stats.uiOccluded += occluded;
+	stats.fTestTime += timer.Update();
+	return occluded;
+}
@@ -0,0 +1,168 @@
+/*****************************************************************************
+ * Filename			OcclusionBuffer.h
+ *
+ * License			GPLv3
+ *
+ * Author			Andrea Bizzotto (bizz84@gmail.com)
+ *
+ * Platform			LinuxX11 / OpenGL
+ *
+ * Description		Software occlusion culling with a low resolution CPU
+ *					depth buffer
+ *
+ *****************************************************************************/
+
+#ifndef _OCCLUSION_BUFFER_H_
+#define _OCCLUSION_BUFFER_H_
+
+#include "Matrix.h"
+#include "Vector.h"
+#include "Frustum.h"
+
+#include <vector>
+using namespace std;
+
+//! Statistics of the last frame (reset by OcclusionBuffer::Begin())
+struct OcclusionStats
+{
+	//! Occluder triangles submitted and polygons actually rasterized
+	unsigned int uiTriangles;
+	unsigned int uiRasterized;
+	//! Objects tested and found to be occluded
+	unsigned int uiTested;
+	unsigned int uiOccluded;
+	//! CPU time (seconds) spent rasterizing occluders and testing objects
+	float fRasterTime;
+	float fTestTime;
+};
+
+//! Low resolution depth buffer of occluders, rasterized on the CPU
+/*!
+ Each frame, the nearest large objects are submitted as occluder triangles
+ (world space) between Begin() and Rasterize(). Bounding volumes of the
+ objects to draw are then tested against the buffer, before submission.
+
+ The buffer stores the clip w (view distance) of the nearest occluder in each
+ pixel. Both occluders and tests are conservative: an occluder only writes
+ the pixels it fully covers, at the depth of its farthest vertex, and an
+ object is occluded only if all the pixels its screen rectangle touches are
+ nearer than its nearest point. As a consequence, pixels along edges shared
+ by two occluder triangles are not covered by either, so large planar
+ occluders should be submitted as quads.
+
+ The buffer is split in tiles, each storing the farthest depth of its pixels
+ so that most tests don't need to read single pixels. Tile rows are
+ rasterized in parallel by the ThreadPool, four pixels at a time with SSE
+ when available. No OpenGL calls are made, so the buffer can be used
+ without a GPU.
+ */
+class OcclusionBuffer
+{
+public:
+	enum { TILE_WIDTH = 16, TILE_HEIGHT = 8 };
+
+private:
+	//! Occluder triangle or convex quad set up in screen space
+	struct Polygon
+	{
+		//! Edge functions a * x + b * y + c, non negative for pixel centers
+		//! of fully covered pixels. Triangles have a fourth edge that always
+		//! passes
+		float a[4], b[4], c[4];
+		//! Farthest depth
+		float z;
+		//! Bounding rectangle in pixels [minX, maxX) x [minY, maxY)
+		int minX, minY, maxX, maxY;
+	};
+
+	unsigned int uiWidth;
+	unsigned int uiHeight;
+	unsigned int uiTilesX;
+	unsigned int uiTilesY;
+	//! Depth of each pixel (row major) and farthest depth of each tile
+	vector<float> aDepth;
+	vector<float> aTileMax;
+
+	vector<Polygon> aPolygons;
+	Matrix4 mViewProj;
+	//! Length of the gradients of clip x, y and w (sphere tests)
+	float afGradient[3];
+	float fNear;
+
+	//! True until occluders are rasterized in the current frame
+	bool bEmpty;
+
+	OcclusionStats stats;
+
+	friend class OcclusionTask;
+
+	//! Projects and sets up a triangle or a planar quad (n = 3 or 4). It is
+	//! dropped if it crosses the near plane or can't fully cover any pixel.
+	//! Returns false if a quad is not convex on screen
+	bool Setup(const Vector3 *const *v, unsigned int n);
+
+	//! Clears and rasterizes all polygons in tile rows [first, last)
+	void RasterizeTiles(unsigned int first, unsigned int last);
+	//! Rasterizes rows [y0, y1) of a polygon
+	void RasterizePolygon(const Polygon &t, int y0, int y1);
+
+	//! Screen rectangle and nearest depth of the box [lo, hi]. Returns false
+	//! if the box crosses the near plane
+	bool Project(const float *lo, const float *hi, int *rect,
+		float &depth) const;
+	//! Converts a rectangle from normalized device coordinates to pixels
+	void ToPixels(float minX, float maxX, float minY, float maxY,
+		int *rect) const;
+	//! True if all pixels of rect are nearer than depth
+	bool RectOccluded(const int *rect, const float depth) const;
+
+	//! Sphere test with no statistics
+	bool Occluded(const float *center, const float radius) const;
+
+public:
+	//! Constructor. Width is rounded up to a multiple of TILE_WIDTH and
+	//! height to a multiple of TILE_HEIGHT
+	OcclusionBuffer(unsigned int width = 256, unsigned int height = 128);
+
+	//! Starts a new frame, removing all occluders
+	/*!
+	 Triangles with a vertex nearer than zNear (view distance) are not used as
+	 occluders, and objects crossing it are always visible
+	 */
+	void Begin(const Matrix4 &viewProj, const float zNear);
+
+	//! Adds numTriangles occluder triangles (three vertices each)
+	void AddTriangles(const Vector3 *vertices, unsigned int numTriangles);
+	//! Adds an indexed occluder mesh
+	void AddTriangles(const Vector3 *vertices, const unsigned int *indices,
+		unsigned int numTriangles);
+	//! Adds a planar quad. Convex quads are rasterized as a single polygon,
+	//! since splitting them would leave uncovered pixels along the diagonal
+	void AddQuad(const Vector3 &a, const Vector3 &b, const Vector3 &c,
+		const Vector3 &d);
+
+	//! Renders all occluders into the buffer
+	void Rasterize();
+
+	//! Returns true if the sphere is hidden by the occluders
+	bool SphereOccluded(const Vector3 &center, const float radius);
+	//! Returns true if the box is hidden by the occluders
+	bool BoxOccluded(const AABB &box);
+
+	//! Tests n spheres (x, y, z, radius) whose mask is not 0, and sets to 0
+	//! the mask of the occluded ones. Returns the number of occluded spheres
+	/*!
+	 If radius is not NULL it overrides the w component of all spheres
+	 */
+	unsigned int TestSpheres(const Vector4 *spheres, unsigned int n,
+		unsigned char *mask, const float *radius = NULL);
+
+	const OcclusionStats &GetStats() const { return stats; }
+
+	unsigned int GetWidth() const { return uiWidth; }
+	unsigned int GetHeight() const { return uiHeight; }
+	//! Depth buffer (row major, bottom row first)
+	const float *GetDepth() const { return &aDepth[0]; }
+};
+
+#endif
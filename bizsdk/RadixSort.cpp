@@ -0,0 +1,189 @@
+/*****************************************************************************
+ * Filename			RadixSort.cpp
+ *
+ * License			GPLv3
+ *
+ * Author			Andrea Bizzotto (bizz84@gmail.com)
+ *
+ * Platform			LinuxX11 / OpenGL
+ *
+ * Description		Parallel LSD radix sort of 32 and 64 bit keys
+ *
+ *****************************************************************************/
+
+#include "RadixSort.h"
+#include "ThreadPool.h"
+
+/*****************************************************************************
+ * RadixSortTask implementation
+ *****************************************************************************/
+
+// One pass of the sort, split in a histogram and a scatter phase
+template <class Key>
+class RadixSortTask : public ThreadTask
+{
+public:
+	enum Phase { HISTOGRAM, SCATTER };
+
+	Phase ePhase;
+	unsigned int uiShift;
+	unsigned int n;
+	// Source data. NULL indices means identity permutation
+	const Key *srcKeys;
+	const unsigned int *srcIndices;
+	Key *dstKeys;
+	unsigned int *dstIndices;
+	// RADIX_SIZE counters per job
+	unsigned int *histogram;
+
+	virtual void Run(unsigned int index, unsigned int count)
+	{
+		unsigned int begin, end;
+		ThreadPool::Range(n, index, count, begin, end);
+
+		const unsigned int mask = RadixSort::RADIX_SIZE - 1;
+		unsigned int *h = histogram + index * RadixSort::RADIX_SIZE;
+
+		if (ePhase == HISTOGRAM)
+		{
+			memset(h, 0, RadixSort::RADIX_SIZE * sizeof(unsigned int));
+			for (unsigned int i = begin; i < end; i++)
+				h[(srcKeys[i] >> uiShift) & mask]++;
+		}
+		else if (srcIndices)
+		{
+			// h now holds the output offsets of this job
+			for (unsigned int i = begin; i < end; i++)
+			{
+				Key key = srcKeys[i];
+				unsigned int pos = h[(key >> uiShift) & mask]++;
+				dstKeys[pos] = key;
+				dstIndices[pos] = srcIndices[i];
+			}
+		}
+		else
+		{
+			for (unsigned int i = begin; i < end; i++)
+			{
+				Key key = srcKeys[i];
+				unsigned int pos = h[(key >> uiShift) & mask]++;
+				dstKeys[pos] = key;
+				dstIndices[pos] = i;
+			}
+		}
+	}
+};
+
+/*****************************************************************************
+ * RadixSort implementation
+ *****************************************************************************/
+
+RadixSort::RadixSort() : uiParallelThreshold(16384)
+{
+
+}
+
+const unsigned int *RadixSort::Sort(const unsigned int *keys, unsigned int n,
+	bool parallel/* = true*/)
+{
+	return SortKeys(keys, n, parallel, aKeys);
+}
+
+const unsigned int *RadixSort::Sort(const unsigned long long *keys,
+	unsigned int n, bool parallel/* = true*/)
+{
+	return SortKeys(keys, n, parallel, aKeys64);
+}
+
+template <class Key>
+const unsigned int *RadixSort::SortKeys(const Key *keys, unsigned int n,
+	bool parallel, vector<Key> *buffers)
+{
+	const unsigned int passes = (sizeof(Key) * 8 + RADIX_BITS - 1) /
+		RADIX_BITS;
+
+	for (unsigned int i = 0; i < 2; i++)
+	{
+		if (buffers[i].size() < n)
+			buffers[i].resize(n);
+		if (aIndices[i].size() < n)
+			aIndices[i].resize(n);
+	}
+	if (n == 0)
+		return NULL;
+
+	ThreadPool &pool = ThreadPool::Instance();
+	unsigned int jobs = parallel && n >= uiParallelThreshold ?
+		pool.NumThreads() : 1;
+	if (aHistogram.size() < jobs * RADIX_SIZE)
+		aHistogram.resize(jobs * RADIX_SIZE);
+
+	RadixSortTask<Key> task;
+	task.n = n;
+	task.srcKeys = keys;
+	task.srcIndices = NULL;
+	task.histogram = &aHistogram[0];
+
+	unsigned int dst = 0;
+	for (unsigned int pass = 0; pass < passes; pass++)
+	{
+		task.uiShift = pass * RADIX_BITS;
+
+		task.ePhase = RadixSortTask<Key>::HISTOGRAM;
+		if (jobs > 1)
+			pool.Execute(task, jobs);
+		else
+			task.Run(0, 1);
+
+		// Skip pass if all keys fall in the same bucket
+		unsigned int *h = &aHistogram[0];
+		bool skip = false;
+		for (unsigned int b = 0; b < RADIX_SIZE; b++)
+		{
+			unsigned int total = 0;
+			for (unsigned int j = 0; j < jobs; j++)
+				total += h[j * RADIX_SIZE + b];
+			if (total)
+			{
+				skip = total == n;
+				break;
+			}
+		}
+		if (skip)
+			continue;
+
+		// Exclusive prefix sum ordered by bucket first, then by job
+		unsigned int sum = 0;
+		for (unsigned int b = 0; b < RADIX_SIZE; b++)
+		{
+			for (unsigned int j = 0; j < jobs; j++)
+			{
+				unsigned int count = h[j * RADIX_SIZE + b];
+				h[j * RADIX_SIZE + b] = sum;
+				sum += count;
+			}
+		}
+
+		task.ePhase = RadixSortTask<Key>::SCATTER;
+		task.dstKeys = &buffers[dst][0];
+		task.dstIndices = &aIndices[dst][0];
+		if (jobs > 1)
+			pool.Execute(task, jobs);
+		else
+			task.Run(0, 1);
+
+		task.srcKeys = task.dstKeys;
+		task.srcIndices = task.dstIndices;
+		dst = 1 - dst;
+	}
+
+	// Keys were already sorted
+	if (task.srcIndices == NULL)
+	{
+		unsigned int *indices = &aIndices[0][0];
+		for (unsigned int i = 0; i < n; i++)
+			indices[i] = i;
+		return indices;
+	}
+	return task.srcIndices;
+}
@@ -0,0 +1,82 @@
+/*****************************************************************************
+ * Filename			RadixSort.h
+ *
+ * License			GPLv3
+ *
+ * Author			Andrea Bizzotto (bizz84@gmail.com)
+ *
+ * Platform			LinuxX11 / OpenGL
+ *
+ * Description		Parallel LSD radix sort of 32 and 64 bit keys
+ *
+ *****************************************************************************/
+
+#ifndef _RADIX_SORT_H_
+#define _RADIX_SORT_H_
+
+#include <string.h>
+
+#include <vector>
+using namespace std;
+
+template <class Key> class RadixSortTask;
+
+//! Least significant digit radix sort of unsigned keys, returns a permutation
+/*!
+ Keys are sorted in passes of 11 bits (three for 32 bit keys, six for 64 bit
+ keys). Each pass builds a histogram per thread and scatters in parallel,
+ which keeps the sort stable. Passes where all
+ keys share the same digit are skipped (common for depth keys, whose exponent
+ bits rarely change). Buffers are kept across calls so that sorting the same
+ amount of data every frame doesn't allocate.
+ */
+class RadixSort
+{
+	template <class Key> friend class RadixSortTask;
+
+	enum { RADIX_BITS = 11, RADIX_SIZE = 1 << RADIX_BITS };
+
+	// Double buffered keys and indices
+	vector<unsigned int> aKeys[2];
+	vector<unsigned long long> aKeys64[2];
+	vector<unsigned int> aIndices[2];
+	// One histogram per thread
+	vector<unsigned int> aHistogram;
+
+	// Below this size the sort runs on the calling thread only
+	unsigned int uiParallelThreshold;
+
+	//! Implementation of Sort() for both key sizes
+	template <class Key>
+	const unsigned int *SortKeys(const Key *keys, unsigned int n,
+		bool parallel, vector<Key> *buffers);
+
+public:
+	RadixSort();
+
+	//! Sets the minimum number of keys that triggers a multithreaded sort
+	void SetParallelThreshold(unsigned int n) { uiParallelThreshold = n; }
+
+	//! Sorts n keys in ascending order
+	/*!
+	 Returns the indices of the keys in sorted order. The returned pointer is
+	 valid until the next call to Sort().
+	 */
+	const unsigned int *Sort(const unsigned int *keys, unsigned int n,
+		bool parallel = true);
+	//! Sorts n 64 bit keys in ascending order
+	const unsigned int *Sort(const unsigned long long *keys, unsigned int n,
+		bool parallel = true);
+
+	//! Maps a float into an unsigned key with the same ordering
+	static unsigned int FloatKey(float f)
+	{
+		unsigned int u;
+		memcpy(&u, &f, sizeof(u));
+		// Negative: flip all bits. Positive: flip sign bit only
+		unsigned int mask = (unsigned int)(-(int)(u >> 31)) | 0x80000000u;
+		return u ^ mask;
+	}
+};
+
+#endif
@@ -0,0 +1,405 @@
+/*****************************************************************************
+ * Filename			Reader3DS.cpp
+ *
+ * License			GPLv3
+ *
+ * Author			Andrea Bizzotto (bizz84@gmail.com)
+ *
+ * Platform			LinuxX11 / OpenGL
+ *
+ * Description		Memory mapped 3DS reader decoding meshes into vertex arrays
+ *
+ *****************************************************************************/
+
+#include "Reader3DS.h"
+#include "ThreadPool.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+// Chunks leading to the triangle meshes, the others are skipped
+enum Chunk3DS
+{
+	CHUNK_MAIN = 0x4d4d,
+	CHUNK_EDITOR = 0x3d3d,
+	CHUNK_OBJECT = 0x4000,
+	CHUNK_TRIANGLES = 0x4100,
+	CHUNK_POINTS = 0x4110,
+	CHUNK_FACES = 0x4120,
+	CHUNK_TEXELS = 0x4140,
+	CHUNK_SMOOTHING = 0x4150
+};
+
+static const unsigned int ChunkHeader = 6;
+static const unsigned int PointSize = 12;
+static const unsigned int TexelSize = 8;
+// Three point indices and flags
+static const unsigned int FaceSize = 8;
+
+// Values in the file are little endian and not aligned
+
+static unsigned int Get16(const unsigned char *p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+static unsigned int Get32(const unsigned char *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24);
+}
+
+static float GetFloat(const unsigned char *p)
+{
+	unsigned int bits = Get32(p);
+	float f;
+	memcpy(&f, &bits, sizeof(f));
+	return f;
+}
+
+// Reads the header of the chunk at p. False if it overflows end
+static bool NextChunk(const unsigned char *p, const unsigned char *end,
+	unsigned int &id, const unsigned char *&data, const unsigned char *&next)
+{
+	if (end - p < (ptrdiff_t)ChunkHeader)
+		return false;
+	const unsigned int length = Get32(p + 2);
+	if (length < ChunkHeader || (size_t)(end - p) < length)
+		return false;
+	id = Get16(p);
+	data = p + ChunkHeader;
+	next = p + length;
+	return true;
+}
+
+// Array of count elements of size bytes after a 16 bits count at p
+static const unsigned char *GetArray(const unsigned char *p,
+	const unsigned char *end, unsigned int size, unsigned int &count)
+{
+	if (end - p < 2)
+		return NULL;
+	count = Get16(p);
+	if ((size_t)(end - p - 2) < (size_t)count * size)
+		return NULL;
+	return p + 2;
+}
+
+bool Reader3DS::Open(const char *filename)
+{
+	Close();
+	if (!file.Open(filename))
+	{
+		printf("Unable to open %s\n", filename);
+		return false;
+	}
+
+	const unsigned char *p = file.Data(), *end = p + file.Size();
+	unsigned int id;
+	const unsigned char *data, *next;
+	bool valid = NextChunk(p, end, id, data, next) && id == CHUNK_MAIN;
+	for (end = next, p = data; valid && p < end; p = next)
+	{
+		valid = NextChunk(p, end, id, data, next);
+		if (!valid || id != CHUNK_EDITOR)
+			continue;
+		const unsigned char *objects = next;
+		for (const unsigned char *q = data; valid && q < objects; q = next)
+		{
+			valid = NextChunk(q, objects, id, data, next);
+			if (valid && id == CHUNK_OBJECT)
+				valid = ReadObject(data, next);
+		}
+	}
+	if (!valid)
+	{
+		printf("%s is not a valid 3DS file\n", filename);
+		Close();
+		return false;
+	}
+	return true;
+}
+
+bool Reader3DS::ReadObject(const unsigned char *p, const unsigned char *end)
+{
+	const unsigned char *nul = (const unsigned char *)memchr(p, 0, end - p);
+	if (!nul)
+		return false;
+	MeshChunks mesh;
+	mesh.name.assign((const char *)p, nul - p);
+	mesh.uiPoints = mesh.uiTexels = mesh.uiFaces = 0;
+	mesh.pPoints = mesh.pTexels = mesh.pFaces = mesh.pSmoothing = NULL;
+
+	// Lights and cameras are objects too
+	bool triangles = false;
+	unsigned int id;
+	const unsigned char *data, *next;
+	for (p = nul + 1; p < end; p = next)
+	{
+		if (!NextChunk(p, end, id, data, next))
+			return false;
+		if (id == CHUNK_TRIANGLES)
+		{
+			if (!ReadTriangles(data, next, mesh))
+				return false;
+			triangles = true;
+		}
+	}
+	if (triangles)
+		aMeshes.push_back(mesh);
+	return true;
+}
+
+bool Reader3DS::ReadTriangles(const unsigned char *p, const unsigned char *end,
+	MeshChunks &mesh)
+{
+	unsigned int id;
+	const unsigned char *data, *next;
+	for (; p < end; p = next)
+	{
+		if (!NextChunk(p, end, id, data, next))
+			return false;
+		switch (id)
+		{
+		case CHUNK_POINTS:
+			mesh.pPoints = GetArray(data, next, PointSize, mesh.uiPoints);
+			if (!mesh.pPoints)
+				return false;
+			break;
+		case CHUNK_TEXELS:
+			mesh.pTexels = GetArray(data, next, TexelSize, mesh.uiTexels);
+			if (!mesh.pTexels)
+				return false;
+			break;
+		case CHUNK_FACES:
+			if (!ReadFaces(data, next, mesh))
+				return false;
+			break;
+		}
+	}
+	return true;
+}
+
+bool Reader3DS::ReadFaces(const unsigned char *p, const unsigned char *end,
+	MeshChunks &mesh)
+{
+	mesh.pFaces = GetArray(p, end, FaceSize, mesh.uiFaces);
+	if (!mesh.pFaces)
+		return false;
+
+	// Material and smoothing groups follow the faces
+	unsigned int id;
+	const unsigned char *data, *next;
+	for (p = mesh.pFaces + mesh.uiFaces * FaceSize; p < end; p = next)
+	{
+		if (!NextChunk(p, end, id, data, next))
+			return false;
+		if (id == CHUNK_SMOOTHING)
+		{
+			if ((size_t)(next - data) < (size_t)mesh.uiFaces * 4)
+				return false;
+			mesh.pSmoothing = data;
+		}
+	}
+	return true;
+}
+
+void Reader3DS::Close()
+{
+	aMeshes.clear();
+	file.Close();
+}
+
+int Reader3DS::Find(const char *name) const
+{
+	for (unsigned int i = 0; i < aMeshes.size(); i++)
+	{
+		if (aMeshes[i].name == name)
+			return i;
+	}
+	return -1;
+}
+
+// Same result as lib3ds_vector_normalize(), degenerate vectors become axes
+static void Normalize(float *v)
+{
+	const float l = sqrtf(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+	if (fabsf(l) >= 1e-8f)
+	{
+		v[0] /= l;
+		v[1] /= l;
+		v[2] /= l;
+	}
+	else
+	{
+		const unsigned int axis = (v[0] >= v[1] && v[0] >= v[2]) ? 0 :
+			(v[1] >= v[2] ? 1 : 2);
+		v[0] = v[1] = v[2] = 0.0f;
+		v[axis] = 1.0f;
+	}
+}
+
+bool Reader3DS::Decode(unsigned int index, const Layout3DS &layout,
+	float *attribs, unsigned int *indices) const
+{
+	const MeshChunks &mesh = aMeshes[index];
+	const unsigned int points = mesh.uiPoints, faces = mesh.uiFaces;
+	unsigned int i, j, k;
+
+	for (i = 0; i < 3 * faces; i++)
+	{
+		indices[i] = Get16(mesh.pFaces + (i / 3) * FaceSize + (i % 3) * 2);
+		if (indices[i] >= points)
+		{
+			printf("Mesh %s: face %d uses point %d of %d\n",
+				mesh.name.c_str(), i / 3, indices[i], points);
+			return false;
+		}
+	}
+
+	float *v = attribs;
+	for (i = 0; i < points; i++, v += layout.uiStride)
+	{
+		const unsigned char *p = mesh.pPoints + i * PointSize;
+		if (layout.iPosition >= 0)
+		{
+			for (j = 0; j < 3; j++)
+			{
+				v[layout.iPosition + j] = layout.fScale *
+					GetFloat(p + 4 * layout.aiPermutation[j]);
+			}
+		}
+		if (layout.iTexCoord >= 0)
+		{
+			const unsigned char *t = i < mesh.uiTexels ?
+				mesh.pTexels + i * TexelSize : NULL;
+			v[layout.iTexCoord + 0] = t ? GetFloat(t) : 0.0f;
+			v[layout.iTexCoord + 1] = t ? GetFloat(t + 4) : 0.0f;
+		}
+		// Points not used by any face keep a null normal
+		if (layout.iNormal >= 0)
+		{
+			for (j = 0; j < 3; j++)
+				v[layout.iNormal + j] = 0.0f;
+		}
+	}
+	if (layout.iNormal < 0 || faces == 0)
+		return true;
+
+	// Face normals, and faces around each point in compressed rows
+	vector<float> normals(3 * faces);
+	vector<unsigned int> first(points + 1, 0), around(3 * faces);
+	for (i = 0; i < faces; i++)
+	{
+		float a[3], b[3], c[3];
+		for (j = 0; j < 3; j++)
+		{
+			a[j] = GetFloat(mesh.pPoints + indices[3 * i + 0] * PointSize + 4 * j);
+			b[j] = GetFloat(mesh.pPoints + indices[3 * i + 1] * PointSize + 4 * j);
+			c[j] = GetFloat(mesh.pPoints + indices[3 * i + 2] * PointSize + 4 * j);
+			c[j] -= b[j];
+			a[j] -= b[j];
+		}
+		float *n = &normals[3 * i];
+		n[0] = c[1] * a[2] - c[2] * a[1];
+		n[1] = c[2] * a[0] - c[0] * a[2];
+		n[2] = c[0] * a[1] - c[1] * a[0];
+		Normalize(n);
+		for (j = 0; j < 3; j++)
+			first[indices[3 * i + j] + 1]++;
+	}
+	for (i = 0; i < points; i++)
+		first[i + 1] += first[i];
+	vector<unsigned int> fill(first.begin(), first.end() - 1);
+	for (i = 0; i < 3 * faces; i++)
+		around[fill[indices[i]]++] = i / 3;
+
+	for (i = 0; i < points; i++)
+	{
+		if (first[i] == first[i + 1])
+			continue;
+		// The last face using the point sets its normal
+		const unsigned int face = around[first[i + 1] - 1];
+		const unsigned int group = mesh.pSmoothing ?
+			Get32(mesh.pSmoothing + 4 * face) : 0;
+		float n[3] = { 0.0f, 0.0f, 0.0f };
+		if (group == 0)
+			memcpy(n, &normals[3 * face], sizeof(n));
+		else
+		{
+			// Faces sharing a smoothing group, each distinct normal once
+			const float *added[32];
+			unsigned int numAdded = 0;
+			for (k = first[i]; k < first[i + 1]; k++)
+			{
+				const unsigned int other = around[k];
+				const float *m = &normals[3 * other];
+				bool found = false;
+				for (j = 0; j < numAdded && !found; j++)
+				{
+					found = fabsf(added[j][0] * m[0] + added[j][1] * m[1] +
+						added[j][2] * m[2] - 1.0f) < 1e-5f;
+				}
+				if (found ||
+					!(group & Get32(mesh.pSmoothing + 4 * other)))
+					continue;
+				n[0] += m[0];
+				n[1] += m[1];
+				n[2] += m[2];
+				if (numAdded < 32)
+					added[numAdded++] = m;
+			}
+		}
+		Normalize(n);
+
+		v = attribs + i * layout.uiStride + layout.iNormal;
+		for (j = 0; j < 3; j++)
+			v[j] = layout.fNormalSign * n[layout.aiPermutation[j]];
+	}
+	return true;
+}
+
+// Decodes a range of the jobs on each thread
+class Decode3DSTask : public ThreadTask
+{
+public:
+	const Reader3DS *reader;
+	Decode3DSJob *jobs;
+	unsigned int n;
+
+	virtual void Run(unsigned int index, unsigned int count)
+	{
+		unsigned int begin, end;
+		ThreadPool::Range(n, index, count, begin, end);
+		for (unsigned int i = begin; i < end; i++)
+		{
+			Decode3DSJob &job = jobs[i];
+			job.bDecoded = reader->Decode(job.uiMesh, job.layout,
+				job.pAttribs, job.pIndices);
+		}
+	}
+};
+
+bool Reader3DS::Decode(Decode3DSJob *jobs, unsigned int count) const
+{
+	for (unsigned int i = 0; i < count; i++)
+		jobs[i].bDecoded = false;
+
+	Decode3DSTask task;
+	task.reader = this;
+	task.jobs = jobs;
+	task.n = count;
+	if (count > 1)
+	{
+		ThreadPool &pool = ThreadPool::Instance();
+		pool.Execute(task, count < pool.NumThreads() ? count :
+			pool.NumThreads());
+	}
+	else
+		task.Run(0, 1);
+
+	// Jobs the pool couldn't run are reported as failed
+	bool decoded = true;
+	for (unsigned int i = 0; i < count; i++)
+		decoded = decoded && jobs[i].bDecoded;
+	return decoded;
+}
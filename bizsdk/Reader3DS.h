@@ -0,0 +1,120 @@
+/*****************************************************************************
+ * Filename			Reader3DS.h
+ *
+ * License			GPLv3
+ *
+ * Author			Andrea Bizzotto (bizz84@gmail.com)
+ *
+ * Platform			LinuxX11 / OpenGL
+ *
+ * Description		Memory mapped 3DS reader decoding meshes into vertex arrays
+ *
+ *****************************************************************************/
+
+#ifndef _READER_3DS_H_
+#define _READER_3DS_H_
+
+#include "Misc.h"
+
+#include <string>
+#include <vector>
+using namespace std;
+
+//! Where Reader3DS writes each attribute of the interleaved vertices
+struct Layout3DS
+{
+	//! Floats per vertex
+	unsigned int uiStride;
+	//! Offsets in floats within a vertex, -1 to skip the attribute
+	int iPosition;
+	int iNormal;
+	int iTexCoord;
+	//! Positions are scaled, normals multiplied by fNormalSign, and both
+	//! have their axes reordered by aiPermutation
+	float fScale;
+	float fNormalSign;
+	int aiPermutation[3];
+};
+
+//! Mesh to decode into arrays provided by the caller
+struct Decode3DSJob
+{
+	unsigned int uiMesh;
+	Layout3DS layout;
+	//! NumPoints() * layout.uiStride floats
+	float *pAttribs;
+	//! NumIndices() entries
+	unsigned int *pIndices;
+	//! Set by Decode()
+	bool bDecoded;
+};
+
+//! 3DS file read in place, without building the whole scene
+/*!
+ Open() maps the file and walks its chunks once, recording where the points,
+ texture coordinates, faces and smoothing groups of each triangle mesh are.
+ Nothing is copied until Decode(), which writes a mesh straight into the
+ interleaved vertex and index arrays of the caller. Vertex normals are
+ computed from the smoothing groups as lib3ds_mesh_calculate_normals() does,
+ keeping for each point the normal of the last face that uses it.
+ */
+class Reader3DS
+{
+	struct MeshChunks
+	{
+		string name;
+		unsigned int uiPoints;
+		unsigned int uiTexels;
+		unsigned int uiFaces;
+		// Little endian arrays within the mapping
+		const unsigned char *pPoints;
+		const unsigned char *pTexels;
+		const unsigned char *pFaces;
+		// NULL if the faces aren't smoothed
+		const unsigned char *pSmoothing;
+	};
+
+	MappedFile file;
+	vector<MeshChunks> aMeshes;
+
+	bool ReadObject(const unsigned char *p, const unsigned char *end);
+	bool ReadTriangles(const unsigned char *p, const unsigned char *end,
+		MeshChunks &mesh);
+	bool ReadFaces(const unsigned char *p, const unsigned char *end,
+		MeshChunks &mesh);
+
+public:
+	//! Maps filename and indexes its meshes
+	bool Open(const char *filename);
+	void Close();
+
+	unsigned int NumMeshes() const { return aMeshes.size(); }
+	//! Index of the mesh called name, -1 if missing
+	int Find(const char *name) const;
+	const char *Name(unsigned int mesh) const
+	{
+		return aMeshes[mesh].name.c_str();
+	}
+	unsigned int NumPoints(unsigned int mesh) const
+	{
+		return aMeshes[mesh].uiPoints;
+	}
+	unsigned int NumIndices(unsigned int mesh) const
+	{
+		return 3 * aMeshes[mesh].uiFaces;
+	}
+	//! True if there is a texture coordinate per point
+	bool HasTexCoords(unsigned int mesh) const
+	{
+		return aMeshes[mesh].uiTexels == aMeshes[mesh].uiPoints;
+	}
+
+	//! Writes mesh into attribs and indices. Can be called concurrently
+	bool Decode(unsigned int mesh, const Layout3DS &layout, float *attribs,
+		unsigned int *indices) const;
+	//! Decodes count meshes in parallel on the ThreadPool (call it from the
+	//! thread that owns the pool). False if any of them failed
+	bool Decode(Decode3DSJob *jobs, unsigned int count) const;
+};
+
+#endif
@@ -0,0 +1,159 @@
+/*****************************************************************************
+ * Filename			RenderQueue.cpp
+ *
+ * License			GPLv3
+ *
+ * Author			Andrea Bizzotto (bizz84@gmail.com)
+ *
+ * Platform			LinuxX11 / OpenGL
+ *
+ * Description		Queue of draw packets sorted to minimize state changes
+ *
+ *****************************************************************************/
+
+#include "RenderQueue.h"
+#include "GLStateCache.h"
+
+#include <assert.h>
+
+void RenderQueue::Recorder::Submit(RenderKey key, const RenderCommand *command,
+	unsigned int param, GLuint program/* = 0*/, GLuint texture/* = 0*/,
+	unsigned int flags/* = 0*/, unsigned int mask/* = ~0U*/)
+{
+	RenderPacket packet;
+	packet.key = key;
+	packet.command = command;
+	packet.param = param;
+	packet.program = program;
+	packet.texture = texture;
+	packet.flags = flags;
+	packet.mask = mask;
+	aPackets.push_back(packet);
+}
+
+RenderQueue::RenderQueue() : uiRecorders(0), uiStateChanges(0)
+{
+	// Queues are short, sorting them in parallel doesn't pay off
+	sorter.SetParallelThreshold(65536);
+}
+
+void RenderQueue::Begin(unsigned int recorders/* = 1*/)
+{
+	// Recorders keep their capacity across frames
+	if (aRecorders.size() < recorders)
+		aRecorders.resize(recorders);
+	for (unsigned int i = 0; i < aRecorders.size(); i++)
+		aRecorders[i].aPackets.clear();
+	uiRecorders = recorders;
+
+	aPackets.clear();
+	aKeys.clear();
+	aOrder.clear();
+}
+
+void RenderQueue::Sort()
+{
+	for (unsigned int i = 0; i < uiRecorders; i++)
+	{
+		const vector<RenderPacket> &packets = aRecorders[i].aPackets;
+		aPackets.insert(aPackets.end(), packets.begin(), packets.end());
+	}
+
+	const unsigned int n = aPackets.size();
+	aKeys.resize(n);
+	for (unsigned int i = 0; i < n; i++)
+		aKeys[i] = aPackets[i].key;
+
+	aOrder.resize(n);
+	if (n)
+	{
+		// The sort is stable: equal keys keep the recording order
+		const unsigned int *sorted = sorter.Sort(&aKeys[0], n);
+		aOrder.assign(sorted, sorted + n);
+	}
+}
+
+void RenderQueue::Execute(unsigned int mask/* = ~0U*/) const
+{
+	GLStateCache &state = GLStateCache::Instance();
+
+	uiStateChanges = 0;
+
+	GLuint program = 0, texture = 0;
+	// Blending disabled and depth writes enabled outside of the queue
+	unsigned int flags = 0;
+	state.Disable(GL_BLEND);
+	state.DepthMask(1);
+
+	for (unsigned int i = 0; i < aOrder.size(); i++)
+	{
+		const RenderPacket &packet = aPackets[aOrder[i]];
+		if (!(packet.mask & mask))
+			continue;
+
+		if (packet.program && packet.program != program)
+		{
+			state.UseProgram(packet.program);
+			program = packet.program;
+			uiStateChanges++;
+		}
+		if (packet.texture && packet.texture != texture)
+		{
+			state.BindTexture(GL_TEXTURE_2D, packet.texture);
+			texture = packet.texture;
+			uiStateChanges++;
+		}
+		unsigned int changed = packet.flags ^ flags;
+		if (changed & RenderPacket::BLEND)
+		{
+			state.Set(GL_BLEND, packet.flags & RenderPacket::BLEND);
+			uiStateChanges++;
+		}
+		if (changed & RenderPacket::NO_DEPTH_WRITE)
+		{
+			state.DepthMask(!(packet.flags & RenderPacket::NO_DEPTH_WRITE));
+			uiStateChanges++;
+		}
+		flags = packet.flags;
+
+		assert(packet.command);
+		packet.command->Execute(packet.param);
+
+		// Commands binding their own program or texture make the values
+		// above unknown
+		if (!packet.program)
+			program = 0;
+		if (!packet.texture)
+			texture = 0;
+	}
+
+	state.Disable(GL_BLEND);
+	state.DepthMask(1);
+}
+
+RenderKey RenderQueue::StateKey(unsigned int pass, GLuint program,
+	GLuint texture, float depth/* = 0.0f*/)
+{
+	assert(pass < MAX_PASSES);
+	return ((RenderKey)pass << 60) |
+		((RenderKey)(program & 0xfff) << 48) |
+		((RenderKey)(texture & 0xffff) << 32) |
+		(RenderKey)RadixSort::FloatKey(depth);
+}
+
+RenderKey RenderQueue::DepthKey(unsigned int pass, float depth,
+	GLuint program/* = 0*/, GLuint texture/* = 0*/)
+{
+	assert(pass < MAX_PASSES);
+	// Inverted so that farther packets come first
+	return ((RenderKey)pass << 60) |
+		((RenderKey)~RadixSort::FloatKey(depth) << 28) |
+		((RenderKey)(program & 0xfff) << 16) |
+		(RenderKey)(texture & 0xffff);
+}
+
+RenderKey RenderQueue::OrderKey(unsigned int pass, unsigned int order)
+{
+	assert(pass < MAX_PASSES);
+	return ((RenderKey)pass << 60) | (RenderKey)order;
+}
@@ -0,0 +1,134 @@
+/*****************************************************************************
+ * Filename			RenderQueue.h
+ *
+ * License			GPLv3
+ *
+ * Author			Andrea Bizzotto (bizz84@gmail.com)
+ *
+ * Platform			LinuxX11 / OpenGL
+ *
+ * Description		Queue of draw packets sorted to minimize state changes
+ *
+ *****************************************************************************/
+
+#ifndef _RENDER_QUEUE_H_
+#define _RENDER_QUEUE_H_
+
+#include "Extensions.h"
+#include "RadixSort.h"
+
+#include <vector>
+using namespace std;
+
+//! Sort key of a draw packet, packets are executed in ascending order
+typedef unsigned long long RenderKey;
+
+//! Interface of the objects issuing the draw calls of a packet
+class RenderCommand
+{
+public:
+	virtual ~RenderCommand() { }
+	//! Draws packet param. The state of the packet is already set
+	virtual void Execute(unsigned int param) const = 0;
+};
+
+//! Draw packet: a command and the state it expects
+struct RenderPacket
+{
+	enum {
+		BLEND = 1,			//!< GL_BLEND enabled
+		NO_DEPTH_WRITE = 2	//!< Depth mask set to false
+	};
+
+	RenderKey key;
+	const RenderCommand *command;
+	unsigned int param;
+	//! Program and 2D texture bound to unit 0, none if 0 (left to command)
+	GLuint program;
+	GLuint texture;
+	unsigned int flags;
+	//! Views the packet is drawn in (see RenderQueue::Execute())
+	unsigned int mask;
+};
+
+//! Draw packets recorded during a frame, sorted by key and then executed
+/*!
+ Each frame, packets are recorded between Begin() and Sort() into one or more
+ recorders. Recorders are independent, so that each thread can fill its own
+ without locks. Sort() merges them (in recorder order, then submission
+ order for equal keys) and radix sorts the keys.
+
+ Execute() issues the packets in order, changing program, texture, blending
+ and depth writes only between packets that need different values. The same
+ sorted queue can be executed more than once, e.g. for the mirrored
+ reflection pass: the mask selects the packets to draw in each view.
+
+ Keys hold the pass in the top 4 bits. StateKey() groups the packets of a
+ pass by program and texture, then front to back. DepthKey() sorts them back
+ to front first (blended geometry) and OrderKey() keeps the given order.
+ */
+class RenderQueue
+{
+public:
+	//! Packets recorded by a single thread
+	class Recorder
+	{
+		friend class RenderQueue;
+
+		vector<RenderPacket> aPackets;
+	public:
+		void Submit(RenderKey key, const RenderCommand *command,
+			unsigned int param, GLuint program = 0, GLuint texture = 0,
+			unsigned int flags = 0, unsigned int mask = ~0U);
+
+		unsigned int Size() const { return aPackets.size(); }
+	};
+
+	enum { MAX_PASSES = 16 };
+
+private:
+	vector<Recorder> aRecorders;
+	unsigned int uiRecorders;
+
+	//! Merged packets, their keys and the sorted order
+	vector<RenderPacket> aPackets;
+	vector<RenderKey> aKeys;
+	vector<unsigned int> aOrder;
+	RadixSort sorter;
+
+	//! State changes issued by the last Execute()
+	mutable unsigned int uiStateChanges;
+
+public:
+	RenderQueue();
+
+	//! Discards the packets of the previous frame and prepares n recorders
+	void Begin(unsigned int recorders = 1);
+
+	//! Recorder i, i < number passed to Begin()
+	Recorder &GetRecorder(unsigned int i) { return aRecorders[i]; }
+
+	//! Merges the recorders and sorts all packets by key
+	void Sort();
+
+	//! Executes the sorted packets whose mask intersects mask
+	/*!
+	 GL_BLEND and the depth mask are restored to disabled and true
+	 afterwards, program and texture are left bound.
+	 */
+	void Execute(unsigned int mask = ~0U) const;
+
+	unsigned int NumPackets() const { return aPackets.size(); }
+	unsigned int GetStateChanges() const { return uiStateChanges; }
+
+	//! Pass, program and texture, then depth (front to back)
+	static RenderKey StateKey(unsigned int pass, GLuint program,
+		GLuint texture, float depth = 0.0f);
+	//! Pass, depth (back to front), then program and texture
+	static RenderKey DepthKey(unsigned int pass, float depth,
+		GLuint program = 0, GLuint texture = 0);
+	//! Pass, then order (ascending)
+	static RenderKey OrderKey(unsigned int pass, unsigned int order);
+};
+
+#endif
@@ -0,0 +1,266 @@
+/*****************************************************************************
+ * Filename			ResourceRegistry.h
+ *
+ * License			GPLv3
+ *
+ * Author			Andrea Bizzotto (bizz84@gmail.com)
+ *
+ * Platform			LinuxX11 / OpenGL
+ *
+ * Description		Keyed, reference counted storage of loaded resources
+ *
+ *****************************************************************************/
+
+#ifndef _RESOURCE_REGISTRY_H_
+#define _RESOURCE_REGISTRY_H_
+
+#include "boost/unordered_map.hpp"
+
+#include <assert.h>
+#include <string>
+#include <vector>
+using namespace std;
+
+//! Generation checked reference to a resource of the registry with type Tag
+/*!
+ The slot index and the generation of the slot are packed in 32 bits. Slots
+ change generation when their resource is evicted, so that handles to it are
+ detected as stale even after the slot has been reused.
+ The default handle is invalid (value 0).
+ */
+template <class Tag>
+class ResourceHandle
+{
+	unsigned int uiValue;
+public:
+	enum { INDEX_BITS = 16, INDEX_MASK = (1 << INDEX_BITS) - 1 };
+
+	ResourceHandle() : uiValue(0) { }
+	ResourceHandle(unsigned int index, unsigned int generation)
+		: uiValue((generation << INDEX_BITS) | (index + 1))
+	{
+		assert(index < INDEX_MASK);
+	}
+
+	bool IsValid() const { return uiValue != 0; }
+	unsigned int Index() const { return (uiValue & INDEX_MASK) - 1; }
+	unsigned int Generation() const { return uiValue >> INDEX_BITS; }
+
+	//! Packed value, for APIs passing handles as unsigned int
+	unsigned int Value() const { return uiValue; }
+	static ResourceHandle FromValue(unsigned int value)
+	{
+		ResourceHandle handle;
+		handle.uiValue = value;
+		return handle;
+	}
+
+	bool operator==(const ResourceHandle &h) const
+	{
+		return uiValue == h.uiValue;
+	}
+	bool operator!=(const ResourceHandle &h) const
+	{
+		return uiValue != h.uiValue;
+	}
+};
+
+//! Resources of type T indexed by a string key, owned by the registry
+/*!
+ Lookups by key are hashed, lookups by handle are a bounds and generation
+ check. Each Acquire() or Add() counts a reference, released with
+ Release(). Unreferenced resources are kept (so that loading them again is
+ free) until EvictUnused() or EvictLRU() deletes them.
+
+ The registry also keeps the size in bytes given for each resource, and
+ the clock (see SetClock()) of its last Acquire(), Add() or Release().
+ */
+template <class T, class Tag>
+class ResourceRegistry
+{
+public:
+	typedef ResourceHandle<Tag> Handle;
+
+private:
+	struct Slot
+	{
+		//! NULL if the slot is free
+		T *pResource;
+		string sKey;
+		unsigned int uiGeneration;
+		unsigned int uiRefs;
+		size_t uiBytes;
+		unsigned int uiLastUse;
+	};
+
+	vector<Slot> aSlots;
+	vector<unsigned int> aFree;
+	boost::unordered_map<string, unsigned int> mKeys;
+
+	unsigned int uiCount;
+	size_t uiBytes;
+	unsigned int uiClock;
+
+	Slot *Lookup(Handle handle)
+	{
+		const ResourceRegistry *self = this;
+		return const_cast<Slot *>(self->Lookup(handle));
+	}
+	const Slot *Lookup(Handle handle) const
+	{
+		if (!handle.IsValid() || handle.Index() >= aSlots.size())
+			return NULL;
+		const Slot &slot = aSlots[handle.Index()];
+		if (!slot.pResource || slot.uiGeneration != handle.Generation())
+			return NULL;
+		return &slot;
+	}
+	Handle MakeHandle(unsigned int index) const
+	{
+		return Handle(index, aSlots[index].uiGeneration);
+	}
+
+	void Evict(unsigned int index)
+	{
+		Slot &slot = aSlots[index];
+		mKeys.erase(slot.sKey);
+		delete slot.pResource;
+		slot.pResource = NULL;
+		slot.sKey.clear();
+		// Invalidates the handles to the slot
+		slot.uiGeneration = (slot.uiGeneration + 1) & 0xffff;
+		uiBytes -= slot.uiBytes;
+		uiCount--;
+		aFree.push_back(index);
+	}
+
+	ResourceRegistry(const ResourceRegistry &);
+	ResourceRegistry &operator=(const ResourceRegistry &);
+public:
+	ResourceRegistry() : uiCount(0), uiBytes(0), uiClock(0) { }
+	~ResourceRegistry() { Clear(); }
+
+	//! Handle of the resource stored with key, with a new reference
+	//! Invalid if there is none
+	Handle Acquire(const string &key)
+	{
+		typename boost::unordered_map<string, unsigned int>::const_iterator
+			iter = mKeys.find(key);
+		if (iter == mKeys.end())
+			return Handle();
+		aSlots[iter->second].uiRefs++;
+		aSlots[iter->second].uiLastUse = uiClock;
+		return MakeHandle(iter->second);
+	}
+
+	//! Stores resource with key (not in the registry) and one reference
+	Handle Add(const string &key, T *resource, size_t bytes)
+	{
+		assert(resource && mKeys.find(key) == mKeys.end());
+		unsigned int index;
+		if (aFree.empty())
+		{
+			index = aSlots.size();
+			aSlots.push_back(Slot());
+			aSlots.back().uiGeneration = 0;
+		}
+		else
+		{
+			index = aFree.back();
+			aFree.pop_back();
+		}
+		Slot &slot = aSlots[index];
+		slot.pResource = resource;
+		slot.sKey = key;
+		slot.uiRefs = 1;
+		slot.uiBytes = bytes;
+		slot.uiLastUse = uiClock;
+		mKeys[key] = index;
+		uiCount++;
+		uiBytes += bytes;
+		return MakeHandle(index);
+	}
+
+	//! Resource of handle, NULL if the handle is stale or invalid
+	T *Get(Handle handle) const
+	{
+		const Slot *slot = Lookup(handle);
+		return slot ? slot->pResource : NULL;
+	}
+
+	//! Drops a reference. False if the handle is stale or invalid
+	bool Release(Handle handle)
+	{
+		Slot *slot = Lookup(handle);
+		if (!slot)
+			return false;
+		assert(slot->uiRefs > 0);
+		slot->uiRefs--;
+		slot->uiLastUse = uiClock;
+		return true;
+	}
+
+	unsigned int GetRefs(Handle handle) const
+	{
+		const Slot *slot = Lookup(handle);
+		return slot ? slot->uiRefs : 0;
+	}
+
+	//! Deletes the resources without references, returns how many
+	unsigned int EvictUnused()
+	{
+		unsigned int evicted = 0;
+		for (unsigned int i = 0; i < aSlots.size(); i++)
+		{
+			if (aSlots[i].pResource && aSlots[i].uiRefs == 0)
+			{
+				Evict(i);
+				evicted++;
+			}
+		}
+		return evicted;
+	}
+
+	//! Deletes the least recently used resources without references until
+	//! the size is within budget (if possible), returns how many
+	unsigned int EvictLRU(size_t budget)
+	{
+		unsigned int evicted = 0;
+		while (uiBytes > budget)
+		{
+			unsigned int oldest = aSlots.size();
+			for (unsigned int i = 0; i < aSlots.size(); i++)
+			{
+				const Slot &slot = aSlots[i];
+				if (slot.pResource && slot.uiRefs == 0 &&
+					(oldest == aSlots.size() ||
+					slot.uiLastUse < aSlots[oldest].uiLastUse))
+					oldest = i;
+			}
+			// Everything left is referenced
+			if (oldest == aSlots.size())
+				break;
+			Evict(oldest);
+			evicted++;
+		}
+		return evicted;
+	}
+
+	//! Deletes all resources, referenced or not
+	void Clear()
+	{
+		for (unsigned int i = 0; i < aSlots.size(); i++)
+		{
+			if (aSlots[i].pResource)
+				Evict(i);
+		}
+	}
+
+	unsigned int Size() const { return uiCount; }
+	size_t Bytes() const { return uiBytes; }
+
+	//! Time stamp of the next uses (usually the frame number)
+	void SetClock(unsigned int clock) { uiClock = clock; }
+};
+
+#endif
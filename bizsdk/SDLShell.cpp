@@ -19,6 +19,10 @@
 #include "TTFont.h"
 
 #include "Extensions.h"
+#include "GLStateCache.h"
+#include "GLResourceManager.h"
+#include "AsyncLoader.h"
+#include "Timer.h"
 
 
 
@@ -67,6 +71,7 @@ void SDLShell::Exit(ExitStage stage)
 	switch (stage)
 	{
 		case EXIT_INIT_GL:
+			AsyncLoader::Instance().Release();
 			ReleaseGL();
 			// Don't break here since everything else needs to be released
 		case EXIT_NO_GL2_SUPPORT:
@@ -177,6 +182,11 @@ void SDLShell::ProcessCommandLine(int argc, char *argv[])
 			if ((value = atoi(aCmdLineParams[i].sValue.c_str())) >= 0)
 				SetVerboseLevel((VerboseLevel)value);
 		}
+		else if (aCmdLineParams[i].sName.compare("programcache") == 0)
+		{
+			value = atoi(aCmdLineParams[i].sValue.c_str());
+			GLResourceManager::Instance().SetProgramCache(value > 0);
+		}
 	}	
 }
 
@@ -185,6 +195,9 @@ int SDLShell::Run(int argc, char *argv[])
 {
 	printf("*** %s, V%s ***\n", GetAppName(), GetAppVersion());
 
+	// Measures the time to the first frame
+	Timer startup;
+
 	int done;
 	Uint8 *keys;
 
@@ -194,6 +207,8 @@ int SDLShell::Run(int argc, char *argv[])
 		return 0;
 	}
 
+	// Enabled unless disabled from the command line (programcache=0)
+	GLResourceManager::Instance().SetProgramCache(true);
 	ProcessCommandLine(argc, argv);
 
 	if (!InitApp())
@@ -269,6 +284,13 @@ int SDLShell::Run(int argc, char *argv[])
 		Exit(EXIT_INIT_GL);
 	}
 
+	GLResourceManager &loader = GLResourceManager::Instance();
+	printf("Startup time %.3f s, %d programs (%d from cache) built in %.3f s\n",
+		startup.Update(), loader.GetProgramsBuilt(),
+		loader.GetProgramsCached(), loader.GetProgramTime());
+	if (Verbose(VerboseInfo))
+		loader.PrintMemoryUsage();
+
 	done = 0;
 	while (!done)
 	{
@@ -368,6 +390,11 @@ int SDLShell::Run(int argc, char *argv[])
 			done = 1;
 		}
 
+		// Textures decoded in the background since the last frame, then
+		// evict the unused ones over budget
+		AsyncLoader::Instance().Update();
+		GLResourceManager::Instance().UpdateResidency();
+		GLStateCache::Instance().NewFrame();
 		if (!Render())
 			break;
 
@@ -375,6 +402,8 @@ int SDLShell::Run(int argc, char *argv[])
 
 		shellFrame++;
 	}
+	// Workers must stop before the textures are deleted
+	AsyncLoader::Instance().Release();
 	ReleaseGL();
 	ReleaseApp();
 
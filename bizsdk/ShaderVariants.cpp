@@ -0,0 +1,68 @@
+/*****************************************************************************
+ * Filename			ShaderVariants.cpp
+ *
+ * License			GPLv3
+ *
+ * Author			Andrea Bizzotto (bizz84@gmail.com)
+ *
+ * Platform			LinuxX11 / OpenGL
+ *
+ * Description		Specialized programs built from one shader pair
+ *
+ *****************************************************************************/
+
+#include "ShaderVariants.h"
+#include "GLResourceManager.h"
+
+#include <stdio.h>
+#include <assert.h>
+
+ShaderVariants::ShaderVariants(const char *vertexShader,
+	const char *fragmentShader, const char *options[],
+	unsigned int numOptions)
+	: sVertShader(vertexShader), sFragShader(fragmentShader)
+{
+	assert(numOptions <= MAX_OPTIONS);
+	for (unsigned int i = 0; i < numOptions; i++)
+		asOption.push_back(options[i]);
+	auiProgram.resize(1 << numOptions, 0);
+}
+
+string ShaderVariants::Defines(unsigned int mask) const
+{
+	string defines;
+	for (unsigned int i = 0; i < asOption.size(); i++)
+	{
+		if (!(mask & (1 << i)))
+			continue;
+		if (!defines.empty())
+			defines += ' ';
+		defines += asOption[i];
+	}
+	return defines;
+}
+
+bool ShaderVariants::Get(unsigned int mask, GLuint &program)
+{
+	if (mask >= auiProgram.size())
+	{
+		printf("Invalid variant %d of %s\n", mask, sVertShader.c_str());
+		return false;
+	}
+	if (auiProgram[mask])
+	{
+		program = auiProgram[mask];
+		return true;
+	}
+
+	string defines = Defines(mask);
+	if (!GLResourceManager::Instance().LoadShaderFromFile(sVertShader.c_str(),
+		sFragShader.c_str(), program, defines.empty() ? NULL : defines.c_str()))
+	{
+		printf("Unable to build variant [%s] of %s %s\n", defines.c_str(),
+			sVertShader.c_str(), sFragShader.c_str());
+		return false;
+	}
+	auiProgram[mask] = program;
+	return true;
+}
@@ -0,0 +1,72 @@
+/*****************************************************************************
+ * Filename			ShaderVariants.h
+ *
+ * License			GPLv3
+ *
+ * Author			Andrea Bizzotto (bizz84@gmail.com)
+ *
+ * Platform			LinuxX11 / OpenGL
+ *
+ * Description		Specialized programs built from one shader pair
+ *
+ *****************************************************************************/
+
+#ifndef _SHADER_VARIANTS_H_
+#define _SHADER_VARIANTS_H_
+
+#include "Extensions.h"
+
+#include <string>
+#include <vector>
+using namespace std;
+
+//! Programs compiled from the same shader files with different options
+/*!
+ Each option is a preprocessor symbol the shaders test with #ifdef, and a
+ variant is selected by a mask with bit i set if option i is defined. Instead
+ of branching on uniforms, renderers pick the cheapest variant doing what they
+ need.
+
+ Variants are compiled the first time they are requested (through
+ GLResourceManager, which owns the programs), or in advance with Warm() to
+ avoid stalls in the middle of a frame.
+ */
+class ShaderVariants
+{
+public:
+	enum { MAX_OPTIONS = 8 };
+
+private:
+	string sVertShader;
+	string sFragShader;
+	vector<string> asOption;
+
+	//! Program of each mask, 0 if not compiled yet
+	vector<GLuint> auiProgram;
+
+	//! Value of the defines argument of GLResourceManager for mask
+	string Defines(unsigned int mask) const;
+public:
+	ShaderVariants(const char *vertexShader, const char *fragmentShader,
+		const char *options[], unsigned int numOptions);
+
+	//! Program of variant mask, compiled if needed. False if it doesn't build
+	bool Get(unsigned int mask, GLuint &program);
+
+	//! Compiles variant mask ahead of its first use
+	bool Warm(unsigned int mask)
+	{
+		GLuint program;
+		return Get(mask, program);
+	}
+
+	//! True if variant mask has already been compiled
+	bool IsCompiled(unsigned int mask) const
+	{
+		return mask < auiProgram.size() && auiProgram[mask] != 0;
+	}
+
+	unsigned int NumOptions() const { return asOption.size(); }
+};
+
+#endif
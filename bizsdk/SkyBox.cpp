@@ -14,6 +14,7 @@
 #include "SkyBox.h"
 #include "GLResourceManager.h"
 #include "Misc.h"
+#include "GLStateCache.h"
 
 /*****************************************************************************
  * SkyBoxTransition implementation
@@ -79,7 +80,7 @@ bool SkyBox::ShaderSetup()
 	if (!loader.LoadShaderFromMemory(SkyBoxVertexShader, SkyBoxFragmentShader, uiProgram))
 		return false;
 
-	glUseProgram(uiProgram);
+	GLStateCache::Instance().UseProgram(uiProgram);
 	glUniform1i(GetUniLoc(uiProgram, "sTexture"), 0);
 	return true;
 }
@@ -100,10 +101,12 @@ bool SkyBox::Init()
 
 void SkyBox::Render() const
 {
+	GLStateCache &state = GLStateCache::Instance();
+
 	assert(init);
 
-	glDepthMask(0);
-	glUseProgram(uiProgram);
+	state.DepthMask(0);
+	state.UseProgram(uiProgram);
 
 	//glDisable(GL_CULL_FACE);
 
@@ -111,7 +114,7 @@ void SkyBox::Render() const
 	pVBOCube->Render(GL_QUADS);
 	//glDisableClientState(GL_VERTEX_ARRAY);
 
-	glDepthMask(1);
+	state.DepthMask(1);
 
 }
 
@@ -151,7 +154,7 @@ bool SkyBoxTransition::ShaderSetup()
 		TransitionFragmentShader, uiProgram))
 		return false;
 
-	glUseProgram(uiProgram);
+	GLStateCache::Instance().UseProgram(uiProgram);
 	glUniform1i(GetUniLoc(uiProgram, "sTexture"), 0);
 	glUniform1i(GetUniLoc(uiProgram, "sTexture2"), 1);
 
@@ -161,10 +164,12 @@ bool SkyBoxTransition::ShaderSetup()
 
 void SkyBoxTransition::Render(const float mix) const
 {
+	GLStateCache &state = GLStateCache::Instance();
+
 	assert(init);
 
-	glDepthMask(0);
-	glUseProgram(uiProgram);
+	state.DepthMask(0);
+	state.UseProgram(uiProgram);
 
 	glUniform1f(locMix, mix);
 
@@ -172,7 +177,7 @@ void SkyBoxTransition::Render(const float mix) const
 	pVBOCube->Render(GL_QUADS);
 	//glDisableClientState(GL_VERTEX_ARRAY);
 
-	glDepthMask(1);
+	state.DepthMask(1);
 }
 
 
@@ -187,7 +192,7 @@ bool CubeMap::Init(const char *textures[])
 	GLint  nOfColors;
 
 	glGenTextures(1, &uiCubeMap);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, uiCubeMap);
+	GLStateCache::Instance().BindTexture(GL_TEXTURE_CUBE_MAP, uiCubeMap);
 	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
 	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
@@ -216,3 +221,23 @@ bool CubeMap::Init(const char *textures[])
 
 	return true;
 }
+
+bool CubeMap::InitAsync(const char *textures[])
+{
+	if (!pAsync)
+		pAsync = AsyncLoader::Instance().LoadCubeMap(textures);
+	return pAsync != NULL;
+}
+
+bool CubeMap::Wait()
+{
+	return !pAsync || AsyncLoader::Instance().Wait(pAsync);
+}
+
+void CubeMap::Release()
+{
+	if (!pAsync)
+		return;
+	AsyncLoader::Instance().Release(pAsync);
+	pAsync = NULL;
+}
@@ -16,6 +16,7 @@
 
 #include "Extensions.h"
 #include "VBO.h"
+#include "AsyncLoader.h"
 
 using namespace std;
 
@@ -25,9 +26,22 @@ using namespace std;
 class CubeMap
 {
 	GLuint uiCubeMap;
+	// Set if loaded by AsyncLoader
+	AsyncTexture *pAsync;
 public:
+	CubeMap() : uiCubeMap(0), pAsync(NULL) { }
+
 	bool Init(const char *textures[]);
-	const GLuint Get() const { return uiCubeMap; }
+	// Requests the textures to AsyncLoader, Get() returns 0 until ready
+	bool InitAsync(const char *textures[]);
+	// Completes an asynchronous load. False if it failed
+	bool Wait();
+	// Drops an asynchronous load, which can then be evicted (see
+	// GLResourceManager::SetTextureBudget())
+	void Release();
+	bool IsRequested() const { return pAsync != NULL; }
+
+	const GLuint Get() const { return pAsync ? pAsync->Get() : uiCubeMap; }
 };
 
 /*****************************************************************************
@@ -19,6 +19,7 @@
 #include <math.h>
 
 #include "SDLShell.h"
+#include "GLStateCache.h"
 
 
 void TTFont::glEnable2D()
@@ -66,6 +67,8 @@ void TTFont::SDL_GL_RenderText(const char *text,
                       SDL_Color color,
                       SDL_Rect *location) const
 {
+	GLStateCache &state = GLStateCache::Instance();
+
 	SDL_Surface *initial;
 	SDL_Surface *intermediary;
 	int w,h;
@@ -85,7 +88,7 @@ void TTFont::SDL_GL_RenderText(const char *text,
 	
 	/* Tell GL about our new texture */
 	glGenTextures(1, &texture);
-	glBindTexture(GL_TEXTURE_2D, texture);
+	state.BindTexture(GL_TEXTURE_2D, texture);
 	glTexImage2D(GL_TEXTURE_2D, 0, 4, w, h, 0, GL_BGRA, 
 			GL_UNSIGNED_BYTE, intermediary->pixels );
 	
@@ -95,7 +98,7 @@ void TTFont::SDL_GL_RenderText(const char *text,
 
 	/* prepare to render our texture */
 	glEnable(GL_TEXTURE_2D);
-	glBindTexture(GL_TEXTURE_2D, texture);
+	state.BindTexture(GL_TEXTURE_2D, texture);
 	glColor3f(1.0f, 1.0f, 1.0f);
 	
 	RenderQuad2D(location->x, location->y, w, h, 0.0, 0.0, 1.0, 1.0);
@@ -111,7 +114,7 @@ void TTFont::SDL_GL_RenderText(const char *text,
 	/* Clean up */
 	SDL_FreeSurface(initial);
 	SDL_FreeSurface(intermediary);
-	glDeleteTextures(1, &texture);
+	state.DeleteTextures(1, &texture);
 }
 
 
@@ -0,0 +1,121 @@
+/*****************************************************************************
+ * Filename			TextureAtlas.cpp
+ *
+ * License			GPLv3
+ *
+ * Author			Andrea Bizzotto (bizz84@gmail.com)
+ *
+ * Platform			LinuxX11 / OpenGL
+ *
+ * Description		Texture atlas and UV table written by AtlasPack
+ *
+ *****************************************************************************/
+
+#include "TextureAtlas.h"
+#include "GLResourceManager.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+bool TextureAtlas::Load(const char *image, GLint minFilter, GLint magFilter,
+	unsigned int columns/* = 1*/, unsigned int rows/* = 1*/)
+{
+	if (!GLResourceManager::Instance().LoadTextureFromFile(image, uiTexture,
+		minFilter, magFilter))
+		return false;
+
+	// Hand drawn atlases have no table
+	string table = TablePathOf(image);
+	FILE *fp = fopen(table.c_str(), "r");
+	if (!fp)
+	{
+		Grid(columns, rows);
+		return true;
+	}
+	fclose(fp);
+	return LoadTable(table.c_str());
+}
+
+bool TextureAtlas::LoadTable(const char *filename)
+{
+	FILE *fp = fopen(filename, "r");
+	if (!fp)
+	{
+		printf("Unable to open %s\n", filename);
+		return false;
+	}
+
+	float width, height;
+	if (fscanf(fp, " atlas %f %f", &width, &height) != 2 ||
+		width <= 0.0f || height <= 0.0f)
+	{
+		printf("%s is not an atlas table\n", filename);
+		fclose(fp);
+		return false;
+	}
+
+	vector<AtlasRect> rects;
+	char name[256];
+	float x, y, w, h;
+	int read;
+	while ((read = fscanf(fp, " %255s %f %f %f %f", name, &x, &y, &w, &h)) ==
+		5)
+	{
+		AtlasRect rect;
+		rect.name = name;
+		rect.u0 = x / width;
+		rect.v0 = y / height;
+		rect.u1 = (x + w) / width;
+		rect.v1 = (y + h) / height;
+		rects.push_back(rect);
+	}
+	// A last entry cut short also ends at the end of the file
+	const bool complete = read == EOF;
+	fclose(fp);
+	if (!complete || rects.empty())
+	{
+		printf("%s: invalid entry after %d sprites\n", filename,
+			(int)rects.size());
+		return false;
+	}
+	aRects.swap(rects);
+	return true;
+}
+
+void TextureAtlas::Grid(unsigned int columns, unsigned int rows)
+{
+	assert(columns && rows);
+	aRects.resize(columns * rows);
+	for (unsigned int i = 0; i < aRects.size(); i++)
+	{
+		AtlasRect &rect = aRects[i];
+		char name[32];
+		sprintf(name, "%d", i);
+		rect.name = name;
+		rect.u0 = (float)(i / rows) / columns;
+		rect.v0 = (float)(i % rows) / rows;
+		rect.u1 = rect.u0 + 1.0f / columns;
+		rect.v1 = rect.v0 + 1.0f / rows;
+	}
+}
+
+int TextureAtlas::Find(const char *name) const
+{
+	for (unsigned int i = 0; i < aRects.size(); i++)
+	{
+		if (aRects[i].name == name)
+			return i;
+	}
+	return -1;
+}
+
+string TextureAtlas::TablePathOf(const char *image)
+{
+	string path = image;
+	size_t dot = path.find_last_of('.');
+	// A dot in a directory name isn't an extension
+	if (dot != string::npos && path.find_first_of("/\\", dot) == string::npos)
+		path.erase(dot);
+	return path + ".atlas";
+}
@@ -0,0 +1,81 @@
+/*****************************************************************************
+ * Filename			TextureAtlas.h
+ *
+ * License			GPLv3
+ *
+ * Author			Andrea Bizzotto (bizz84@gmail.com)
+ *
+ * Platform			LinuxX11 / OpenGL
+ *
+ * Description		Texture atlas and UV table written by AtlasPack
+ *
+ *****************************************************************************/
+
+#ifndef _TEXTURE_ATLAS_H_
+#define _TEXTURE_ATLAS_H_
+
+#include "Extensions.h"
+#include "Vector.h"
+
+#include <string>
+#include <vector>
+using namespace std;
+
+//! Rectangle of a sprite in the atlas, in texture coordinates
+/*!
+ v grows downwards in the image, as the rows of textures loaded by
+ GLResourceManager
+ */
+struct AtlasRect
+{
+	string name;
+	float u0, v0, u1, v1;
+
+	//! Maps coord, in [0, 1] x [0, 1] over the sprite, into the atlas
+	Point2 Map(const Point2 &coord) const
+	{
+		return Point2(u0 + coord[0] * (u1 - u0), v0 + coord[1] * (v1 - v0));
+	}
+};
+
+//! Texture shared by many sprites, each looked up by index or name
+/*!
+ The UV table is a text file next to the image (see TablePathOf()):
+ \code
+ atlas <width> <height>
+ <name> <x> <y> <width> <height>
+ ...
+ \endcode
+ with one line per sprite, in pixels from the top left corner of the image.
+ Sprites are indexed in the order of the table.
+ */
+class TextureAtlas
+{
+	GLuint uiTexture;
+	vector<AtlasRect> aRects;
+
+public:
+	TextureAtlas() : uiTexture(0) { }
+
+	//! Loads image and its UV table. Images without a table are split in a
+	//! grid of columns x rows sprites, indexed column by column
+	bool Load(const char *image, GLint minFilter, GLint magFilter,
+		unsigned int columns = 1, unsigned int rows = 1);
+
+	//! Replaces the rectangles with those listed in filename
+	bool LoadTable(const char *filename);
+	//! Replaces the rectangles with a columns x rows grid
+	void Grid(unsigned int columns, unsigned int rows);
+
+	GLuint Texture() const { return uiTexture; }
+	unsigned int NumRects() const { return aRects.size(); }
+	const AtlasRect &Rect(unsigned int index) const { return aRects[index]; }
+
+	//! Index of the sprite called name, -1 if missing
+	int Find(const char *name) const;
+
+	//! UV table of an image: its name with the extension replaced
+	static string TablePathOf(const char *image);
+};
+
+#endif
@@ -0,0 +1,357 @@
+/*****************************************************************************
+ * Filename			TextureFile.cpp
+ *
+ * License			GPLv3
+ *
+ * Author			Andrea Bizzotto (bizz84@gmail.com)
+ *
+ * Platform			LinuxX11 / OpenGL
+ *
+ * Description		GPU ready texture container written by TexturePack
+ *
+ *****************************************************************************/
+
+#include "TextureFile.h"
+#include "Image.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+#include <vector>
+
+static const char Magic[4] = { 'B', 'Z', 'T', 'X' };
+static const unsigned int Version = 1;
+static const unsigned int Alignment = 16;
+
+static unsigned int Align(unsigned int offset)
+{
+	return (offset + Alignment - 1) & ~(Alignment - 1);
+}
+
+/*****************************************************************************
+ * S3TC block compression
+ *****************************************************************************/
+
+// Packs an RGB color to 5:6:5
+static unsigned short To565(const int *c)
+{
+	return (unsigned short)(((c[0] * 31 + 127) / 255) << 11 |
+		((c[1] * 63 + 127) / 255) << 5 | ((c[2] * 31 + 127) / 255));
+}
+
+static void From565(unsigned short v, int *c)
+{
+	c[0] = ((v >> 11) & 31) * 255 / 31;
+	c[1] = ((v >> 5) & 63) * 255 / 63;
+	c[2] = (v & 31) * 255 / 31;
+}
+
+// Color block of a 4x4 RGBA block: endpoints of the bounding box of the
+// colors (inset by 1/16 to reduce the error), four color mode
+static void CompressColorBlock(const unsigned char *block, unsigned char *out)
+{
+	int lo[3] = { 255, 255, 255 }, hi[3] = { 0, 0, 0 };
+	for (unsigned int i = 0; i < 16; i++)
+	{
+		for (unsigned int k = 0; k < 3; k++)
+		{
+			int v = block[i * 4 + k];
+			lo[k] = v < lo[k] ? v : lo[k];
+			hi[k] = v > hi[k] ? v : hi[k];
+		}
+	}
+	for (unsigned int k = 0; k < 3; k++)
+	{
+		int inset = (hi[k] - lo[k]) >> 4;
+		lo[k] += inset;
+		hi[k] -= inset;
+	}
+
+	unsigned short c0 = To565(hi), c1 = To565(lo);
+	unsigned int indices = 0;
+	if (c0 != c1)
+	{
+		// Four color mode needs c0 > c1
+		if (c0 < c1)
+		{
+			unsigned short t = c0;
+			c0 = c1;
+			c1 = t;
+		}
+		int palette[4][3];
+		From565(c0, palette[0]);
+		From565(c1, palette[1]);
+		for (unsigned int k = 0; k < 3; k++)
+		{
+			palette[2][k] = (2 * palette[0][k] + palette[1][k]) / 3;
+			palette[3][k] = (palette[0][k] + 2 * palette[1][k]) / 3;
+		}
+		for (unsigned int i = 0; i < 16; i++)
+		{
+			int best = 0, bestDist = 0x7fffffff;
+			for (int j = 0; j < 4; j++)
+			{
+				int dist = 0;
+				for (unsigned int k = 0; k < 3; k++)
+				{
+					int d = block[i * 4 + k] - palette[j][k];
+					dist += d * d;
+				}
+				if (dist < bestDist)
+				{
+					best = j;
+					bestDist = dist;
+				}
+			}
+			indices |= best << (2 * i);
+		}
+	}
+
+	out[0] = c0 & 0xff;
+	out[1] = c0 >> 8;
+	out[2] = c1 & 0xff;
+	out[3] = c1 >> 8;
+	for (unsigned int i = 0; i < 4; i++)
+		out[4 + i] = (indices >> (8 * i)) & 0xff;
+}
+
+// DXT5 alpha block: endpoints at the alpha range, eight value mode
+static void CompressAlphaBlock(const unsigned char *block, unsigned char *out)
+{
+	int lo = 255, hi = 0;
+	for (unsigned int i = 0; i < 16; i++)
+	{
+		int a = block[i * 4 + 3];
+		lo = a < lo ? a : lo;
+		hi = a > hi ? a : hi;
+	}
+
+	unsigned long long indices = 0;
+	if (hi != lo)
+	{
+		int palette[8];
+		palette[0] = hi;
+		palette[1] = lo;
+		for (int j = 1; j < 7; j++)
+			palette[j + 1] = ((7 - j) * hi + j * lo) / 7;
+		for (unsigned int i = 0; i < 16; i++)
+		{
+			int a = block[i * 4 + 3];
+			unsigned long long best = 0;
+			int bestDist = 256;
+			for (int j = 0; j < 8; j++)
+			{
+				int d = a > palette[j] ? a - palette[j] : palette[j] - a;
+				if (d < bestDist)
+				{
+					best = j;
+					bestDist = d;
+				}
+			}
+			indices |= best << (3 * i);
+		}
+	}
+
+	out[0] = (unsigned char)hi;
+	out[1] = (unsigned char)lo;
+	for (unsigned int i = 0; i < 6; i++)
+		out[2 + i] = (indices >> (8 * i)) & 0xff;
+}
+
+// Compresses level to DXT1 (8 bytes per block) or DXT5 (16 bytes)
+static void CompressLevel(const Image &level, bool alpha,
+	vector<unsigned char> &out)
+{
+	const unsigned int bw = (level.Width() + 3) / 4;
+	const unsigned int bh = (level.Height() + 3) / 4;
+	const unsigned int blockSize = alpha ? 16 : 8;
+	const unsigned int c = level.Components();
+	out.resize(bw * bh * blockSize);
+
+	unsigned char block[16 * 4];
+	unsigned char *dst = &out[0];
+	for (unsigned int by = 0; by < bh; by++)
+	{
+		for (unsigned int bx = 0; bx < bw; bx++)
+		{
+			// Pixels past the edges repeat the last row or column
+			for (unsigned int i = 0; i < 16; i++)
+			{
+				unsigned int x = bx * 4 + (i & 3), y = by * 4 + (i >> 2);
+				x = x < level.Width() ? x : level.Width() - 1;
+				y = y < level.Height() ? y : level.Height() - 1;
+				const unsigned char *p = level.Data() +
+					(y * level.Width() + x) * c;
+				block[i * 4] = p[0];
+				block[i * 4 + 1] = p[1];
+				block[i * 4 + 2] = p[2];
+				block[i * 4 + 3] = c == 4 ? p[3] : 255;
+			}
+			if (alpha)
+			{
+				CompressAlphaBlock(block, dst);
+				dst += 8;
+			}
+			CompressColorBlock(block, dst);
+			dst += 8;
+		}
+	}
+}
+
+/*****************************************************************************
+ * TextureFile implementation
+ *****************************************************************************/
+
+bool TextureFile::Open(const char *filename)
+{
+	Close();
+	if (!file.Open(filename))
+		return false;
+
+	const size_t size = file.Size();
+	pHeader = (const TextureFileHeader *)file.Data();
+	pLevels = (const TextureFileLevel *)(pHeader + 1);
+	bool valid = size >= sizeof(TextureFileHeader) &&
+		memcmp(pHeader->acMagic, Magic, sizeof(Magic)) == 0 &&
+		pHeader->uiVersion == Version && pHeader->uiLevels > 0 &&
+		sizeof(TextureFileHeader) +
+		pHeader->uiLevels * sizeof(TextureFileLevel) <= size;
+	for (unsigned int i = 0; valid && i < pHeader->uiLevels; i++)
+		valid = (size_t)pLevels[i].uiOffset + pLevels[i].uiSize <= size;
+	if (!valid)
+	{
+		printf("%s is not a valid texture file\n", filename);
+		Close();
+		return false;
+	}
+	return true;
+}
+
+void TextureFile::Close()
+{
+	file.Close();
+	pHeader = NULL;
+	pLevels = NULL;
+}
+
+size_t TextureFile::Bytes(unsigned int levels) const
+{
+	size_t bytes = 0;
+	for (unsigned int i = 0; i < levels && i < pHeader->uiLevels; i++)
+		bytes += pLevels[i].uiSize;
+	return bytes;
+}
+
+bool TextureFile::Upload(GLenum target, unsigned int levels) const
+{
+	if (IsCompressed() && !CompressionSupported())
+		return false;
+
+	// Rows are tightly packed
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	for (unsigned int i = 0; i < levels && i < pHeader->uiLevels; i++)
+	{
+		const TextureFileLevel &level = pLevels[i];
+		const unsigned char *data = file.Data() + level.uiOffset;
+		if (IsCompressed())
+		{
+			glCompressedTexImage2D(target, i, pHeader->uiInternalFormat,
+				level.uiWidth, level.uiHeight, 0, level.uiSize, data);
+		}
+		else
+		{
+			glTexImage2D(target, i, pHeader->uiInternalFormat, level.uiWidth,
+				level.uiHeight, 0, pHeader->uiFormat, GL_UNSIGNED_BYTE, data);
+		}
+	}
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	return true;
+}
+
+bool TextureFile::Write(const char *filename, const MipChain &chain,
+	unsigned long long sourceHash, bool compress,
+	unsigned int flags/* = FLAG_SRGB_FILTERED*/)
+{
+	assert(chain.NumLevels() > 0);
+	const Image &base = chain.Level(0);
+	const bool alpha = base.Components() == 4;
+
+	TextureFileHeader header;
+	memcpy(header.acMagic, Magic, sizeof(Magic));
+	header.uiVersion = Version;
+	header.ullSourceHash = sourceHash;
+	header.uiWidth = base.Width();
+	header.uiHeight = base.Height();
+	header.uiLevels = chain.NumLevels();
+	if (compress)
+	{
+		header.uiInternalFormat = alpha ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT :
+			GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+		header.uiFormat = 0;
+	}
+	else
+	{
+		header.uiInternalFormat = header.uiFormat = base.Format();
+	}
+	header.uiFlags = flags;
+
+	// Compressed levels are kept until written
+	vector<vector<unsigned char> > compressed(compress ? chain.NumLevels() : 0);
+	vector<TextureFileLevel> levels(chain.NumLevels());
+	unsigned int offset = sizeof(TextureFileHeader) +
+		levels.size() * sizeof(TextureFileLevel);
+	for (unsigned int i = 0; i < levels.size(); i++)
+	{
+		const Image &level = chain.Level(i);
+		if (compress)
+			CompressLevel(level, alpha, compressed[i]);
+		offset = Align(offset);
+		levels[i].uiWidth = level.Width();
+		levels[i].uiHeight = level.Height();
+		levels[i].uiOffset = offset;
+		levels[i].uiSize = compress ? compressed[i].size() : level.Bytes();
+		offset += levels[i].uiSize;
+	}
+
+	FILE *fp = fopen(filename, "wb");
+	if (!fp)
+	{
+		printf("Unable to write %s\n", filename);
+		return false;
+	}
+	bool ok = fwrite(&header, sizeof(header), 1, fp) == 1 &&
+		fwrite(&levels[0], sizeof(TextureFileLevel), levels.size(), fp) ==
+		levels.size();
+	static const unsigned char padding[Alignment] = { 0 };
+	for (unsigned int i = 0; ok && i < levels.size(); i++)
+	{
+		long pad = levels[i].uiOffset - ftell(fp);
+		const unsigned char *data = compress ? &compressed[i][0] :
+			chain.Level(i).Data();
+		ok = fwrite(padding, 1, pad, fp) == (size_t)pad &&
+			fwrite(data, 1, levels[i].uiSize, fp) == levels[i].uiSize;
+	}
+	fclose(fp);
+	if (!ok)
+		printf("Error writing %s\n", filename);
+	return ok;
+}
+
+string TextureFile::PathOf(const char *imageFile)
+{
+	string path = imageFile;
+	size_t dot = path.find_last_of('.');
+	// A dot in a directory name isn't an extension
+	if (dot != string::npos && path.find_first_of("/\\", dot) == string::npos)
+		path.erase(dot);
+	return path + ".btx";
+}
+
+bool TextureFile::CompressionSupported()
+{
+	static int supported = -1;
+	if (supported < 0)
+		supported = IsExtensionSupported("GL_EXT_texture_compression_s3tc");
+	return supported != 0;
+}
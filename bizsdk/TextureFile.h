@@ -0,0 +1,103 @@
+/*****************************************************************************
+ * Filename			TextureFile.h
+ *
+ * License			GPLv3
+ *
+ * Author			Andrea Bizzotto (bizz84@gmail.com)
+ *
+ * Platform			LinuxX11 / OpenGL
+ *
+ * Description		GPU ready texture container written by TexturePack
+ *
+ *****************************************************************************/
+
+#ifndef _TEXTURE_FILE_H_
+#define _TEXTURE_FILE_H_
+
+#include "Extensions.h"
+#include "Misc.h"
+
+#include <string>
+using namespace std;
+
+class MipChain;
+
+//! Header of a .btx file
+/*!
+ The header is followed by uiLevels TextureFileLevel entries and by the
+ data of the levels, each at a 16 byte aligned offset, ready for
+ glTexImage2D() (rows tightly packed) or glCompressedTexImage2D().
+ Values are stored in the byte order of the machine that wrote the file.
+ */
+struct TextureFileHeader
+{
+	char acMagic[4];
+	unsigned int uiVersion;
+	//! Hash64() of the image file the texture was made from
+	unsigned long long ullSourceHash;
+	unsigned int uiWidth;
+	unsigned int uiHeight;
+	unsigned int uiLevels;
+	//! Internal format: GL_RGB, GL_RGBA or an S3TC format
+	unsigned int uiInternalFormat;
+	//! GL_RGB or GL_RGBA, 0 if compressed
+	unsigned int uiFormat;
+	unsigned int uiFlags;
+};
+
+struct TextureFileLevel
+{
+	unsigned int uiWidth;
+	unsigned int uiHeight;
+	unsigned int uiOffset;
+	unsigned int uiSize;
+};
+
+//! Memory mapped .btx file, uploaded level by level without conversions
+class TextureFile
+{
+public:
+	enum {
+		//! Levels were filtered in linear space (see Image::SRGB)
+		FLAG_SRGB_FILTERED = 1
+	};
+
+private:
+	MappedFile file;
+	const TextureFileHeader *pHeader;
+	const TextureFileLevel *pLevels;
+
+public:
+	TextureFile() : pHeader(NULL), pLevels(NULL) { }
+
+	//! Maps filename. False if it is missing, truncated or of another
+	//! version
+	bool Open(const char *filename);
+	void Close();
+
+	unsigned int Width() const { return pHeader->uiWidth; }
+	unsigned int Height() const { return pHeader->uiHeight; }
+	unsigned int NumLevels() const { return pHeader->uiLevels; }
+	unsigned long long SourceHash() const { return pHeader->ullSourceHash; }
+	bool IsCompressed() const { return pHeader->uiFormat == 0; }
+	GLenum InternalFormat() const { return pHeader->uiInternalFormat; }
+
+	//! Size of the first levels
+	size_t Bytes(unsigned int levels) const;
+
+	//! Uploads the first levels to target. False if the format isn't
+	//! supported by the driver
+	bool Upload(GLenum target, unsigned int levels) const;
+
+	//! Writes the levels of chain, compressed with S3TC if compress is set
+	static bool Write(const char *filename, const MipChain &chain,
+		unsigned long long sourceHash, bool compress,
+		unsigned int flags = FLAG_SRGB_FILTERED);
+
+	//! Container of an image file: its name with the extension replaced
+	static string PathOf(const char *imageFile);
+	//! True if the driver can upload S3TC compressed levels
+	static bool CompressionSupported();
+};
+
+#endif
@@ -0,0 +1,159 @@
+/*****************************************************************************
+ * Filename			ThreadPool.cpp
+ *
+ * License			GPLv3
+ *
+ * Author			Andrea Bizzotto (bizz84@gmail.com)
+ *
+ * Platform			LinuxX11 / OpenGL
+ *
+ * Description		Pool of worker threads for data parallel CPU tasks
+ *
+ *****************************************************************************/
+
+#include "ThreadPool.h"
+#include "Misc.h"
+
+#include <stdio.h>
+
+#ifdef __linux__
+#include <unistd.h>
+#else
+#include <windows.h>
+#endif
+
+// Upper limit to the number of threads, more don't pay off for our workloads
+static const unsigned int MaxThreads = 16;
+
+ThreadPool::ThreadPool() : aWorker(NULL), uiWorkers(0), pDone(NULL),
+	pTask(NULL), uiCount(0), bQuit(false)
+{
+
+}
+
+ThreadPool::~ThreadPool()
+{
+	Release();
+}
+
+ThreadPool &ThreadPool::Instance()
+{
+	static ThreadPool instance;
+	return instance;
+}
+
+unsigned int ThreadPool::NumProcessors()
+{
+#ifdef __linux__
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	return n > 0 ? (unsigned int)n : 1;
+#else
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwNumberOfProcessors > 0 ? info.dwNumberOfProcessors : 1;
+#endif
+}
+
+bool ThreadPool::Init()
+{
+	if (aWorker)
+		return true;
+
+	unsigned int n = NumProcessors();
+	if (n > MaxThreads)
+		n = MaxThreads;
+
+	pDone = SDL_CreateSemaphore(0);
+	aWorker = new Worker[n - 1];
+	bQuit = false;
+	for (uiWorkers = 0; uiWorkers < n - 1; uiWorkers++)
+	{
+		Worker &w = aWorker[uiWorkers];
+		w.pool = this;
+		w.index = uiWorkers + 1;
+		w.start = SDL_CreateSemaphore(0);
+		w.thread = SDL_CreateThread(WorkerMain, &w);
+		if (w.thread == NULL)
+		{
+			printf("ThreadPool: unable to create worker thread %d\n", w.index);
+			SDL_DestroySemaphore(w.start);
+			break;
+		}
+	}
+	if (Verbose(VerboseInfo))
+		printf("ThreadPool: %d worker threads\n", uiWorkers);
+	return true;
+}
+
+int ThreadPool::WorkerMain(void *data)
+{
+	Worker *w = (Worker *)data;
+	ThreadPool *pool = w->pool;
+	while (true)
+	{
+		SDL_SemWait(w->start);
+		if (pool->bQuit)
+			break;
+		pool->pTask->Run(w->index, pool->uiCount);
+		SDL_SemPost(pool->pDone);
+	}
+	return 0;
+}
+
+unsigned int ThreadPool::NumThreads()
+{
+	Init();
+	return uiWorkers + 1;
+}
+
+unsigned int ThreadPool::Execute(ThreadTask &task, unsigned int count/* = 0*/)
+{
+	unsigned int n = NumThreads();
+	if (count == 0 || count > n)
+		count = n;
+
+	pTask = &task;
+	uiCount = count;
+	// Wake up workers (job 0 is run by the caller)
+	for (unsigned int i = 1; i < count; i++)
+		SDL_SemPost(aWorker[i - 1].start);
+
+	task.Run(0, count);
+
+	for (unsigned int i = 1; i < count; i++)
+		SDL_SemWait(pDone);
+
+	pTask = NULL;
+	return count;
+}
+
+void ThreadPool::Range(unsigned int n, unsigned int index, unsigned int count,
+	unsigned int &begin, unsigned int &end)
+{
+	unsigned int size = n / count;
+	unsigned int rest = n % count;
+	// First rest ranges have one more element
+	begin = index * size + (index < rest ? index : rest);
+	end = begin + size + (index < rest ? 1 : 0);
+}
+
+void ThreadPool::Release()
+{
+	if (!aWorker)
+		return;
+
+	bQuit = true;
+	for (unsigned int i = 0; i < uiWorkers; i++)
+		SDL_SemPost(aWorker[i].start);
+	for (unsigned int i = 0; i < uiWorkers; i++)
+	{
+		SDL_WaitThread(aWorker[i].thread, NULL);
+		SDL_DestroySemaphore(aWorker[i].start);
+	}
+	SDL_DestroySemaphore(pDone);
+
+	delete [] aWorker;
+	aWorker = NULL;
+	pDone = NULL;
+	uiWorkers = 0;
+}
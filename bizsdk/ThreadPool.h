@@ -0,0 +1,93 @@
+/*****************************************************************************
+ * Filename			ThreadPool.h
+ *
+ * License			GPLv3
+ *
+ * Author			Andrea Bizzotto (bizz84@gmail.com)
+ *
+ * Platform			LinuxX11 / OpenGL
+ *
+ * Description		Pool of worker threads for data parallel CPU tasks
+ *
+ *****************************************************************************/
+
+#ifndef _THREAD_POOL_H_
+#define _THREAD_POOL_H_
+
+#ifdef __linux__
+#include <SDL/SDL_thread.h>
+#else
+#include <SDL_thread.h>
+#endif
+
+//! Interface for a task that can be split into a number of independent jobs
+class ThreadTask
+{
+public:
+	virtual ~ThreadTask() { }
+	//! Runs job number index out of count. Called concurrently.
+	virtual void Run(unsigned int index, unsigned int count) = 0;
+};
+
+//! Fixed size pool of worker threads (singleton)
+/*!
+ Workers are created on first use and sleep on a semaphore between tasks.
+ Execute() blocks until all the jobs have completed, and the calling thread
+ runs job 0 itself. Only one thread at a time is expected to call Execute().
+ */
+class ThreadPool
+{
+	//! Data passed to each worker thread
+	struct Worker
+	{
+		ThreadPool *pool;
+		unsigned int index;
+		SDL_Thread *thread;
+		SDL_sem *start;
+	};
+
+	Worker *aWorker;
+	unsigned int uiWorkers;
+	SDL_sem *pDone;
+
+	// State of the task in progress
+	ThreadTask *pTask;
+	unsigned int uiCount;
+	bool bQuit;
+
+	//! Worker thread entry point
+	static int WorkerMain(void *data);
+
+	//! Creates the worker threads if they don't exist already
+	bool Init();
+
+	//! Number of online processors
+	static unsigned int NumProcessors();
+
+	ThreadPool();
+	ThreadPool(const ThreadPool &);
+	ThreadPool &operator=(const ThreadPool &);
+public:
+	~ThreadPool();
+
+	static ThreadPool &Instance();
+
+	//! Maximum number of jobs that can run concurrently (workers + caller)
+	unsigned int NumThreads();
+
+	//! Runs task.Run(i, count) for i in [0, count) and waits for completion
+	/*!
+	 If count is 0 or greater than NumThreads(), NumThreads() jobs are run.
+	 Returns the number of jobs that have been executed.
+	 */
+	unsigned int Execute(ThreadTask &task, unsigned int count = 0);
+
+	//! Splits n items in count contiguous ranges, returns range [begin, end)
+	static void Range(unsigned int n, unsigned int index, unsigned int count,
+		unsigned int &begin, unsigned int &end);
+
+	//! Terminates all worker threads
+	void Release();
+};
+
+#endif
@@ -12,27 +12,52 @@
  *****************************************************************************/
 
 #include "VBO.h"
+#include "Misc.h"
+#include "GLStateCache.h"
+
+#include <stdio.h>
+#include <string.h>
 
 /*****************************************************************************
  * VBO class implementation
  *****************************************************************************/
+bool VBO::bUseVAO = true;
+
 VBO::VBO(void *data, GLsizei stride, unsigned int count)
-	: uiStride(stride), uiCount(count), usFlags(VERTEX_POINTER_FLAG),
+	: uiVAO(0), bVAO(bUseVAO && IsVAOSupported()),
+	uiStride(stride), uiCount(count), usFlags(VERTEX_POINTER_FLAG),
 	pVertexOffset(NULL), pNormalOffset(NULL), pColorOffset(NULL),
 	pTexCoordOffset(NULL), uiVertexSize(3), uiColorSize(3), uiTexCoordSize(2)
 {
+	GLStateCache &state = GLStateCache::Instance();
+
 	glGenBuffers(1, &uiVBO);					
-	glBindBuffer(GL_ARRAY_BUFFER_ARB, uiVBO);
+	state.BindBuffer(GL_ARRAY_BUFFER_ARB, uiVBO);
 	glBufferData(GL_ARRAY_BUFFER_ARB, stride * count, data,
 		GL_STATIC_DRAW_ARB);
 
 	// Unbind for safety
-	glBindBuffer(GL_ARRAY_BUFFER_ARB, 0);
+	state.BindBuffer(GL_ARRAY_BUFFER_ARB, 0);
 }
 
 VBO::~VBO()
 {
-	glDeleteBuffers(1, &uiVBO);
+	Invalidate();
+	GLStateCache::Instance().DeleteBuffers(1, &uiVBO);
+}
+
+bool VBO::IsVAOSupported()
+{
+	return IsExtensionSupported("GL_ARB_vertex_array_object");
+}
+
+void VBO::Invalidate()
+{
+	if (uiVAO)
+	{
+		GLStateCache::Instance().DeleteVertexArrays(1, &uiVAO);
+		uiVAO = 0;
+	}
 }
 
 void VBO::SetVertexData(unsigned int offset, unsigned int size)
@@ -40,12 +65,14 @@ void VBO::SetVertexData(unsigned int offset, unsigned int size)
 	usFlags |= VERTEX_POINTER_FLAG;
 	pVertexOffset = (void *)offset;
 	uiVertexSize = size;
+	Invalidate();
 }
 
 void VBO::SetNormalData(unsigned int offset)
 {
 	usFlags |= NORMAL_POINTER_FLAG;
 	pNormalOffset = (void *)offset;
+	Invalidate();
 }
 
 void VBO::SetColorData(unsigned int offset, unsigned int size)
@@ -53,6 +80,7 @@ void VBO::SetColorData(unsigned int offset, unsigned int size)
 	usFlags |= COLOR_POINTER_FLAG;
 	pColorOffset = (void *)offset;
 	uiColorSize = size;
+	Invalidate();
 }
 
 void VBO::SetTexCoordData(unsigned int offset, unsigned int size)
@@ -60,6 +88,7 @@ void VBO::SetTexCoordData(unsigned int offset, unsigned int size)
 	usFlags |= TEXCOORD_POINTER_FLAG;
 	pTexCoordOffset = (void *)offset;
 	uiTexCoordSize = size;
+	Invalidate();
 }
 
 
@@ -67,12 +96,23 @@ void VBO::AddEntry(ArrayFuncPointer pointer, GLint size, GLenum type,
 	unsigned int offset)
 {
 	aEntry.push_back(new VBOEntry(pointer, size, type, offset));
+	Invalidate();
 }
 
+void VBO::AddAttrib(GLint loc, GLint size, unsigned int offset)
+{
+	if (loc == -1)
+		return;
+	Attrib attrib;
+	attrib.iLoc = loc;
+	attrib.iSize = size;
+	attrib.pOffset = (void *)offset;
+	aAttrib.push_back(attrib);
+	Invalidate();
+}
 
-void VBO::Bind() const
+void VBO::SetPointers() const
 {
-	glBindBuffer(GL_ARRAY_BUFFER_ARB, uiVBO);
 	ptr_list<VBOEntry>::const_iterator iter;
 	for (iter = aEntry.begin(); iter != aEntry.end(); iter++)
 	{
@@ -95,51 +135,135 @@ void VBO::Bind() const
 	{
 		glTexCoordPointer(uiTexCoordSize, GL_FLOAT, uiStride, pTexCoordOffset);
 	}
-	glBindBuffer(GL_ARRAY_BUFFER_ARB, 0);
+	vector<Attrib>::const_iterator attrib;
+	for (attrib = aAttrib.begin(); attrib != aAttrib.end(); attrib++)
+	{
+		glEnableVertexAttribArray(attrib->iLoc);
+		glVertexAttribPointer(attrib->iLoc, attrib->iSize, GL_FLOAT, GL_FALSE,
+			uiStride, attrib->pOffset);
+	}
+}
+
+void VBO::Record() const
+{
+	GLStateCache &state = GLStateCache::Instance();
+
+	glGenVertexArrays(1, &uiVAO);
+	state.BindVertexArray(uiVAO);
+	state.BindBuffer(GL_ARRAY_BUFFER_ARB, uiVBO);
+
+	// A new VAO has all arrays disabled
+	if (usFlags & VERTEX_POINTER_FLAG)
+		glEnableClientState(GL_VERTEX_ARRAY);
+	if (usFlags & NORMAL_POINTER_FLAG)
+		glEnableClientState(GL_NORMAL_ARRAY);
+	if (usFlags & COLOR_POINTER_FLAG)
+		glEnableClientState(GL_COLOR_ARRAY);
+	if (usFlags & TEXCOORD_POINTER_FLAG)
+		glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+	SetPointers();
+
+	state.BindVertexArray(0);
+	state.BindBuffer(GL_ARRAY_BUFFER_ARB, 0);
+}
+
+void VBO::Bind() const
+{
+	GLStateCache &state = GLStateCache::Instance();
+
+	if (bVAO)
+	{
+		if (!uiVAO)
+			Record();
+		state.BindVertexArray(uiVAO);
+		return;
+	}
+
+	state.BindBuffer(GL_ARRAY_BUFFER_ARB, uiVBO);
+	SetPointers();
+	state.BindBuffer(GL_ARRAY_BUFFER_ARB, 0);
+}
+
+void VBO::Unbind() const
+{
+	if (bVAO)
+	{
+		GLStateCache::Instance().BindVertexArray(0);
+		return;
+	}
+
+	vector<Attrib>::const_iterator attrib;
+	for (attrib = aAttrib.begin(); attrib != aAttrib.end(); attrib++)
+		glDisableVertexAttribArray(attrib->iLoc);
 }
 
 void VBO::Bind(ArrayFuncPointer funcPointer, GLint size, GLenum type,
 	unsigned int offset) const
 {
-	glBindBuffer(GL_ARRAY_BUFFER_ARB, uiVBO);
+	GLStateCache &state = GLStateCache::Instance();
+
+	state.BindBuffer(GL_ARRAY_BUFFER_ARB, uiVBO);
 	(*funcPointer)(size, type, uiStride, (void *)offset);
-	glBindBuffer(GL_ARRAY_BUFFER_ARB, 0);
+	state.BindBuffer(GL_ARRAY_BUFFER_ARB, 0);
 }
 
 void VBO::Render(GLenum mode) const
 {
 	Bind();
 	Draw(mode);
+	Unbind();
 }
 void VBO::Draw(GLenum mode) const
 {
 	glDrawArrays(mode, 0, GetCount());
 }
 
+void VBO::DrawInstanced(GLenum mode, unsigned int instances) const
+{
+	glDrawArraysInstancedARB(mode, 0, GetCount(), instances);
+}
+
 /*****************************************************************************
  * IndexedVBO class implementation
  *****************************************************************************/
 IndexedVBO::IndexedVBO(void *data, GLsizei stride, unsigned int count,
-	void *indices, unsigned int elements)
-	: VBO(data, stride, count), uiElements(elements)
+	void *indices, unsigned int elements,
+	GLenum indexType/* = GL_UNSIGNED_INT*/)
+	: VBO(data, stride, count), uiElements(elements), eIndexType(indexType)
 {
+	GLStateCache &state = GLStateCache::Instance();
+
 	// Load The Indices
 	glGenBuffers( 1, &uiIndexVBO );
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER_ARB, uiIndexVBO);
+	state.BindBuffer(GL_ELEMENT_ARRAY_BUFFER_ARB, uiIndexVBO);
 	glBufferData(GL_ELEMENT_ARRAY_BUFFER_ARB,
-		elements * sizeof(GL_UNSIGNED_INT), indices, GL_STATIC_DRAW_ARB );	
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER_ARB, 0);
+		elements * IndexSize(eIndexType), indices, GL_STATIC_DRAW_ARB );	
+	state.BindBuffer(GL_ELEMENT_ARRAY_BUFFER_ARB, 0);
+}
+
+void IndexedVBO::Record() const
+{
+	GLStateCache &state = GLStateCache::Instance();
+
+	VBO::Record();
+	state.BindVertexArray(uiVAO);
+	state.BindBuffer(GL_ELEMENT_ARRAY_BUFFER_ARB, uiIndexVBO);
+	state.BindVertexArray(0);
 }
 
 void IndexedVBO::Bind() const
 {
 	VBO::Bind();
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER_ARB, uiIndexVBO);
+	if (!bVAO)
+		GLStateCache::Instance().BindBuffer(GL_ELEMENT_ARRAY_BUFFER_ARB,
+			uiIndexVBO);
 }	
 
 void IndexedVBO::Unbind() const
 {
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER_ARB, 0);
+	if (!bVAO)
+		GLStateCache::Instance().BindBuffer(GL_ELEMENT_ARRAY_BUFFER_ARB, 0);
+	VBO::Unbind();
 }
 
 void IndexedVBO::Render(GLenum mode) const
@@ -151,7 +275,342 @@ void IndexedVBO::Render(GLenum mode) const
 
 void IndexedVBO::Draw(GLenum mode) const
 {
-	// TODO: Use a member variable to switch between GL_UNSIGNED_INT and
-	// GL_UNSIGNED_SHORT
-	glDrawElements(mode, GetElements(), GL_UNSIGNED_INT, 0);
+	glDrawElements(mode, GetElements(), eIndexType, 0);
+}
+
+void IndexedVBO::DrawInstanced(GLenum mode, unsigned int instances) const
+{
+	glDrawElementsInstancedARB(mode, GetElements(), eIndexType, 0,
+		instances);
+}
+
+/*****************************************************************************
+ * InstanceVBO class implementation
+ *****************************************************************************/
+InstanceVBO::InstanceVBO(GLsizei stride) : uiStride(stride), uiCount(0)
+{
+	glGenBuffers(1, &uiVBO);
+}
+
+InstanceVBO::~InstanceVBO()
+{
+	GLStateCache::Instance().DeleteBuffers(1, &uiVBO);
+}
+
+void InstanceVBO::AddAttrib(GLint loc, GLint size, unsigned int offset)
+{
+	if (loc == -1)
+		return;
+	Attrib attrib;
+	attrib.iLoc = loc;
+	attrib.iSize = size;
+	attrib.pOffset = (void *)offset;
+	aAttrib.push_back(attrib);
+}
+
+void InstanceVBO::Update(const void *data, unsigned int count)
+{
+	GLStateCache &state = GLStateCache::Instance();
+
+	uiCount = count;
+	state.BindBuffer(GL_ARRAY_BUFFER_ARB, uiVBO);
+	// Orphan previous storage
+	glBufferData(GL_ARRAY_BUFFER_ARB, uiStride * count, NULL,
+		GL_STREAM_DRAW_ARB);
+	if (count)
+		glBufferSubData(GL_ARRAY_BUFFER_ARB, 0, uiStride * count, data);
+	state.BindBuffer(GL_ARRAY_BUFFER_ARB, 0);
+}
+
+void InstanceVBO::Bind(unsigned int first/* = 0*/) const
+{
+	GLStateCache &state = GLStateCache::Instance();
+
+	const char *base = (const char *)0 + first * uiStride;
+	state.BindBuffer(GL_ARRAY_BUFFER_ARB, uiVBO);
+	vector<Attrib>::const_iterator iter;
+	for (iter = aAttrib.begin(); iter != aAttrib.end(); iter++)
+	{
+		glEnableVertexAttribArray(iter->iLoc);
+		glVertexAttribPointer(iter->iLoc, iter->iSize, GL_FLOAT, GL_FALSE,
+			uiStride, base + (size_t)iter->pOffset);
+		glVertexAttribDivisorARB(iter->iLoc, 1);
+	}
+	state.BindBuffer(GL_ARRAY_BUFFER_ARB, 0);
+}
+
+void InstanceVBO::Unbind() const
+{
+	vector<Attrib>::const_iterator iter;
+	for (iter = aAttrib.begin(); iter != aAttrib.end(); iter++)
+	{
+		glVertexAttribDivisorARB(iter->iLoc, 0);
+		glDisableVertexAttribArray(iter->iLoc);
+	}
+}
+
+bool InstanceVBO::IsSupported()
+{
+	return IsExtensionSupported("GL_ARB_instanced_arrays") &&
+		IsExtensionSupported("GL_ARB_draw_instanced");
+}
+
+/*****************************************************************************
+ * StreamingVBO class implementation
+ *****************************************************************************/
+// Offsets are aligned so that any vertex format can start at them
+static const unsigned int StreamAlignment = 16;
+
+static unsigned int StreamAlign(unsigned int size)
+{
+	return (size + StreamAlignment - 1) & ~(StreamAlignment - 1);
+}
+
+StreamingVBO::StreamingVBO(unsigned int regionSize)
+	: eStrategy(ChooseStrategy()), uiRegionSize(StreamAlign(regionSize)),
+	uiRegion(0), uiOffset(0), uiMapOffset(0), uiMapSize(0), bStaged(false),
+	bLost(false), bReported(false), uiStalls(0)
+{
+	GLStateCache &state = GLStateCache::Instance();
+
+	for (unsigned int i = 0; i < NUM_REGIONS; i++)
+		aFence[i] = NULL;
+
+	glGenBuffers(1, &uiVBO);
+	state.BindBuffer(GL_ARRAY_BUFFER_ARB, uiVBO);
+	glBufferData(GL_ARRAY_BUFFER_ARB, NUM_REGIONS * uiRegionSize, NULL,
+		GL_STREAM_DRAW_ARB);
+	state.BindBuffer(GL_ARRAY_BUFFER_ARB, 0);
+}
+
+StreamingVBO::~StreamingVBO()
+{
+	DeleteFences();
+	GLStateCache::Instance().DeleteBuffers(1, &uiVBO);
+}
+
+StreamingVBO::Strategy StreamingVBO::ChooseStrategy()
+{
+	if (IsExtensionSupported("GL_ARB_map_buffer_range") &&
+		IsExtensionSupported("GL_ARB_sync"))
+	{
+		return MAP_UNSYNCHRONIZED;
+	}
+	return ORPHAN;
+}
+
+void StreamingVBO::DeleteFences()
+{
+	for (unsigned int i = 0; i < NUM_REGIONS; i++)
+	{
+		if (aFence[i])
+		{
+			glDeleteSync(aFence[i]);
+			aFence[i] = NULL;
+		}
+	}
+}
+
+void StreamingVBO::Grow(unsigned int size)
+{
+	GLStateCache &state = GLStateCache::Instance();
+
+	while (uiRegionSize < size)
+		uiRegionSize *= 2;
+
+	// The new storage is not in use by the GPU, so no fence is needed
+	DeleteFences();
+	state.BindBuffer(GL_ARRAY_BUFFER_ARB, uiVBO);
+	glBufferData(GL_ARRAY_BUFFER_ARB, NUM_REGIONS * uiRegionSize, NULL,
+		GL_STREAM_DRAW_ARB);
+	state.BindBuffer(GL_ARRAY_BUFFER_ARB, 0);
+	uiRegion = 0;
+	uiOffset = 0;
+}
+
+void StreamingVBO::NextRegion()
+{
+	GLStateCache &state = GLStateCache::Instance();
+
+	// All draw calls sourcing the current region have been issued
+	if (eStrategy == MAP_UNSYNCHRONIZED)
+		aFence[uiRegion] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+	uiRegion = (uiRegion + 1) % NUM_REGIONS;
+	uiOffset = uiRegion * uiRegionSize;
+
+	if (eStrategy == MAP_UNSYNCHRONIZED)
+	{
+		GLsync fence = aFence[uiRegion];
+		if (fence)
+		{
+			// Flush only if the GPU is still busy, so that the wait ends
+			if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+			{
+				uiStalls++;
+				while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+					1000000) == GL_TIMEOUT_EXPIRED) { }
+			}
+			glDeleteSync(fence);
+			aFence[uiRegion] = NULL;
+		}
+	}
+	else if (uiRegion == 0)
+	{
+		// Orphan the whole ring instead of writing over regions in use
+		state.BindBuffer(GL_ARRAY_BUFFER_ARB, uiVBO);
+		glBufferData(GL_ARRAY_BUFFER_ARB, NUM_REGIONS * uiRegionSize, NULL,
+			GL_STREAM_DRAW_ARB);
+		state.BindBuffer(GL_ARRAY_BUFFER_ARB, 0);
+	}
+}
+
+void *StreamingVBO::Stage(unsigned int size)
+{
+	bStaged = true;
+	// Never empty, so that the pointer is valid even for 0 bytes
+	if (aStaging.size() < size || aStaging.empty())
+		aStaging.resize(size ? size : 1);
+	return &aStaging[0];
+}
+
+void StreamingVBO::Report(const char *message, unsigned int size)
+{
+	if (!bReported)
+	{
+		printf("StreamingVBO: %s (%d bytes)\n", message, size);
+		bReported = true;
+	}
+}
+
+void *StreamingVBO::Map(unsigned int size)
+{
+	GLStateCache &state = GLStateCache::Instance();
+
+	// Nothing to write: no range is mapped and Unmap() copies nothing
+	if (size == 0)
+	{
+		uiMapOffset = uiOffset;
+		uiMapSize = 0;
+		return Stage(0);
+	}
+
+	size = StreamAlign(size);
+	if (size > uiRegionSize)
+		Grow(size);
+	else if (uiOffset + size > (uiRegion + 1) * uiRegionSize)
+		NextRegion();
+
+	uiMapOffset = uiOffset;
+	uiMapSize = size;
+
+	if (eStrategy == ORPHAN)
+		return Stage(size);
+
+	state.BindBuffer(GL_ARRAY_BUFFER_ARB, uiVBO);
+	void *ptr = glMapBufferRange(GL_ARRAY_BUFFER_ARB, uiMapOffset, size,
+		GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT |
+		GL_MAP_INVALIDATE_RANGE_BIT);
+	state.BindBuffer(GL_ARRAY_BUFFER_ARB, 0);
+	if (ptr == NULL)
+	{
+		// Out of memory, or the driver refused the range: copied by Unmap()
+		Report("unable to map, copying instead", size);
+		return Stage(size);
+	}
+	bStaged = false;
+	return ptr;
+}
+
+const GLvoid *StreamingVBO::Unmap()
+{
+	GLStateCache &state = GLStateCache::Instance();
+
+	bLost = false;
+	state.BindBuffer(GL_ARRAY_BUFFER_ARB, uiVBO);
+	if (bStaged)
+	{
+		if (uiMapSize)
+		{
+			glBufferSubData(GL_ARRAY_BUFFER_ARB, uiMapOffset, uiMapSize,
+				&aStaging[0]);
+		}
+	}
+	else if (!glUnmapBuffer(GL_ARRAY_BUFFER_ARB))
+	{
+		// The GL dropped the mapping (e.g. on a mode switch), and may do it
+		// again: copies from system memory can't be lost
+		Report("buffer contents lost, copying from now on", uiMapSize);
+		bLost = true;
+		DeleteFences();
+		eStrategy = ORPHAN;
+	}
+	state.BindBuffer(GL_ARRAY_BUFFER_ARB, 0);
+
+	uiOffset += uiMapSize;
+	return (const char *)0 + uiMapOffset;
+}
+
+const GLvoid *StreamingVBO::Upload(const void *data, unsigned int size)
+{
+	memcpy(Map(size), data, size);
+	const GLvoid *offset = Unmap();
+	// Streamed again through the staging copy
+	if (bLost)
+	{
+		memcpy(Map(size), data, size);
+		offset = Unmap();
+	}
+	return offset;
+}
+
+void StreamingVBO::Bind() const
+{
+	GLStateCache::Instance().BindBuffer(GL_ARRAY_BUFFER_ARB, uiVBO);
+}
+
+void StreamingVBO::Unbind() const
+{
+	GLStateCache::Instance().BindBuffer(GL_ARRAY_BUFFER_ARB, 0);
+}
+
+/*****************************************************************************
+ * UniformBuffer class implementation
+ *****************************************************************************/
+UniformBuffer::UniformBuffer(GLsizeiptr size, GLuint binding)
+	: uiSize(size), uiBinding(binding)
+{
+	GLStateCache &state = GLStateCache::Instance();
+
+	glGenBuffers(1, &uiUBO);
+	state.BindBuffer(GL_UNIFORM_BUFFER, uiUBO);
+	glBufferData(GL_UNIFORM_BUFFER, uiSize, NULL, GL_DYNAMIC_DRAW);
+	state.BindBuffer(GL_UNIFORM_BUFFER, 0);
+	Bind();
+}
+
+UniformBuffer::~UniformBuffer()
+{
+	GLStateCache::Instance().DeleteBuffers(1, &uiUBO);
+}
+
+void UniformBuffer::Update(const void *data)
+{
+	GLStateCache &state = GLStateCache::Instance();
+
+	state.BindBuffer(GL_UNIFORM_BUFFER, uiUBO);
+	// Orphan previous storage, the last frame may still be reading it
+	glBufferData(GL_UNIFORM_BUFFER, uiSize, NULL, GL_DYNAMIC_DRAW);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, uiSize, data);
+	state.BindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void UniformBuffer::Bind() const
+{
+	glBindBufferBase(GL_UNIFORM_BUFFER, uiBinding, uiUBO);
+}
+
+bool UniformBuffer::IsSupported()
+{
+	return IsExtensionSupported("GL_ARB_uniform_buffer_object");
 }
@@ -19,6 +19,9 @@
 #include "boost/ptr_container/ptr_list.hpp"
 using namespace boost;
 
+#include <vector>
+using namespace std;
+
 //! Type defining the a function pointer used to specify a vertex array.
 //! Functions like glVertexPointer have such signature
 typedef void (*ArrayFuncPointer)(GLint size, GLenum type, GLsizei stride,
@@ -43,6 +46,10 @@ enum {
  Only generic vertex pointers should be specified in recent versions of the GL
  spec, although this class provides backwards compatibility with the old
  "glVertexPointer" type calls.
+ If vertex array objects are supported, the layout is recorded into a VAO the
+ first time the VBO is bound, so that binding is a single call. Every Bind()
+ must then be paired with an Unbind() before client side arrays are used
+ again, or they would be recorded into the VAO too.
  */
 class VBO
 {
@@ -80,9 +87,22 @@ protected:
 	};
 	//! List of entries to be called
 	ptr_list<VBOEntry> aEntry;
+
+	//! Generic float attribute
+	struct Attrib
+	{
+		GLint iLoc;
+		GLint iSize;
+		void *pOffset;
+	};
+	vector<Attrib> aAttrib;
 	
 	//! Handle returned by GL when creating the VBO
 	GLuint uiVBO;
+	//! Vertex array object recording the layout (0 until first bound)
+	mutable GLuint uiVAO;
+	//! True if the layout is recorded into a VAO
+	bool bVAO;
 	//! Stride
 	GLsizei uiStride;
 	//! Number of elements (this is multiplied by the stride when creating the
@@ -100,6 +120,15 @@ protected:
 	//! Sizes of the standard vertex array elements (normally 2, 3 or 4)
 	unsigned int uiVertexSize, uiColorSize, uiTexCoordSize;
 
+	//! Specifies all the arrays with the VBO bound
+	void SetPointers() const;
+	//! Records the layout into uiVAO
+	virtual void Record() const;
+	//! Deletes the VAO, so that it is recorded again with the new layout
+	void Invalidate();
+
+	//! Set with EnableVAO()
+	static bool bUseVAO;
 
 public:
 	//! Constructor
@@ -107,15 +136,22 @@ public:
 	virtual ~VBO();
 
 	//! Adds an additional vertex array
+	/*!
+	 The corresponding client state is not enabled by the VBO
+	 */
 	void AddEntry(ArrayFuncPointer pointer, GLint size, GLenum type,
 		unsigned int offset);
+	//! Adds a generic float attribute. Location -1 is ignored
+	void AddAttrib(GLint loc, GLint size, unsigned int offset);
 		
 	//! Binds the VBO
 	/*!
 	 Binds the VBO and all the corresponding arrays (standard ones + all the
-	 entries originally added with AddEntry()
+	 entries originally added with AddEntry() and AddAttrib()
 	 */
 	virtual void Bind() const;
+	//! Restores the state changed by Bind()
+	virtual void Unbind() const;
 	//! Binds an array passed at runtime
 	virtual void Bind(ArrayFuncPointer funcPointer, GLint size, GLenum type,
 		unsigned int offset) const;
@@ -132,6 +168,11 @@ public:
 	 the first call.
 	 */
 	virtual void Draw(GLenum mode) const;
+	//! Calls glDrawArraysInstanced
+	/*!
+	 Requires instanced arrays support (see InstanceVBO::IsSupported())
+	 */
+	virtual void DrawInstanced(GLenum mode, unsigned int instances) const;
 
 	//! Sets the vertex data values used when binding
 	void SetVertexData(unsigned int offset = 0, unsigned int size = 3);
@@ -151,6 +192,14 @@ public:
 
 	//! Returns handle to VBO
 	const GLuint GetVBO() const { return uiVBO; }
+	//! True if the layout is recorded into a VAO
+	const bool UsesVAO() const { return bVAO; }
+
+	//! Returns true if vertex array objects are supported by the GL
+	static bool IsVAOSupported();
+	//! Enables or disables VAOs for the VBOs created afterwards (enabled by
+	//! default if supported)
+	static void EnableVAO(bool enable) { bUseVAO = enable; }
 };
 
 //! Class defining an indexed Vertex Buffer Object
@@ -165,14 +214,23 @@ protected:
 	GLuint uiIndexVBO;
 	//! Number of elements in the index array
 	unsigned int uiElements;
+	//! GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+	GLenum eIndexType;
+
+	//! The element array buffer is part of the VAO state
+	virtual void Record() const;
 public:
 	//! Constructor
+	/*!
+	 indices are of indexType: GL_UNSIGNED_SHORT halves the index buffer of
+	 meshes with up to 65536 vertices (see IndexType())
+	 */
 	IndexedVBO(void *data, GLsizei stride, unsigned int count, void *indices,
-		unsigned int elements);
+		unsigned int elements, GLenum indexType = GL_UNSIGNED_INT);
 
 	//! Binds element array buffer. Internally calls VBO::Bind()
 	virtual void Bind() const;
-	//! Unbinds the element array buffer
+	//! Unbinds the element array buffer. Internally calls VBO::Unbind()
 	virtual void Unbind() const;
 
 	//! Binds the array automatically and calls glDrawElements
@@ -187,13 +245,231 @@ public:
 	 the first call.
 	 */
 	virtual void Draw(GLenum mode) const;
+	//! Calls glDrawElementsInstanced
+	virtual void DrawInstanced(GLenum mode, unsigned int instances) const;
 
 	//! Getter for the number of elements
 	const unsigned int GetElements() const { return uiElements; }
+	//! Type of the indices
+	const GLenum GetIndexType() const { return eIndexType; }
+
+	//! Smallest index type addressing count vertices
+	static GLenum IndexType(unsigned int count)
+	{
+		return count <= 0x10000 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+	}
+	//! Size in bytes of an index of type
+	static unsigned int IndexSize(GLenum type)
+	{
+		return type == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+	}
 
 	//! Returns handle to VBO index buffer
 	const GLuint GetIndexedVBO() const { return uiIndexVBO; }
 };
 
+//! Class defining a buffer of per-instance vertex attributes
+/*!
+ InstanceVBO stores one record per instance, to be used together with a VBO
+ or IndexedVBO holding the shared geometry and drawn with DrawInstanced().
+ The content is respecified with Update(), normally once per frame: the
+ previous storage is orphaned so that the upload doesn't wait for the GPU to
+ finish with it.
+ All attributes are generic float attributes with a divisor of 1, so that
+ each record is used for all the vertices of one instance.
+ */
+class InstanceVBO
+{
+protected:
+	//! Generic attribute sourced from the buffer
+	struct Attrib
+	{
+		GLint iLoc;
+		GLint iSize;
+		void *pOffset;
+	};
+	vector<Attrib> aAttrib;
+
+	//! Handle returned by GL when creating the VBO
+	GLuint uiVBO;
+	//! Size in bytes of an instance record
+	GLsizei uiStride;
+	//! Number of instances stored by the last Update()
+	unsigned int uiCount;
+
+public:
+	//! Constructor
+	InstanceVBO(GLsizei stride);
+	~InstanceVBO();
+
+	//! Adds a float attribute of the given size at offset in the record
+	/*!
+	 Attributes with location -1 (not used by the shader) are ignored
+	 */
+	void AddAttrib(GLint loc, GLint size, unsigned int offset);
+
+	//! Uploads count records
+	void Update(const void *data, unsigned int count);
+
+	//! Enables the attributes and sets their divisor
+	/*!
+	 Attributes are sourced starting from record first, so that a range of
+	 instances can be drawn without a base instance parameter
+	 */
+	void Bind(unsigned int first = 0) const;
+	//! Disables the attributes and resets their divisor
+	void Unbind() const;
+
+	//! Number of instances stored by the last Update()
+	const unsigned int GetCount() const { return uiCount; }
+
+	//! Returns true if instanced arrays are supported by the GL
+	static bool IsSupported();
+};
+
+//! Class defining a ring buffer for vertex data respecified every frame
+/*!
+ StreamingVBO replaces client side arrays for dynamic geometry. Callers get a
+ write pointer with Map(), fill it and call Unmap(), which returns the offset
+ of the data in the buffer: while the buffer is bound, it is passed to the
+ gl*Pointer() calls in place of the client pointer.
+ Upload() does the same starting from an existing array.
+
+ The buffer is split in NUM_REGIONS regions used in turn, so that the CPU
+ writes to one region while the GPU is still reading the others. The strategy
+ is chosen at construction depending on the GL capabilities:
+ - MAP_UNSYNCHRONIZED (GL_ARB_map_buffer_range and GL_ARB_sync): the data is
+   written directly into the buffer with unsynchronized maps. A fence is
+   inserted when leaving a region and waited for before writing to it again,
+   which only blocks if the GPU is NUM_REGIONS - 1 regions behind.
+ - ORPHAN: the data is written to system memory and copied with
+   glBufferSubData(). The storage is orphaned when the ring wraps around, so
+   that the regions still in use are never overwritten.
+ If a map fails, that write falls back to the system memory copy of ORPHAN.
+
+ Draw calls sourcing a range must be issued before the next Map(), since it
+ can move to another region. Allocations larger than a region grow the
+ buffer.
+ */
+class StreamingVBO
+{
+public:
+	enum Strategy { MAP_UNSYNCHRONIZED, ORPHAN };
+	enum { NUM_REGIONS = 3 };
+
+protected:
+	//! Handle returned by GL when creating the VBO
+	GLuint uiVBO;
+	//! Strategy used to write the data
+	Strategy eStrategy;
+	//! Size in bytes of a region
+	unsigned int uiRegionSize;
+	//! Current region and write offset (in bytes from the start of the buffer)
+	unsigned int uiRegion;
+	unsigned int uiOffset;
+	//! Fences inserted when leaving each region (MAP_UNSYNCHRONIZED only)
+	GLsync aFence[NUM_REGIONS];
+	//! Range written by the current Map()
+	unsigned int uiMapOffset;
+	unsigned int uiMapSize;
+	//! System memory copy written by Map() (ORPHAN, or if mapping failed)
+	vector<char> aStaging;
+	//! True if the current Map() returned aStaging
+	bool bStaged;
+	//! True if the last Unmap() could not keep the data
+	bool bLost;
+	//! True once a failure has been reported, so that it isn't every frame
+	bool bReported;
+	//! Number of times the CPU had to wait for the GPU
+	unsigned int uiStalls;
+
+	//! Reallocates the buffer so that a region holds at least size bytes
+	void Grow(unsigned int size);
+	//! Moves to the next region, waiting for the GPU to be done with it
+	void NextRegion();
+	//! Returns aStaging, holding at least size bytes, for Unmap() to copy
+	void *Stage(unsigned int size);
+	//! Prints message the first time something fails
+	void Report(const char *message, unsigned int size);
+	void DeleteFences();
+
+public:
+	//! Constructor. regionSize is the size in bytes of the data normally
+	//! written in one frame
+	StreamingVBO(unsigned int regionSize);
+	~StreamingVBO();
+
+	//! Returns a pointer where size bytes can be written (write only)
+	void *Map(unsigned int size);
+	//! Ends the write started by Map() and returns the offset of the data,
+	//! to be used as pointer in the gl*Pointer() calls
+	const GLvoid *Unmap();
+	//! True if the data of the last Unmap() is undefined (the GL lost the
+	//! mapped buffer): the draw using it must be skipped. Later writes are
+	//! staged, so they can't be lost
+	bool ContentsLost() const { return bLost; }
+	//! Copies size bytes into the buffer. Returns the offset as Unmap().
+	//! Data lost on unmapping is written again, so it never is
+	const GLvoid *Upload(const void *data, unsigned int size);
+
+	//! Binds the buffer, so that the gl*Pointer() calls take offsets
+	void Bind() const;
+	//! Unbinds the buffer, restoring client side arrays
+	void Unbind() const;
+
+	//! Returns handle to VBO
+	const GLuint GetVBO() const { return uiVBO; }
+	//! Strategy in use: ORPHAN from the first time contents are lost
+	const Strategy GetStrategy() const { return eStrategy; }
+	//! Number of times the CPU had to wait for the GPU
+	const unsigned int GetStalls() const { return uiStalls; }
+
+	//! Returns the best strategy supported by the GL
+	static Strategy ChooseStrategy();
+};
+
+/*****************************************************************************
+ * UniformBuffer class definition
+ *****************************************************************************/
+
+//! Class defining a uniform buffer object shared by several programs
+/*!
+ The buffer backs a uniform block laid out with std140 rules: the CPU struct
+ passed to Update() must match it, i.e. vec4 and mat4 members are aligned to
+ 16 bytes and array elements (even float ones) take 16 bytes each.
+ Programs are attached to the buffer with
+ GLResourceManager::BindUniformBlock(), with the same binding point.
+
+ Update() is meant to be called once per frame, before the first draw call
+ using the block.
+ */
+class UniformBuffer
+{
+protected:
+	//! Handle returned by GL when creating the buffer
+	GLuint uiUBO;
+	//! Size in bytes of the block
+	GLsizeiptr uiSize;
+	//! Binding point used by the programs
+	GLuint uiBinding;
+
+public:
+	//! Constructor. Allocates size bytes and attaches them to binding
+	UniformBuffer(GLsizeiptr size, GLuint binding);
+	~UniformBuffer();
+
+	//! Uploads the whole block
+	void Update(const void *data);
+	//! Attaches the buffer to its binding point again (needed only if the
+	//! binding point has been used by another buffer)
+	void Bind() const;
+
+	const GLsizeiptr GetSize() const { return uiSize; }
+	const GLuint GetBinding() const { return uiBinding; }
+
+	//! Returns true if uniform buffer objects are supported by the GL
+	static bool IsSupported();
+};
+
 #endif
 
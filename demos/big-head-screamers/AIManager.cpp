@@ -13,18 +13,25 @@
 
 #include "AIManager.h"
 #include "Misc.h" // Used for RandRange()
-#include "Enemy.h" // for NUM_SPRITES
+#include "Enemy.h"
 #include "ParticleEmitter.h"
 #include "Settings.h"
 
+#include <assert.h>
+
 Enemy *AIManager::NewEnemy(const Vector2 &p, const int health,
 		const int index1, const int index2)
 {
 	return new SpriteEnemy(p, health, index1, index2);
 }
 
-AIManager::AIManager(const Vector3 &player)
+AIManager::AIManager(const Vector3 &player,
+		unsigned int numSprites/* = EnemyRenderer::NUM_SPRITES*/) :
+	uiNumParticles(0),
+	uiBloodDrops(Settings::Instance().NumBloodDrops),
+	uiMaxParticles(Settings::Instance().MaxParticles)
 {
+	assert(numSprites >= 2);
 	float maxd = Settings::Instance().EnemyMaxDistance;
 	// Create an array of enemies around the player
 	const Vector2 target = Vector2(player[0], player[2]);
@@ -36,7 +43,7 @@ AIManager::AIManager(const Vector3 &player)
 		if ((pos - target).Length() < Settings::Instance().EnemyMinDistance)
 			continue;
 		// TODO: Used for sprite enemies. Move somewhere else in the factory.
-		int texture = (rand() % (EnemyRenderer::NUM_SPRITES >> 1));
+		int texture = (rand() % (numSprites >> 1));
 		data.push_back(NewEnemy(pos + target, Settings::Instance().EnemyHealth,
 			texture << 1, (texture << 1) + 1));
 		i++;
@@ -97,9 +104,35 @@ bool ExpiredCondition(const ParticleEmitter &particle)
 	return particle.Expired();
 }
 
+void AIManager::Bleed(const Point3 &pos)
+{
+	if (uiBloodDrops && uiNumParticles + uiBloodDrops <= uiMaxParticles)
+	{
+		particles.push_back(new BloodDropEmitter(pos, uiBloodDrops));
+		uiNumParticles += uiBloodDrops;
+	}
+}
+
 void AIManager::AddParticles(const Point3 &pos, const unsigned int health)
 {
-	particles.push_back(new BloodDropEmitter(pos, Settings::Instance().NumBloodDrops));
+	Bleed(pos);
+}
+
+void AIManager::SetLiveEnemies(unsigned int n, const Vector3 &player)
+{
+	// Park enemies from the back, so that the others keep their index
+	while (data.size() > n && !data.empty())
+	{
+		parked.transfer(parked.end(), data.end() - 1, data);
+	}
+	// Bring back parked enemies at a new position
+	const Vector2 target = Vector2(player[0], player[2]);
+	while (data.size() < n && !parked.empty())
+	{
+		data.transfer(data.end(), parked.end() - 1, parked);
+		ptr_vector<Enemy>::iterator iter = data.end() - 1;
+		Spawn(iter, target);
+	}
 }
 
 
@@ -114,11 +147,16 @@ void AIManager::UpdateState(const Vector3 &player)
 		{
 			// Some more blood never hurts
 			Vector3 pos = Vector3(iter->pos[0], 0.75 * Settings::Instance().EnemyHeight, iter->pos[1]);
-			particles.push_back(new BloodDropEmitter(pos, Settings::Instance().NumBloodDrops));
+			Bleed(pos);
 			// New position
 			Spawn(iter, target);
 		}
 	}
 	// FIXME: This causes memory leaks!!
 	particles.erase_if(ExpiredCondition);	
+
+	uiNumParticles = 0;
+	ptr_list<ParticleEmitter>::const_iterator e;
+	for (e = particles.begin(); e != particles.end(); e++)
+		uiNumParticles += e->GetNumParticles();
 }
\ No newline at end of file
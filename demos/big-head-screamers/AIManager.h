@@ -16,6 +16,7 @@
 
 #include "Extensions.h"
 #include "Vector.h"
+#include "Enemy.h"
 
 #include <vector>
 #include <list>
@@ -27,7 +28,6 @@ using namespace boost;
 
 
 class ParticleEmitter;
-class Enemy;
 
 
 // AIManager defines the generation and update logic of enemies.
@@ -43,13 +43,25 @@ class AIManager
 	// Vector containing all the enemies
 	ptr_vector<Enemy> data;
 
+	// Enemies removed from the game by SetLiveEnemies()
+	ptr_vector<Enemy> parked;
+
 	// Blood
 	ptr_list<ParticleEmitter> particles;
+	// Live particles, drops per emitter and upper limit of live particles
+	unsigned int uiNumParticles;
+	unsigned int uiBloodDrops;
+	unsigned int uiMaxParticles;
 
 	// Spawn new enemy
 	void Spawn(ptr_vector<Enemy>::iterator &iter, const Vector2 &player);
+
+	// Adds a blood emitter unless the particle budget is exhausted
+	void Bleed(const Point3 &pos);
 public:
-	AIManager(const Vector3 &player);
+	// Enemy types are picked among numSprites / 2 pairs of sprites
+	AIManager(const Vector3 &player,
+		unsigned int numSprites = EnemyRenderer::NUM_SPRITES);
 	~AIManager();
 
 	// Update of all enemy positions
@@ -64,6 +76,12 @@ public:
 	const ptr_list<ParticleEmitter> &GetParticles() const { return particles; }
 
 	void AddParticles(const Point3 &pos, const unsigned int health);
+
+	// Quality settings (driven by the frame governor)
+	void SetLiveEnemies(unsigned int n, const Vector3 &player);
+	void SetBloodDrops(unsigned int n) { uiBloodDrops = n; }
+	void SetMaxParticles(unsigned int n) { uiMaxParticles = n; }
+	unsigned int GetNumParticles() const { return uiNumParticles; }
 };
 
 #endif
\ No newline at end of file
@@ -26,13 +26,17 @@
 #include "AIManager.h"
 #include "WeaponManager.h"
 #include "ParticleRenderer.h"
-#include "EnemyRendererAttrib.h"
+#include "EnemyRendererInstanced.h"
 #include "CollisionDetector.h"
+#include "TransparencyPass.h"
 
 #include "GrenadeRenderer.h"
 #include "Settings.h"
 #include "Fonts/FontGothic.h"
 #include "Fonts/FontTechno.h"
+#include "GLStateCache.h"
+#include "Image.h"
+#include "UnitTest.h"
 
 #include <iostream>
 
@@ -46,15 +50,22 @@ static const char *TimerStrings[] = {
 	"Weapons",
 	"AI",
 	"Collisions",
+	"Transparency",
 	"Enemy Renderer",
+	"Laser Renderer",
 	"Input",
 };
 
 BigHeadScreamers::BigHeadScreamers() : 
 	iShowInfo(0),
 	bReflectionFlag(false),
+	fReflectionScale(1.0f),
+	uiReflectionWidth(0),
+	uiReflectionHeight(0),
 	fSetTime(0.0f),
 	fRandomTime(0.0f),
+	fFrameBudget(0.0f),
+	uiMipmapBench(0),
 	fFOV(90.0f),
 	eCollisionType(0),
 	uiNumComparisons(0)
@@ -64,6 +75,7 @@ BigHeadScreamers::BigHeadScreamers() :
 
 	bFeatureEnabled[F_REFLECTION] = true;
 	bFeatureEnabled[F_INPUT] = true;
+	bFeatureEnabled[F_OCCLUSION] = true;
 
 	for (unsigned int i = 0; i < NUM_TIMERS; i++)
 		afTimeOf[i] = 0.0f;
@@ -81,6 +93,34 @@ bool BigHeadScreamers::InitApp()
 		{
 			iShowInfo = atoi(iter->sValue.c_str());
 		}
+		// Frame budget in milliseconds
+		else if (iter->sName == "budget")
+		{
+			fFrameBudget = atof(iter->sValue.c_str()) * 0.001f;
+		}
+		// Headless benchmark, quits when done
+		else if (iter->sName == "occlusionbench")
+		{
+			OcclusionBenchmark(atoi(iter->sValue.c_str()));
+			return false;
+		}
+		// Behavior tests of the CPU side libraries, quits when done
+		else if (iter->sName == "unittest")
+		{
+			RunTests();
+			return false;
+		}
+		// Needs a GL context, run by InitGL()
+		else if (iter->sName == "mipbench")
+		{
+			uiMipmapBench = atoi(iter->sValue.c_str());
+		}
+		// Memory of loaded textures in MB, unused ones are evicted above it
+		else if (iter->sName == "texbudget")
+		{
+			GLResourceManager::Instance().SetTextureBudget(
+				(size_t)(atof(iter->sValue.c_str()) * 1024.0 * 1024.0));
+		}
 	}	
 
 	return true;
@@ -88,13 +128,218 @@ bool BigHeadScreamers::InitApp()
 
 void BigHeadScreamers::ReloadFBO()
 {
+	uiReflectionWidth = (unsigned int)(ShellGet(SHELL_WIDTH) * fReflectionScale);
+	uiReflectionHeight = (unsigned int)(ShellGet(SHELL_HEIGHT) * fReflectionScale);
 	// Initialize fbo used for drawing reflection
 	pReflectionFBO = auto_ptr<FBO>(new FBO(GL_RGB, GL_UNSIGNED_SHORT_5_6_5,
-		ShellGet(SHELL_WIDTH), ShellGet(SHELL_HEIGHT), true));
+		uiReflectionWidth, uiReflectionHeight, true));
+}
+
+void BigHeadScreamers::InitGovernor()
+{
+	const Settings &s = Settings::Instance();
+	// PID output is in seconds of frame time error. Knob gains are such that
+	// an error of 5ms moves each knob by 1% of its range per frame
+	governor.Init(fFrameBudget, 1.0f, 0.5f, 0.0f, 1.0f);
+	governor.SetHysteresis(s.GovernorBand, s.GovernorHoldTime);
+	governor.SetSmoothing(0.8f);
+
+	const float gain = 2.0f;
+	governor.AddKnob("Blood drops", s.NumBloodDrops, s.NumBloodDrops / 10,
+		s.NumBloodDrops, gain * s.NumBloodDrops, K_BLOOD_DROPS, 1.0f);
+	governor.AddKnob("Particles", s.MaxParticles, s.MaxParticles / 20,
+		s.MaxParticles, gain * s.MaxParticles, K_PARTICLES, 1.0f);
+	governor.AddKnob("Reflection", 1.0f, 0.25f, 1.0f, gain, K_REFLECTION, 0.125f);
+	governor.AddKnob("Enemies", s.NumEnemies, s.NumEnemies / 4,
+		s.NumEnemies, gain * s.NumEnemies, K_ENEMIES, 1.0f);
+}
+
+void BigHeadScreamers::GovernorInput(float dt)
+{
+	if (fFrameBudget <= 0.0f || !governor.Update(dt, dt))
+		return;
+
+	if (governor.Changed(K_BLOOD_DROPS))
+		pAI->SetBloodDrops((unsigned int)governor.Get(K_BLOOD_DROPS));
+	if (governor.Changed(K_PARTICLES))
+		pAI->SetMaxParticles((unsigned int)governor.Get(K_PARTICLES));
+	if (governor.Changed(K_ENEMIES))
+		pAI->SetLiveEnemies((unsigned int)governor.Get(K_ENEMIES),
+			pFPSCamera->GetPosition());
+	if (governor.Changed(K_REFLECTION))
+	{
+		fReflectionScale = governor.Get(K_REFLECTION);
+		ReloadFBO();
+	}
+}
+
+// Camera turning at a constant rate (occlusion benchmark)
+class TurningCamera : public FPSCamera
+{
+public:
+	void SetAlpha(float a) { alpha = a; }
+};
+
+void BigHeadScreamers::OcclusionBenchmark(unsigned int frames) const
+{
+	if (!frames)
+		return;
+
+	const Settings &s = Settings::Instance();
+	const float dt = 1.0f / 60.0f;
+
+	TurningCamera camera;
+	camera.Init(5.0f * 20.0f, -20.0f);
+	AIManager ai(camera.GetPosition());
+	TransparencyPass tp;
+	Frustum culler;
+	OcclusionBuffer buffer;
+
+	float aspect = (float)ShellGet(SHELL_WIDTH) / (float)ShellGet(SHELL_HEIGHT);
+	Matrix4 proj = ProjectionRHInfinite(s.Fov * M_PI / 180.0f, aspect, s.Near);
+
+	// Totals over all frames, without and with occlusion culling
+	unsigned int drawn[2] = { 0, 0 };
+	float sortTime[2] = { 0.0f, 0.0f };
+	unsigned int tested = 0, occluded = 0;
+	float rasterTime = 0.0f, testTime = 0.0f;
+
+	Timer timer;
+	for (unsigned int f = 0; f < frames; f++)
+	{
+		// One full turn every 10 seconds
+		const float t = f * dt;
+		camera.SetAlpha(36.0f * t);
+		const Vector3 eye = camera.GetPosition();
+		ai.Input(t, dt, eye);
+		ai.UpdateState(eye);
+
+		// Blood on a random enemy every frame
+		const ptr_vector<Enemy> &enemies = ai.GetData();
+		if (!enemies.empty())
+		{
+			const Vector2 &p = enemies[rand() % enemies.size()].pos;
+			ai.AddParticles(Point3(p[0], s.EnemyHeight, p[1]), s.EnemyHealth);
+		}
+
+		Matrix4 viewProj = proj * camera.GetViewMatrix();
+		culler.Extract(viewProj);
+		for (unsigned int k = 0; k < 2; k++)
+		{
+			if (k)
+				buffer.Begin(viewProj, s.Near);
+			timer.Start();
+			tp.Update(enemies, s.EnemyHeight, ai.GetParticles(), camera,
+				&culler, NULL, k ? &buffer : NULL);
+			sortTime[k] += timer.Update();
+			drawn[k] += tp.NumPrimitives();
+		}
+
+		const OcclusionStats &stats = buffer.GetStats();
+		tested += stats.uiTested;
+		occluded += stats.uiOccluded;
+		rasterTime += stats.fRasterTime;
+		testTime += stats.fTestTime;
+	}
+
+	const float inv = 1.0f / frames;
+	printf("Occlusion benchmark: %d frames, %d enemies, %dx%d buffer\n",
+		frames, s.NumEnemies, buffer.GetWidth(), buffer.GetHeight());
+	printf("Primitives per frame: %.1f without occlusion, %.1f with\n",
+		drawn[0] * inv, drawn[1] * inv);
+	printf("Objects tested per frame: %.1f, occluded: %.1f (%.1f%%)\n",
+		tested * inv, occluded * inv, tested ? 100.0f * occluded / tested : 0.0f);
+	printf("Culling and sorting: %.3fms without occlusion, %.3fms with "
+		"(raster %.3fms, test %.3fms)\n", sortTime[0] * inv * 1000.0f,
+		sortTime[1] * inv * 1000.0f, rasterTime * inv * 1000.0f,
+		testTime * inv * 1000.0f);
+}
+
+// Textures of the mipmap benchmark: ground and first skybox
+static const char *MipmapBenchTextures[] = {
+	"data/textures/TiZeta_pav2.bmp",
+	"data/textures/Rore_floor-tiles2.bmp",
+	"data/textures/Skybox_faesky/faesky02left.bmp",
+	"data/textures/Skybox_faesky/faesky02right.bmp",
+	"data/textures/Skybox_faesky/faesky02up.bmp",
+	"data/textures/Skybox_faesky/faesky02down.bmp",
+	"data/textures/Skybox_faesky/faesky02back.bmp",
+	"data/textures/Skybox_faesky/faesky02front.bmp",
+};
+
+void BigHeadScreamers::MipmapBenchmark(unsigned int repeats) const
+{
+	if (!repeats)
+		return;
+
+	GLStateCache &state = GLStateCache::Instance();
+	const unsigned int n = sizeof(MipmapBenchTextures) / sizeof(char *);
+
+	// GLU, MipChain on one thread, MipChain on the ThreadPool
+	float time[3] = { 0.0f, 0.0f, 0.0f };
+	unsigned int loaded = 0;
+	size_t bytes = 0;
+
+	GLuint texture;
+	glGenTextures(1, &texture);
+	state.BindTexture(GL_TEXTURE_2D, texture);
+
+	Timer timer;
+	for (unsigned int i = 0; i < n; i++)
+	{
+		SDL_Surface *surface;
+		GLenum format;
+		GLint components;
+		if (!LoadImage(MipmapBenchTextures[i], surface, format, components))
+			continue;
+		loaded++;
+
+		// Uploads are included, and finished, since GLU converts while
+		// uploading
+		for (unsigned int r = 0; r < repeats; r++)
+		{
+			timer.Start();
+			gluBuild2DMipmaps(GL_TEXTURE_2D, components, surface->w,
+				surface->h, format, GL_UNSIGNED_BYTE, surface->pixels);
+			glFinish();
+			time[0] += timer.Update();
+
+			for (unsigned int k = 0; k < 2; k++)
+			{
+				timer.Start();
+				MipChain chain;
+				chain.Base().FromSurface(surface);
+				chain.Build(Image::SRGB | (k ? Image::PARALLEL : 0));
+				chain.Upload(GL_TEXTURE_2D);
+				glFinish();
+				time[1 + k] += timer.Update();
+				if (r == 0 && k == 0)
+					bytes += chain.Bytes();
+			}
+		}
+		SDL_FreeSurface(surface);
+	}
+	state.DeleteTextures(1, &texture);
+
+	if (!loaded)
+		return;
+	const float inv = 1000.0f / repeats;
+	printf("Mipmap benchmark: %d textures, %.1f MB with mipmaps, "
+		"%d repetitions\n", loaded, bytes / (1024.0f * 1024.0f), repeats);
+	printf("gluBuild2DMipmaps %.2fms, MipChain %.2fms (x%.1f), "
+		"parallel %.2fms (x%.1f)\n", time[0] * inv, time[1] * inv,
+		time[1] > 0.0f ? time[0] / time[1] : 0.0f, time[2] * inv,
+		time[2] > 0.0f ? time[0] / time[2] : 0.0f);
 }
 
 bool BigHeadScreamers::InitGL()
 {
+	GLStateCache &state = GLStateCache::Instance();
+	// All tracked state is changed through the cache
+	state.SetFiltering(true);
+
+	MipmapBenchmark(uiMipmapBench);
+
 	// Initialize camera
 	pFPSCamera = auto_ptr<FPSCamera>(new FPSCamera());
 	pFPSCamera->Init(5.0f * 20.0f, -20.0f);
@@ -107,6 +352,7 @@ bool BigHeadScreamers::InitGL()
 	// Load Shaders
 	if (!LoadShaders(Shaders, NUM_PROGRAMS))
 		return false;
+	offsetUni = Uniform(P_COLOR_OFFSET, "Offset");
 
 	// Initialize skybox singleton
 	pSkyBoxManager = auto_ptr<SkyBoxManager>(new SkyBoxManager());
@@ -118,8 +364,15 @@ bool BigHeadScreamers::InitGL()
 	// Initialize fbo used for drawing reflection
 	//ReloadFBO(); // Commented out since it's called by Resize() later on
 
-	// Initialize AI 
-	pAI = auto_ptr<AIManager>(new AIManager(pFPSCamera->GetPosition()));
+	// Initialize enemy renderer (attribute arrays if instancing is missing)
+	if (InstanceVBO::IsSupported())
+		pER = auto_ptr<EnemyRenderer>(new EnemyRendererInstanced());
+	else
+		pER = auto_ptr<EnemyRenderer>(new EnemyRendererAttrib());
+
+	// Initialize AI (enemy types depend on the sprites in the atlas)
+	pAI = auto_ptr<AIManager>(new AIManager(pFPSCamera->GetPosition(),
+		pER->NumSprites()));
 
 	// Initialize weapon system
 	pWM = auto_ptr<WeaponManager>(new WeaponManager());
@@ -127,8 +380,12 @@ bool BigHeadScreamers::InitGL()
 	// Initialize weapon renderer
 	pPR = auto_ptr<ParticleRenderer>(new ParticleRenderer());
 
-	// Initialize enemy renderer	
-	pER = auto_ptr<EnemyRendererAttrib>(new EnemyRendererAttrib());
+	// Quality settings are adjusted only if a frame budget is given
+	if (fFrameBudget > 0.0f)
+		InitGovernor();
+
+	// Initialize depth sorting of blended primitives
+	pTP = auto_ptr<TransparencyPass>(new TransparencyPass());
 
 	// Enable two collision detectors (used to compare at runtime)
 	pDetector[DETECTOR_SEGMENT_SPHERE] = 
@@ -168,16 +425,19 @@ bool BigHeadScreamers::InitGL()
 	// These operations are performed in Input() but are set here to update the state
 	// in case Input() is not used (benchmarking)
 	pFPSCamera->Update(this, 0.0f);
-	pER->Update(pAI->GetData(), -pFPSCamera->GetAlpha(), Settings::Instance().EnemyHeight);
+	pTP->Update(pAI->GetData(), Settings::Instance().EnemyHeight,
+		pAI->GetParticles(), *pFPSCamera);
+	pER->Update(pAI->GetData(), -pFPSCamera->GetAlpha(), Settings::Instance().EnemyHeight,
+		pTP->GetSpriteOrder(), pTP->NumSprites());
 	GroundInput();
 
 	// This is for GL state variables that won't change across the whole program
-	glEnable(GL_DEPTH_TEST);
+	state.Enable(GL_DEPTH_TEST);
 	glEnable(GL_TEXTURE_2D);
 	glEnableClientState(GL_VERTEX_ARRAY);	
 	glEnableClientState(GL_TEXTURE_COORD_ARRAY);
 	glEnableClientState(GL_NORMAL_ARRAY);
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	state.BlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
 	timer.Start();
 	return true;
@@ -190,8 +450,8 @@ void BigHeadScreamers::SetupProjection(unsigned int width, unsigned int height)
 	float fov = fFOV * M_PI / 180.0f;
 	float aspect = (GLfloat)width/(GLfloat)height;
 	//Matrix4 proj = ProjectionRH(fov, aspect, Near, Far);
-	Matrix4 proj = ProjectionRHInfinite(fov, aspect, Settings::Instance().Near);
-	glLoadTransposeMatrixf(proj.data());
+	mProj = ProjectionRHInfinite(fov, aspect, Settings::Instance().Near);
+	glLoadTransposeMatrixf(mProj.data());
 	// Calculate inverse (used to draw infinite plane)
 	mInvProj = InverseProjectionRHInfinite(fov, 1.0/aspect, Settings::Instance().Near);
 	// Alternatively use standard gluPerspective method
@@ -227,6 +487,12 @@ void BigHeadScreamers::Input()
 	float t = timer.GetTime();
 	float dt = timer.GetDeltaTime();
 
+	GovernorInput(dt);
+
+	// CPU time spent drawing lasers in the last frame (all passes)
+	afTimeOf[TIME_LASER_RENDERER] = pWM->GetLaserRenderTime();
+	pWM->ResetRenderTime();
+
 	/* User Input */
 	// Visual options input: ground and cubemap textures
 	if (KeyPressed(KEY_1))
@@ -271,6 +537,10 @@ void BigHeadScreamers::Input()
 	{
 		bFeatureEnabled[F_INPUT] = !bFeatureEnabled[F_INPUT];
 	}
+	if (KeyPressed(KEY_F))
+	{
+		bFeatureEnabled[F_OCCLUSION] = !bFeatureEnabled[F_OCCLUSION];
+	}
 
 	// Change weapon
 	if (ScrollDown())
@@ -331,12 +601,45 @@ void BigHeadScreamers::Input()
 		pAI->UpdateState(pFPSCamera->GetPosition());
 		afTimeOf[TIME_AI] += timer.Update();
 
-		// Enemy Renderer update
+		// Frustum and occlusion culling and depth sort of sprites and
+		// particles. Sprites visible only in the reflection are kept
 		timer.Start();
-		pER->Update(pAI->GetData(), -pFPSCamera->GetAlpha(), Settings::Instance().EnemyHeight);
+		const bool reflection = bFeatureEnabled[F_REFLECTION];
+		const bool occlude = bFeatureEnabled[F_OCCLUSION];
+		const float zNear = Settings::Instance().Near;
+		Matrix4 viewProj = mProj * pFPSCamera->GetViewMatrix();
+		frustum.Extract(viewProj);
+		if (occlude)
+			occlusion.Begin(viewProj, zNear);
+		if (reflection)
+		{
+			Matrix4 mirror;
+			mirror[1][1] = -1.0f;
+			mirrorFrustum.Extract(viewProj * mirror);
+			if (occlude)
+				mirrorOcclusion.Begin(viewProj * mirror, zNear);
+		}
+		pTP->Update(pAI->GetData(), Settings::Instance().EnemyHeight,
+			pAI->GetParticles(), *pFPSCamera, &frustum,
+			reflection ? &mirrorFrustum : NULL,
+			occlude ? &occlusion : NULL,
+			occlude && reflection ? &mirrorOcclusion : NULL);
+		afTimeOf[TIME_TRANSPARENCY] = timer.Update();
+
+		// Enemy Renderer update (visible sprites, written back to front)
+		timer.Start();
+		pER->Update(pAI->GetData(), -pFPSCamera->GetAlpha(), Settings::Instance().EnemyHeight,
+			pTP->GetSpriteOrder(), pTP->NumSprites());
 		afTimeOf[TIME_ENEMY_RENDERER] = timer.Update();
 
 	}
+	// Draw packets of the frame. Weapons and blended primitives use separate
+	// recorders, so that they can be filled concurrently
+	queue.Begin(2);
+	pWM->Submit(queue.GetRecorder(0), PASS_OPAQUE, PASS_LASER);
+	pTP->Submit(queue.GetRecorder(1), PASS_BLENDED, *pER, *pPR, VIEW_MAIN);
+	queue.Sort();
+
 	// Overlay update
 	if (iShowInfo >= 1)
 	{
@@ -398,9 +701,11 @@ void BigHeadScreamers::RenderReflection() const
 	// Causes all rendered objects to be premultiplied by the mirror matrix
 	bReflectionFlag = true;
 	pReflectionFBO->BindBuffer();
+	glViewport(0, 0, uiReflectionWidth, uiReflectionHeight);
 	
 	RenderScene();
 	
+	glViewport(0, 0, ShellGet(SHELL_WIDTH), ShellGet(SHELL_HEIGHT));
 	pReflectionFBO->UnbindBuffer();
 	bReflectionFlag = false;
 }
@@ -434,12 +739,14 @@ void BigHeadScreamers::RenderSkyBox() const
 
 void BigHeadScreamers::RenderGround() const
 {
+	GLStateCache &state = GLStateCache::Instance();
+
 	pFPSCamera->LoadMatrixNoXZ();
 
 	// Set reflection texture (the shader in Ground expects it)
-	glActiveTexture(GL_TEXTURE1);
+	state.ActiveTexture(1);
 	pReflectionFBO->BindTexture();
-	glActiveTexture(GL_TEXTURE0);
+	state.ActiveTexture(0);
 
 	pGround->Render(pFPSCamera->GetPosition(), Settings::Instance().Far,
 		ShellGet(SDLShell::SHELL_WIDTH), ShellGet(SDLShell::SHELL_HEIGHT));
@@ -450,15 +757,9 @@ void BigHeadScreamers::RenderContent() const
 	pFPSCamera->LoadMatrix();
 	MultMirror();
 
-	glEnable(GL_BLEND);
-	// Note alpha mask is needed since the polygons z-fight otherwise
-	pER->Render(pAI->GetData(), -pFPSCamera->GetAlpha(), Settings::Instance().EnemyHeight);
-	glDisable(GL_BLEND);
-
-	pWM->Render();
-
-	if (!bReflectionFlag)
-		pPR->Render(pAI->GetParticles());
+	// Opaque weapons, lasers, then blended primitives sorted back to front.
+	// Particles are not visible in the reflection
+	queue.Execute(bReflectionFlag ? VIEW_REFLECTION : VIEW_MAIN);
 }
 
 
@@ -467,9 +768,8 @@ void BigHeadScreamers::DrawCoordinateFrame() const
 	glClear(GL_DEPTH_BUFFER_BIT);
 	
 	float offset[] = { -0.9f, -0.9f };
-	GLuint shader = Program(P_COLOR_OFFSET);
-	glUseProgram(shader);
-	glUniform2fv(GetUniLoc(shader, "Offset"), 1, offset);
+	GLStateCache::Instance().UseProgram(Program(P_COLOR_OFFSET));
+	offsetUni.Set2fv(offset);
 
 	glPushMatrix();
 	glLoadIdentity();
@@ -494,7 +794,7 @@ void BigHeadScreamers::RenderReflectionFBO() const
 	glPushMatrix();
 	glLoadIdentity();
 
-	glUseProgram(Program(P_LOOKUP));
+	GLStateCache::Instance().UseProgram(Program(P_LOOKUP));
 
 	pReflectionFBO->BindTexture();
 
@@ -509,6 +809,8 @@ void BigHeadScreamers::RenderReflectionFBO() const
 
 void BigHeadScreamers::ShowInfo() const
 {
+	GLStateCache &state = GLStateCache::Instance();
+
 	if (!iShowInfo)
 		printf("FPS=%.1f\n", 1.0f / timer.GetDeltaTime());
 
@@ -520,7 +822,7 @@ void BigHeadScreamers::ShowInfo() const
 			DrawCoordinateFrame();
 		}
 
-		glDisable(GL_DEPTH_TEST);
+		state.Disable(GL_DEPTH_TEST);
 		
 		if (iShowInfo >= 2)
 		{			
@@ -529,7 +831,7 @@ void BigHeadScreamers::ShowInfo() const
 
 		pFPSGraph->Draw();
 
-		glEnable(GL_BLEND);
+		state.Enable(GL_BLEND);
 		pFont->Bind();
 
 		ShowIntro(timer.GetTime());
@@ -550,11 +852,20 @@ void BigHeadScreamers::ShowInfo() const
 
 
 			pFont->Render(x, y -= mscale, scale, color, horz, vert,
-				"B=%d,E=%d", pWM->GetBullets().size(), pAI->GetData().size());
+				"B=%d,E=%d,V=%d", pWM->NumBullets(), pAI->GetData().size(),
+				pTP->NumSprites());
 
 			pFont->Render(x, y -= mscale, scale, color, horz, vert,
 				"Detector=%d, comp=%d", eCollisionType, uiNumComparisons);
 
+			if (bFeatureEnabled[F_OCCLUSION])
+			{
+				const OcclusionStats &stats = occlusion.GetStats();
+				pFont->Render(x, y -= mscale, scale, color, horz, vert,
+					"Occluded=%d/%d,%.2fms", stats.uiOccluded, stats.uiTested,
+					(stats.fRasterTime + stats.fTestTime) * 1000.0f);
+			}
+
 			for (unsigned int i = 0; i < NUM_TIMERS; i++)
 			{
 				y -= mscale;
@@ -567,19 +878,38 @@ void BigHeadScreamers::ShowInfo() const
 				"%.2fms", timer.GetDeltaTime() * 1000.0f);
 
 			//pFont->Render(x, y -= mscale, scale, color, horz, vert,
-			//	"E * B = %d * %d = %d", pAI->GetData().size(), pWM->GetBullets().size(),
-			//	pAI->GetData().size() * pWM->GetBullets().size());
+			//	"E * B = %d * %d = %d", pAI->GetData().size(), pWM->NumBullets(),
+			//	pAI->GetData().size() * pWM->NumBullets());
 
 			pFont->Render(x, y -= mscale, scale, color, horz, vert,
 				"FOV=%.2f", fFOV);
 
+			pFont->Render(x, y -= mscale, scale, color, horz, vert,
+				"GL calls=%d/%d", state.GetSubmitted(),
+				state.GetSubmitted() + state.GetFiltered());
+
+			pFont->Render(x, y -= mscale, scale, color, horz, vert,
+				"Packets=%d, changes=%d", queue.NumPackets(),
+				queue.GetStateChanges());
+
+			if (fFrameBudget > 0.0f)
+			{
+				pFont->Render(x, y -= mscale, scale, color, horz, vert,
+					"Budget=%.1fms", fFrameBudget * 1000.0f);
+				for (unsigned int i = 0; i < governor.NumKnobs(); i++)
+				{
+					pFont->Render(x, y -= mscale, scale, color, horz, vert,
+						"%s=%g", governor.GetKnob(i).szName, governor.Get(i));
+				}
+			}
+
 			// Uncomment this to see all available characters on scren
 			//pFont->TestFont();
 		}
 
-		glDisable(GL_BLEND);
+		state.Disable(GL_BLEND);
 
-		glEnable(GL_DEPTH_TEST);
+		state.Enable(GL_DEPTH_TEST);
 	}
 }
 
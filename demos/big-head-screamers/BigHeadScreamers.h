@@ -21,6 +21,10 @@
 
 #include "Timer.h"
 #include "Matrix.h"
+#include "FrameGovernor.h"
+#include "Frustum.h"
+#include "OcclusionBuffer.h"
+#include "RenderQueue.h"
 #include "CoordinateFrame.h"
 
 using namespace std; // for auto_ptr
@@ -32,6 +36,7 @@ class WeaponManager;
 class ParticleRenderer;
 class BulletRenderer;
 class EnemyRenderer;
+class TransparencyPass;
 class CollisionDetector;
 class SkyBoxManager;
 class FPSCamera;
@@ -47,7 +52,10 @@ class BigHeadScreamers : public SDLShell, private ProgramArray
 		NUM_PROGRAMS 
 	};	
 
-	enum { F_REFLECTION, F_INPUT, NUM_FEATURES };
+	// Offset of the coordinate frame (P_COLOR_OFFSET)
+	UniformHandle offsetUni;
+
+	enum { F_REFLECTION, F_INPUT, F_OCCLUSION, NUM_FEATURES };
 	bool bFeatureEnabled[NUM_FEATURES];
 
 	int iShowInfo;
@@ -56,21 +64,49 @@ class BigHeadScreamers : public SDLShell, private ProgramArray
 	// aka logical constness
 	mutable bool bReflectionFlag;
 	auto_ptr<FBO> pReflectionFBO;
+	// Reflection FBO size, scaled down by the governor if needed
+	float fReflectionScale;
+	unsigned int uiReflectionWidth, uiReflectionHeight;
 
 	// Timing related variables
 	Timer timer;
 	float fSetTime;
 	float fRandomTime;
 
-	// Timers used to measure input stages
-	enum { TIME_WEAPON, TIME_AI, TIME_COLLISIONS,
-		TIME_ENEMY_RENDERER, TIME_INPUT, NUM_TIMERS };
+	// Timers used to measure input stages (and laser rendering of the
+	// previous frame)
+	enum { TIME_WEAPON, TIME_AI, TIME_COLLISIONS, TIME_TRANSPARENCY,
+		TIME_ENEMY_RENDERER, TIME_LASER_RENDERER, TIME_INPUT, NUM_TIMERS };
 	float afTimeOf[NUM_TIMERS];
 
+	// Frame budget in seconds (0 = governor disabled)
+	float fFrameBudget;
+	// Quality knobs, registered in this order (lowest priority first)
+	enum { K_BLOOD_DROPS, K_PARTICLES, K_REFLECTION, K_ENEMIES, NUM_KNOBS };
+	FrameGovernor governor;
+
+	// Repetitions of the mipmap benchmark run by InitGL() (0 = disabled)
+	unsigned int uiMipmapBench;
+
 	// Projection matrix related variables
 	float fFOV;
-	// Inverted projection matrix (needed by infinite plane rendering)
+	// Projection matrix (row major) and its inverse (needed by infinite
+	// plane rendering)
+	Matrix4 mProj;
 	Matrix4 mInvProj;
+	// View frustum of the current frame and of the reflection pass (used to
+	// cull sprites and particles)
+	Frustum frustum;
+	Frustum mirrorFrustum;
+	// CPU depth buffers of the nearest sprites, used to cull hidden sprites
+	// and particles in view and reflection
+	OcclusionBuffer occlusion;
+	OcclusionBuffer mirrorOcclusion;
+	// Draw packets of weapons, sprites and particles, recorded once per frame
+	// by Input() and executed by both the reflection and the main pass
+	enum { PASS_OPAQUE, PASS_LASER, PASS_BLENDED };
+	enum { VIEW_MAIN = 1, VIEW_REFLECTION = 2 };
+	RenderQueue queue;
 	
 	// Ground renderer
 	auto_ptr<Ground> pGround;
@@ -82,6 +118,8 @@ class BigHeadScreamers : public SDLShell, private ProgramArray
 	auto_ptr<AIManager> pAI;
 	// Base class for enemy renderer
 	auto_ptr<EnemyRenderer> pER;
+	// Depth sorts enemy sprites and particles
+	auto_ptr<TransparencyPass> pTP;
 	// Contains cubemaps and skybox load, update and rendering code
 	auto_ptr<SkyBoxManager> pSkyBoxManager;
 	//! Enum listing different types of collision detectors
@@ -113,6 +151,19 @@ protected:
 	// Updates matrices and ground state
 	void GroundInput();
 
+	// Registers the quality knobs with the frame governor
+	void InitGovernor();
+	// Adjusts quality settings to the frame budget (called by Input())
+	void GovernorInput(float dt);
+
+	// Measures occlusion culling on a simulated crowd, with no GL calls so
+	// that it runs on machines without a GPU (occlusionbench=frames)
+	void OcclusionBenchmark(unsigned int frames) const;
+
+	// Compares mipmap generation and upload of gluBuild2DMipmaps() with
+	// MipChain on the ground and skybox textures (mipbench=repetitions)
+	void MipmapBenchmark(unsigned int repeats) const;
+
 	// Loads reflection FBO. Actually reload since this is called
 	// each time the window is resized
 	void ReloadFBO();
@@ -12,73 +12,139 @@
  *****************************************************************************/
 
 #include "Bullet.h"
-#include "BulletRenderer.h"
 
 /*****************************************************************************
- * Bullet implementation
+ * BulletPool implementation
  *****************************************************************************/
 
- Bullet::Bullet(const Point3 &p,
-	 const float yRot, const float xRot, const float speed, const float damage)
-	 : xRot(xRot), yRot(yRot), damage(damage)
+BulletPool::BulletPool() : eMotion(StraightMotion), uiDamage(0), uiSize(0)
 {
-	impact = false;
-	pos[1] = -p;
-	pos[1][1] -= 10.0f;
-	pos[0] = pos[1];
-	vel = Matrix3::RotationY(-yRot) * (Matrix3::RotationX(-xRot) *
-		Vector3(0.0f, 0.0f, -speed));		
+
 }
 
+void BulletPool::Init(Motion motion, unsigned int damage, unsigned int capacity)
+{
+	eMotion = motion;
+	uiDamage = damage;
+	uiSize = 0;
+	Reserve(capacity);
+}
 
-		
-/*****************************************************************************
- * GravityBullet implementation
- *****************************************************************************/
+void BulletPool::Reserve(unsigned int capacity)
+{
+	aPrevPos.resize(capacity);
+	aPos.resize(capacity);
+	aVel.resize(capacity);
+	aAngleX.resize(capacity);
+	aAngleY.resize(capacity);
+	aLife.resize(capacity);
+	aImpact.resize(capacity);
+}
 
-bool GravityBullet::Update(const float dt)
+void BulletPool::Add(const Point3 &p,
+	const float yRot, const float xRot, const float speed)
 {
-	pos[0] = pos[1];
-	float speed = dt * Settings::Instance().BulletSpeed;
-	float f = Settings::Instance().BulletGravity * speed;
+	if (uiSize == aPos.size())
+		Reserve(uiSize ? uiSize * 2 : 64);
+
+	const unsigned int i = uiSize++;
+	aPos[i] = -p;
+	aPos[i][1] -= 10.0f;
+	aPrevPos[i] = aPos[i];
+	aVel[i] = Matrix3::RotationY(-yRot) * (Matrix3::RotationX(-xRot) *
+		Vector3(0.0f, 0.0f, -speed));
+	aAngleX[i] = xRot;
+	aAngleY[i] = yRot;
+	aLife[i] = 0.0f;
+	aImpact[i] = 0;
+}
 
-	vel[1] -= f;
+void BulletPool::Update(const float dt)
+{
+	if (eMotion == GravityMotion)
+		UpdateGravity(dt);
+	else
+		UpdateStraight(dt);
+}
 
-	pos[1] += vel * speed;
+void BulletPool::UpdateGravity(const float dt)
+{
+	const Settings &s = Settings::Instance();
+	const float speed = dt * s.BulletSpeed;
+	const float f = s.BulletGravity * speed;
+	const float slowDown = s.GrenadeBounceSlowDown;
+	const float maxBounces = (float)s.GrenadeMaxBounces;
 
-	if (pos[1][1] < 0.0f)
+	for (unsigned int i = 0; i < uiSize; i++)
 	{
-		bounces++;
-		pos[1][1] = -pos[1][1];
-		vel[0] *= Settings::Instance().GrenadeBounceSlowDown;
-		vel[1] *= -Settings::Instance().GrenadeBounceSlowDown;
-		vel[2] *= Settings::Instance().GrenadeBounceSlowDown;
+		Point3 &pos = aPos[i];
+		Vector3 &vel = aVel[i];
+		aPrevPos[i] = pos;
+
+		vel[1] -= f;
+		pos += vel * speed;
+
+		if (pos[1] < 0.0f)
+		{
+			aLife[i] += 1.0f;
+			pos[1] = -pos[1];
+			vel[0] *= slowDown;
+			vel[1] *= -slowDown;
+			vel[2] *= slowDown;
+		}
+		if (aLife[i] >= maxBounces)
+			aImpact[i] = 1;
+
+		aAngleX[i] = -atan2(vel[1], Point2(vel[0], vel[2]).Length());
 	}
-	if (bounces >= Settings::Instance().GrenadeMaxBounces)
-		impact = true;
-
-	xRot = -atan2(vel[1], Point2(vel[0], vel[2]).Length());
-	
-	return !Impact();
-
 }
 
-
-/*****************************************************************************
- * GravityBullet implementation
- *****************************************************************************/
-bool StraightBullet::Update(float dt)
+void BulletPool::UpdateStraight(const float dt)
 {
-	float speed = dt * Settings::Instance().LaserSpeed;
-	pos[0] = pos[1];
-	pos[1] += vel * speed;
+	const Settings &s = Settings::Instance();
+	const float speed = dt * s.LaserSpeed;
+	const float maxDistance = s.LaserMaxDistance;
 
-	if (pos[1][1] <= 0.0f)
-		impact = true;
+	for (unsigned int i = 0; i < uiSize; i++)
+	{
+		aPrevPos[i] = aPos[i];
+		aPos[i] += aVel[i] * speed;
+
+		if (aPos[i][1] <= 0.0f)
+			aImpact[i] = 1;
 
-	if ((distance += speed) > Settings::Instance().LaserMaxDistance)
-		impact = true;
+		if ((aLife[i] += speed) > maxDistance)
+			aImpact[i] = 1;
+	}
+}
 
-	return !Impact();
+void BulletPool::Move(unsigned int dst, unsigned int src)
+{
+	aPrevPos[dst] = aPrevPos[src];
+	aPos[dst] = aPos[src];
+	aVel[dst] = aVel[src];
+	aAngleX[dst] = aAngleX[src];
+	aAngleY[dst] = aAngleY[src];
+	aLife[dst] = aLife[src];
+	aImpact[dst] = aImpact[src];
 }
 
+unsigned int BulletPool::RemoveImpacted()
+{
+	unsigned int removed = 0;
+	unsigned int i = 0;
+	while (i < uiSize)
+	{
+		if (aImpact[i])
+		{
+			// Don't advance: the moved bullet needs checking too
+			Move(i, --uiSize);
+			removed++;
+		}
+		else
+		{
+			i++;
+		}
+	}
+	return removed;
+}
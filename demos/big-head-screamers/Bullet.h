@@ -18,68 +18,71 @@
 #include "Settings.h"
 
 
+#include <vector>
+using namespace std;
+
 /*****************************************************************************
- * Bullet class declaration
+ * BulletPool class declaration
  *****************************************************************************/
- 
-class Bullet
+
+// Stores all the bullets of one weapon type as a structure of arrays.
+// Arrays only grow (doubling), so firing doesn't allocate once the pool has
+// reached its steady state size. Removal swaps the last bullet into the freed
+// slot, hence bullet indices are only valid until the next RemoveImpacted().
+class BulletPool
 {
-protected:
+public:
+	// Update logic
+	enum Motion { GravityMotion, StraightMotion };
+
+private:
+	Motion eMotion;
+	unsigned int uiDamage;
+	unsigned int uiSize;
+
 	// store previous and current (needed for collision detection)
-	Point3 pos[2];
-	Vector3 vel;
-	float xRot, yRot;
-	bool impact;
-	float damage;
+	vector<Point3> aPrevPos;
+	vector<Point3> aPos;
+	vector<Vector3> aVel;
+	vector<float> aAngleX;
+	vector<float> aAngleY;
+	// Bounces (gravity) or travelled distance (straight)
+	vector<float> aLife;
+	vector<unsigned char> aImpact;
 
-public:
-	Bullet(const Point3 &p,
-		const float yRot, const float xRot, const float speed, const float damage);
-	virtual ~Bullet() { }
-		
-	virtual bool Update(const float dt) = 0;
-
-	const bool Impact() const { return impact; }
-
-	const Point3 &GetPosition() const { return pos[1]; }
-	const Point3 &GetPrevPosition() const { return pos[0]; }
-	
-	void SetImpact() { impact = true; }
-	//void SetPosition(const Point3 &pos) { pos[1] = pos; }
-	const float GetAngleX() const { return xRot; }
-	const float GetAngleY() const { return yRot; }
-
-	const unsigned int Damage() const { return damage; }
-};
+	void Reserve(unsigned int capacity);
+	void Move(unsigned int dst, unsigned int src);
 
-/*****************************************************************************
- * GravityBullet class declaration
- *****************************************************************************/
-// TODO: rename to GravityBullet
-class GravityBullet : public Bullet
-{
-	unsigned int bounces;
+	void UpdateGravity(const float dt);
+	void UpdateStraight(const float dt);
 
 public:
-	GravityBullet(const Point3 &p,
-		const float yRot, const float xRot, const float speed)
-		: Bullet(p, yRot, xRot, speed, Settings::Instance().GrenadeDamage), bounces(0) { }
-	virtual bool Update(const float dt);
-};
+	BulletPool();
 
-/*****************************************************************************
- * StraightBullet class declaration
- *****************************************************************************/
-// TODO: Rename to Straight Bullet
-class StraightBullet : public Bullet
-{
-	float distance;
-public:
-	StraightBullet(const Point3 &p,
-		const float yRot, const float xRot, const float speed)
-		: Bullet(p, yRot, xRot, speed, Settings::Instance().LaserDamage), distance(0.0f) { }
+	void Init(Motion motion, unsigned int damage, unsigned int capacity);
+
+	void Add(const Point3 &p, const float yRot, const float xRot,
+		const float speed);
+
+	void Update(const float dt);
+
+	// Swap-removes all bullets that have hit something. Returns # removed
+	unsigned int RemoveImpacted();
+
+	unsigned int Size() const { return uiSize; }
+	bool Empty() const { return uiSize == 0; }
+
+	const Point3 &GetPosition(unsigned int i) const { return aPos[i]; }
+	// Contiguous positions of all bullets (Size() elements)
+	const Point3 *GetPositions() const { return uiSize ? &aPos[0] : NULL; }
+	const Point3 &GetPrevPosition(unsigned int i) const { return aPrevPos[i]; }
+	const float GetAngleX(unsigned int i) const { return aAngleX[i]; }
+	const float GetAngleY(unsigned int i) const { return aAngleY[i]; }
+
+	const bool Impact(unsigned int i) const { return aImpact[i] != 0; }
+	void SetImpact(unsigned int i) { aImpact[i] = 1; }
 
-	virtual bool Update(const float dt);
+	const unsigned int Damage() const { return uiDamage; }
 };
 
 #endif
@@ -15,16 +15,16 @@
 
 #include "Extensions.h"
 
-#include <list>
-using namespace std;
-
-class Bullet;
+class BulletPool;
 
 class BulletRenderer
 {
 public:
 	virtual ~BulletRenderer() { }
-	virtual void Render(const list<Bullet *> &bullets) const = 0;
+	virtual void Render(const BulletPool &bullets) const = 0;
+	// Program and texture bound by Render() (used to sort draw packets)
+	virtual GLuint GetProgram() const = 0;
+	virtual GLuint GetTexture() const { return 0; }
 };
 
 #endif
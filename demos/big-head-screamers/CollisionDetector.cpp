@@ -59,45 +59,48 @@ unsigned int CollisionDetector::Run()
 
 unsigned int CPUCollisionDetector::Execute()
 {
-	ptr_list<Bullet> &bullets = (ptr_list<Bullet> &)GetWM()->GetBullets();
+	WeaponManager *wm = GetWM();
 	ptr_vector<Enemy> &enemies = (ptr_vector<Enemy> &)GetAI()->GetData();
 
-	if (bullets.size() == 0 || enemies.size() == 0)
+	if (wm->NumBullets() == 0 || enemies.size() == 0)
 		return 0;
 		
-	ptr_list<Bullet>::iterator b;
 	ptr_vector<Enemy>::iterator e;
 
 	unsigned int comparisons = 0;
 	// TODO: Find solution cheaper than O(B * E)
-	for (b = bullets.begin(); b != bullets.end(); b++)
+	for (unsigned int w = 0; w < WeaponManager::NumWeapons; w++)
 	{
+		BulletPool &b = wm->GetBullets(w);
+		for (unsigned int i = 0; i < b.Size(); i++)
+		{
 #ifdef HEIGHT_TEST
-		// discard bullets that are above the enemy height
-		if (AboveHeight(b->GetPosition()[1]))
-			continue;
-#endif
-		for (e = enemies.begin(); e != enemies.end(); e++)
-		{	
-			comparisons++;
-			// Bullet has exploded already
-			if (b->Impact())
-				continue;
-				
-			// Enemy has been killed already
-			if (e->health <= 0)
+			// discard bullets that are above the enemy height
+			if (AboveHeight(b.GetPosition(i)[1]))
 				continue;
-
-			Point3 target3 = Point3(e->pos[0], Settings::Instance().EnemyHeight, e->pos[1]);
-				
-			//if (CollisionSphereSphere(curr, target3, Settings::Instance().CollisionRadius))
-			if (Collision(b->GetPrevPosition(), b->GetPosition(),
-				target3, Settings::Instance().CollisionRadius))
-			{
-				b->SetImpact();
-
-				e->health -= b->Damage();
-				GetAI()->AddParticles(b->GetPosition(), e->health);
+#endif
+			for (e = enemies.begin(); e != enemies.end(); e++)
+			{	
+				comparisons++;
+				// Bullet has exploded already
+				if (b.Impact(i))
+					continue;
+					
+				// Enemy has been killed already
+				if (e->health <= 0)
+					continue;
+
+				Point3 target3 = Point3(e->pos[0], Settings::Instance().EnemyHeight, e->pos[1]);
+					
+				//if (CollisionSphereSphere(curr, target3, Settings::Instance().CollisionRadius))
+				if (Collision(b.GetPrevPosition(i), b.GetPosition(i),
+					target3, Settings::Instance().CollisionRadius))
+				{
+					b.SetImpact(i);
+
+					e->health -= b.Damage();
+					GetAI()->AddParticles(b.GetPosition(i), e->health);
+				}
 			}
 		}
 	}
@@ -123,56 +126,58 @@ bool CPUSphereSphereCollisionDetector::Collision(const Vector3 &a,
 
 unsigned int QuadTreeCollisionDetector::Execute()
 {
-	ptr_list<Bullet> &bullets = (ptr_list<Bullet> &)GetWM()->GetBullets();
+	WeaponManager *wm = GetWM();
 	ptr_vector<Enemy> &enemies = (ptr_vector<Enemy> &)GetAI()->GetData();
 
-	if (bullets.size() == 0 || enemies.size() == 0)
+	if (wm->NumBullets() == 0 || enemies.size() == 0)
 		return 0;
 
 	// Generate tree
 	unsigned int divisions = (unsigned int)(0.5 * sqrt((double)Settings::Instance().NumEnemies));
 	QuadTree tree(divisions, enemies);
 
-	ptr_list<Bullet>::iterator b;
-
 	unsigned int comparisons = 0;
-	for (b = bullets.begin(); b != bullets.end(); b++)
+	for (unsigned int w = 0; w < WeaponManager::NumWeapons; w++)
 	{
-		Point3 p = b->GetPosition();
+		BulletPool &b = wm->GetBullets(w);
+		for (unsigned int i = 0; i < b.Size(); i++)
+		{
+			const Point3 &p = b.GetPosition(i);
 #ifdef HEIGHT_TEST
-		// discard bullets that are above the enemy height
-		if (AboveHeight(p[1]))
-			continue;
-#endif
-		Point2 pos(p[0], p[2]);
-		list<Enemy *> *bin = tree.GetBin(pos);
-		// discard bullets that are outside the enemy area
-		if (bin == NULL)
-			continue;
-
-		list<Enemy *>::iterator f;
-		for (f = bin->begin(); f != bin->end(); f++)
-		{	
-			comparisons++;
-			Enemy *e = *f;
-			// Bullet has exploded already
-			if (b->Impact())
+			// discard bullets that are above the enemy height
+			if (AboveHeight(p[1]))
 				continue;
-				
-			// Enemy has been killed already
-			if (e->health <= 0)
+#endif
+			Point2 pos(p[0], p[2]);
+			list<Enemy *> *bin = tree.GetBin(pos);
+			// discard bullets that are outside the enemy area
+			if (bin == NULL)
 				continue;
 
-			Point3 target3 = Point3(e->pos[0], Settings::Instance().EnemyHeight, e->pos[1]);
-				
-			//if (CollisionSphereSphere(b->GetPosition(), target3, Settings::Instance().CollisionRadius))
-			if (CollisionSegmentSphere(b->GetPrevPosition(), b->GetPosition(),
-				target3, Settings::Instance().CollisionRadius))
-			{
-				b->SetImpact();
-
-				e->health -= b->Damage();
-				GetAI()->AddParticles(b->GetPosition(), e->health);
+			list<Enemy *>::iterator f;
+			for (f = bin->begin(); f != bin->end(); f++)
+			{	
+				comparisons++;
+				Enemy *e = *f;
+				// Bullet has exploded already
+				if (b.Impact(i))
+					continue;
+					
+				// Enemy has been killed already
+				if (e->health <= 0)
+					continue;
+
+				Point3 target3 = Point3(e->pos[0], Settings::Instance().EnemyHeight, e->pos[1]);
+					
+				//if (CollisionSphereSphere(p, target3, Settings::Instance().CollisionRadius))
+				if (CollisionSegmentSphere(b.GetPrevPosition(i), p,
+					target3, Settings::Instance().CollisionRadius))
+				{
+					b.SetImpact(i);
+
+					e->health -= b.Damage();
+					GetAI()->AddParticles(p, e->health);
+				}
 			}
 		}
 	}	
@@ -24,18 +24,25 @@ using namespace boost;
 
 class Enemy
 {
+public:
+	// Type tag of derived classes (avoids RTTI in renderers)
+	enum EnemyType { TypeSprite };
 protected:
 	// Only AIManager can create instances of Enemy via derived classes
-	Enemy(const Vector2 &p, const int health)
-		: pos(p), health(health) { }
+	Enemy(const Vector2 &p, const int health, const EnemyType type)
+		: pos(p), health(health), eType(type) { }
 public:
 	virtual ~Enemy() { }
 
 	// public
 	Vector2 pos;
 	int health;
+	const EnemyType eType;
 
 	bool Dead() const { return health <= 0; }
+
+	// Index in the sprite atlas
+	inline const int GetTextureIndex() const;
 };
 
 /*****************************************************************************
@@ -47,13 +54,24 @@ class SpriteEnemy : public Enemy
 public:
 	SpriteEnemy(const Vector2 &p, const int health,
 		const int index1, const int index2)
-			: Enemy(p, health), texIndex0(index1), texIndex1(index2) { }
+			: Enemy(p, health, TypeSprite), texIndex0(index1), texIndex1(index2) { }
 
 	int texIndex0, texIndex1;
 
 	const int GetTextureIndex() const { return health <= 50 ? texIndex1 : texIndex0; }
 };
 
+inline const int Enemy::GetTextureIndex() const
+{
+	switch (eType)
+	{
+	case TypeSprite:
+		return static_cast<const SpriteEnemy *>(this)->GetTextureIndex();
+	default:
+		return 0;
+	}
+}
+
 
 /*****************************************************************************
  * Base EnemyRenderer class for rendering billboarded enemies
@@ -67,10 +85,19 @@ public:
 public:
 	virtual ~EnemyRenderer() { }
 	virtual bool LoadSprites() = 0;
-	virtual bool Update(const ptr_vector<Enemy> &data, const float angle,
-		const float height) { return false; }
+	// Number of texture indices enemies can use (two per enemy type)
+	virtual unsigned int NumSprites() const { return NUM_SPRITES; }
+	// order (optional) lists count enemy indices in drawing order. Enemies
+	// that are not listed (i.e. culled) are not drawn
+	virtual bool Update(const ptr_vector<Enemy> &/*data*/,
+		const float /*angle*/, const float /*height*/,
+		const unsigned int */*order*/ = NULL,
+		const unsigned int /*count*/ = 0) { return false; }
 	virtual void Render(const ptr_vector<Enemy> &data, const float angle,
 		const float height) const = 0;
+	// Renders count sprites starting at first, in the order of Update()
+	virtual void Render(unsigned int /*first*/, unsigned int /*count*/) const
+	{ }
 };
 
 #endif
@@ -12,10 +12,11 @@
  *****************************************************************************/
 
 #include "EnemyRendererAttrib.h"
-#include "GLResourceManager.h"
 #include "Enemy.h"
 #include "Misc.h"
 #include "Settings.h"
+#include "ThreadPool.h"
+#include "GLStateCache.h"
 
 #define _USE_MATH_DEFINES
 #include <math.h>
@@ -38,8 +39,11 @@ static const Point2 t2( 1.0f,  1.0f);
 static const Point2 t3( 1.0f,  0.0f);
 static const Point2 t4( 0.0f,  0.0f);
 
+// Minimum number of sprites worth splitting across threads
+static const unsigned int ParallelThreshold = 4096;
 
-EnemyRendererAttrib::EnemyRendererAttrib()
+
+EnemyRendererAttrib::EnemyRendererAttrib() : pAttrib(NULL), uiNumSprites(0)
 {
 	assert(LoadShaders(AttribShaders, NUM_PROGRAMS));
 	assert(LoadSprites());
@@ -52,94 +56,126 @@ EnemyRendererAttrib::EnemyRendererAttrib()
 	attribLoc[A_ROT_ANGLE] = glGetAttribLocation(program, "inRotAngle");
 	attribLoc[A_TRANSLATE] = glGetAttribLocation(program, "inTranslate");
 
-	attrib = new SpriteVertexData[4 * Settings::Instance().NumEnemies];
+	pStream = auto_ptr<StreamingVBO>(new StreamingVBO(
+		4 * sizeof(SpriteVertexData) * Settings::Instance().NumEnemies));
 }
 EnemyRendererAttrib::~EnemyRendererAttrib()
 {
-	delete [] attrib;
 }
 
 bool EnemyRendererAttrib::LoadSprites()
 {
-	GLResourceManager &loader = GLResourceManager::Instance();
-	// Load texture atlas
-	return loader.LoadTextureFromFile("data/textures/sprites/Atlas.bmp",
-			uiAtlas, GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR_MIPMAP_LINEAR);
+	// Load texture atlas (hand drawn ones are a 5 x 2 grid)
+	return atlas.Load("data/textures/sprites/Atlas.bmp",
+		GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR_MIPMAP_LINEAR, 5, 2);
   
 	//glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
 	//glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 
 }
 
-Point2 EnemyRendererAttrib::TexCoord(Point2 coord, int index)
+/*****************************************************************************
+ * SpriteAttribTask implementation
+ *****************************************************************************/
+
+// Writes the four vertices of a range of sprites
+class SpriteAttribTask : public ThreadTask
 {
-	coord[0] *= 0.2f;
-	coord[1] *= 0.5f;
-	coord[0] += (index / 2) * 0.2f;
-	coord[1] += (index % 2) * 0.5f;
-	return coord;
-}
+public:
+	const ptr_vector<Enemy> *data;
+	const unsigned int *order;
+	const TextureAtlas *atlas;
+	unsigned int n;
+	float scale;
+	float radAngle;
+	float height;
+	EnemyRendererAttrib::SpriteVertexData *attrib;
+
+	virtual void Run(unsigned int index, unsigned int count)
+	{
+		unsigned int begin, end;
+		ThreadPool::Range(n, index, count, begin, end);
+
+		// Sprites are made by groups of four vertices sharing the same
+		// attributes
+		EnemyRendererAttrib::SpriteVertexData *ptr = attrib + (begin << 2);
+		for (unsigned int i = begin; i < end; i++)
+		{
+			const Enemy &enemy = (*data)[order ? order[i] : i];
+			const AtlasRect &rect = atlas->Rect(enemy.GetTextureIndex());
+			Vector3 translation = Point3(enemy.pos[0], height, enemy.pos[1]);
+		
+			// positions-texcoords loop
+			ptr->pos = v1;
+			ptr->tex = rect.Map(t1);
+			ptr->SetAttributes(scale, radAngle, translation);
+			ptr++;
+			
+			ptr->pos = v2;
+			ptr->tex = rect.Map(t2);
+			ptr->SetAttributes(scale, radAngle, translation);
+			ptr++;
+
+			ptr->pos = v3;
+			ptr->tex = rect.Map(t3);
+			ptr->SetAttributes(scale, radAngle, translation);
+			ptr++;
+			
+			ptr->pos = v4;
+			ptr->tex = rect.Map(t4);
+			ptr->SetAttributes(scale, radAngle, translation);
+			ptr++;
+		}
+	}
+};
 
-// TODO: this is a minor bottleneck -> optimize
 bool EnemyRendererAttrib::Update(const ptr_vector<Enemy> &data, const float angle,
-							const float height)
+							const float height, const unsigned int *order/* = NULL*/,
+							const unsigned int count/* = 0*/)
 {
+	// Only listed (visible) enemies are written
+	uiNumSprites = order ? count : data.size();
+	if (uiNumSprites > (unsigned int)Settings::Instance().NumEnemies)
+		uiNumSprites = Settings::Instance().NumEnemies;
+
 	// Render if there's at least one enemy
-	if (!data.size())
+	if (!uiNumSprites)
 		return false;
 
-	// Create attribute array to be passed to GL
-	// vertices = # sprites * 4
-	//size_t size = data.size() << 2;
-
-	// Use this if # of enemies is not capped
-	//SpriteVertexData *attrib = new SpriteVertexData[size];
-	
-	float radAngle = angle * M_PI / 180.0f;
-	// Loop through sprites: Sprites are made by groups of four vertices
-	// sharing the same attributes
-	ptr_vector<Enemy>::const_iterator iter;
-	SpriteVertexData *ptr = attrib;
-	for (iter = data.begin(); iter != data.end(); iter++)
-	{
-		int texIndex = (dynamic_cast<const SpriteEnemy *>(&*iter))->GetTextureIndex();
-		Vector3 translation = Point3(iter->pos[0], height, iter->pos[1]);
-	
-		// positions-texcoords loop
-		ptr->pos = v1;
-		ptr->tex = TexCoord(t1, texIndex);
-		ptr->SetAttributes(Settings::Instance().EnemyScale, radAngle, translation);
-		ptr++;
-		
-		ptr->pos = v2;
-		ptr->tex = TexCoord(t2, texIndex);
-		ptr->SetAttributes(Settings::Instance().EnemyScale, radAngle, translation);
-		ptr++;
-
-		ptr->pos = v3;
-		ptr->tex = TexCoord(t3, texIndex);
-		ptr->SetAttributes(Settings::Instance().EnemyScale, radAngle, translation);
-		ptr++;
-		
-		ptr->pos = v4;
-		ptr->tex = TexCoord(t4, texIndex);
-		ptr->SetAttributes(Settings::Instance().EnemyScale, radAngle, translation);
-		ptr++;
-	}
-	return true;
+	SpriteAttribTask task;
+	task.data = &data;
+	task.order = order;
+	task.atlas = &atlas;
+	task.n = uiNumSprites;
+	task.scale = Settings::Instance().EnemyScale;
+	task.radAngle = angle * M_PI / 180.0f;
+	task.height = height;
+	// Vertices are written directly into the stream, also by the workers
+	task.attrib = (SpriteVertexData *)pStream->Map(
+		4 * sizeof(SpriteVertexData) * uiNumSprites);
+
+	if (uiNumSprites >= ParallelThreshold)
+		ThreadPool::Instance().Execute(task);
+	else
+		task.Run(0, 1);
+
+	pAttrib = pStream->Unmap();
+
+	return !pStream->ContentsLost();
 }
 
 GLuint EnemyRendererAttrib::UseProgram(int index) const
 {
 	GLuint program = Program(index);
-	glUseProgram(program);
+	GLStateCache::Instance().UseProgram(program);
 	// Set uniforms
 	//float offset[] = { 4.0f / 2048.0f, 4.0f / 2048.0f };
 	//glUniform2fv(GetUniLoc(program, "NeighborOffset"), 1, offset);
 	return program;
 }
 
-bool EnemyRendererAttrib::SetAttribPointer(GLint loc, size_t size, GLenum type, void *address) const
+bool EnemyRendererAttrib::SetAttribPointer(GLint loc, size_t size, GLenum type,
+	const GLvoid *address) const
 {
 	if (loc != -1)
 	{
@@ -163,16 +199,18 @@ bool EnemyRendererAttrib::UnsetAttribPointer(GLint loc) const
 
 
 // BindTexture happens outside
-void EnemyRendererAttrib::Render(const ptr_vector<Enemy> &data, const float angle,
-							const float height) const
+void EnemyRendererAttrib::Render(const ptr_vector<Enemy> &/*data*/,
+	const float /*angle*/, const float /*height*/) const
 {
-	// Render if there's at least one enemy
-	if (!data.size())
+	Render(0, uiNumSprites);
+}
+
+void EnemyRendererAttrib::Render(unsigned int first, unsigned int count) const
+{
+	if (!count)
 		return;
 
-	size_t size = data.size() << 2;
-	
-	glBindTexture(GL_TEXTURE_2D, uiAtlas);
+	GLStateCache::Instance().BindTexture(GL_TEXTURE_2D, atlas.Texture());
 
 	//glEnableClientState(GL_VERTEX_ARRAY);	
 	//glEnableClientState(GL_TEXTURE_COORD_ARRAY);
@@ -187,15 +225,19 @@ void EnemyRendererAttrib::Render(const ptr_vector<Enemy> &data, const float angl
 	// Pass in attributes
 	// This ones shouldn't be necessary if glVertexPointer and
 	// glTexCoordPointer are issued
+	// Pointers are offsets into the stream written by Update()
+	const SpriteVertexData *attrib = (const SpriteVertexData *)pAttrib;
+	pStream->Bind();
 	SetAttribPointer(attribLoc[A_VERTEX], 2, GL_FLOAT, &attrib->pos);
 	SetAttribPointer(attribLoc[A_TEX_COORD], 2, GL_FLOAT, &attrib->tex);
 	// Custom attributes
 	SetAttribPointer(attribLoc[A_SCALE], 1, GL_FLOAT, &attrib->scale);
 	SetAttribPointer(attribLoc[A_ROT_ANGLE], 1, GL_FLOAT, &attrib->rotAngle);
 	SetAttribPointer(attribLoc[A_TRANSLATE], 3, GL_FLOAT, &attrib->translation);
+	pStream->Unbind();
 
 	// Render VBO
-	glDrawArrays(GL_QUADS, 0, size);
+	glDrawArrays(GL_QUADS, first << 2, count << 2);
 	
 	// Once finished, disable arrays
 	for (unsigned int i = 0; i < P_ATTRIBS; i++)
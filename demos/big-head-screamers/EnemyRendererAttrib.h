@@ -16,6 +16,8 @@
 #include "Extensions.h"
 #include "ProgramArray.h"
 #include "Enemy.h"
+#include "VBO.h"
+#include "TextureAtlas.h"
 
 #include <vector>
 using namespace std;
@@ -46,7 +48,7 @@ private:
 
 	GLuint UseProgram(int index) const;
 
-	GLuint uiAtlas;
+	TextureAtlas atlas;
 
 	struct SpriteVertexData
 	{
@@ -64,13 +66,18 @@ private:
 			translation = t;
 		}
 	};
-	SpriteVertexData *attrib;
+	// Vertices written by the last Update() and their offset in the stream
+	auto_ptr<StreamingVBO> pStream;
+	const GLvoid *pAttrib;
+	// Number of sprites written by the last Update()
+	unsigned int uiNumSprites;
 
 	bool LoadSprites();
 
-	static Point2 TexCoord(Point2 coord, int index);
+	friend class SpriteAttribTask;
 
-	bool SetAttribPointer(GLint loc, size_t size, GLenum type, void *address) const;
+	bool SetAttribPointer(GLint loc, size_t size, GLenum type,
+		const GLvoid *address) const;
 	bool UnsetAttribPointer(GLint loc) const;
 
 public:
@@ -78,12 +85,15 @@ public:
 	~EnemyRendererAttrib();
 
 	virtual bool Update(const ptr_vector<Enemy> &data, const float angle,
-		const float height);
+		const float height, const unsigned int *order = NULL,
+		const unsigned int count = 0);
 
 	virtual void Render(const ptr_vector<Enemy> &data, const float angle,
 		const float height) const;	
 
-	static const unsigned int NumSprites;
+	virtual void Render(unsigned int first, unsigned int count) const;
+
+	virtual unsigned int NumSprites() const { return atlas.NumRects(); }
 };
 
 #endif
@@ -14,6 +14,7 @@
 #include "EnemyRendererBasic.h"
 #include "GLResourceManager.h"
 #include "Misc.h"
+#include "GLStateCache.h"
 
 #define _USE_MATH_DEFINES
 #include <math.h>
@@ -61,13 +62,15 @@ bool EnemyRendererBasic::LoadSprites()
 void EnemyRendererBasic::Render(const vector<Enemy *> &data, const float angle,
 		const float height) const
 {
+	GLStateCache &state = GLStateCache::Instance();
+
 	vector<Enemy *>::const_iterator iter;
 	// Alternative method: render each sprite one by one
-	glUseProgram(Program(P_SPRITE));
+	state.UseProgram(Program(P_SPRITE));
 	for (iter = data.begin(); iter != data.end(); iter++)
 	{
-		glBindTexture(GL_TEXTURE_2D,
-			uiSprite[(dynamic_cast<SpriteEnemy *>(*iter))->GetTextureIndex()]);
+		state.BindTexture(GL_TEXTURE_2D,
+			uiSprite[(*iter)->GetTextureIndex()]);
 
 		glPushMatrix();
 
@@ -0,0 +1,188 @@
+/*****************************************************************************
+ * Filename			EnemyRendererInstanced.cpp
+ * 
+ * License			GPLv3
+ *
+ * Author			Andrea Bizzotto (bizz84@gmail.com)
+ *
+ * Platform			LinuxX11 / OpenGL
+ * 
+ * Description		Enemy renderer based on instanced arrays
+ *
+ *****************************************************************************/
+
+#include "EnemyRendererInstanced.h"
+#include "Enemy.h"
+#include "Misc.h"
+#include "Settings.h"
+#include "ThreadPool.h"
+#include "GLStateCache.h"
+
+#define _USE_MATH_DEFINES
+#include <math.h>
+
+#include <stdio.h>
+#include <assert.h>
+
+/*****************************************************************************
+ * EnemyRendererInstanced implementation
+ *****************************************************************************/
+static const char *Options[] = { "INSTANCED" };
+
+// Unit quad in triangle strip order: position, texcoord
+static const float QuadVertices[] = {
+	-0.5f, -1.0f, 0.0f, 1.0f,
+	 0.5f, -1.0f, 1.0f, 1.0f,
+	-0.5f,  1.0f, 0.0f, 0.0f,
+	 0.5f,  1.0f, 1.0f, 0.0f,
+};
+
+// Minimum number of sprites worth splitting across threads
+static const unsigned int ParallelThreshold = 4096;
+
+EnemyRendererInstanced::EnemyRendererInstanced()
+	: variants("data/shaders/SpriteAttrib.vert", "data/shaders/Sprite.frag",
+	Options, 1), uiProgram(0)
+{
+	GLResourceManager &loader = GLResourceManager::Instance();
+
+	assert(variants.Get(V_INSTANCED, uiProgram));
+	assert(LoadSprites());
+
+	attribLoc[A_TRANSLATE] = loader.GetAttrib(uiProgram, "inTranslate");
+	attribLoc[A_ROT_ANGLE] = loader.GetAttrib(uiProgram, "inRotAngle");
+	attribLoc[A_TEX_INDEX] = loader.GetAttrib(uiProgram, "inTexIndex");
+	scaleUni = loader.GetUniform(uiProgram, "Scale");
+	texRectsUni = loader.GetUniform(uiProgram, "TexRects");
+
+	// Upload the UV table once: offset and size of each sprite
+	vector<float> rects(4 * NumSprites());
+	for (unsigned int i = 0; i < NumSprites(); i++)
+	{
+		const AtlasRect &rect = atlas.Rect(i);
+		rects[4 * i] = rect.u0;
+		rects[4 * i + 1] = rect.v0;
+		rects[4 * i + 2] = rect.u1 - rect.u0;
+		rects[4 * i + 3] = rect.v1 - rect.v0;
+	}
+	GLStateCache::Instance().UseProgram(uiProgram);
+	texRectsUni.Set4fv(&rects[0], NumSprites());
+
+	pQuadVBO = auto_ptr<VBO>(new VBO((void *)QuadVertices,
+		sizeof(float) * 4, 4));
+	pQuadVBO->SetVertexData(0, 2);
+	pQuadVBO->SetTexCoordData(sizeof(float) * 2);
+
+	pInstanceVBO = auto_ptr<InstanceVBO>(
+		new InstanceVBO(sizeof(SpriteInstanceData)));
+	pInstanceVBO->AddAttrib(attribLoc[A_TRANSLATE], 3, 0);
+	pInstanceVBO->AddAttrib(attribLoc[A_ROT_ANGLE], 1, sizeof(Vector3));
+	pInstanceVBO->AddAttrib(attribLoc[A_TEX_INDEX], 1,
+		sizeof(Vector3) + sizeof(float));
+
+	aInstances.reserve(Settings::Instance().NumEnemies);
+}
+
+bool EnemyRendererInstanced::LoadSprites()
+{
+	// Load texture atlas (hand drawn ones are a 5 x 2 grid)
+	if (!atlas.Load("data/textures/sprites/Atlas.bmp",
+		GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR_MIPMAP_LINEAR, 5, 2))
+		return false;
+	if (atlas.NumRects() > MAX_SPRITES)
+		printf("Only the first %d of %d sprites can be used\n", MAX_SPRITES,
+			atlas.NumRects());
+	return true;
+}
+
+unsigned int EnemyRendererInstanced::NumSprites() const
+{
+	return atlas.NumRects() < MAX_SPRITES ? atlas.NumRects() :
+		(unsigned int)MAX_SPRITES;
+}
+
+/*****************************************************************************
+ * SpriteInstanceTask implementation
+ *****************************************************************************/
+
+// Writes the instance records of a range of sprites
+class SpriteInstanceTask : public ThreadTask
+{
+public:
+	const ptr_vector<Enemy> *data;
+	const unsigned int *order;
+	unsigned int n;
+	float radAngle;
+	float height;
+	EnemyRendererInstanced::SpriteInstanceData *instances;
+
+	virtual void Run(unsigned int index, unsigned int count)
+	{
+		unsigned int begin, end;
+		ThreadPool::Range(n, index, count, begin, end);
+
+		for (unsigned int i = begin; i < end; i++)
+		{
+			const Enemy &enemy = (*data)[order ? order[i] : i];
+			EnemyRendererInstanced::SpriteInstanceData &instance = instances[i];
+			instance.translation = Point3(enemy.pos[0], height, enemy.pos[1]);
+			instance.rotAngle = radAngle;
+			instance.texIndex = (float)enemy.GetTextureIndex();
+		}
+	}
+};
+
+bool EnemyRendererInstanced::Update(const ptr_vector<Enemy> &data,
+	const float angle, const float height,
+	const unsigned int *order/* = NULL*/, const unsigned int count/* = 0*/)
+{
+	// Only listed (visible) enemies are written
+	const unsigned int n = order ? count : data.size();
+	aInstances.resize(n);
+	if (!n)
+		return false;
+
+	SpriteInstanceTask task;
+	task.data = &data;
+	task.order = order;
+	task.n = n;
+	task.radAngle = angle * M_PI / 180.0f;
+	task.height = height;
+	task.instances = &aInstances[0];
+
+	if (n >= ParallelThreshold)
+		ThreadPool::Instance().Execute(task);
+	else
+		task.Run(0, 1);
+
+	pInstanceVBO->Update(&aInstances[0], n);
+	return true;
+}
+
+// BindTexture happens outside
+void EnemyRendererInstanced::Render(const ptr_vector<Enemy> &/*data*/,
+	const float /*angle*/, const float /*height*/) const
+{
+	Render(0, aInstances.size());
+}
+
+void EnemyRendererInstanced::Render(unsigned int first, unsigned int count) const
+{
+	GLStateCache &state = GLStateCache::Instance();
+
+	if (!count)
+		return;
+
+	state.BindTexture(GL_TEXTURE_2D, atlas.Texture());
+
+	state.UseProgram(uiProgram);
+	scaleUni.Set1f(Settings::Instance().EnemyScale);
+
+	pQuadVBO->Bind();
+	pInstanceVBO->Bind(first);
+
+	pQuadVBO->DrawInstanced(GL_TRIANGLE_STRIP, count);
+
+	pInstanceVBO->Unbind();
+	pQuadVBO->Unbind();
+}
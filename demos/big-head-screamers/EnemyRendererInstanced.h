@@ -0,0 +1,91 @@
+/*****************************************************************************
+ * Filename			EnemyRendererInstanced.h
+ * 
+ * License			GPLv3
+ *
+ * Author			Andrea Bizzotto (bizz84@gmail.com)
+ *
+ * Platform			LinuxX11 / OpenGL
+ * 
+ * Description		Enemy renderer based on instanced arrays
+ *
+ *****************************************************************************/
+#ifndef _ENEMY_RENDERER_INSTANCED_H_
+#define _ENEMY_RENDERER_INSTANCED_H_
+
+#include "Extensions.h"
+#include "GLResourceManager.h"
+#include "ShaderVariants.h"
+#include "Enemy.h"
+#include "VBO.h"
+#include "TextureAtlas.h"
+
+#include <memory>
+#include <vector>
+using namespace std;
+
+/*****************************************************************************
+ * Derived class (one draw call for all enemies via hardware instancing)
+ *****************************************************************************/
+
+// Each enemy is a single 20 bytes record in a streamed instance buffer, while
+// the unit quad is stored once in a static VBO. Compared to
+// EnemyRendererAttrib, which replicates all attributes on four vertices
+// (112 bytes per enemy), this uploads about 5 times less data per frame.
+// Requires instanced arrays (see InstanceVBO::IsSupported())
+class EnemyRendererInstanced : public EnemyRenderer
+{
+	// Options of the SpriteAttrib shader variants
+	enum { V_INSTANCED = 1 };
+	ShaderVariants variants;
+	GLuint uiProgram;
+
+	// Per instance attributes
+	enum {
+		A_TRANSLATE,
+		A_ROT_ANGLE,
+		A_TEX_INDEX,
+		P_ATTRIBS
+	};
+	GLint attribLoc[P_ATTRIBS];
+
+	UniformHandle scaleUni;
+	// UV table of the atlas
+	UniformHandle texRectsUni;
+
+	// Size of the TexRects array of SpriteAttrib.vert
+	enum { MAX_SPRITES = 64 };
+	TextureAtlas atlas;
+
+	struct SpriteInstanceData
+	{
+		Vector3 translation;
+		float rotAngle;
+		// Index in the UV table of the atlas
+		float texIndex;
+	};
+	vector<SpriteInstanceData> aInstances;
+
+	auto_ptr<VBO> pQuadVBO;
+	auto_ptr<InstanceVBO> pInstanceVBO;
+
+	bool LoadSprites();
+
+	friend class SpriteInstanceTask;
+
+public:
+	EnemyRendererInstanced();
+
+	virtual bool Update(const ptr_vector<Enemy> &data, const float angle,
+		const float height, const unsigned int *order = NULL,
+		const unsigned int count = 0);
+
+	virtual void Render(const ptr_vector<Enemy> &data, const float angle,
+		const float height) const;	
+
+	virtual void Render(unsigned int first, unsigned int count) const;
+
+	virtual unsigned int NumSprites() const;
+};
+
+#endif
@@ -16,28 +16,46 @@
 #include "Bullet.h" // Bullet part of it
 #include "GLResourceManager.h"
 #include "Mesh.h"
+#include "GLStateCache.h"
 
 #include <assert.h>
 
 
-static const char *Shaders[] = {
-	"data/shaders/Grenade.vert", "data/shaders/Grenade.frag",
-};
+static const char *Options[] = { "INSTANCED" };
 
 GrenadeRenderer::GrenadeRenderer()
+	: variants("data/shaders/Grenade.vert", "data/shaders/Grenade.frag",
+	Options, 1), uiProgram(0)
 {
 	pMesh[0] = pMesh[1] = NULL;
 
-	assert(LoadShaders(Shaders, NUM_PROGRAMS));
-
-
 	GLResourceManager &loader = GLResourceManager::Instance();
 
-	unsigned int index;
-	assert(loader.Load3DSFile("data/scenes/grenade.3ds", index));
+	// Read from the mesh cache, the 3DS file is only parsed to rebuild it
 	int permutation[] = { 0, 1, 2 };
-	pMesh[0] = new Mesh(loader.FindMesh(index, "Sphere"), Settings::Instance().GrenadeSize, false, permutation);
-	pMesh[1] = new Mesh(loader.FindMesh(index, "Sphere.001"), Settings::Instance().GrenadeSize, false, permutation);
+	const char *names[] = { "Sphere", "Sphere.001" };
+	const bool loaded = Mesh::Load("data/scenes/grenade.3ds", names, 2, pMesh, Settings::Instance().GrenadeSize, false, permutation);
+	assert(loaded);
+
+	// The instanced variant is only built if it can be used
+	GLint attribLoc[NUM_ATTRIBS] = { -1, -1 };
+	if (InstanceVBO::IsSupported() && variants.Get(V_INSTANCED, uiProgram))
+	{
+		attribLoc[A_TRANSLATE] = loader.GetAttrib(uiProgram, "inTranslate");
+		attribLoc[A_ROTATE] = loader.GetAttrib(uiProgram, "inRotate");
+	}
+	bInstanced = attribLoc[A_TRANSLATE] != -1 && attribLoc[A_ROTATE] != -1;
+	if (!bInstanced)
+		assert(variants.Get(0, uiProgram));
+	colorUni = loader.GetUniform(uiProgram, "Color");
+
+	if (bInstanced)
+	{
+		pInstanceVBO = auto_ptr<InstanceVBO>(
+			new InstanceVBO(sizeof(GrenadeInstance)));
+		pInstanceVBO->AddAttrib(attribLoc[A_TRANSLATE], 3, 0);
+		pInstanceVBO->AddAttrib(attribLoc[A_ROTATE], 2, sizeof(Vector3));
+	}
 }
 
 GrenadeRenderer::~GrenadeRenderer()
@@ -47,28 +65,35 @@ GrenadeRenderer::~GrenadeRenderer()
 }
 
 // TODO: Implement same approach as in LaserRenderer
-void GrenadeRenderer::Render(const list<Bullet *> &bullets) const
+void GrenadeRenderer::Render(const BulletPool &bullets) const
 {
+	if (bullets.Empty())
+		return;
+
+	if (bInstanced)
+	{
+		RenderInstanced(bullets);
+		return;
+	}
+
 	// TODO: This is pre-render (factor out as the function is templatized)
 	float color[] = { 0.8f, 0.8f, 0.8f, 1.0f };
-	GLuint shader = Program(P_GRENADE);
-	glUseProgram(shader);
-	glUniform4fv(GetUniLoc(shader, "Color"), 1, color);
+	GLStateCache::Instance().UseProgram(uiProgram);
+	colorUni.Set4fv(color);
 
 	//glEnableClientState(GL_VERTEX_ARRAY);
 	//glEnableClientState(GL_NORMAL_ARRAY);
 
-	list<Bullet *>::const_iterator iter;
 
 	// Render all instances of mesh 0
 	pMesh[0]->GetVBO()->Bind();
-	for (iter = bullets.begin(); iter != bullets.end(); iter++)
+	for (unsigned int i = 0; i < bullets.Size(); i++)
 	{
 		glPushMatrix();
-		const Point3 &pos = (*iter)->GetPosition();
+		const Point3 &pos = bullets.GetPosition(i);
 		glTranslatef(pos[0], pos[1], pos[2]);
-		glRotatef(-(*iter)->GetAngleY() * 180.0f / M_PI, 0.0f, 1.0f, 0.0f);
-		glRotatef(-(*iter)->GetAngleX() * 180.0f / M_PI, 1.0f, 0.0f, 0.0f);
+		glRotatef(-bullets.GetAngleY(i) * 180.0f / M_PI, 0.0f, 1.0f, 0.0f);
+		glRotatef(-bullets.GetAngleX(i) * 180.0f / M_PI, 1.0f, 0.0f, 0.0f);
 		glRotatef(180.0f, 0.0f, 1.0f, 0.0f);
 		pMesh[0]->GetVBO()->Draw(GL_TRIANGLES);
 		glPopMatrix();
@@ -77,15 +102,15 @@ void GrenadeRenderer::Render(const list<Bullet *> &bullets) const
 
 	// Render all instances of mesh 1
 	pMesh[1]->GetVBO()->Bind();
-	for (iter = bullets.begin(); iter != bullets.end(); iter++)
+	for (unsigned int i = 0; i < bullets.Size(); i++)
 	{
 		glPushMatrix();
-		const Point3 &pos = (*iter)->GetPosition();
+		const Point3 &pos = bullets.GetPosition(i);
 		glTranslatef(pos[0], pos[1], pos[2]);
-		glRotatef(-(*iter)->GetAngleY() * 180.0f / M_PI, 0.0f, 1.0f, 0.0f);
-		glRotatef(-(*iter)->GetAngleX() * 180.0f / M_PI, 1.0f, 0.0f, 0.0f);
+		glRotatef(-bullets.GetAngleY(i) * 180.0f / M_PI, 0.0f, 1.0f, 0.0f);
+		glRotatef(-bullets.GetAngleX(i) * 180.0f / M_PI, 1.0f, 0.0f, 0.0f);
 		glRotatef(180.0f, 0.0f, 1.0f, 0.0f);
-		pMesh[0]->GetVBO()->Draw(GL_TRIANGLES);
+		pMesh[1]->GetVBO()->Draw(GL_TRIANGLES);
 		glPopMatrix();
 	}
 	pMesh[1]->GetVBO()->Unbind();
@@ -94,3 +119,32 @@ void GrenadeRenderer::Render(const list<Bullet *> &bullets) const
 	//glDisableClientState(GL_NORMAL_ARRAY);
 	//glDisableClientState(GL_VERTEX_ARRAY);
 }
+
+void GrenadeRenderer::RenderInstanced(const BulletPool &bullets) const
+{
+	float color[] = { 0.8f, 0.8f, 0.8f, 1.0f };
+	GLStateCache::Instance().UseProgram(uiProgram);
+	colorUni.Set4fv(color);
+
+	// Same transformation as the glRotatef() calls above, 180 degrees
+	// around y are applied in the shader
+	const unsigned int n = bullets.Size();
+	aInstances.resize(n);
+	for (unsigned int i = 0; i < n; i++)
+	{
+		aInstances[i].translate = bullets.GetPosition(i);
+		aInstances[i].rotate = Vector2(-bullets.GetAngleX(i),
+			-bullets.GetAngleY(i));
+	}
+	pInstanceVBO->Update(&aInstances[0], n);
+
+	// Both meshes share the same instance data
+	for (unsigned int i = 0; i < 2; i++)
+	{
+		pMesh[i]->GetVBO()->Bind();
+		pInstanceVBO->Bind();
+		pMesh[i]->GetVBO()->DrawInstanced(GL_TRIANGLES, n);
+		pInstanceVBO->Unbind();
+		pMesh[i]->GetVBO()->Unbind();
+	}
+}
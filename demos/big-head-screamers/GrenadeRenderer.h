@@ -14,24 +14,53 @@
 #define _GRENADE_RENDERER_H_
 
 #include "Extensions.h"
-#include "ProgramArray.h"
 #include "BulletRenderer.h"
+#include "GLResourceManager.h"
+#include "ShaderVariants.h"
+#include "VBO.h"
+#include "Vector.h"
+
+#include <memory>
+#include <vector>
 
-#include <list>
 using namespace std;
 
-class Bullet;
+class BulletPool;
 class Mesh;
 
-class GrenadeRenderer : public BulletRenderer, private ProgramArray
+// Draws each of the two grenade meshes with one instanced call if supported,
+// one call per grenade otherwise
+class GrenadeRenderer : public BulletRenderer
 {
-	enum { P_GRENADE, NUM_PROGRAMS };
+	// Options of the Grenade shader variants
+	enum { V_INSTANCED = 1 };
+
+	enum { A_TRANSLATE, A_ROTATE, NUM_ATTRIBS };
+
+	struct GrenadeInstance
+	{
+		Vector3 translate;
+		Vector2 rotate;
+	};
 
 	Mesh *pMesh[2];
+
+	// Only the variant in use is compiled
+	ShaderVariants variants;
+	GLuint uiProgram;
+
+	UniformHandle colorUni;
+
+	bool bInstanced;
+	auto_ptr<InstanceVBO> pInstanceVBO;
+	mutable vector<GrenadeInstance> aInstances;
+
+	void RenderInstanced(const BulletPool &bullets) const;
 public:
 	GrenadeRenderer();
 	~GrenadeRenderer();
-	virtual void Render(const list<Bullet *> &bullets) const;
+	virtual void Render(const BulletPool &bullets) const;
+	virtual GLuint GetProgram() const { return uiProgram; }
 };
 
 #endif
@@ -15,6 +15,7 @@
 #include "GLResourceManager.h"
 #include "Ground.h"
 #include "Misc.h"
+#include "GLStateCache.h"
 
 static const char *Shaders[] = {
 	"data/shaders/Infinite.vert", "data/shaders/Infinite.frag",
@@ -29,16 +30,20 @@ static const char *Textures[] = {
 
 bool Ground::LoadTextures()
 {
-	GLResourceManager &loader = GLResourceManager::Instance();
+	// The others are loaded when selected
+	SelectTexture(0);
+	return AsyncLoader::Instance().Wait(apTexture[0]);
+}
 
-	for (unsigned int i = 0; i < NUM_TEXTURES; i++)
+void Ground::SelectTexture(unsigned int index)
+{
+	uiCurTexture = index;
+	// Load texture for ground
+	if (!apTexture[index])
 	{
-		// Load texture for ground
-		if (!loader.LoadTextureFromFile(Textures[i],
-			uiTexture[i], GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR_MIPMAP_LINEAR))
-			return false;
+		apTexture[index] = AsyncLoader::Instance().LoadTexture(
+			Textures[index], GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR_MIPMAP_LINEAR);
 	}
-	return true;
 }
 
 bool Ground::Init()
@@ -47,7 +52,7 @@ bool Ground::Init()
 		return false;
 	// set samplers
 	GLuint program = Program(P_INFINITE);
-	glUseProgram(program);
+	GLStateCache::Instance().UseProgram(program);
 	glUniform1i(GetUniLoc(program, "sTexture"), 0);
 	glUniform1i(GetUniLoc(program, "sTexture2"), 1);
 
@@ -56,6 +61,9 @@ bool Ground::Init()
 	loc[L_POS_OFFSET] = GetUniLoc(program, "PosOffset");
 	loc[L_SCREEN_INV] = GetUniLoc(program, "ScreenInv");
 
+	// Ground is drawn a few times per frame (view and reflection)
+	pStream = auto_ptr<StreamingVBO>(new StreamingVBO(4 * sizeof(vGround)));
+
 	return LoadTextures();
 }
 
@@ -67,6 +75,27 @@ void Ground::Input(const Matrix4 &invProjView,
 	// adding the xz offset to the texture coordinates
 	Vector3 fakePos = Vector3(0.0f, eyePos[1], 0.0f);
 
+	// The selected texture replaces the drawn one once loaded, or is
+	// dropped if it failed
+	const AsyncTexture *selected = apTexture[uiCurTexture];
+	if (selected->IsDone())
+	{
+		if (selected->IsReady())
+			uiShownTexture = uiCurTexture;
+		else
+			uiCurTexture = uiShownTexture;
+	}
+	// The others are released, so that they can be evicted
+	AsyncLoader &loader = AsyncLoader::Instance();
+	for (unsigned int i = 0; i < NUM_TEXTURES; i++)
+	{
+		if (apTexture[i] && i != uiShownTexture && i != uiCurTexture)
+		{
+			loader.Release(apTexture[i]);
+			apTexture[i] = NULL;
+		}
+	}
+
 	const float plane[] = { 0.0f, 1.0f, 0.0f, 0.0f };
 	uiInfPlaneVertices = InfinitePlane(vGround, plane, invProjView, fakePos,
 		zfar);
@@ -75,7 +104,12 @@ void Ground::Input(const Matrix4 &invProjView,
 void Ground::Render(const Vector3 &eyePos, const float zfar,
 	const unsigned int width, const unsigned int height) const
 {
-	glBindTexture(GL_TEXTURE_2D, CurrentTexture());
+	GLStateCache &state = GLStateCache::Instance();
+
+	if (!uiInfPlaneVertices)
+		return;
+
+	state.BindTexture(GL_TEXTURE_2D, CurrentTexture());
 
 	// Additional value for mix computation can be passed to the vertex shader
 	/*float arg[5];
@@ -88,7 +122,7 @@ void Ground::Render(const Vector3 &eyePos, const float zfar,
 
 	GLuint shader = Program(P_INFINITE);
 
-	glUseProgram(shader);
+	state.UseProgram(shader);
 
 	float screeninv[] = { 1.0f / (float)width, 1.0f / (float)height };
 	float texoffset[] = { eyePos[0], eyePos[2] };
@@ -103,7 +137,11 @@ void Ground::Render(const Vector3 &eyePos, const float zfar,
 
 	// Find out why passing w != 0 in the vertex array doesn't work either
 	//glVertexPointer(4, GL_FLOAT, sizeof(Vector4), &vAttrib);
-	glVertexPointer(3, GL_FLOAT, sizeof(Vector3), &vGround);
+	const GLvoid *offset = pStream->Upload(vGround,
+		sizeof(Vector3) * uiInfPlaneVertices);
+	pStream->Bind();
+	glVertexPointer(3, GL_FLOAT, sizeof(Vector3), offset);
+	pStream->Unbind();
 	glDrawArrays(GL_TRIANGLE_FAN, 0, uiInfPlaneVertices);
 
 	//glDisableClientState(GL_VERTEX_ARRAY);	
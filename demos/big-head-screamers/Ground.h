@@ -18,17 +18,25 @@
 #include "Vector.h"
 #include "Matrix.h"
 #include "ProgramArray.h"
+#include "VBO.h"
+#include "AsyncLoader.h"
 
 // is-implemented-in-terms-of
 class Ground : private ProgramArray
 {
 	enum { NUM_TEXTURES = 2 };
-	// Ground texture data
+	// Ground texture data: the selected texture, and the one drawn until
+	// the selected one is loaded
 	unsigned int uiCurTexture;
-	GLuint uiTexture[NUM_TEXTURES];
+	unsigned int uiShownTexture;
+	// Owned by AsyncLoader, NULL if not requested. Only the drawn and the
+	// selected textures are kept
+	AsyncTexture *apTexture[NUM_TEXTURES];
 
 	unsigned int uiInfPlaneVertices;
 	Vector3 vGround[5];
+	// Visible polygon is uploaded here when rendering
+	auto_ptr<StreamingVBO> pStream;
 
 	enum { L_ZFAR, L_TEX_REPEAT, L_POS_OFFSET, L_SCREEN_INV, NUM_LOCATIONS };
 	GLint loc[NUM_LOCATIONS];
@@ -36,13 +44,19 @@ class Ground : private ProgramArray
 	enum { P_INFINITE, NUM_PROGRAMS };
 
 	bool LoadTextures();
+	void SelectTexture(unsigned int index);
 public:
-	Ground() : uiCurTexture(0), uiInfPlaneVertices(0) { }
+	Ground() : uiCurTexture(0), uiShownTexture(0), uiInfPlaneVertices(0)
+	{
+		for (unsigned int i = 0; i < NUM_TEXTURES; i++)
+			apTexture[i] = NULL;
+	}
 
 	bool Init();
 
 	// Conceptually Input() and Render() are distinct since one
-	// updates the state, the other renders
+	// updates the state, the other renders. Input() also switches to the
+	// selected texture once loaded
 	void Input(const Matrix4 &invProjView,
 		const Vector3 &eyePos, const float zfar);
 
@@ -55,9 +69,13 @@ public:
 	const Vector3 &operator[](int i) const { return vGround[i]; }
 
 	// Texture methods
-	const GLuint CurrentTexture() const { return uiTexture[uiCurTexture]; }
-	void NextTexture() { uiCurTexture = Next(uiCurTexture, NUM_TEXTURES); }
-	void PrevTexture() { uiCurTexture = Prev(uiCurTexture, NUM_TEXTURES); }
+	// The previous texture is shown until the selected one is loaded
+	const GLuint CurrentTexture() const
+	{
+		return apTexture[uiShownTexture]->Get();
+	}
+	void NextTexture() { SelectTexture(Next(uiCurTexture, NUM_TEXTURES)); }
+	void PrevTexture() { SelectTexture(Prev(uiCurTexture, NUM_TEXTURES)); }
 };
 
 #endif
@@ -16,6 +16,7 @@
 #include "Bullet.h" // Bullet part of it
 #include "GLResourceManager.h"
 #include "Mesh.h"
+#include "GLStateCache.h"
 
 #include <assert.h>
 
@@ -24,120 +25,162 @@ static const char *Textures[] = {
 	"data/textures/256_64.bmp"
 };
 
-static const char *Shaders[] = {
-	"data/shaders/Laser.vert", "data/shaders/Laser.frag",
+static const char *Options[] = { "INSTANCED" };
+
+// Half width and half length of a laser
+static const float LaserWidth = 3.0f;
+static const float LaserLength = 3.0f * 8.0f;
+
+// Horizontal quad (a vertical one can be added for an X shaped laser)
+// Position and texture coordinates
+static const float QuadVertices[] = {
+	-LaserWidth, 0.0f, -LaserLength, 0.0f, 1.0f,
+	 LaserWidth, 0.0f, -LaserLength, 0.0f, 0.0f,
+	 LaserWidth, 0.0f,  LaserLength, 1.0f, 0.0f,
+	-LaserWidth, 0.0f,  LaserLength, 1.0f, 1.0f,
 };
 
 LaserRenderer::LaserRenderer()
+	: variants("data/shaders/Laser.vert", "data/shaders/Laser.frag",
+	Options, 1), uiProgram(0)
 {
-	assert(LoadShaders(Shaders, NUM_PROGRAMS));
-
-	GLuint shader = Program(P_LASER);
-	glUseProgram(shader);
+	GLResourceManager &loader = GLResourceManager::Instance();
 
-	iColorLoc = GetUniLoc(shader, "Color");
-	iTranslateLoc = GetUniLoc(shader, "Translate");
-	iRotateLoc = GetUniLoc(shader, "Rotate");
+	// The instanced variant is only built if it can be used
+	attribLoc[A_TRANSLATE] = attribLoc[A_ROTATE] = -1;
+	if (InstanceVBO::IsSupported() && variants.Get(V_INSTANCED, uiProgram))
+	{
+		attribLoc[A_TRANSLATE] = loader.GetAttrib(uiProgram, "inTranslate");
+		attribLoc[A_ROTATE] = loader.GetAttrib(uiProgram, "inRotate");
+	}
+	bInstanced = attribLoc[A_TRANSLATE] != -1 && attribLoc[A_ROTATE] != -1;
+	if (!bInstanced)
+	{
+		assert(variants.Get(0, uiProgram));
+		translateUni = loader.GetUniform(uiProgram, "Translate");
+		rotateUni = loader.GetUniform(uiProgram, "Rotate");
+	}
+	colorUni = loader.GetUniform(uiProgram, "Color");
 
-	// Should uniform array locations be non consecutive, use this
-	/*char name[15];
-	for (unsigned int i = 0; i < BATCH_SIZE; i++)
+	if (bInstanced)
 	{
-		sprintf(name, "Translate[%d]", i);
-		iTranslateLoc[i] = GetUniLoc(shader, name);
-		sprintf(name, "Rotate[%d]", i);
-		iRotateLoc[i] = GetUniLoc(shader, "Rotate");
-	}*/
-	
-	GLResourceManager &loader = GLResourceManager::Instance();
-	
+		pQuadVBO = auto_ptr<VBO>(new VBO((void *)QuadVertices,
+			sizeof(float) * 5, 4));
+		pQuadVBO->SetTexCoordData(sizeof(float) * 3);
+
+		pInstanceVBO = auto_ptr<InstanceVBO>(
+			new InstanceVBO(sizeof(LaserInstance)));
+		pInstanceVBO->AddAttrib(attribLoc[A_TRANSLATE], 3, 0);
+		pInstanceVBO->AddAttrib(attribLoc[A_ROTATE], 2, sizeof(Vector3));
+	}
+	else
+	{
+		// Replicate the quad BATCH_SIZE times, tagging it with its index.
+		// The geometry never changes, so it is stored in a static VBO
+		vector<float> batch(BATCH_SIZE * 4 * 6);
+		for (unsigned int i = 0; i < BATCH_SIZE; i++)
+		{
+			for (unsigned int j = 0; j < 4; j++)
+			{
+				float *v = &batch[(i * 4 + j) * 6];
+				v[0] = QuadVertices[j * 5 + 0];
+				v[1] = QuadVertices[j * 5 + 1];
+				v[2] = QuadVertices[j * 5 + 2];
+				v[3] = (float)i;
+				v[4] = QuadVertices[j * 5 + 3];
+				v[5] = QuadVertices[j * 5 + 4];
+			}
+		}
+		pBatchVBO = auto_ptr<VBO>(new VBO(&batch[0], sizeof(float) * 6,
+			BATCH_SIZE * 4));
+		pBatchVBO->SetVertexData(0, 4);
+		pBatchVBO->SetTexCoordData(sizeof(float) * 4);
+	}
+	if (Verbose(VerboseInfo))
+	{
+		printf("LaserRenderer: %s\n", bInstanced ? "instanced arrays" :
+			"uniform batches");
+	}
+
 	// Load texture for ground
 	assert(loader.LoadTextureFromFile(Textures[0],
 		uiTexture, GL_LINEAR, GL_LINEAR));
 	
 }
 
-void LaserRenderer::Render(const list<Bullet *> &bullets) const
+void LaserRenderer::Render(const BulletPool &bullets) const
 {
-	glDepthMask(0);
+	if (bullets.Empty())
+		return;
 
-	glBindTexture(GL_TEXTURE_2D, uiTexture);
-	glUseProgram(Program(P_LASER));
+	GLStateCache::Instance().BindTexture(GL_TEXTURE_2D, uiTexture);
+
+	if (bInstanced)
+		RenderInstanced(bullets);
+	else
+		RenderBatched(bullets);
+}
+
+void LaserRenderer::RenderInstanced(const BulletPool &bullets) const
+{
+	const unsigned int n = bullets.Size();
+
+	GLStateCache::Instance().UseProgram(uiProgram);
 
 	float color[] = { 1.0f, 1.0f, 0.0f, 1.0f };
-	glUniform4fv(iColorLoc, 1, color);
+	colorUni.Set4fv(color);
 
-	const float u = 1.0f;
-	const float z = 0.0f;
+	// Rotation angles are negated here rather than in the shader
+	aInstances.resize(n);
+	for (unsigned int i = 0; i < n; i++)
+	{
+		aInstances[i].translate = bullets.GetPosition(i);
+		aInstances[i].rotate = Vector2(-bullets.GetAngleX(i),
+			-bullets.GetAngleY(i));
+	}
 
-	float afTexAttrib[] = {
-		z, u,
-		z, z,
-		u, z,
-	    u, u,
-		z, u,
-		z, z,
-		u, z,
-	    u, u
-	};
-	glTexCoordPointer(2, GL_FLOAT, sizeof(float) * 2, afTexAttrib);
+	pQuadVBO->Bind();
+	pInstanceVBO->Update(&aInstances[0], n);
+	pInstanceVBO->Bind();
 
+	pQuadVBO->DrawInstanced(GL_QUADS, n);
 
-	list<Bullet *>::const_iterator iter;
+	pInstanceVBO->Unbind();
+	pQuadVBO->Unbind();
+}
 
-	
-	assert(bullets.size() <= 64); // TODO: Use multiple batches instead
+void LaserRenderer::RenderBatched(const BulletPool &bullets) const
+{
+	GLStateCache::Instance().UseProgram(uiProgram);
+
+	float color[] = { 1.0f, 1.0f, 0.0f, 1.0f };
+	colorUni.Set4fv(color);
+
+	pBatchVBO->Bind();
 
 	// The rotation can be calculated as a Matrix3 on the CPU and passed as such,
 	// or the two angles can be passed to the GPU as uniforms and the matrix 
 	// calculated in the vertex shader.
 	// The second approach is used here since the first doesn't seem to work
-	unsigned int i = 0;
-	//Matrix3 rotUni[64];
-	Vector2 rotUni[64];
-	Vector3 trUni[64];
-	for (iter = bullets.begin(); iter != bullets.end(); iter++, i++)
-	{
-		trUni[i] = (*iter)->GetPosition();
-		//rotUni[i] = (Matrix3::RotationY(-(*iter)->GetAngleY()) * Matrix3::RotationX(-(*iter)->GetAngleX()));
-		rotUni[i] = Vector2(-(*iter)->GetAngleX(), -(*iter)->GetAngleY());
-	}
-	glUniform3fv(iTranslateLoc, 64, (float *)&trUni);
-	glUniform2fv(iRotateLoc, 64, (float *)&rotUni);
-	//glUniformMatrix3fv(iRotateLoc, 64, GL_TRUE, (float *)&rotUni);
-
-	const float s = 3.0f;
-	const float z1 = -s * 8.0f;
-	const float z2 =  s * 8.0f;
+	Vector2 rotUni[BATCH_SIZE];
+	Vector3 trUni[BATCH_SIZE];
 
-	i = 0;
-	for (iter = bullets.begin(); iter != bullets.end(); iter++, i++)
+	const unsigned int n = bullets.Size();
+	for (unsigned int first = 0; first < n; first += BATCH_SIZE)
 	{
-		float afVertAttrib[] = {
-			-s, z, z1, (float)i,
-			 s, z, z1, (float)i,
-			 s, z, z2, (float)i,
-			-s, z, z2, (float)i,
-			z, -s, z1, (float)i,
-			z,  s, z1, (float)i,
-			z,  s, z2, (float)i,
-			z, -s, z2, (float)i,
-		};
-			
-		glVertexPointer(4, GL_FLOAT, sizeof(float) * 4, afVertAttrib);
-
-		// TODO: Measure performance improvement of pseudo-instanced approach
-		/*glPushMatrix();
-		const Point3 &pos = (*iter)->GetPosition();
-		glTranslatef(pos[0], pos[1], pos[2]);
-		//glScalef(AmmoSize, AmmoSize, AmmoSize);
-	
-		glRotatef(-(*iter)->GetAngleY() * 180.0f / M_PI, 0.0f, 1.0f, 0.0f);
-		glRotatef(-(*iter)->GetAngleX() * 180.0f / M_PI, 1.0f, 0.0f, 0.0f);
-		*/
-		glDrawArrays(GL_QUADS, 0, 4); // 8 to draw vertical one as well
-		
-		//glPopMatrix();
+		unsigned int count = n - first < BATCH_SIZE ? n - first :
+			(unsigned int)BATCH_SIZE;
+		for (unsigned int i = 0; i < count; i++)
+		{
+			trUni[i] = bullets.GetPosition(first + i);
+			rotUni[i] = Vector2(-bullets.GetAngleX(first + i),
+				-bullets.GetAngleY(first + i));
+		}
+		translateUni.Set3fv((float *)&trUni, count);
+		rotateUni.Set2fv((float *)&rotUni, count);
+
+		glDrawArrays(GL_QUADS, 0, count * 4);
 	}
-	glDepthMask(1);
+
+	pBatchVBO->Unbind();
 }
@@ -14,38 +14,71 @@
 #define _LASER_RENDERER_H_
 
 #include "Extensions.h"
-#include "ProgramArray.h"
 #include "BulletRenderer.h"
+#include "GLResourceManager.h"
+#include "ShaderVariants.h"
 
 #include "Vector.h"
+#include "VBO.h"
 
-#include <list>
+#include <memory>
+#include <vector>
 using namespace std;
 
-class Bullet;
+class BulletPool;
 
-// This uses a pseudo instancing approach (uniform batch)
-// TODO: Document
-class LaserRenderer : public BulletRenderer, private ProgramArray
+// Draws all lasers with a constant number of draw calls.
+// If instanced arrays are supported, the transformation of each laser is
+// streamed as per-instance attributes and everything is drawn in one call.
+// Otherwise lasers are drawn in batches of BATCH_SIZE, passing the
+// transformations as uniform arrays (pseudo instancing, one call per batch).
+class LaserRenderer : public BulletRenderer
 {
-	enum { P_LASER, NUM_PROGRAMS };
+	// Options of the Laser shader variants
+	enum { V_INSTANCED = 1 };
 
+	// Must match the size of the uniform arrays in Laser.vert
 	enum { BATCH_SIZE = 64 };
 
+	enum { A_TRANSLATE, A_ROTATE, NUM_ATTRIBS };
+
+	struct LaserInstance
+	{
+		Vector3 translate;
+		Vector2 rotate;
+	};
+
+	bool bInstanced;
+
+	// Only the variant in use is compiled
+	ShaderVariants variants;
+	GLuint uiProgram;
+
 	GLuint uiTexture;
-	GLint iColorLoc;
-	GLint iTranslateLoc;
-	GLint iRotateLoc;
+	UniformHandle colorUni;
+	// Uniform arrays (uniform path)
+	UniformHandle translateUni;
+	UniformHandle rotateUni;
+	GLint attribLoc[NUM_ATTRIBS];
+
+	// Single quad and per instance attributes (instanced path)
+	auto_ptr<VBO> pQuadVBO;
+	auto_ptr<InstanceVBO> pInstanceVBO;
+	mutable vector<LaserInstance> aInstances;
+
+	// BATCH_SIZE quads, w holds the index in the batch (uniform path)
+	auto_ptr<VBO> pBatchVBO;
 
-	
-	//Matrix3 rotUni[64];
-	//Vector2 rotUni[64];
-	//Vector3 trUni[64];
+	void RenderInstanced(const BulletPool &bullets) const;
+	void RenderBatched(const BulletPool &bullets) const;
 
 public:
 	LaserRenderer();
 	~LaserRenderer() { }
-	virtual void Render(const list<Bullet *> &bullets) const;
+	// Expects blending enabled and depth writes disabled
+	virtual void Render(const BulletPool &bullets) const;
+	virtual GLuint GetProgram() const { return uiProgram; }
+	virtual GLuint GetTexture() const { return uiTexture; }
 };
 
 #endif
@@ -17,6 +17,7 @@
 #include "Extensions.h"
 #include "Misc.h"
 #include "Settings.h"
+#include "VBO.h"
 
 ParticleEmitter::ParticleEmitter(const int n)
 	: numParticles(n), expired(false)
@@ -82,9 +83,21 @@ bool BloodDropEmitter::ParticleUpdate(Particle *p, const float dt)
 	return true;
 }
 
-void BloodDropEmitter::Render() const
+void BloodDropEmitter::Render(StreamingVBO &stream) const
 {
-	//glBindBuffer(GL_ARRAY_BUFFER_ARB, 0);
-	glVertexPointer(4, GL_FLOAT, sizeof(BloodParticle), particle);
+	if (!numParticles)
+		return;
+
+	// Only positions are needed, velocities are not uploaded
+	Point4 *pos = (Point4 *)stream.Map(sizeof(Point4) * numParticles);
+	for (unsigned int i = 0; i < numParticles; i++)
+		pos[i] = particle[i].pos;
+	const GLvoid *offset = stream.Unmap();
+	if (stream.ContentsLost())
+		return;
+
+	stream.Bind();
+	glVertexPointer(4, GL_FLOAT, sizeof(Point4), offset);
+	stream.Unbind();
 	glDrawArrays(GL_POINTS, 0, numParticles);
 }
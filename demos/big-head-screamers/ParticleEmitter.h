@@ -22,6 +22,8 @@
 
 using namespace std;
 
+class StreamingVBO;
+
 class ParticleEmitter
 {
 protected:
@@ -46,7 +48,12 @@ public:
 
 	bool Expired() const { return expired; }
 
-	virtual void Render() const { }
+	// Read access to particle positions (used for depth sorting)
+	unsigned int GetNumParticles() const { return numParticles; }
+	const Point4 &GetPosition(unsigned int i) const { return particle[i].pos; }
+
+	// Draws the particles, uploading them to stream
+	virtual void Render(StreamingVBO &/*stream*/) const { }
 };
 
 class BloodDropEmitter : public ParticleEmitter
@@ -62,7 +69,7 @@ protected:
 public:
 	BloodDropEmitter(const Point3 &pos, const int n);
 
-	virtual void Render() const;
+	virtual void Render(StreamingVBO &stream) const;
 };
 
 #endif
@@ -13,6 +13,7 @@
 
 #include "ParticleRenderer.h"
 #include "ParticleEmitter.h"
+#include "GLStateCache.h"
 
 #include <assert.h>
 
@@ -20,22 +21,41 @@ static const char *Shaders[] = {
 	"data/shaders/Particle.vert", "data/shaders/Particle.frag",
 };
 
+// Initial size of a stream region (grown if more particles are drawn)
+static const unsigned int StreamSize = 4096 * sizeof(Point4);
+
 ParticleRenderer::ParticleRenderer()
 {
 	assert(LoadShaders(Shaders, NUM_PROGRAMS));
+
+	pStream = auto_ptr<StreamingVBO>(new StreamingVBO(StreamSize));
 }
 
 
 void ParticleRenderer::Render(const ptr_list<ParticleEmitter> &particles) const
 {
 	GLuint shader = Program(P_PARTICLE);
-	glUseProgram(shader);
+	GLStateCache::Instance().UseProgram(shader);
 
 	//glEnableClientState(GL_VERTEX_ARRAY);
 	ptr_list<ParticleEmitter>::const_iterator iter;
 	for (iter = particles.begin(); iter != particles.end(); iter++)
 	{
-		iter->Render();
+		iter->Render(*pStream);
 	}
 	//glDisableClientState(GL_VERTEX_ARRAY);
-}
\ No newline at end of file
+}
+
+void ParticleRenderer::Render(const Point4 *points, unsigned int first,
+	unsigned int count) const
+{
+	GLStateCache::Instance().UseProgram(Program(P_PARTICLE));
+
+	// Only the batch is uploaded
+	const GLvoid *offset = pStream->Upload(points + first,
+		sizeof(Point4) * count);
+	pStream->Bind();
+	glVertexPointer(4, GL_FLOAT, sizeof(Point4), offset);
+	pStream->Unbind();
+	glDrawArrays(GL_POINTS, 0, count);
+}
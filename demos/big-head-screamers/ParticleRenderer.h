@@ -15,6 +15,8 @@
 
 #include "Extensions.h"
 #include "ProgramArray.h"
+#include "Vector.h"
+#include "VBO.h"
 
 #include "boost/ptr_container/ptr_list.hpp"
 using namespace boost;
@@ -25,10 +27,16 @@ class ParticleRenderer : private ProgramArray
 {
 	enum { P_PARTICLE, NUM_PROGRAMS };
 
+	// Points of all emitters and batches drawn in one frame
+	auto_ptr<StreamingVBO> pStream;
+
 public:
 	ParticleRenderer();
 	virtual ~ParticleRenderer() { }
 	void Render(const ptr_list<ParticleEmitter> &particles) const;
+	// Renders count points starting at first from a flat array
+	void Render(const Point4 *points, unsigned int first,
+		unsigned int count) const;
 };
 
 #endif
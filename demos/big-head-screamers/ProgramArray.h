@@ -15,6 +15,7 @@
 
 #include <stdio.h>
 #include "Extensions.h"
+#include "GLResourceManager.h"
 
 class ProgramArray
 {
@@ -23,6 +24,12 @@ private:
 protected:
 	GLuint Program(int index) const { return uiProgram[index]; }
 	bool LoadShaders(const char *Shaders[], const unsigned int n);
+	// Handle of a uniform of program index, to be looked up at load time
+	UniformHandle Uniform(int index, const char *name) const
+	{
+		return GLResourceManager::Instance().GetUniform(uiProgram[index],
+			name);
+	}
 public:
 	ProgramArray() : uiProgram(NULL) { }
 	virtual ~ProgramArray();
@@ -38,6 +38,7 @@ Settings::Settings() :
 	ParticleGravity(100.0f),
 	ParticleSpeed(15.0f),
 	PointSize(3.5f),
+	MaxParticles(200000),
 
 	// Near, Far values for projection matrix and distance from plane
 	Fov(90.0f),
@@ -61,7 +62,13 @@ Settings::Settings() :
 	LaserSpeed(16.0f),
 	LaserReload(0.1f),
 	LaserDamage(50),
-	LaserMaxDistance(40.0f)
+	LaserMaxDistance(40.0f),
+
+	GovernorBand(0.05f),
+	GovernorHoldTime(0.25f),
+
+	MaxOccluders(64),
+	OccluderScale(0.5f)
 {
 	// Read from configuration file or write it
 	if (!Read())
@@ -97,6 +104,7 @@ bool Settings::Read()
 		READ(stream, fieldName, ParticleGravity)
 		READ(stream, fieldName, ParticleSpeed)
 		READ(stream, fieldName, PointSize)
+		READ(stream, fieldName, MaxParticles)
 		READ(stream, fieldName, Fov)
 		READ(stream, fieldName, Near)
 		READ(stream, fieldName, Far)
@@ -114,6 +122,10 @@ bool Settings::Read()
 		READ(stream, fieldName, LaserReload)
 		READ(stream, fieldName, LaserDamage)
 		READ(stream, fieldName, LaserMaxDistance)
+		READ(stream, fieldName, GovernorBand)
+		READ(stream, fieldName, GovernorHoldTime)
+		READ(stream, fieldName, MaxOccluders)
+		READ(stream, fieldName, OccluderScale)
 		return true;
 	}
 	return false;
@@ -139,6 +151,7 @@ bool Settings::Write()
 		WRITE(ParticleGravity)
 		WRITE(ParticleSpeed)
 		WRITE(PointSize)
+		WRITE(MaxParticles)
 		WRITE(Fov)
 		WRITE(Near)
 		WRITE(Far)
@@ -155,7 +168,11 @@ bool Settings::Write()
 		WRITE(LaserSpeed)
 		WRITE(LaserReload)
 		WRITE(LaserDamage)
-		WRITE(LaserMaxDistance);
+		WRITE(LaserMaxDistance)
+		WRITE(GovernorBand)
+		WRITE(GovernorHoldTime)
+		WRITE(MaxOccluders)
+		WRITE(OccluderScale);
 
 	return true;
 }
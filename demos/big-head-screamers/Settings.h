@@ -42,6 +42,7 @@ public:
 	float ParticleGravity;
 	float ParticleSpeed;
 	float PointSize;
+	unsigned int MaxParticles;
 
 	// Near, Far values for projection matrix and distance from plane
 	float Fov;
@@ -67,6 +68,14 @@ public:
 	unsigned int LaserDamage;
 	float LaserMaxDistance;
 
+	// Frame governor: dead band (fraction of budget) and hold time
+	float GovernorBand;
+	float GovernorHoldTime;
+
+	// Occlusion culling: number of nearest sprites used as occluders and
+	// size of the occluder quad relative to the sprite
+	unsigned int MaxOccluders;
+	float OccluderScale;
 };
 
 #endif
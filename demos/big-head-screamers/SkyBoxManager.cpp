@@ -14,6 +14,7 @@
 #include "SkyBoxManager.h"
 #include "GLResourceManager.h"
 #include "Settings.h"
+#include "GLStateCache.h"
 	
 // Credit for cubemaps:
 // http://www.alusion-fr.com/
@@ -86,13 +87,26 @@ SkyBoxManager::SkyBoxManager() :
 	if (!SkyBoxTransition::Instance().Init())
 		return;
 
+	// Only the first cubemap is needed to start, the next one is loaded in
+	// the background
+	if (!cubemap[0].InitAsync(Cubemaps[0]) || !cubemap[0].Wait())
+		return;
+	Retain();
+	init = true;
+	assert(init);
+}
+
+void SkyBoxManager::Retain()
+{
+	const unsigned int next = Next(uiCurCubemap, NUM_CUBEMAPS);
 	for (unsigned int i = 0; i < NUM_CUBEMAPS; i++)
 	{
-		if (!cubemap[i].Init(Cubemaps[i]))
-			return;
+		if (i == uiCurCubemap || i == next ||
+			(i == uiPrevCubemap && CubemapTransition()))
+			cubemap[i].InitAsync(Cubemaps[i]);
+		else
+			cubemap[i].Release();
 	}
-	init = true;
-	assert(init);
 }
 
 
@@ -104,6 +118,13 @@ void SkyBoxManager::CubemapUpdate(bool next, const float time)
 		NextCubemap();
 	else
 		PrevCubemap();
+	fCubemapTransitionCur = 0.0f;
+	// Usually prefetched already, unless going backwards or switching
+	// right after startup
+	if (!cubemap[uiCurCubemap].InitAsync(Cubemaps[uiCurCubemap]) ||
+		!cubemap[uiCurCubemap].Wait())
+		uiCurCubemap = uiPrevCubemap;
+	Retain();
 }
 float SkyBoxManager::CubemapTransitionTime() const
 {
@@ -117,27 +138,33 @@ bool SkyBoxManager::CubemapTransition() const
 
 void SkyBoxManager::Update(const float time)
 {
+	const bool transition = CubemapTransition();
 	fCubemapTransitionCur = time - fCubemapTransitionStart;
+	// The previous cubemap isn't needed after the transition
+	if (transition && !CubemapTransition())
+		Retain();
 }
 
 void SkyBoxManager::Render() const
 {
+	GLStateCache &state = GLStateCache::Instance();
+
 	if (!init)
 		return;
 
 	glEnable(GL_TEXTURE_CUBE_MAP_EXT);
 	if (CubemapTransition())
 	{
-		glActiveTexture(GL_TEXTURE1);
-		glBindTexture(GL_TEXTURE_CUBE_MAP, CurrCubemap().Get());
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_CUBE_MAP, PrevCubemap().Get());
+		state.ActiveTexture(1);
+		state.BindTexture(GL_TEXTURE_CUBE_MAP, CurrCubemap().Get());
+		state.ActiveTexture(0);
+		state.BindTexture(GL_TEXTURE_CUBE_MAP, PrevCubemap().Get());
 
 		SkyBoxTransition::Instance().Render(CubemapTransitionTime());
 	}
 	else
 	{
-		glBindTexture(GL_TEXTURE_CUBE_MAP, CurrCubemap().Get());
+		state.BindTexture(GL_TEXTURE_CUBE_MAP, CurrCubemap().Get());
 
 		SkyBox::Instance().Render();
 	}		
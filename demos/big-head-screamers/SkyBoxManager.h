@@ -36,6 +36,10 @@ class SkyBoxManager
 	void PrevCubemap() { uiCurCubemap = Prev(uiCurCubemap, NUM_CUBEMAPS); }
 	bool CubemapTransition() const;
 	float CubemapTransitionTime() const;
+	// Keeps only the cubemaps in use (the previous one during a transition)
+	// and prefetches the next one, so that CubemapUpdate() doesn't wait.
+	// The others can be evicted by the texture budget
+	void Retain();
 public:
 	SkyBoxManager();
 
@@ -15,6 +15,7 @@
 #include "Misc.h"
 #include "Bullet.h" // Bullet part of it
 #include "GLResourceManager.h"
+#include "GLStateCache.h"
 
 #include <assert.h>
 
@@ -35,19 +36,37 @@ static const int TetraIndices[12] = {
 
 static const float AmmoSize = 5.0f;
 
-static const char *Shaders[] = {
-	"data/shaders/LookupColor.vert", "data/shaders/LookupColor.frag",
-};
+static const char *Options[] = { "INSTANCED" };
 
 TetraRenderer::TetraRenderer()
-	: pTetraVBO(NULL)
+	: variants("data/shaders/LookupColor.vert", "data/shaders/LookupColor.frag",
+	Options, 1), uiProgram(0), pTetraVBO(NULL)
 {
-	assert(LoadShaders(Shaders, NUM_PROGRAMS));
+	GLResourceManager &loader = GLResourceManager::Instance();
+
+	// The instanced variant is only built if it can be used
+	GLint loc = -1;
+	if (InstanceVBO::IsSupported() && variants.Get(V_INSTANCED, uiProgram))
+		loc = loader.GetAttrib(uiProgram, "inTranslate");
+	bInstanced = loc != -1;
+	if (!bInstanced)
+		assert(variants.Get(0, uiProgram));
+
+	colorUni = loader.GetUniform(uiProgram, "Color");
+	if (bInstanced)
+		scaleUni = loader.GetUniform(uiProgram, "Scale");
 
 	// Initialize vbo used for tetrahedron
 	pTetraVBO = new IndexedVBO((void *)TetraVertices, sizeof(float) * 5, 4,
 	                           (void *)TetraIndices, 12);
 	pTetraVBO->SetTexCoordData(sizeof(float) * 3);
+
+	if (bInstanced)
+	{
+		// Positions are uploaded straight from the bullet pool
+		pInstanceVBO = auto_ptr<InstanceVBO>(new InstanceVBO(sizeof(Point3)));
+		pInstanceVBO->AddAttrib(loc, 3, 0);
+	}
 }
 
 TetraRenderer::~TetraRenderer()
@@ -56,23 +75,30 @@ TetraRenderer::~TetraRenderer()
 }
 
 
-void TetraRenderer::Render(const list<Bullet *> &bullets) const
+void TetraRenderer::Render(const BulletPool &bullets) const
 {
+	if (bullets.Empty())
+		return;
+
+	if (bInstanced)
+	{
+		RenderInstanced(bullets);
+		return;
+	}
+
 	// TODO: This is pre-render (factor out as the function is templatized)
 	float color[] = { 1.0f, 1.0f, 0.0f, 1.0f };
-	GLuint shader = Program(P_LOOKUP_COLOR);
-	glUseProgram(shader);
-	glUniform4fv(GetUniLoc(shader, "Color"), 1, color);
+	GLStateCache::Instance().UseProgram(uiProgram);
+	colorUni.Set4fv(color);
 
 	//glEnableClientState(GL_VERTEX_ARRAY);
 	//glEnableClientState(GL_TEXTURE_COORD_ARRAY);
 
 	pTetraVBO->Bind();
-	list<Bullet *>::const_iterator iter;
-	for (iter = bullets.begin(); iter != bullets.end(); iter++)
+	for (unsigned int i = 0; i < bullets.Size(); i++)
 	{
 		glPushMatrix();
-		const Point3 &pos = (*iter)->GetPosition();
+		const Point3 &pos = bullets.GetPosition(i);
 		glTranslatef(pos[0], pos[1], pos[2]);
 		glScalef(AmmoSize, AmmoSize, AmmoSize);
 		pTetraVBO->Draw(GL_TRIANGLES);
@@ -85,3 +111,18 @@ void TetraRenderer::Render(const list<Bullet *> &bullets) const
 	//glDisableClientState(GL_TEXTURE_COORD_ARRAY);
 }
 
+void TetraRenderer::RenderInstanced(const BulletPool &bullets) const
+{
+	float color[] = { 1.0f, 1.0f, 0.0f, 1.0f };
+	GLStateCache::Instance().UseProgram(uiProgram);
+	colorUni.Set4fv(color);
+	scaleUni.Set1f(AmmoSize);
+
+	pInstanceVBO->Update(bullets.GetPositions(), bullets.Size());
+
+	pTetraVBO->Bind();
+	pInstanceVBO->Bind();
+	pTetraVBO->DrawInstanced(GL_TRIANGLES, bullets.Size());
+	pInstanceVBO->Unbind();
+	pTetraVBO->Unbind();
+}
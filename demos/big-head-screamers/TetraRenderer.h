@@ -14,24 +14,42 @@
 #define _TETRA_RENDERER_H_
 
 #include "Extensions.h"
-#include "ProgramArray.h"
 #include "BulletRenderer.h"
+#include "GLResourceManager.h"
+#include "ShaderVariants.h"
+#include "VBO.h"
+
+#include <memory>
 
-#include <list>
 using namespace std;
 
-class Bullet;
-class IndexedVBO;
+class BulletPool;
 
-class TetraRenderer : public BulletRenderer, private ProgramArray
+// Draws all tetras with one instanced call if supported, one call per tetra
+// otherwise. Instance data is the bullet position only
+class TetraRenderer : public BulletRenderer
 {
-	enum { P_LOOKUP_COLOR, NUM_PROGRAMS };
+	// Options of the LookupColor shader variants
+	enum { V_INSTANCED = 1 };
+
+	// Only the variant in use is compiled
+	ShaderVariants variants;
+	GLuint uiProgram;
 
 	IndexedVBO *pTetraVBO;
+
+	UniformHandle colorUni;
+	UniformHandle scaleUni;
+
+	bool bInstanced;
+	auto_ptr<InstanceVBO> pInstanceVBO;
+
+	void RenderInstanced(const BulletPool &bullets) const;
 public:
 	TetraRenderer();
 	~TetraRenderer();
-	virtual void Render(const list<Bullet *> &bullets) const;
+	virtual void Render(const BulletPool &bullets) const;
+	virtual GLuint GetProgram() const { return uiProgram; }
 };
 
 #endif
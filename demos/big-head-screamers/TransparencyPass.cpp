@@ -0,0 +1,407 @@
+/*****************************************************************************
+ * Filename			TransparencyPass.cpp
+ *
+ * License			GPLv3
+ *
+ * Author			Andrea Bizzotto (bizz84@gmail.com)
+ *
+ * Platform			LinuxX11 / OpenGL
+ *
+ * Description		Depth sorting of blended primitives (enemy sprites and
+ *					blood particles)
+ *
+ *****************************************************************************/
+
+#include "TransparencyPass.h"
+#include "Enemy.h"
+#include "ParticleEmitter.h"
+#include "ParticleRenderer.h"
+#include "CameraController.h"
+#include "ThreadPool.h"
+#include "Misc.h"
+#include "Frustum.h"
+#include "OcclusionBuffer.h"
+#include "Settings.h"
+
+#define _USE_MATH_DEFINES
+#include <math.h>
+
+#include <algorithm>
+
+// Depth is quantized to 22 bits, so that the sort takes two 11 bit passes
+static const unsigned int KeyBits = 22;
+
+// Particles are culled as spheres of this radius
+static const float ParticleRadius = 1.0f;
+
+// Minimum number of primitives worth splitting across threads
+static const unsigned int ParallelThreshold = 16384;
+
+/*****************************************************************************
+ * DepthTask implementation
+ *****************************************************************************/
+
+// Computes view space z of a range of points (first phase) and quantizes it
+// into integer keys (second phase)
+class DepthTask : public ThreadTask
+{
+public:
+	enum { MaxJobs = 16 };
+	enum Phase { DEPTH, QUANTIZE };
+
+	Phase ePhase;
+	const Point4 *points;
+	float *depth;
+	unsigned int *keys;
+	unsigned int n;
+	// View z axis and eye position
+	Vector3 axis;
+	Vector3 eye;
+	// Range of z for each job
+	float zMin[MaxJobs];
+	float zMax[MaxJobs];
+	// Quantization parameters
+	float fMin;
+	float fScale;
+
+	virtual void Run(unsigned int index, unsigned int count)
+	{
+		unsigned int begin, end;
+		ThreadPool::Range(n, index, count, begin, end);
+
+		if (ePhase == DEPTH)
+		{
+			float *z = depth;
+			float lo = 0.0f, hi = 0.0f;
+			const float ax = axis[0], ay = axis[1], az = axis[2];
+			const float ex = eye[0], ey = eye[1], ez = eye[2];
+			for (unsigned int i = begin; i < end; i++)
+			{
+				const Point4 &p = points[i];
+				float d = ax * (p[0] - ex) + ay * (p[1] - ey) + az * (p[2] - ez);
+				z[i] = d;
+				if (i == begin || d < lo)
+					lo = d;
+				if (i == begin || d > hi)
+					hi = d;
+			}
+			zMin[index] = lo;
+			zMax[index] = hi;
+		}
+		else
+		{
+			const float *z = depth;
+			for (unsigned int i = begin; i < end; i++)
+				keys[i] = (unsigned int)((z[i] - fMin) * fScale);
+		}
+	}
+};
+
+/*****************************************************************************
+ * TransparencyPass implementation
+ *****************************************************************************/
+
+TransparencyPass::TransparencyPass() : uiSprites(0), pEnemyRenderer(NULL),
+	pParticleRenderer(NULL)
+{
+	sorter.SetParallelThreshold(ParallelThreshold);
+}
+
+void TransparencyPass::GatherSprites(const ptr_vector<Enemy> &enemies,
+	const float height, const Frustum *frustum, const Frustum *mirrorFrustum)
+{
+	aPoints.clear();
+	aSpriteIndex.clear();
+	aInView.clear();
+	aInMirror.clear();
+
+	// Bounding sphere of the sprite quad (see EnemyRendererAttrib)
+	const float radius = 1.12f * Settings::Instance().EnemyScale;
+	const unsigned int numEnemies = enemies.size();
+
+	aSpheres.resize(numEnemies);
+	aVisible.resize(numEnemies);
+	aVisibleMirror.resize(numEnemies);
+	for (unsigned int i = 0; i < numEnemies; i++)
+	{
+		const Vector2 &pos = enemies[i].pos;
+		aSpheres[i] = Point4(pos[0], height, pos[1], radius);
+		aVisible[i] = 1;
+		aVisibleMirror[i] = 0;
+	}
+	if (frustum && numEnemies)
+	{
+		frustum->CullSpheres(&aSpheres[0], numEnemies, &aVisible[0]);
+		if (mirrorFrustum)
+		{
+			mirrorFrustum->CullSpheres(&aSpheres[0], numEnemies,
+				&aVisibleMirror[0]);
+		}
+	}
+
+	// Sprites are sorted by their center
+	for (unsigned int i = 0; i < numEnemies; i++)
+	{
+		if (aVisible[i] || aVisibleMirror[i])
+		{
+			aPoints.push_back(aSpheres[i]);
+			aSpriteIndex.push_back(i);
+			aInView.push_back(aVisible[i]);
+			aInMirror.push_back(aVisibleMirror[i]);
+		}
+	}
+	uiSprites = aPoints.size();
+}
+
+void TransparencyPass::OccludeSprites(const FPSCamera &camera,
+	OcclusionBuffer &occlusion, OcclusionBuffer *mirrorOcclusion)
+{
+	const Settings &s = Settings::Instance();
+
+	// Nearest sprites visible in view are the occluders
+	const Vector3 eye = camera.GetPosition();
+	aDistances.clear();
+	for (unsigned int i = 0; i < uiSprites; i++)
+	{
+		if (aInView[i])
+		{
+			const Point4 &p = aPoints[i];
+			Vector3 d(p[0] - eye[0], p[1] - eye[1], p[2] - eye[2]);
+			aDistances.push_back(make_pair(d.dot(d), i));
+		}
+	}
+	unsigned int numOccluders = aDistances.size();
+	if (numOccluders > s.MaxOccluders)
+	{
+		numOccluders = s.MaxOccluders;
+		nth_element(aDistances.begin(), aDistances.begin() + numOccluders,
+			aDistances.end());
+	}
+
+	// Opaque part of the sprite quad, rotated as in EnemyRendererAttrib
+	const float radAngle = -camera.GetAlpha() * M_PI / 180.0f;
+	const float w = 0.5f * s.EnemyScale * s.OccluderScale;
+	const float h = s.EnemyScale * s.OccluderScale;
+	const Vector3 right(w * cos(radAngle), 0.0f, -w * sin(radAngle));
+	const Vector3 up(0.0f, h, 0.0f);
+	for (unsigned int k = 0; k < numOccluders; k++)
+	{
+		const Point4 &p = aPoints[aDistances[k].second];
+		const Vector3 c(p[0], p[1], p[2]);
+		const Vector3 v[] = {
+			c - right - up, c + right - up, c + right + up, c - right + up
+		};
+		occlusion.AddQuad(v[0], v[1], v[2], v[3]);
+		if (mirrorOcclusion)
+			mirrorOcclusion->AddQuad(v[0], v[1], v[2], v[3]);
+	}
+	occlusion.Rasterize();
+	if (mirrorOcclusion)
+		mirrorOcclusion->Rasterize();
+
+	if (uiSprites == 0)
+		return;
+
+	// Sprites visible in the reflection are not culled by the main view
+	occlusion.TestSpheres(&aPoints[0], uiSprites, &aInView[0]);
+	if (mirrorOcclusion)
+		mirrorOcclusion->TestSpheres(&aPoints[0], uiSprites, &aInMirror[0]);
+
+	unsigned int count = 0;
+	for (unsigned int i = 0; i < uiSprites; i++)
+	{
+		if (aInView[i] || aInMirror[i])
+		{
+			aPoints[count] = aPoints[i];
+			aSpriteIndex[count] = aSpriteIndex[i];
+			count++;
+		}
+	}
+	aPoints.resize(count);
+	aSpriteIndex.resize(count);
+	uiSprites = count;
+}
+
+void TransparencyPass::GatherParticles(const ptr_list<ParticleEmitter> &particles,
+	const Frustum *frustum, OcclusionBuffer *occlusion)
+{
+	// Particles below ground are done with and not visible
+	ptr_list<ParticleEmitter>::const_iterator e;
+	for (e = particles.begin(); e != particles.end(); e++)
+	{
+		const unsigned int first = aPoints.size();
+		AABB box;
+		for (unsigned int i = 0; i < e->GetNumParticles(); i++)
+		{
+			const Point4 &p = e->GetPosition(i);
+			if (p[1] < 0.0f)
+				continue;
+			aPoints.push_back(p);
+			for (unsigned int j = 0; j < 3; j++)
+			{
+				if (aPoints.size() == first + 1 || p[j] < box.vMin[j])
+					box.vMin[j] = p[j];
+				if (aPoints.size() == first + 1 || p[j] > box.vMax[j])
+					box.vMax[j] = p[j];
+			}
+		}
+
+		// Drop the whole emitter if hidden
+		if (occlusion && aPoints.size() > first)
+		{
+			const Vector3 r(ParticleRadius, ParticleRadius, ParticleRadius);
+			box.vMin = box.vMin - r;
+			box.vMax = box.vMax + r;
+			if (occlusion->BoxOccluded(box))
+				aPoints.resize(first);
+		}
+	}
+
+	// Compact visible particles (they are not drawn in the reflection)
+	const unsigned int numParticles = aPoints.size() - uiSprites;
+	if (frustum && numParticles)
+	{
+		aCulled.resize(numParticles);
+		Point4 *p = &aPoints[uiSprites];
+		unsigned int count = frustum->CullPoints(p, numParticles,
+			ParticleRadius, &aCulled[0]);
+		for (unsigned int i = 0; i < count; i++)
+			p[i] = p[aCulled[i]];
+		aPoints.resize(uiSprites + count);
+	}
+}
+
+void TransparencyPass::ComputeKeys(const FPSCamera &camera)
+{
+	const unsigned int n = aPoints.size();
+	aDepth.resize(n);
+	aKeys.resize(n);
+
+	// The view z axis is the third row of the camera rotation. Points with
+	// smaller z are further away, so ascending z order is back to front
+	Matrix3 rot = AlphaBetaRotation(camera.GetAlpha() * M_PI / 180.0f,
+		camera.GetBeta() * M_PI / 180.0f);
+
+	DepthTask task;
+	task.points = &aPoints[0];
+	task.depth = &aDepth[0];
+	task.keys = &aKeys[0];
+	task.n = n;
+	task.axis = Vector3(rot[2][0], rot[2][1], rot[2][2]);
+	task.eye = camera.GetPosition();
+
+	ThreadPool &pool = ThreadPool::Instance();
+	unsigned int jobs = n >= ParallelThreshold ? pool.NumThreads() : 1;
+	if (jobs > DepthTask::MaxJobs)
+		jobs = DepthTask::MaxJobs;
+
+	task.ePhase = DepthTask::DEPTH;
+	if (jobs > 1)
+		pool.Execute(task, jobs);
+	else
+		task.Run(0, 1);
+
+	float lo = task.zMin[0], hi = task.zMax[0];
+	for (unsigned int j = 1; j < jobs; j++)
+	{
+		if (task.zMin[j] < lo)
+			lo = task.zMin[j];
+		if (task.zMax[j] > hi)
+			hi = task.zMax[j];
+	}
+
+	task.ePhase = DepthTask::QUANTIZE;
+	task.fMin = lo;
+	// Slightly less than 2^KeyBits to avoid overflow due to rounding
+	task.fScale = hi > lo ? (float)((1 << KeyBits) - 2) / (hi - lo) : 0.0f;
+	if (jobs > 1)
+		pool.Execute(task, jobs);
+	else
+		task.Run(0, 1);
+}
+
+void TransparencyPass::BuildStream(const unsigned int *sorted)
+{
+	const unsigned int n = aKeys.size();
+	aSpriteOrder.resize(uiSprites);
+	aParticles.resize(n - uiSprites);
+	aBatches.clear();
+
+	unsigned int numSprites = 0, numParticles = 0;
+	for (unsigned int i = 0; i < n; i++)
+	{
+		unsigned int index = sorted[i];
+		PrimitiveType type = index < uiSprites ? TypeSprite : TypeParticle;
+		if (type == TypeSprite)
+			aSpriteOrder[numSprites] = aSpriteIndex[index];
+		else
+			aParticles[numParticles] = aPoints[index];
+
+		// Start a new batch when the primitive type changes
+		if (aBatches.empty() || aBatches.back().type != type)
+		{
+			Batch b;
+			b.type = type;
+			b.first = type == TypeSprite ? numSprites : numParticles;
+			b.count = 0;
+			aBatches.push_back(b);
+		}
+		aBatches.back().count++;
+
+		if (type == TypeSprite)
+			numSprites++;
+		else
+			numParticles++;
+	}
+}
+
+void TransparencyPass::Update(const ptr_vector<Enemy> &enemies,
+	const float height, const ptr_list<ParticleEmitter> &particles,
+	const FPSCamera &camera, const Frustum *frustum/* = NULL*/,
+	const Frustum *mirrorFrustum/* = NULL*/,
+	OcclusionBuffer *occlusion/* = NULL*/,
+	OcclusionBuffer *mirrorOcclusion/* = NULL*/)
+{
+	GatherSprites(enemies, height, frustum, mirrorFrustum);
+	if (occlusion)
+		OccludeSprites(camera, *occlusion, mirrorOcclusion);
+	GatherParticles(particles, frustum, occlusion);
+	if (aPoints.empty())
+	{
+		aKeys.clear();
+		aSpriteOrder.clear();
+		aParticles.clear();
+		aBatches.clear();
+		return;
+	}
+	ComputeKeys(camera);
+
+	const unsigned int *sorted = sorter.Sort(&aKeys[0], aKeys.size());
+
+	BuildStream(sorted);
+}
+
+void TransparencyPass::Submit(RenderQueue::Recorder &recorder,
+	unsigned int pass, const EnemyRenderer &enemyRenderer,
+	const ParticleRenderer &particleRenderer, unsigned int particleMask)
+{
+	pEnemyRenderer = &enemyRenderer;
+	pParticleRenderer = &particleRenderer;
+
+	// Batches are already sorted back to front, their order is the key
+	for (unsigned int i = 0; i < aBatches.size(); i++)
+	{
+		recorder.Submit(RenderQueue::OrderKey(pass, i), this, i, 0, 0,
+			RenderPacket::BLEND,
+			aBatches[i].type == TypeSprite ? ~0U : particleMask);
+	}
+}
+
+void TransparencyPass::Execute(unsigned int param) const
+{
+	const Batch &batch = aBatches[param];
+	if (batch.type == TypeSprite)
+		pEnemyRenderer->Render(batch.first, batch.count);
+	else
+		pParticleRenderer->Render(&aParticles[0], batch.first, batch.count);
+}
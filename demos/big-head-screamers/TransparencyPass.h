@@ -0,0 +1,144 @@
+/*****************************************************************************
+ * Filename			TransparencyPass.h
+ *
+ * License			GPLv3
+ *
+ * Author			Andrea Bizzotto (bizz84@gmail.com)
+ *
+ * Platform			LinuxX11 / OpenGL
+ *
+ * Description		Depth sorting of blended primitives (enemy sprites and
+ *					blood particles)
+ *
+ *****************************************************************************/
+#ifndef _TRANSPARENCY_PASS_H_
+#define _TRANSPARENCY_PASS_H_
+
+#include "Vector.h"
+#include "RadixSort.h"
+#include "RenderQueue.h"
+
+#include <vector>
+using namespace std;
+
+#include "boost/ptr_container/ptr_list.hpp"
+#include "boost/ptr_container/ptr_vector.hpp"
+using namespace boost;
+
+class Enemy;
+class EnemyRenderer;
+class ParticleEmitter;
+class ParticleRenderer;
+class FPSCamera;
+class Frustum;
+class OcclusionBuffer;
+
+// Computes view depth for all blended primitives, sorts them back to front
+// and produces a single ordered stream made of batches of the same type.
+// Sprites all stand at the same height, so mirroring them shifts their view
+// depths by the same amount and their order also holds in the mirrored
+// (reflection) pass. Particles don't: they are masked out of that pass (see
+// Submit()) rather than sorted again.
+class TransparencyPass : public RenderCommand
+{
+public:
+	enum PrimitiveType { TypeSprite, TypeParticle };
+
+	// Consecutive primitives of the same type, drawn with one call
+	struct Batch
+	{
+		PrimitiveType type;
+		unsigned int first;
+		unsigned int count;
+	};
+
+private:
+	// Positions of all primitives: sprites first, then particles
+	vector<Point4> aPoints;
+	// View space z of aPoints and corresponding quantized keys
+	vector<float> aDepth;
+	vector<unsigned int> aKeys;
+	unsigned int uiSprites;
+	// Enemy index of each visible sprite in aPoints
+	vector<unsigned int> aSpriteIndex;
+	// Culling of sprites (bounding spheres, visibility in view and
+	// reflection) and particles (visible indices)
+	vector<Point4> aSpheres;
+	vector<unsigned char> aVisible;
+	vector<unsigned char> aVisibleMirror;
+	vector<unsigned int> aCulled;
+	// Visibility of the sprites in aPoints in view and reflection, and
+	// distances used to choose the occluders
+	vector<unsigned char> aInView;
+	vector<unsigned char> aInMirror;
+	vector<pair<float, unsigned int> > aDistances;
+
+	RadixSort sorter;
+
+	// Output stream
+	vector<unsigned int> aSpriteOrder;
+	vector<Point4> aParticles;
+	vector<Batch> aBatches;
+
+	// Renderers used by Execute(), set by Submit()
+	const EnemyRenderer *pEnemyRenderer;
+	const ParticleRenderer *pParticleRenderer;
+
+	// Gathers the positions of visible enemies into aPoints
+	void GatherSprites(const ptr_vector<Enemy> &enemies, const float height,
+		const Frustum *frustum, const Frustum *mirrorFrustum);
+
+	// Renders the nearest sprites into the occlusion buffers and removes
+	// the sprites they hide from aPoints
+	void OccludeSprites(const FPSCamera &camera, OcclusionBuffer &occlusion,
+		OcclusionBuffer *mirrorOcclusion);
+
+	// Appends the positions of visible particles to aPoints. Emitters are
+	// tested as a whole against the occlusion buffer
+	void GatherParticles(const ptr_list<ParticleEmitter> &particles,
+		const Frustum *frustum, OcclusionBuffer *occlusion);
+
+	// Fills aKeys so that ascending order is back to front
+	void ComputeKeys(const FPSCamera &camera);
+
+	// Builds aSpriteOrder, aParticles and aBatches from the sorted indices
+	void BuildStream(const unsigned int *sorted);
+
+public:
+	TransparencyPass();
+
+	// Sorts all the primitives (called once per frame). If a frustum is
+	// given, sprites and particles outside of it are dropped. Sprites inside
+	// mirrorFrustum (the frustum of the reflection pass) are kept too.
+	// Occlusion buffers must have been started with Begin(): the nearest
+	// sprites are rendered into them, and the sprites and particles they
+	// hide are dropped (sprites only if hidden in both views)
+	void Update(const ptr_vector<Enemy> &enemies, const float height,
+		const ptr_list<ParticleEmitter> &particles, const FPSCamera &camera,
+		const Frustum *frustum = NULL, const Frustum *mirrorFrustum = NULL,
+		OcclusionBuffer *occlusion = NULL,
+		OcclusionBuffer *mirrorOcclusion = NULL);
+
+	// Indices of visible enemies sorted back to front (used by
+	// EnemyRenderer::Update). Never NULL, so that a frame with every enemy
+	// culled writes no sprites rather than all of them
+	const unsigned int *GetSpriteOrder() const
+	{
+		static const unsigned int none = 0;
+		return aSpriteOrder.empty() ? &none : &aSpriteOrder[0];
+	}
+	unsigned int NumSprites() const { return aSpriteOrder.size(); }
+
+	const vector<Batch> &GetBatches() const { return aBatches; }
+	unsigned int NumPrimitives() const { return aKeys.size(); }
+
+	// Records one blended packet per batch, in order. Particle batches are
+	// only drawn in the views of particleMask
+	void Submit(RenderQueue::Recorder &recorder, unsigned int pass,
+		const EnemyRenderer &enemyRenderer,
+		const ParticleRenderer &particleRenderer, unsigned int particleMask);
+	// Draws batch param
+	virtual void Execute(unsigned int param) const;
+};
+
+#endif
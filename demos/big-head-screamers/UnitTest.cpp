@@ -26,6 +26,22 @@
 #include "boost/shared_ptr.hpp"
 #include "boost/ptr_container/ptr_list.hpp"
 #include "boost/ptr_container/ptr_vector.hpp"
+#include "GLStateCache.h"
+#include "RadixSort.h"
+#include "Frustum.h"
+#include "OcclusionBuffer.h"
+#include "MeshOptimizer.h"
+#include "MeshFile.h"
+#include "Image.h"
+#include "TextureFile.h"
+#include "TextureAtlas.h"
+#include "RenderQueue.h"
+#include "ResourceRegistry.h"
+#include "FrameGovernor.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
 
 using namespace boost;
 
@@ -198,19 +214,21 @@ void UnitTestRun()
 
 bool AttribTest()
 {
+	GLStateCache &state = GLStateCache::Instance();
+
 	GLResourceManager &loader = GLResourceManager::Instance();
 	GLuint texture, program;
 	if (!loader.LoadTextureFromFile("data/textures/Sprites/BER01.bmp",
 			texture, GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR_MIPMAP_LINEAR))
 		return false;
 
-	glBindTexture(GL_TEXTURE_2D, texture);
+	state.BindTexture(GL_TEXTURE_2D, texture);
 
 	if (!loader.LoadShaderFromFile("data/shaders/TestAttrib.vert", "data/shaders/Lookup.frag", program))
 		return false;
 
 
-	glUseProgram(program);
+	state.UseProgram(program);
 
 	//glEnableClientState(GL_VERTEX_ARRAY);	
 	//glEnableClientState(GL_TEXTURE_COORD_ARRAY);
@@ -332,3 +350,992 @@ void TestList()
 
 	return;
 }
+
+/*****************************************************************************
+ * Behavior tests
+ *****************************************************************************/
+
+// Prints what if the test failed
+static bool Check(bool ok, const char *what)
+{
+	if (!ok)
+		printf("  failed: %s\n", what);
+	return ok;
+}
+
+// True if order is a stable ascending permutation of the n keys
+template <class Key>
+static bool IsSortedPermutation(const Key *keys, const unsigned int *order,
+	unsigned int n)
+{
+	vector<bool> seen(n, false);
+	for (unsigned int i = 0; i < n; i++)
+	{
+		if (order[i] >= n || seen[order[i]])
+			return false;
+		seen[order[i]] = true;
+		if (i == 0)
+			continue;
+		const Key a = keys[order[i - 1]], b = keys[order[i]];
+		// Equal keys keep their input order
+		if (a > b || (a == b && order[i - 1] > order[i]))
+			return false;
+	}
+	return true;
+}
+
+bool RadixSortTest()
+{
+	bool ok = true;
+	RadixSort sorter;
+	// Force the multithreaded path on small inputs too
+	sorter.SetParallelThreshold(256);
+
+	srand(1);
+	const unsigned int n = 10000;
+	vector<unsigned int> keys(n);
+	vector<unsigned long long> keys64(n);
+	for (unsigned int i = 0; i < n; i++)
+	{
+		// Few distinct values in the low digits, so that there are ties
+		keys[i] = ((unsigned int)rand() << 16) ^ (rand() & 0x3f);
+		keys64[i] = ((unsigned long long)keys[i] << 29) ^ (rand() & 0x7);
+	}
+
+	for (unsigned int parallel = 0; parallel < 2; parallel++)
+	{
+		ok &= Check(IsSortedPermutation(&keys[0],
+			sorter.Sort(&keys[0], n, parallel != 0), n), "32 bit keys");
+		ok &= Check(IsSortedPermutation(&keys64[0],
+			sorter.Sort(&keys64[0], n, parallel != 0), n), "64 bit keys");
+	}
+
+	// Digits shared by all keys are skipped, the order must still be right
+	vector<unsigned int> same(n);
+	for (unsigned int i = 0; i < n; i++)
+		same[i] = 0x7f000000u | (i % 3);
+	ok &= Check(IsSortedPermutation(&same[0], sorter.Sort(&same[0], n), n),
+		"keys with constant digits");
+
+	unsigned int one = 42;
+	ok &= Check(sorter.Sort(&one, 1)[0] == 0, "single key");
+
+	// FloatKey() keeps the order of floats, of both signs
+	const float floats[] = {
+		-1e30f, -2.5f, -1.0f, -1e-30f, 0.0f, 1e-30f, 0.5f, 1.0f, 3.0f, 1e30f
+	};
+	const unsigned int numFloats = sizeof(floats) / sizeof(floats[0]);
+	for (unsigned int i = 1; i < numFloats; i++)
+	{
+		ok &= Check(RadixSort::FloatKey(floats[i - 1]) <
+			RadixSort::FloatKey(floats[i]), "FloatKey order");
+	}
+	return ok;
+}
+
+static float Random(float lo, float hi)
+{
+	return lo + (hi - lo) * rand() / (float)RAND_MAX;
+}
+
+bool FrustumTest()
+{
+	bool ok = true;
+	Frustum frustum;
+
+	// With the identity, the frustum is the [-1, 1] cube
+	ok &= Check(frustum.Extract(Matrix4::Identity()), "Extract");
+	ok &= Check(!frustum.Extract(Matrix4::Identity()),
+		"Extract of the same matrix");
+	ok &= Check(frustum.NumPlanes() == Frustum::MAX_PLANES, "cube planes");
+	ok &= Check(frustum.SphereVisible(Vector3(0.0f, 0.0f, 0.0f), 0.1f),
+		"sphere inside");
+	ok &= Check(frustum.SphereVisible(Vector3(1.05f, 0.0f, 0.0f), 0.1f),
+		"sphere across a plane");
+	ok &= Check(!frustum.SphereVisible(Vector3(1.2f, 0.0f, 0.0f), 0.1f),
+		"sphere right");
+	ok &= Check(!frustum.SphereVisible(Vector3(0.0f, -1.2f, 0.0f), 0.1f),
+		"sphere below");
+	ok &= Check(!frustum.SphereVisible(Vector3(0.0f, 0.0f, 1.2f), 0.1f),
+		"sphere beyond far");
+
+	// Infinite perspective, 90 degrees, aspect 2, near 1: the far plane
+	// degenerates and is dropped
+	const float n = 1.0f;
+	Matrix4 proj(
+		0.5f, 0.0f,  0.0f,  0.0f,
+		0.0f, 1.0f,  0.0f,  0.0f,
+		0.0f, 0.0f, -1.0f, -2.0f * n,
+		0.0f, 0.0f, -1.0f,  0.0f);
+	frustum.Extract(proj);
+	ok &= Check(frustum.NumPlanes() == Frustum::MAX_PLANES - 1,
+		"infinite far plane");
+	ok &= Check(frustum.SphereVisible(Vector3(0.0f, 0.0f, -10.0f), 1.0f),
+		"sphere ahead");
+	ok &= Check(frustum.SphereVisible(Vector3(0.0f, 0.0f, -1e6f), 1.0f),
+		"sphere far ahead");
+	ok &= Check(!frustum.SphereVisible(Vector3(0.0f, 0.0f, 10.0f), 1.0f),
+		"sphere behind");
+	ok &= Check(!frustum.SphereVisible(Vector3(25.0f, 0.0f, -10.0f), 1.0f),
+		"sphere outside the side");
+	ok &= Check(frustum.SphereVisible(Vector3(19.5f, 0.0f, -10.0f), 1.0f),
+		"sphere inside the side");
+
+	// The batch versions (SIMD, 4 at a time) agree with SphereVisible(),
+	// with a count that isn't a multiple of 4
+	srand(2);
+	const unsigned int count = 1001;
+	vector<Vector4> spheres(count);
+	vector<AABB> boxes(count);
+	for (unsigned int i = 0; i < count; i++)
+	{
+		spheres[i] = Vector4(Random(-60.0f, 60.0f), Random(-30.0f, 30.0f),
+			Random(-40.0f, 20.0f), Random(0.0f, 5.0f));
+		const Vector3 center(spheres[i][0], spheres[i][1], spheres[i][2]);
+		const Vector3 extent(spheres[i][3], spheres[i][3], spheres[i][3]);
+		boxes[i].vMin = center - extent;
+		boxes[i].vMax = center + extent;
+	}
+	vector<unsigned char> mask(count), hints(count, Frustum::VISIBLE);
+	vector<unsigned int> indices(count), coherent(count), points(count);
+	frustum.CullSpheres(&spheres[0], count, &mask[0]);
+	const unsigned int visible = frustum.CullSpheres(&spheres[0], count,
+		&indices[0]);
+	// Twice, so that the second test starts from the hints of the first
+	frustum.CullSpheres(&spheres[0], count, &hints[0], &coherent[0]);
+	const unsigned int visibleCoherent = frustum.CullSpheres(&spheres[0],
+		count, &hints[0], &coherent[0]);
+	const unsigned int visiblePoints = frustum.CullPoints(&spheres[0], count,
+		2.0f, &points[0]);
+
+	unsigned int expected = 0, expectedPoints = 0;
+	bool agree = true, agreePoints = true, agreeBoxes = true;
+	for (unsigned int i = 0; i < count; i++)
+	{
+		const Vector3 center(spheres[i][0], spheres[i][1], spheres[i][2]);
+		const bool in = frustum.SphereVisible(center, spheres[i][3]);
+		if (in)
+		{
+			agree &= expected < visible && indices[expected] == i &&
+				expected < visibleCoherent && coherent[expected] == i;
+			expected++;
+		}
+		agree &= mask[i] == (in ? 1 : 0);
+		if (frustum.SphereVisible(center, 2.0f))
+		{
+			agreePoints &= expectedPoints < visiblePoints &&
+				points[expectedPoints] == i;
+			expectedPoints++;
+		}
+		// Boxes bound the spheres, so they are visible at least as often
+		agreeBoxes &= !in || frustum.BoxVisible(boxes[i]);
+	}
+	ok &= Check(agree && expected == visible && expected == visibleCoherent,
+		"CullSpheres against SphereVisible");
+	ok &= Check(agreePoints && expectedPoints == visiblePoints,
+		"CullPoints against SphereVisible");
+	ok &= Check(agreeBoxes, "boxes around visible spheres");
+	ok &= Check(visible > 0 && visible < count, "mix of visible spheres");
+
+	vector<unsigned char> boxMask(count);
+	frustum.CullBoxes(&boxes[0], count, &boxMask[0]);
+	bool agreeBoxMask = true;
+	for (unsigned int i = 0; i < count; i++)
+		agreeBoxMask &= boxMask[i] == (frustum.BoxVisible(boxes[i]) ? 1 : 0);
+	ok &= Check(agreeBoxMask, "CullBoxes against BoxVisible");
+	return ok;
+}
+
+// True if the ray from the origin through p crosses the square of half
+// size s centered on the z axis at z = -d
+static bool ThroughSquare(const Vector3 &p, float d, float s)
+{
+	if (p[2] >= 0.0f)
+		return false;
+	const float t = d / -p[2];
+	return fabs(p[0] * t) <= s && fabs(p[1] * t) <= s;
+}
+
+bool OcclusionTest()
+{
+	bool ok = true;
+	const float zNear = 1.0f;
+	// Camera at the origin looking down -z, 90 degrees, aspect 2
+	const Matrix4 proj(
+		0.5f, 0.0f,  0.0f,  0.0f,
+		0.0f, 1.0f,  0.0f,  0.0f,
+		0.0f, 0.0f, -1.0f, -2.0f * zNear,
+		0.0f, 0.0f, -1.0f,  0.0f);
+
+	OcclusionBuffer buffer;
+	ok &= Check(buffer.GetWidth() % OcclusionBuffer::TILE_WIDTH == 0 &&
+		buffer.GetHeight() % OcclusionBuffer::TILE_HEIGHT == 0, "tile size");
+
+	// Nothing hides anything without occluders
+	buffer.Begin(proj, zNear);
+	buffer.Rasterize();
+	ok &= Check(!buffer.SphereOccluded(Vector3(0.0f, 0.0f, -50.0f), 1.0f),
+		"empty buffer");
+
+	// A 10x10 wall 10 units ahead
+	const float wall = 10.0f, half = 5.0f;
+	buffer.Begin(proj, zNear);
+	buffer.AddQuad(Vector3(-half, -half, -wall), Vector3(half, -half, -wall),
+		Vector3(half, half, -wall), Vector3(-half, half, -wall));
+	buffer.Rasterize();
+	ok &= Check(buffer.SphereOccluded(Vector3(0.0f, 0.0f, -20.0f), 1.0f),
+		"sphere behind the wall");
+	ok &= Check(!buffer.SphereOccluded(Vector3(0.0f, 0.0f, -5.0f), 1.0f),
+		"sphere in front of the wall");
+	ok &= Check(!buffer.SphereOccluded(Vector3(0.0f, 0.0f, -20.0f), 15.0f),
+		"sphere larger than the wall");
+	ok &= Check(!buffer.SphereOccluded(Vector3(20.0f, 0.0f, -20.0f), 1.0f),
+		"sphere beside the wall");
+	ok &= Check(!buffer.SphereOccluded(Vector3(0.0f, 0.0f, -10.5f), 1.0f),
+		"sphere through the wall");
+	ok &= Check(!buffer.SphereOccluded(Vector3(0.0f, 0.0f, 0.0f), 1.0f),
+		"sphere around the camera");
+	AABB box = { Vector3(-1.0f, -1.0f, -30.0f), Vector3(1.0f, 1.0f, -20.0f) };
+	ok &= Check(buffer.BoxOccluded(box), "box behind the wall");
+	box.vMin[0] = 10.0f;
+	box.vMax[0] = 12.0f;
+	ok &= Check(!buffer.BoxOccluded(box), "box beside the wall");
+
+	// Conservative: every sphere found hidden is really behind the wall.
+	// Its surface is sampled, each sample must be seen through the wall
+	srand(3);
+	const unsigned int count = 2000;
+	vector<Vector4> spheres(count);
+	for (unsigned int i = 0; i < count; i++)
+	{
+		spheres[i] = Vector4(Random(-20.0f, 20.0f), Random(-20.0f, 20.0f),
+			Random(-60.0f, -2.0f), Random(0.1f, 4.0f));
+	}
+	vector<unsigned char> mask(count, 1);
+	const unsigned int hidden = buffer.TestSpheres(&spheres[0], count,
+		&mask[0]);
+
+	unsigned int counted = 0;
+	bool conservative = true, agree = true;
+	for (unsigned int i = 0; i < count; i++)
+	{
+		const Vector3 c(spheres[i][0], spheres[i][1], spheres[i][2]);
+		const float r = spheres[i][3];
+		agree &= (mask[i] == 0) == buffer.SphereOccluded(c, r);
+		if (mask[i])
+			continue;
+		counted++;
+		conservative &= c[2] + r < -wall;
+		for (unsigned int j = 0; j < 64; j++)
+		{
+			const float theta = (float)M_PI * (j / 8 + 0.5f) / 8.0f;
+			const float phi = 2.0f * (float)M_PI * (j % 8) / 8.0f;
+			const Vector3 p(c[0] + r * sin(theta) * cos(phi),
+				c[1] + r * sin(theta) * sin(phi), c[2] + r * cos(theta));
+			conservative &= ThroughSquare(p, wall, half);
+		}
+	}
+	ok &= Check(counted == hidden, "TestSpheres count");
+	ok &= Check(agree, "TestSpheres against SphereOccluded");
+	ok &= Check(conservative, "hidden spheres are behind the wall");
+	ok &= Check(hidden > 0, "some spheres are hidden");
+	return ok;
+}
+
+// Triangles rotated to start from their smallest index, keeping the
+// winding, and sorted: equal if two lists hold the same triangles
+static vector<unsigned int> CanonicalTriangles(const unsigned int *indices,
+	unsigned int elements)
+{
+	vector<unsigned int> keys;
+	for (unsigned int i = 0; i < elements; i += 3)
+	{
+		const unsigned int *t = &indices[i];
+		unsigned int r = 0;
+		if (t[1] < t[r])
+			r = 1;
+		if (t[2] < t[r])
+			r = 2;
+		// 10 bits per index are enough for the test meshes
+		keys.push_back(t[r] << 20 | t[(r + 1) % 3] << 10 | t[(r + 2) % 3]);
+	}
+	sort(keys.begin(), keys.end());
+	return keys;
+}
+
+bool MeshOptimizerTest()
+{
+	bool ok = true;
+	unsigned int i, j;
+
+	// A quad misses its 4 vertices once, over 2 triangles
+	const unsigned int quad[] = { 0, 1, 2, 0, 2, 3 };
+	ok &= Check(CacheMissRatio(quad, 6, 4) == 2.0f, "ACMR of a quad");
+	// A 2 entry cache has evicted 0 by the second triangle
+	ok &= Check(CacheMissRatio(quad, 6, 4, 2) == 2.5f, "ACMR with eviction");
+
+	// Grid of size x size quads, its triangles shuffled
+	const unsigned int size = 24, vertices = (size + 1) * (size + 1);
+	vector<unsigned int> indices;
+	for (j = 0; j < size; j++)
+	{
+		for (i = 0; i < size; i++)
+		{
+			const unsigned int v = j * (size + 1) + i;
+			const unsigned int tris[] = { v, v + 1, v + size + 2,
+				v, v + size + 2, v + size + 1 };
+			indices.insert(indices.end(), tris, tris + 6);
+		}
+	}
+	const unsigned int elements = indices.size();
+	srand(5);
+	for (i = elements / 3 - 1; i > 0; i--)
+	{
+		const unsigned int k = rand() % (i + 1);
+		for (j = 0; j < 3; j++)
+			swap(indices[3 * i + j], indices[3 * k + j]);
+	}
+
+	const vector<unsigned int> before = CanonicalTriangles(&indices[0],
+		elements);
+	const float shuffled = CacheMissRatio(&indices[0], elements, vertices);
+	OptimizeTriangleOrder(&indices[0], elements, vertices);
+	const float optimized = CacheMissRatio(&indices[0], elements, vertices);
+	ok &= Check(CanonicalTriangles(&indices[0], elements) == before,
+		"triangles and winding kept");
+	ok &= Check(optimized < shuffled, "ACMR lowered");
+	// A regular grid gets close to 0.5 with a 16 entry cache
+	ok &= Check(optimized < 0.8f, "ACMR of the optimized grid");
+
+	// An extra vertex no triangle uses, each attribute is its old index
+	const unsigned int stride = 2;
+	vector<float> attribs(stride * (vertices + 1));
+	for (i = 0; i <= vertices; i++)
+	{
+		attribs[stride * i] = (float)i;
+		attribs[stride * i + 1] = -(float)i;
+	}
+	const vector<unsigned int> old = indices;
+	const unsigned int used = OptimizeVertexOrder(&attribs[0], stride,
+		vertices + 1, &indices[0], elements);
+	ok &= Check(used == vertices, "unused vertex removed");
+	bool remapped = true, sequential = true;
+	unsigned int next = 0;
+	for (i = 0; i < elements; i++)
+	{
+		const unsigned int v = indices[i];
+		remapped &= v < used && attribs[stride * v] == (float)old[i] &&
+			attribs[stride * v + 1] == -(float)old[i];
+		// Each new vertex is numbered after those used before it
+		sequential &= v <= next;
+		if (v == next)
+			next++;
+	}
+	ok &= Check(remapped, "attributes follow the indices");
+	ok &= Check(sequential, "vertices in order of first use");
+	ok &= Check(CacheMissRatio(&indices[0], elements, used) == optimized,
+		"ACMR unchanged by renumbering");
+	return ok;
+}
+
+// Copies the first bytes of a file into another
+static bool CopyPrefix(const char *from, const char *to, size_t bytes)
+{
+	MappedFile file;
+	if (!file.Open(from) || bytes > file.Size())
+		return false;
+	FILE *fp = fopen(to, "wb");
+	if (!fp)
+		return false;
+	const bool ok = fwrite(file.Data(), 1, bytes, fp) == bytes;
+	fclose(fp);
+	return ok;
+}
+
+bool MeshFileTest()
+{
+	bool ok = true;
+	const char *filename = "UnitTest.bmsh";
+	const char *truncated = "UnitTestTruncated.bmsh";
+
+	// 5 vertices of 6 floats, whose end isn't aligned, and 16 bits indices
+	const unsigned int vertices = 5, stride = 6, indices = 9;
+	float attribs[vertices * stride];
+	for (unsigned int i = 0; i < vertices * stride; i++)
+		attribs[i] = 0.25f * i;
+	const unsigned short elements[indices] = { 0, 1, 2, 2, 1, 3, 3, 1, 4 };
+	const int permutation[3] = { 0, 2, 1 };
+
+	MeshFileHeader header;
+	memset(&header, 0, sizeof(header));
+	header.ullSourceHash = 0x0123456789abcdefULL;
+	header.fScale = 0.5f;
+	header.uiFlipNormals = 1;
+	memcpy(header.aiPermutation, permutation, sizeof(permutation));
+	header.uiVertices = vertices;
+	header.uiStride = stride * sizeof(float);
+	header.uiIndices = indices;
+	header.uiIndexSize = sizeof(unsigned short);
+	header.afMin[0] = -1.0f;
+	header.afMax[2] = 2.0f;
+	ok &= Check(MeshFile::Write(filename, header, attribs, elements),
+		"writing the mesh");
+
+	MeshFile file;
+	if (!Check(file.Open(filename), "opening the mesh"))
+	{
+		remove(filename);
+		return false;
+	}
+	const MeshFileHeader &read = file.Header();
+	ok &= Check(read.uiVertices == vertices &&
+		read.uiStride == stride * sizeof(float) && read.uiIndices == indices &&
+		read.uiIndexSize == sizeof(unsigned short) &&
+		read.afMin[0] == -1.0f && read.afMax[2] == 2.0f, "header read back");
+	ok &= Check(read.uiVertexOffset % 16 == 0 && read.uiIndexOffset % 16 == 0,
+		"aligned arrays");
+	ok &= Check(memcmp(file.Vertices(), attribs, sizeof(attribs)) == 0,
+		"vertices read back");
+	ok &= Check(memcmp(file.Indices(), elements, sizeof(elements)) == 0,
+		"indices read back");
+
+	ok &= Check(file.Matches(header.ullSourceHash, 0.5f, true, permutation),
+		"matching import");
+	const int identity[3] = { 0, 1, 2 };
+	ok &= Check(!file.Matches(header.ullSourceHash + 1, 0.5f, true,
+		permutation), "other source");
+	ok &= Check(!file.Matches(header.ullSourceHash, 1.0f, true, permutation),
+		"other scale");
+	ok &= Check(!file.Matches(header.ullSourceHash, 0.5f, false, permutation),
+		"other normals");
+	ok &= Check(!file.Matches(header.ullSourceHash, 0.5f, true, identity),
+		"other permutation");
+
+	// Files missing their last index or most of the header are refused
+	const size_t size = read.uiIndexOffset + sizeof(elements);
+	file.Close();
+	ok &= Check(CopyPrefix(filename, truncated, size - 1) &&
+		!file.Open(truncated), "truncated indices");
+	ok &= Check(CopyPrefix(filename, truncated, 8) && !file.Open(truncated),
+		"truncated header");
+	ok &= Check(!file.Open("UnitTestMissing.bmsh"), "missing file");
+	remove(truncated);
+	remove(filename);
+
+	ok &= Check(MeshFile::PathOf("data/Head.3ds", "Eye") ==
+		"data/Head.Eye.bmsh", "path of a mesh");
+	ok &= Check(MeshFile::PathOf("data.v2/Head", "Eye") ==
+		"data.v2/Head.Eye.bmsh", "path without extension");
+	return ok;
+}
+
+// Image of width x height with a pattern in each component
+static void FillImage(Image &image, unsigned int width, unsigned int height,
+	unsigned int components)
+{
+	image.Resize(width, height, components);
+	unsigned char *p = image.Data();
+	for (unsigned int y = 0; y < height; y++)
+	{
+		for (unsigned int x = 0; x < width; x++)
+		{
+			for (unsigned int k = 0; k < components; k++)
+				*p++ = (unsigned char)((x * 37 + y * 91 + k * 53) ^ (x * y));
+		}
+	}
+}
+
+bool ImageTest()
+{
+	bool ok = true;
+	unsigned int i, k;
+
+	// Black and white average to half the light, not to half the value
+	Image checker(2, 2, 4), half;
+	unsigned char *p = checker.Data();
+	for (i = 0; i < 16; i++)
+		p[i] = (i / 4) % 3 == 0 ? 0 : 255;
+	checker.Downsample(half, Image::SRGB);
+	ok &= Check(half.Width() == 1 && half.Height() == 1, "size of 2x2");
+	p = half.Data();
+	ok &= Check(p[0] >= 186 && p[0] <= 190 && p[0] == p[1] && p[1] == p[2],
+		"sRGB color average");
+	ok &= Check(p[3] == 127 || p[3] == 128, "alpha average");
+	checker.Downsample(half, 0);
+	p = half.Data();
+	ok &= Check((p[0] == 127 || p[0] == 128) && p[0] == p[1] &&
+		p[1] == p[2] && p[3] == p[0], "linear average");
+
+	// RGB and RGBA images filter their colors the same way
+	Image rgb, rgba, rgbHalf, rgbaHalf;
+	FillImage(rgba, 34, 18, 4);
+	rgb.Resize(34, 18, 3);
+	for (i = 0; i < 34 * 18; i++)
+		memcpy(rgb.Data() + 3 * i, rgba.Data() + 4 * i, 3);
+	for (unsigned int flags = 0; flags <= Image::SRGB; flags++)
+	{
+		rgb.Downsample(rgbHalf, flags);
+		rgba.Downsample(rgbaHalf, flags);
+		bool same = rgbHalf.Width() == 17 && rgbHalf.Height() == 9 &&
+			rgbaHalf.Width() == 17 && rgbaHalf.Height() == 9;
+		for (i = 0; same && i < 17 * 9; i++)
+		{
+			for (k = 0; k < 3; k++)
+				same &= rgbHalf.Data()[3 * i + k] == rgbaHalf.Data()[4 * i + k];
+		}
+		ok &= Check(same, flags ? "sRGB RGB and RGBA" : "linear RGB and RGBA");
+	}
+
+	// Splitting the rows doesn't change the result
+	Image large, serial, parallel;
+	FillImage(large, 256, 256, 4);
+	large.Downsample(serial, Image::SRGB);
+	large.Downsample(parallel, Image::SRGB | Image::PARALLEL);
+	ok &= Check(serial.Bytes() == parallel.Bytes() &&
+		memcmp(serial.Data(), parallel.Data(), serial.Bytes()) == 0,
+		"parallel downsampling");
+
+	// Levels go down to 1x1, odd sizes rounded down and each side at least 1
+	MipChain chain;
+	FillImage(chain.Base(), 12, 6, 3);
+	chain.Build();
+	const unsigned int sizes[][2] = { { 12, 6 }, { 6, 3 }, { 3, 1 }, { 1, 1 } };
+	bool levels = chain.NumLevels() == 4;
+	size_t bytes = 0;
+	for (i = 0; levels && i < 4; i++)
+	{
+		const Image &level = chain.Level(i);
+		levels &= level.Width() == sizes[i][0] &&
+			level.Height() == sizes[i][1] && level.Components() == 3;
+		bytes += level.Bytes();
+	}
+	ok &= Check(levels, "mipmap level sizes");
+	ok &= Check(bytes == chain.Bytes(), "mipmap chain size");
+	chain.Clear();
+	FillImage(chain.Base(), 1, 8, 4);
+	chain.Build();
+	ok &= Check(chain.NumLevels() == 4 && chain.Level(3).Width() == 1 &&
+		chain.Level(3).Height() == 1, "levels of a column");
+	return ok;
+}
+
+// Colors of the 16 pixels of a DXT color block
+static void DecodeColorBlock(const unsigned char *in, int colors[16][3])
+{
+	const unsigned short c0 = in[0] | in[1] << 8, c1 = in[2] | in[3] << 8;
+	int palette[4][3];
+	const unsigned short c[2] = { c0, c1 };
+	for (unsigned int j = 0; j < 2; j++)
+	{
+		palette[j][0] = ((c[j] >> 11) & 31) * 255 / 31;
+		palette[j][1] = ((c[j] >> 5) & 63) * 255 / 63;
+		palette[j][2] = (c[j] & 31) * 255 / 31;
+	}
+	for (unsigned int k = 0; k < 3; k++)
+	{
+		if (c0 > c1)
+		{
+			palette[2][k] = (2 * palette[0][k] + palette[1][k]) / 3;
+			palette[3][k] = (palette[0][k] + 2 * palette[1][k]) / 3;
+		}
+		else
+		{
+			palette[2][k] = (palette[0][k] + palette[1][k]) / 2;
+			palette[3][k] = 0;
+		}
+	}
+	const unsigned int indices = in[4] | in[5] << 8 | in[6] << 16 |
+		(unsigned int)in[7] << 24;
+	for (unsigned int i = 0; i < 16; i++)
+		memcpy(colors[i], palette[(indices >> (2 * i)) & 3], sizeof(colors[i]));
+}
+
+// Alphas of the 16 pixels of a DXT5 alpha block
+static void DecodeAlphaBlock(const unsigned char *in, int alphas[16])
+{
+	int palette[8] = { in[0], in[1] };
+	for (int j = 1; j < 7; j++)
+	{
+		if (in[0] > in[1])
+			palette[j + 1] = ((7 - j) * in[0] + j * in[1]) / 7;
+		else if (j < 5)
+			palette[j + 1] = ((5 - j) * in[0] + j * in[1]) / 5;
+		else
+			palette[j + 1] = j == 5 ? 0 : 255;
+	}
+	unsigned long long indices = 0;
+	for (unsigned int i = 0; i < 6; i++)
+		indices |= (unsigned long long)in[2 + i] << (8 * i);
+	for (unsigned int i = 0; i < 16; i++)
+		alphas[i] = palette[(indices >> (3 * i)) & 7];
+}
+
+bool TextureFileTest()
+{
+	bool ok = true;
+	const char *filename = "UnitTest.btx";
+	const unsigned long long hash = 0xfedcba9876543210ULL;
+	unsigned int i;
+
+	// Uncompressed levels are stored as they are
+	MipChain chain;
+	FillImage(chain.Base(), 12, 6, 3);
+	chain.Build();
+	ok &= Check(TextureFile::Write(filename, chain, hash, false),
+		"writing the texture");
+	TextureFile texture;
+	if (!Check(texture.Open(filename), "opening the texture"))
+	{
+		remove(filename);
+		return false;
+	}
+	ok &= Check(texture.Width() == 12 && texture.Height() == 6 &&
+		texture.NumLevels() == chain.NumLevels() &&
+		texture.SourceHash() == hash && !texture.IsCompressed() &&
+		texture.InternalFormat() == GL_RGB, "header read back");
+	ok &= Check(texture.Bytes(chain.NumLevels()) == chain.Bytes() &&
+		texture.Bytes(1) == chain.Level(0).Bytes(), "size of the levels");
+	texture.Close();
+
+	// The level table follows the header, each level at an aligned offset
+	MappedFile file;
+	file.Open(filename);
+	const TextureFileHeader *header = (const TextureFileHeader *)file.Data();
+	const TextureFileLevel *levels = (const TextureFileLevel *)(header + 1);
+	bool same = header->uiFlags == TextureFile::FLAG_SRGB_FILTERED;
+	for (i = 0; i < chain.NumLevels(); i++)
+	{
+		const Image &level = chain.Level(i);
+		same &= levels[i].uiWidth == level.Width() &&
+			levels[i].uiHeight == level.Height() &&
+			levels[i].uiOffset % 16 == 0 && levels[i].uiSize == level.Bytes() &&
+			memcmp(file.Data() + levels[i].uiOffset, level.Data(),
+			level.Bytes()) == 0;
+	}
+	ok &= Check(same, "levels read back");
+	file.Close();
+
+	// Compressed levels decode close to the image, alpha included
+	const unsigned int size = 8;
+	chain.Clear();
+	Image &base = chain.Base();
+	base.Resize(size, size, 4);
+	for (unsigned int y = 0; y < size; y++)
+	{
+		for (unsigned int x = 0; x < size; x++)
+		{
+			unsigned char *p = base.Data() + (y * size + x) * 4;
+			// Colors along the diagonal of their bounding box, which the
+			// endpoints of the compressor lie on
+			p[0] = (unsigned char)(4 * (x + y));
+			p[1] = (unsigned char)(100 + 4 * (x + y));
+			p[2] = (unsigned char)(200 + 2 * (x + y));
+			p[3] = (unsigned char)(64 + 8 * x + 8 * y);
+		}
+	}
+	chain.Build(0);
+	ok &= Check(TextureFile::Write(filename, chain, hash, true, 0),
+		"writing the compressed texture");
+	if (!Check(file.Open(filename), "opening the compressed texture"))
+	{
+		remove(filename);
+		return false;
+	}
+	header = (const TextureFileHeader *)file.Data();
+	levels = (const TextureFileLevel *)(header + 1);
+	ok &= Check(header->uiFormat == 0 && header->uiFlags == 0 &&
+		header->uiInternalFormat == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT,
+		"compressed format");
+	// DXT5 blocks of 16 bytes, 4x4 pixels even for the smallest levels
+	ok &= Check(levels[0].uiSize == 4 * 16 && levels[1].uiSize == 16 &&
+		levels[3].uiSize == 16, "compressed level sizes");
+
+	int maxError = 0;
+	for (unsigned int block = 0; block < 4; block++)
+	{
+		const unsigned char *in = file.Data() + levels[0].uiOffset + 16 * block;
+		int colors[16][3], alphas[16];
+		DecodeAlphaBlock(in, alphas);
+		DecodeColorBlock(in + 8, colors);
+		for (i = 0; i < 16; i++)
+		{
+			const unsigned int x = (block % 2) * 4 + i % 4;
+			const unsigned int y = (block / 2) * 4 + i / 4;
+			const unsigned char *p = base.Data() + (y * size + x) * 4;
+			for (unsigned int k = 0; k < 4; k++)
+			{
+				const int error = abs((k < 3 ? colors[i][k] : alphas[i]) - p[k]);
+				maxError = error > maxError ? error : maxError;
+			}
+		}
+	}
+	// Half a palette step, and the 5:6:5 rounding of the endpoints
+	ok &= Check(maxError <= 8, "compression error");
+	file.Close();
+	remove(filename);
+
+	ok &= Check(TextureFile::PathOf("data/Head.png") == "data/Head.btx" &&
+		TextureFile::PathOf("data.v2/Head") == "data.v2/Head.btx",
+		"path of a texture");
+	return ok;
+}
+
+// Writes text to filename
+static bool WriteText(const char *filename, const char *text)
+{
+	FILE *fp = fopen(filename, "w");
+	if (!fp)
+		return false;
+	const bool ok = fputs(text, fp) >= 0;
+	fclose(fp);
+	return ok;
+}
+
+bool TextureAtlasTest()
+{
+	bool ok = true;
+	const char *filename = "UnitTest.atlas";
+	TextureAtlas atlas;
+
+	ok &= Check(WriteText(filename,
+		"atlas 256 128\n"
+		"Head 0 0 64 64\n"
+		"Eye 64 32 16 8\n"), "writing the table");
+	ok &= Check(atlas.LoadTable(filename), "loading the table");
+	ok &= Check(atlas.NumRects() == 2 && atlas.Find("Head") == 0 &&
+		atlas.Find("Eye") == 1 && atlas.Find("Nose") == -1, "sprite names");
+	if (atlas.NumRects() == 2)
+	{
+		const AtlasRect &eye = atlas.Rect(1);
+		ok &= Check(eye.u0 == 0.25f && eye.v0 == 0.25f &&
+			eye.u1 == 0.3125f && eye.v1 == 0.3125f, "rectangle in pixels");
+		const Point2 center = eye.Map(Point2(0.5f, 0.5f));
+		ok &= Check(center[0] == 0.28125f && center[1] == 0.28125f,
+			"mapping into the rectangle");
+	}
+
+	// Bad tables leave the rectangles as they were
+	ok &= Check(WriteText(filename, "atlas 0 128\nHead 0 0 64 64\n") &&
+		!atlas.LoadTable(filename), "table of an empty image");
+	ok &= Check(WriteText(filename,
+		"atlas 256 128\nHead 0 0 64 64\nEye 64 32\n") &&
+		!atlas.LoadTable(filename), "truncated entry");
+	ok &= Check(WriteText(filename,
+		"atlas 256 128\nHead 0 0 64 64\nEye x 32 16 8\n") &&
+		!atlas.LoadTable(filename), "invalid entry");
+	ok &= Check(WriteText(filename, "atlas 256 128\n") &&
+		!atlas.LoadTable(filename), "table without sprites");
+	ok &= Check(!atlas.LoadTable("UnitTestMissing.atlas"), "missing table");
+	ok &= Check(atlas.NumRects() == 2, "rectangles kept");
+	remove(filename);
+
+	// Grids are indexed column by column
+	atlas.Grid(4, 2);
+	ok &= Check(atlas.NumRects() == 8, "grid size");
+	if (atlas.NumRects() == 8)
+	{
+		const AtlasRect &r = atlas.Rect(3);
+		ok &= Check(r.u0 == 0.25f && r.v0 == 0.5f && r.u1 == 0.5f &&
+			r.v1 == 1.0f && atlas.Find("3") == 3, "grid rectangle");
+	}
+
+	ok &= Check(TextureAtlas::TablePathOf("data/Heads.png") ==
+		"data/Heads.atlas", "path of a table");
+	return ok;
+}
+
+bool RenderKeyTest()
+{
+	bool ok = true;
+	typedef RenderQueue Q;
+
+	// The pass comes first whatever the rest of the key
+	ok &= Check(Q::StateKey(1, 0xfff, 0xffff, 1e30f) <
+		Q::StateKey(2, 0, 0, -1e30f), "state keys by pass");
+	ok &= Check(Q::DepthKey(1, -1e30f, 0xfff, 0xffff) <
+		Q::OrderKey(2, 0), "depth keys by pass");
+	ok &= Check(Q::OrderKey(1, ~0U) < Q::StateKey(2, 0, 0),
+		"order keys by pass");
+
+	// State keys: program, then texture, then front to back
+	ok &= Check(Q::StateKey(0, 1, 9, 50.0f) < Q::StateKey(0, 2, 1, 1.0f),
+		"state keys by program");
+	ok &= Check(Q::StateKey(0, 1, 1, 50.0f) < Q::StateKey(0, 1, 2, 1.0f),
+		"state keys by texture");
+	ok &= Check(Q::StateKey(0, 1, 1, -2.0f) < Q::StateKey(0, 1, 1, -1.0f) &&
+		Q::StateKey(0, 1, 1, -1.0f) < Q::StateKey(0, 1, 1, 0.5f) &&
+		Q::StateKey(0, 1, 1, 0.5f) < Q::StateKey(0, 1, 1, 2.0f),
+		"state keys by depth");
+
+	// Depth keys: back to front, then program and texture
+	ok &= Check(Q::DepthKey(0, 2.0f, 9, 9) < Q::DepthKey(0, 0.5f, 1, 1) &&
+		Q::DepthKey(0, 0.5f, 9, 9) < Q::DepthKey(0, -1.0f, 1, 1) &&
+		Q::DepthKey(0, -1.0f, 9, 9) < Q::DepthKey(0, -2.0f, 1, 1),
+		"depth keys by depth");
+	ok &= Check(Q::DepthKey(0, 1.0f, 1, 9) < Q::DepthKey(0, 1.0f, 2, 1) &&
+		Q::DepthKey(0, 1.0f, 1, 1) < Q::DepthKey(0, 1.0f, 1, 2),
+		"depth keys by state");
+
+	ok &= Check(Q::OrderKey(3, 7) < Q::OrderKey(3, 8), "order keys by order");
+
+	// Names past the bits of the key wrap around instead of changing pass
+	ok &= Check(Q::StateKey(0, 0x1001, 0x10001) >> 60 == 0 &&
+		Q::DepthKey(0, 1.0f, 0x1001, 0x10001) >> 60 == 0, "wrapping names");
+	return ok;
+}
+
+// Resource counting its instances, to see the registry delete them
+struct CountedResource
+{
+	static int iLive;
+	CountedResource() { iLive++; }
+	~CountedResource() { iLive--; }
+};
+int CountedResource::iLive = 0;
+
+struct CountedTag { };
+
+bool ResourceRegistryTest()
+{
+	bool ok = true;
+	typedef ResourceRegistry<CountedResource, CountedTag> Registry;
+	typedef Registry::Handle Handle;
+
+	ok &= Check(!Handle().IsValid(), "default handle");
+	const Handle packed(5, 3);
+	ok &= Check(packed.Index() == 5 && packed.Generation() == 3 &&
+		Handle::FromValue(packed.Value()) == packed, "handle packing");
+
+	{
+		Registry registry;
+		CountedResource *a = new CountedResource, *b = new CountedResource;
+		registry.SetClock(1);
+		const Handle ha = registry.Add("a", a, 100);
+		registry.SetClock(2);
+		const Handle hb = registry.Add("b", b, 50);
+		ok &= Check(registry.Get(ha) == a && registry.Get(hb) == b &&
+			registry.Size() == 2 && registry.Bytes() == 150, "added resources");
+		ok &= Check(registry.Acquire("a") == ha && registry.GetRefs(ha) == 2 &&
+			!registry.Acquire("c").IsValid(), "acquired by key");
+
+		// Referenced resources survive eviction
+		ok &= Check(registry.EvictUnused() == 0 && registry.EvictLRU(0) == 0 &&
+			CountedResource::iLive == 2, "referenced resources kept");
+
+		// The least recently released goes first
+		registry.SetClock(3);
+		registry.Release(hb);
+		registry.SetClock(4);
+		registry.Release(ha);
+		registry.Release(ha);
+		ok &= Check(registry.GetRefs(ha) == 0 && registry.Get(ha) == a,
+			"unreferenced resources kept");
+		ok &= Check(registry.EvictLRU(100) == 1 && registry.Get(hb) == NULL &&
+			registry.Get(ha) == a && registry.Bytes() == 100 &&
+			CountedResource::iLive == 1, "least recently used evicted");
+
+		// A handle to an evicted resource stays stale once its slot is reused
+		CountedResource *c = new CountedResource;
+		const Handle hc = registry.Add("c", c, 10);
+		ok &= Check(hc.Index() == hb.Index() && hc != hb &&
+			registry.Get(hb) == NULL && registry.Get(hc) == c,
+			"stale handle");
+		ok &= Check(!registry.Release(hb) && registry.GetRefs(hb) == 0,
+			"release of a stale handle");
+		ok &= Check(!registry.Acquire("b").IsValid(), "evicted key");
+
+		ok &= Check(registry.EvictUnused() == 1 && registry.Size() == 1 &&
+			CountedResource::iLive == 1, "unused resources evicted");
+	}
+	// The registry deletes what is left, referenced or not
+	ok &= Check(CountedResource::iLive == 0, "resources deleted");
+	return ok;
+}
+
+bool FrameGovernorTest()
+{
+	bool ok = true;
+	const float dt = 0.1f, target = 0.02f, over = 0.03f, under = 0.01f;
+	unsigned int i;
+
+	// Proportional only: each frame 10 ms over budget outputs -0.1
+	FrameGovernor governor;
+	governor.Init(target, 10.0f, 0.0f, 0.0f);
+	governor.SetHysteresis(0.1f, 0.45f);
+	const unsigned int shadows = governor.AddKnob("shadows", 1.0f, 0.0f, 1.0f,
+		1.0f, 0);
+	const unsigned int particles = governor.AddKnob("particles", 1000.0f,
+		100.0f, 1000.0f, 10000.0f, 1, 100.0f);
+
+	// Nothing changes inside the dead band, or until the hold time passed
+	bool changed = false;
+	for (i = 0; i < 10; i++)
+		changed |= governor.Update(dt, target * 1.05f);
+	for (i = 0; i < 4; i++)
+		changed |= governor.Update(dt, over);
+	ok &= Check(!changed && governor.Get(shadows) == 1.0f &&
+		governor.Get(particles) == 1000.0f, "dead band and hold time");
+
+	// The lowest priority knob is degraded first
+	ok &= Check(governor.Update(dt, over) && governor.Changed(shadows) &&
+		!governor.Changed(particles), "change reported");
+	ok &= Check(fabs(governor.Get(shadows) - 0.9f) < 1e-4f &&
+		governor.Get(particles) == 1000.0f, "lowest priority degraded");
+
+	// Then the next one, once the first is at its bound
+	for (i = 0; i < 100; i++)
+		governor.Update(dt, over);
+	ok &= Check(governor.Get(shadows) == 0.0f &&
+		governor.Get(particles) == 100.0f, "all knobs degraded");
+	ok &= Check(!governor.Update(dt, over), "nothing left to degrade");
+
+	// Under budget, the highest priority knob is restored first
+	governor.Update(dt, under);
+	ok &= Check(governor.Get(particles) == 1000.0f &&
+		governor.Get(shadows) < 0.1f, "highest priority restored");
+	for (i = 0; i < 100; i++)
+		governor.Update(dt, under);
+	ok &= Check(governor.Get(shadows) == 1.0f, "all knobs restored");
+
+	// Values are clamped, and reported in steps
+	governor.Set(particles, 5000.0f);
+	ok &= Check(governor.Get(particles) == 1000.0f, "clamped value");
+	governor.Set(particles, 432.0f);
+	ok &= Check(governor.Get(particles) == 400.0f, "value in steps");
+	return ok;
+}
+
+bool RunTests()
+{
+	struct Test
+	{
+		const char *name;
+		bool (*run)();
+	};
+	static const Test tests[] = {
+		{ "RadixSort", RadixSortTest },
+		{ "Frustum", FrustumTest },
+		{ "OcclusionBuffer", OcclusionTest },
+		{ "MeshOptimizer", MeshOptimizerTest },
+		{ "MeshFile", MeshFileTest },
+		{ "Image", ImageTest },
+		{ "TextureFile", TextureFileTest },
+		{ "TextureAtlas", TextureAtlasTest },
+		{ "RenderQueue", RenderKeyTest },
+		{ "ResourceRegistry", ResourceRegistryTest },
+		{ "FrameGovernor", FrameGovernorTest },
+	};
+	const unsigned int numTests = sizeof(tests) / sizeof(tests[0]);
+
+	unsigned int passed = 0;
+	for (unsigned int i = 0; i < numTests; i++)
+	{
+		printf("%s\n", tests[i].name);
+		if (tests[i].run())
+			passed++;
+		else
+			printf("%s FAILED\n", tests[i].name);
+	}
+	printf("%d of %d tests passed\n", passed, numTests);
+	return passed == numTests;
+}
@@ -50,4 +50,21 @@ bool AttribTest();
 
 void TestList();
 
+// Behavior tests of the CPU side libraries, no GL context needed. Each one
+// prints what failed and returns false
+bool RadixSortTest();
+bool FrustumTest();
+bool OcclusionTest();
+bool MeshOptimizerTest();
+bool MeshFileTest();
+bool ImageTest();
+bool TextureFileTest();
+bool TextureAtlasTest();
+bool RenderKeyTest();
+bool ResourceRegistryTest();
+bool FrameGovernorTest();
+
+// Runs all the behavior tests, returns true if they all pass
+bool RunTests();
+
 #endif
\ No newline at end of file
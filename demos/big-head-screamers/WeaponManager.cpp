@@ -16,6 +16,7 @@
 #include "GrenadeRenderer.h"
 #include "LaserRenderer.h"
 #include "TetraRenderer.h"
+#include "Timer.h"
 
 #define _USE_MATH_DEFINES
 #include <math.h>
@@ -27,12 +28,21 @@
  * WeaponManager implementation
  *****************************************************************************/
 WeaponManager::WeaponManager()
-		: time(0.0f), canFire(true), currWeapon(TypeGrenade)
+		: time(0.0f), canFire(true), currWeapon(TypeGrenade),
+		fLaserRenderTime(0.0f)
 {
 	reloadTime[TypeGrenade] = Settings::Instance().GrenadeReload;
 	reloadTime[TypeLaser] = Settings::Instance().LaserReload;
 	reloadTime[TypeTetra] = Settings::Instance().LaserReload;
 
+	// Enough for the maximum fire rate, pools grow if needed
+	bullets[TypeGrenade].Init(BulletPool::GravityMotion,
+		Settings::Instance().GrenadeDamage, 64);
+	bullets[TypeLaser].Init(BulletPool::StraightMotion,
+		Settings::Instance().LaserDamage, 256);
+	bullets[TypeTetra].Init(BulletPool::StraightMotion,
+		Settings::Instance().LaserDamage, 256);
+
 	
 	pRenderer[TypeGrenade] = auto_ptr<BulletRenderer>(new GrenadeRenderer());
 	pRenderer[TypeLaser] = auto_ptr<BulletRenderer>(new LaserRenderer());
@@ -49,24 +59,17 @@ WeaponManager::~WeaponManager()
 void WeaponManager::NewBullet(const Point3 &p, const float yRot,
 								const float xRot, const float speed)
 {
-	Bullet *bullet;
-	switch (CurrWeapon())
-	{
-	case TypeGrenade:
-		bullet = new GravityBullet(p, yRot, xRot, speed);
-		break;
-	// Both of these have the same update logic
-	case TypeLaser:
-	case TypeTetra:
-	default:
-		bullet = new StraightBullet(p, yRot, xRot, speed);
-		break;
-	}
-	pList[CurrWeapon()].push_back(bullet);
-	bullets.push_back(bullet);
+	// Grenades use gravity, lasers and tetras move straight
+	bullets[CurrWeapon()].Add(p, yRot, xRot, speed);
 }
 
-
+unsigned int WeaponManager::NumBullets() const
+{
+	unsigned int n = 0;
+	for (unsigned int i = 0; i < NumWeapons; i++)
+		n += bullets[i].Size();
+	return n;
+}
 
 void WeaponManager::Input(const float dt, const FPSCamera &cameraPos, const bool fire)
 {
@@ -84,41 +87,56 @@ void WeaponManager::Input(const float dt, const FPSCamera &cameraPos, const bool
 			cameraPos.GetAlpha() * M_1_RAD, cameraPos.GetBeta() * M_1_RAD, 50.0f);
 	}
 
-	// Update grenades
-	// TODO: should be a generic Bullet * routine
-	ptr_list<Bullet>::iterator b;
-	for (b = bullets.begin(); b != bullets.end(); b++)
+	for (unsigned int i = 0; i < NumWeapons; i++)
 	{
-		b->Update(dt);
+		bullets[i].Update(dt);
 	}
 }
 
-bool RemoveCondition(const Bullet *bullet)
-{
-	return bullet->Impact();
-}
-
-bool EraseCondition(const Bullet &bullet)
+void WeaponManager::UpdateState()
 {
-	return bullet.Impact();
+	// This is called after collision detection
+	for (unsigned int i = 0; i < NumWeapons; i++)
+	{
+		bullets[i].RemoveImpacted();
+	}
 }
 
-
-void WeaponManager::UpdateState()
+void WeaponManager::Submit(RenderQueue::Recorder &recorder,
+	unsigned int opaquePass, unsigned int laserPass) const
 {
-	// This is called after collision detection
 	for (unsigned int i = 0; i < NumWeapons; i++)
 	{
-		pList[i].remove_if(RemoveCondition);
+		if (bullets[i].Empty())
+			continue;
+
+		const BulletRenderer &renderer = *pRenderer[i];
+		if (i == TypeLaser)
+		{
+			recorder.Submit(RenderQueue::StateKey(laserPass,
+				renderer.GetProgram(), renderer.GetTexture()), this, i,
+				renderer.GetProgram(), renderer.GetTexture(),
+				RenderPacket::BLEND | RenderPacket::NO_DEPTH_WRITE);
+		}
+		else
+		{
+			recorder.Submit(RenderQueue::StateKey(opaquePass,
+				renderer.GetProgram(), renderer.GetTexture()), this, i,
+				renderer.GetProgram(), renderer.GetTexture());
+		}
 	}
-	bullets.erase_if(EraseCondition);
 }
 
-void WeaponManager::Render()
+void WeaponManager::Execute(unsigned int param) const
 {
-	pRenderer[TypeGrenade]->Render(pList[TypeGrenade]);
-	pRenderer[TypeTetra]->Render(pList[TypeTetra]);
-	glEnable(GL_BLEND);
-	pRenderer[TypeLaser]->Render(pList[TypeLaser]);
-	glDisable(GL_BLEND);
+	if (param == TypeLaser)
+	{
+		Timer laserTime;
+		pRenderer[param]->Render(bullets[param]);
+		fLaserRenderTime += laserTime.Update();
+	}
+	else
+	{
+		pRenderer[param]->Render(bullets[param]);
+	}
 }
@@ -17,18 +17,16 @@
 #include "Matrix.h"
 #include "CameraController.h"
 #include "Misc.h"
+#include "Bullet.h"
+#include "RenderQueue.h"
 
-#include "boost/ptr_container/ptr_list.hpp"
-using namespace boost;
-
-class Bullet;
 class BulletRenderer;
 
 /*****************************************************************************
  * WeaponManager class declaration
  *****************************************************************************/
 
-class WeaponManager
+class WeaponManager : public RenderCommand
 {
 public:
 	enum WeaponType { TypeGrenade, TypeLaser, TypeTetra, NumWeapons };
@@ -40,13 +38,15 @@ private:
 
 	int currWeapon;
 
-	// pimpl idiom
-	ptr_list<Bullet> bullets;
-	// weak container
-	list<Bullet *> pList[NumWeapons];
+	// One pool per weapon type, read directly by renderers and collision
+	// detectors
+	BulletPool bullets[NumWeapons];
 
 	auto_ptr<BulletRenderer> pRenderer[NumWeapons];
 
+	// Accumulated CPU time of LaserRenderer::Render()
+	mutable float fLaserRenderTime;
+
 public:
 	WeaponManager();
 	// TODO: why does this raise a compile error if defined on header file or
@@ -63,14 +63,25 @@ public:
 
 	// Get data array (used bt WeaponRenderer)
 	// The non const version is the one passed to CollisionDetector
-	ptr_list<Bullet> &GetBullets() { return bullets; }
-	const ptr_list<Bullet> &GetBullets() const { return bullets; }
+	BulletPool &GetBullets(unsigned int type) { return bullets[type]; }
+	const BulletPool &GetBullets(unsigned int type) const { return bullets[type]; }
+
+	// Total number of bullets in flight
+	unsigned int NumBullets() const;
 
 	void NextWeapon() { currWeapon = Next(currWeapon, NumWeapons); }
 	void PrevWeapon() { currWeapon = Prev(currWeapon, NumWeapons); }
 	const int CurrWeapon() const { return currWeapon; }
 
-	void Render();
+	// Records one draw packet per weapon type with bullets in flight.
+	// Lasers are blended and go in their own pass
+	void Submit(RenderQueue::Recorder &recorder, unsigned int opaquePass,
+		unsigned int laserPass) const;
+	// Draws the bullets of weapon type param
+	virtual void Execute(unsigned int param) const;
+
+	float GetLaserRenderTime() const { return fLaserRenderTime; }
+	void ResetRenderTime() { fLaserRenderTime = 0.0f; }
 };
 
 #endif
@@ -1,9 +1,47 @@
-
+// If INSTANCED is defined, position and orientation of each grenade are
+// per-instance attributes. Otherwise the modelview matrix places it
 
 varying float Intensity;
 
+#ifdef INSTANCED
+// Per instance attributes
+attribute vec3 inTranslate;
+attribute vec2 inRotate;
+
+const float u = 1.0;
+const float z = 0.0;
+
+mat3 RotationX(float angle)
+{
+	float c = cos(angle);
+	float s = sin(angle);
+	return mat3(
+		u, z, z,
+		z, c, s,
+		z,-s, c);
+}
+
+mat3 RotationY(float angle)
+{
+	float c = cos(angle);
+	float s = sin(angle);
+	return mat3(
+		 c, z,-s,
+		 z, u, z,
+		 s, z, c);
+}
+#endif
+
 void main()
 {
 	Intensity = max(0.2, dot(gl_Normal, vec3(0.0, 1.0, 0.0)));
+#ifdef INSTANCED
+	// Mesh is turned by 180 degrees around y
+	vec3 pos = vec3(-gl_Vertex.x, gl_Vertex.y, -gl_Vertex.z);
+	pos = inTranslate + RotationY(inRotate.y) * RotationX(inRotate.x) * pos;
+
+    gl_Position = gl_ModelViewProjectionMatrix * vec4(pos, 1.0);
+#else
     gl_Position = gl_ModelViewProjectionMatrix * gl_Vertex;
+#endif
 }
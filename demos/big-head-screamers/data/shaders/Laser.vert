@@ -1,7 +1,16 @@
-
+// If INSTANCED is defined, the transformation of each laser is read from
+// per-instance attributes, so that all lasers are drawn in one call.
+// Otherwise it is read from uniform arrays, indexed by w (one call per batch)
+
+#ifdef INSTANCED
+// Per instance attributes
+attribute vec3 inTranslate;
+attribute vec2 inRotate;
+#else
 uniform vec3 Translate[64];
 uniform vec2 Rotate[64];
 //uniform mat3 Rotate[64];
+#endif
 
 const float u = 1.0;
 const float z = 0.0;
@@ -29,10 +38,14 @@ mat3 RotationY(float angle)
 void main(void)
 {
 	vec3 pos = gl_Vertex.xyz;
+#ifdef INSTANCED
+	pos = inTranslate + RotationY(inRotate.y) * RotationX(inRotate.x) * pos;
+#else
 	int id = int(gl_Vertex.w);
 	
 	pos = Translate[id] + RotationY(Rotate[id].y) * RotationX(Rotate[id].x) * pos;
 	//pos = Translate[id] + Rotate[id] * pos;
+#endif
 
     gl_Position = gl_ModelViewProjectionMatrix * vec4(pos, 1.0);
 
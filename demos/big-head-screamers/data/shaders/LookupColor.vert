@@ -1,6 +1,19 @@
+// If INSTANCED is defined, each instance is translated by a per-instance
+// attribute and scaled by Scale. Otherwise the modelview matrix places it
+
+#ifdef INSTANCED
+// Per instance attributes
+attribute vec3 inTranslate;
+
+uniform float Scale;
+#endif
 
 void main(void)
 {
 	gl_TexCoord[0] = gl_MultiTexCoord0;
+#ifdef INSTANCED
+    gl_Position = gl_ModelViewProjectionMatrix * vec4(gl_Vertex.xyz * Scale + inTranslate, 1.0);
+#else
     gl_Position = gl_ModelViewProjectionMatrix * gl_Vertex;
+#endif
 }
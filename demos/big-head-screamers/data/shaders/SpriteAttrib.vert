@@ -1,13 +1,26 @@
 // Instanced implementation of the sprite renderer
 // Allows to render all sprites in one draw call
 // Aka this is a vertex-shader implementation of the flyweight design pattern
+// If INSTANCED is defined, the unit quad is shared by all sprites (hardware
+// instancing) and each instance only stores its own translation, rotation
+// and index in the UV table of the atlas. Otherwise all attributes are
+// replicated on the four vertices of each sprite
 
-attribute vec2 inVertex;
-attribute vec2 inTexCoord;
 // Own sprite transformations
-attribute float inScale;
 attribute float inRotAngle;
 attribute vec3 inTranslate;
+#ifdef INSTANCED
+// Per instance attributes, with the above
+attribute float inTexIndex;
+
+uniform float Scale;
+// UV table of the atlas: offset (xy) and size (zw) of each sprite
+uniform vec4 TexRects[64];
+#else
+attribute vec2 inVertex;
+attribute vec2 inTexCoord;
+attribute float inScale;
+#endif
 
 //uniform vec2 NeighborOffset;
 
@@ -16,7 +29,12 @@ attribute vec3 inTranslate;
 void main()
 {
 	// Find corresponding image in texture atlas
+#ifdef INSTANCED
+	vec4 rect = TexRects[int(inTexIndex + 0.5)];
+	gl_TexCoord[0].xy = rect.xy + gl_MultiTexCoord0.xy * rect.zw;
+#else
 	gl_TexCoord[0].xy = inTexCoord;
+#endif
 	
 	/*Neighbor[0] = inTexCoord + vec2(-NeighborOffset.x,  NeighborOffset.y);
 	Neighbor[1] = inTexCoord + vec2( NeighborOffset.x,  NeighborOffset.y);
@@ -24,8 +42,13 @@ void main()
 	Neighbor[3] = inTexCoord + vec2(-NeighborOffset.x, -NeighborOffset.y);*/
 
 	// Instancing transformation
+#ifdef INSTANCED
+	vec3 Pos = vec3(gl_Vertex.x, gl_Vertex.y, 0.0);
+	Pos *= Scale;
+#else
 	vec3 Pos = vec3(inVertex.x, inVertex.y, 0.0);
 	Pos *= inScale;
+#endif
 	
 	float c = cos(inRotAngle);
 	float s = sin(inRotAngle);
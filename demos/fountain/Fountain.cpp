@@ -409,7 +409,9 @@ bool Fountain::InitGL()
 
 	iCurPIDParam = -1;
 
-	pidController.Init(TARGET_FRAMETIME, 1.0f, 0.0f, 0.0f, 200000.0f);
+	governor.Init(TARGET_FRAMETIME, 1.0f, 0.0f, 0.0f, 200000.0f);
+	uiParticlesKnob = governor.AddKnob("Particles", BUFFERS_SIZE,
+		MIN_SIZE, BUFFERS_SIZE, 1.0f, 0, 1.0f);
 
 
 	glEnable(GL_TEXTURE_2D);
@@ -472,13 +474,10 @@ void Fountain::CPUReference(float g, float dt)
 
 void Fountain::UpdatePID(float dt, unsigned int &nParticles)
 {
-	float out = pidController.Update(dt, dt);
-
-	nParticles += out;
-	if ((nParticles /= 1.02f) < MIN_SIZE)
-		nParticles = MIN_SIZE;
-	if ((nParticles *= 1.02f) > BUFFERS_SIZE)
-		nParticles = BUFFERS_SIZE;
+	// Each implementation has its own number of particles
+	governor.Set(uiParticlesKnob, nParticles);
+	governor.Update(dt, dt);
+	nParticles = (unsigned int)governor.Get(uiParticlesKnob);
 
 	if (eMode != CPU)
 	{
@@ -524,21 +523,21 @@ bool Fountain::Input(float t, float dt)
 			// Convert to fps and back
 			if (iCurPIDParam == -1)
 			{
-				float f = 1.0f / pidController.fTarget - 1.0f;
-				pidController.fTarget = 1.0f / f;
+				float f = 1.0f / governor.GetController().fTarget - 1.0f;
+				governor.GetController().fTarget = 1.0f / f;
 			}
 			else
-				pidController.UpdateParam(iCurPIDParam, iCurPIDParam == 3 ? -1.0f : -0.1f);
+				governor.GetController().UpdateParam(iCurPIDParam, iCurPIDParam == 3 ? -1.0f : -0.1f);
 		}
 		if (KeyPressed(KEY_RIGHT))
 		{
 			if (iCurPIDParam == -1)
 			{
-				float f = 1.0f / pidController.fTarget + 1.0f;
-				pidController.fTarget = 1.0f / f;
+				float f = 1.0f / governor.GetController().fTarget + 1.0f;
+				governor.GetController().fTarget = 1.0f / f;
 			}
 			else
-				pidController.UpdateParam(iCurPIDParam, iCurPIDParam == 3 ? 1.0f : 0.1f);
+				governor.GetController().UpdateParam(iCurPIDParam, iCurPIDParam == 3 ? 1.0f : 0.1f);
 		}
 		if (KeyPressed(KEY_UP))
 		{
@@ -809,19 +808,19 @@ bool Fountain::RunGL(float t, float dt)
 
 			float green[] = {0.0,1.0,0.0,1.0};
 			pFont->Render(x, y -= mscale, scale, iCurPIDParam == -1 ? green : yellow, horz, vert,
-				"target=%.1f", 1.0f / pidController.fTarget);
+				"target=%.1f", 1.0f / governor.GetController().fTarget);
 
 			pFont->Render(x, y -= mscale, scale, iCurPIDParam == 0 ? green : yellow, horz, vert,
-				"Kp=%.1f", pidController.Kp);
+				"Kp=%.1f", governor.GetController().Kp);
 
 			pFont->Render(x, y -= mscale, scale, iCurPIDParam == 1 ? green : yellow, horz, vert,
-				"Ki=%.1f", pidController.Ki);
+				"Ki=%.1f", governor.GetController().Ki);
 
 			pFont->Render(x, y -= mscale, scale, iCurPIDParam == 2 ? green : yellow, horz, vert,
-				"Kd=%.1f", pidController.Kd);
+				"Kd=%.1f", governor.GetController().Kd);
 
 			pFont->Render(x, y -= mscale, scale, iCurPIDParam == 3 ? green : yellow, horz, vert,
-				"Kg=%.1f", pidController.Kg);
+				"Kg=%.1f", governor.GetController().Kg);
 		}		
 		glDisable(GL_BLEND);
 	}
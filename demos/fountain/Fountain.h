@@ -29,7 +29,7 @@
 
 #include "BaseGraph.h"
 #include "Mesh.h"
-#include "PIDController.h"
+#include "FrameGovernor.h"
 
 // Code for OpenCL Initialization
 #include "CLContext.h"
@@ -125,7 +125,8 @@ class Fountain : public SDLShell, public CLContext
 	bool bDisableRendering;
 	// PID Controller related variables
 	bool bUsePID;
-	PIDControllerGain pidController;
+	FrameGovernor governor;
+	unsigned int uiParticlesKnob;
 	int iCurPIDParam;
 	void UpdatePID(float dt, unsigned int &nParticles);
 
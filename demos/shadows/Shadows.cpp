@@ -16,6 +16,7 @@
 #include "Shadows.h"
 #include "TextGraph.h"
 #include "Fonts/FontTechno.h"
+#include "GLStateCache.h"
 
 enum DisplayMode {
 	E_SHADOWS,
@@ -78,6 +79,9 @@ Shadows::Shadows()
 
 	iCurrentGroup = 0;
 
+	fSubmitTime = fSubmitStart = fSubmitAverage = fSubmitTotal = 0.0f;
+	uiSubmitFrames = uiSubmitTotalFrames = 0;
+
 	iCurLight = 0;
 	iNumLights = 1;
 	light[0].fLightSpeed = 0.5f;
@@ -110,6 +114,7 @@ bool Shadows::InitApp()
 {
 	iShowInfo = 0;
 	bFPSMode = false;
+	bUseUBO = true;
 
 	// Custom command line processing
 	vector<CmdLineParameter>::const_iterator iter;
@@ -125,6 +130,21 @@ bool Shadows::InitApp()
 		{
 			bFPSMode = (bool)atoi(iter->sValue.c_str());
 		}
+		if (iter->sName == "lights")
+		{
+			int n = atoi(iter->sValue.c_str());
+			iNumLights = n < 1 ? 1 : n > MAX_LIGHTS ? MAX_LIGHTS : n;
+		}
+		// Disabling VAOs allows to compare submission times
+		if (iter->sName == "vao")
+		{
+			VBO::EnableVAO((bool)atoi(iter->sValue.c_str()));
+		}
+		// Light positions in a uniform buffer (if supported) or glLightfv()
+		if (iter->sName == "ubo")
+		{
+			bUseUBO = (bool)atoi(iter->sValue.c_str());
+		}
 		
 	}	
 
@@ -136,8 +156,35 @@ bool Shadows::LoadShaders()
 	GLResourceManager &loader = GLResourceManager::Instance();
 	for (unsigned int i = 0; i < E_NUM_PROGRAMS; i++)
 	{
+		const char *defines = NULL;
+		if (bUseUBO && (i == E_DIFFUSE || i == E_SHADOW_VOLUME))
+			defines = defineUBO;
+
 		if (!loader.LoadShaderFromFile(shaders[i*2+0], shaders[i*2+1],
-			uiProgram[i]))
+			uiProgram[i], defines))
+			return false;
+	}
+
+	uniform[U_DIFFUSE_NUM_LIGHTS] =
+		loader.GetUniform(uiProgram[E_DIFFUSE], "NumLights");
+	uniform[U_DIFFUSE_COLOR] = loader.GetUniform(uiProgram[E_DIFFUSE], "Color");
+	uniform[U_UNIFORM_COLOR] = loader.GetUniform(uiProgram[E_UNIFORM], "Color");
+	uniform[U_PLANE_COLOR] = loader.GetUniform(uiProgram[E_PLANE], "Color");
+	uniform[U_VOLUME_LIGHT_INDEX] =
+		loader.GetUniform(uiProgram[E_SHADOW_VOLUME], "LightIndex");
+	uniform[U_VOLUME_SHADOW_EXTENT] =
+		loader.GetUniform(uiProgram[E_SHADOW_VOLUME], "ShadowExtent");
+	uniform[U_OFFSET] = loader.GetUniform(uiProgram[E_COLOR_OFFSET], "Offset");
+
+	if (bUseUBO)
+	{
+		pLightUBO = auto_ptr<UniformBuffer>(
+			new UniformBuffer(sizeof(LightBlock), LIGHTS_BINDING));
+		if (!loader.BindUniformBlock(uiProgram[E_DIFFUSE], "Lights",
+			LIGHTS_BINDING, sizeof(LightBlock)))
+			return false;
+		if (!loader.BindUniformBlock(uiProgram[E_SHADOW_VOLUME], "Lights",
+			LIGHTS_BINDING, sizeof(LightBlock)))
 			return false;
 	}
 	return true;
@@ -145,9 +192,14 @@ bool Shadows::LoadShaders()
 
 bool Shadows::InitGL()
 {
+	GLStateCache &state = GLStateCache::Instance();
+	// All tracked state is changed through the cache
+	state.SetFiltering(true);
+
 	GLResourceManager &loader = GLResourceManager::Instance();
 
 	// Load Shaders
+	bUseUBO = bUseUBO && UniformBuffer::IsSupported();
 	if (!LoadShaders())
 		return false;
 
@@ -165,8 +217,8 @@ bool Shadows::InitGL()
 	//if (!loader.Load3DSFile("data/scenes/monkey.3ds", handle3DSFile[2]))
 	//	return false;
 
-	// Load outer room
-	pRoomMesh = new Mesh(loader.FindMesh(handle3DSFile[0], "Box"));
+	// Load outer room (from the mesh cache if up to date)
+	pRoomMesh = new Mesh("data/scenes/primitives.3ds", "Box");
 	
 	// Load Object Meshes and generate Shadow Volumes
 	pSVMesh[MESH_TORUS] = new ShadowVolumeMesh(
@@ -212,7 +264,7 @@ bool Shadows::InitGL()
 
 	Resize(ShellGet(SHELL_WIDTH), ShellGet(SHELL_HEIGHT));
 
-	glDisable(GL_DEPTH_TEST);
+	state.Disable(GL_DEPTH_TEST);
 
 	// Hack
 	fMaxDistance *= 3.0f;
@@ -223,13 +275,13 @@ bool Shadows::InitGL()
 	glEnableClientState(GL_VERTEX_ARRAY);	
 	glEnableClientState(GL_TEXTURE_COORD_ARRAY);
 	glEnableClientState(GL_NORMAL_ARRAY);	
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	state.BlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
 	timer.Start();
 	return true;
 }
 
-void Shadows::CalculateBoundaries(int index3ds)
+void Shadows::CalculateBoundaries(unsigned int index3ds)
 {
 	GLResourceManager &loader = GLResourceManager::Instance();
 
@@ -270,6 +322,7 @@ void Shadows::UpdateModelView()
 	if (bFPSMode)
 	{
 		fpsCamera.LoadMatrix();
+		mView = fpsCamera.GetViewMatrix();
 	}
 	else
 	{
@@ -279,12 +332,18 @@ void Shadows::UpdateModelView()
 		glTranslatef(0.0f, 0.0f, -fDistance);
 		glRotatef(xRot, 1.0f, 0.0f, 0.0f);
 		glRotatef(yRot, 0.0f, 1.0f, 0.0f);
+
+		mView = Matrix4::Translation(Vector3(0.0f, 0.0f, -fDistance)) *
+			Matrix4(Matrix3::RotationX(xRot * M_PI / 180.0f)) *
+			Matrix4(Matrix3::RotationY(yRot * M_PI / 180.0f));
 	}
 }
 
 
 bool Shadows::Render()
 {
+	GLStateCache &state = GLStateCache::Instance();
+
 	/* Input - timer and fps graph */
 	timer.Update();
 
@@ -409,17 +468,31 @@ bool Shadows::Render()
 	// Clear color and depth buffer
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-	glEnable(GL_DEPTH_TEST);
+	state.Enable(GL_DEPTH_TEST);
 
 	UpdateModelView();
 
 
-	glEnable(GL_CULL_FACE);
+	state.Enable(GL_CULL_FACE);
 
-	// Draw scene (including shadow if enabled)
+	// Draw scene (including shadow if enabled). Only the CPU time spent
+	// issuing the commands is measured
+	Timer submitTimer;
 	RenderScene();
+	float submit = submitTimer.Update();
+	fSubmitTime += submit;
+	fSubmitTotal += submit;
+	uiSubmitFrames++;
+	uiSubmitTotalFrames++;
+	if (timer.GetTime() - fSubmitStart >= 1.0f)
+	{
+		fSubmitAverage = 1000.0f * fSubmitTime / uiSubmitFrames;
+		fSubmitTime = 0.0f;
+		uiSubmitFrames = 0;
+		fSubmitStart = timer.GetTime();
+	}
 
-	glDisable(GL_CULL_FACE);
+	state.Disable(GL_CULL_FACE);
 
 	// Render Light
 	for (unsigned int i = 0; i < iNumLights; i++)
@@ -436,7 +509,7 @@ bool Shadows::Render()
 	{
 		pFPSGraph->Draw();
 
-		glEnable(GL_BLEND);
+		state.Enable(GL_BLEND);
 		pFont->Bind();
 
 		pFPSGraph->TextDraw(pFont.get());
@@ -472,9 +545,17 @@ bool Shadows::Render()
 			pFont->Render(x, y -= mscale, scale, red, horz, vert,
 				"[0] Wireframe=%d", bWireframe ? 1 : 0);
 
+			pFont->Render(x, y -= mscale, scale, red, horz, vert,
+				"[1,2] Lights=%d Submit=%.3fms VAO=%d UBO=%d", iNumLights,
+				fSubmitAverage, pTetraVBO->UsesVAO() ? 1 : 0, bUseUBO ? 1 : 0);
+
+			pFont->Render(x, y -= mscale, scale, red, horz, vert,
+				"GL calls=%d/%d", state.GetSubmitted(),
+				state.GetSubmitted() + state.GetFiltered());
+
 		}
 
-		glDisable(GL_BLEND);
+		state.Disable(GL_BLEND);
 	}
 	iFrameCounter++;
 	
@@ -483,17 +564,19 @@ bool Shadows::Render()
 
 void Shadows::PreRenderGeometry(GLuint program)
 {
+	GLStateCache &state = GLStateCache::Instance();
+
 	/* Draw mesh */
-	glUseProgram(program);
+	state.UseProgram(program);
 
 	glEnable(GL_TEXTURE_2D);
-	glBindTexture(GL_TEXTURE_2D, uiBGTexture);
+	state.BindTexture(GL_TEXTURE_2D, uiBGTexture);
 
 	///glEnableClientState(GL_VERTEX_ARRAY);
 	///glEnableClientState(GL_NORMAL_ARRAY);
 	//glEnableClientState(GL_TEXTURE_COORD_ARRAY);
 
-	glCullFace(GL_BACK);
+	state.CullFace(GL_BACK);
 }
 
 void Shadows::PostRenderGeometry(GLuint program)
@@ -509,8 +592,8 @@ void Shadows::RenderGeometry(GLuint program)
 
 	if (program == uiProgram[E_DIFFUSE])
 	{
-		glUniform1i(GetUniLoc(program, "NumLights"), iNumLights);
-		glUniform4fv(GetUniLoc(program, "Color"), 1, GrayColor);
+		uniform[U_DIFFUSE_NUM_LIGHTS].Set1i(iNumLights);
+		uniform[U_DIFFUSE_COLOR].Set4fv(GrayColor);
 	}
 	PrintOpenGLError();
 
@@ -518,7 +601,7 @@ void Shadows::RenderGeometry(GLuint program)
 
 	if (program == uiProgram[E_DIFFUSE])
 	{
-		glUniform4fv(GetUniLoc(program, "Color"), 1, WhiteColor);
+		uniform[U_DIFFUSE_COLOR].Set4fv(WhiteColor);
 	}
 	RenderCurrentGroup(false);
 
@@ -570,24 +653,24 @@ void Shadows::CurrentGroupDesc(char *str)
 
 void Shadows::ShowShadowVolume(unsigned int lightIndex)
 {
-	glEnable(GL_CULL_FACE);
-	glCullFace(GL_BACK);
+	GLStateCache &state = GLStateCache::Instance();
+
+	state.Enable(GL_CULL_FACE);
+	state.CullFace(GL_BACK);
 
-	glUseProgram(uiProgram[E_SHADOW_VOLUME]);
+	state.UseProgram(uiProgram[E_SHADOW_VOLUME]);
 
-	glEnable(GL_BLEND);
+	state.Enable(GL_BLEND);
 
-	GLuint program = uiProgram[E_SHADOW_VOLUME];
-	glUniform1i(GetUniLoc(program, "LightIndex"), lightIndex);
-	glUniform1f(GetUniLoc(program, "ShadowExtent"), fShadowExtent);
-	glUniform1i(GetUniLoc(program, "InfiniteShadowVolume"), false);
+	uniform[U_VOLUME_LIGHT_INDEX].Set1i(lightIndex);
+	uniform[U_VOLUME_SHADOW_EXTENT].Set1f(fShadowExtent);
 
 	//glEnableClientState(GL_VERTEX_ARRAY);
 	//glEnableClientState(GL_NORMAL_ARRAY);
 
 	RenderCurrentGroup(true);
 
-	glDisable(GL_BLEND);
+	state.Disable(GL_BLEND);
 
 	//glDisableClientState(GL_NORMAL_ARRAY);	
 	//glDisableClientState(GL_VERTEX_ARRAY);
@@ -595,52 +678,52 @@ void Shadows::ShowShadowVolume(unsigned int lightIndex)
 
 void Shadows::RenderShadowVolumes(unsigned int lightIndex)
 {
+	GLStateCache &state = GLStateCache::Instance();
+
 	// store current OpenGL state
 	//glPushAttrib(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | 
 	//             GL_POLYGON_BIT | GL_STENCIL_BUFFER_BIT);
 
-	GLuint program = uiProgram[E_SHADOW_VOLUME];
-	glUseProgram(program);
+	state.UseProgram(uiProgram[E_SHADOW_VOLUME]);
 
-	glUniform1i(GetUniLoc(program, "LightIndex"), lightIndex);
-	glUniform1f(GetUniLoc(program, "ShadowExtent"), fShadowExtent);
-	glUniform1i(GetUniLoc(program, "InfiniteShadowVolume"), false);
+	uniform[U_VOLUME_LIGHT_INDEX].Set1i(lightIndex);
+	uniform[U_VOLUME_SHADOW_EXTENT].Set1f(fShadowExtent);
 
 	glClear(GL_STENCIL_BUFFER_BIT);
 
 	if (eDisplayMode == E_SHADOW_VOLUMES)
-		glEnable(GL_BLEND);
+		state.Enable(GL_BLEND);
 	else
-		glColorMask(0, 0, 0, 0); // do not write to the color buffer
+		state.ColorMask(0, 0, 0, 0); // do not write to the color buffer
 
-	glDepthMask(0); // do not write to the depth (Z) buffer
-	glEnable(GL_STENCIL_TEST); // enable stencil testing
+	state.DepthMask(0); // do not write to the depth (Z) buffer
+	state.Enable(GL_STENCIL_TEST); // enable stencil testing
 
 	//glEnableClientState(GL_VERTEX_ARRAY);
 	//glEnableClientState(GL_NORMAL_ARRAY);
 
 	// set the reference stencil value to 0
-	glStencilFunc(GL_ALWAYS, 0, ~0);
+	state.StencilFunc(GL_ALWAYS, 0, ~0);
 
 	if (bUseDoubleStencil)
 	{
-		glDisable(GL_CULL_FACE); // cull faces (back or front)
+		state.Disable(GL_CULL_FACE); // cull faces (back or front)
 
-		glStencilOpSeparate(GL_BACK, GL_KEEP, GL_INCR_WRAP, GL_KEEP);
-		glStencilOpSeparate(GL_FRONT, GL_KEEP, GL_DECR_WRAP, GL_KEEP);
+		state.StencilOpSeparate(GL_BACK, GL_KEEP, GL_INCR_WRAP, GL_KEEP);
+		state.StencilOpSeparate(GL_FRONT, GL_KEEP, GL_DECR_WRAP, GL_KEEP);
 
 		// Render group of meshes
 		RenderCurrentGroup(true);
 	}
 	else
 	{
-		glEnable(GL_CULL_FACE); // cull faces (back or front)
+		state.Enable(GL_CULL_FACE); // cull faces (back or front)
 
 		// Pass 1 for Z-fail
 		// increment the stencil value on Z fail
-		glStencilOp(GL_KEEP, GL_INCR, GL_KEEP);
+		state.StencilOp(GL_KEEP, GL_INCR, GL_KEEP);
 		// draw only the back faces of the shadow volume
-		glCullFace(GL_FRONT);
+		state.CullFace(GL_FRONT);
 
 		// Render group of meshes
 		RenderCurrentGroup(true);
@@ -648,9 +731,9 @@ void Shadows::RenderShadowVolumes(unsigned int lightIndex)
 		//glStencilFunc(GL_ALWAYS, 0, ~0);
 		// Pass 2 for Z-fail
 		// decrement the stencil value on Z fail
-		glStencilOp(GL_KEEP, GL_DECR, GL_KEEP);
+		state.StencilOp(GL_KEEP, GL_DECR, GL_KEEP);
 		// draw only the front faces of the shadow volume
-		glCullFace(GL_BACK);
+		state.CullFace(GL_BACK);
 
 		// Render group of meshes
 		RenderCurrentGroup(true);
@@ -662,10 +745,10 @@ void Shadows::RenderShadowVolumes(unsigned int lightIndex)
 	//glDisableClientState(GL_VERTEX_ARRAY);
 
 	if (eDisplayMode == E_SHADOW_VOLUMES)
-		glDisable(GL_BLEND);
+		state.Disable(GL_BLEND);
 	else
-		glColorMask(1, 1, 1, 1); // do not write to the color buffer
-	glDepthMask(1); // do not write to the depth (Z) buffer
+		state.ColorMask(1, 1, 1, 1); // do not write to the color buffer
+	state.DepthMask(1); // do not write to the depth (Z) buffer
 
 	// restore OpenGL state
 	//glPopAttrib();
@@ -684,7 +767,10 @@ void Shadows::RenderPlane(GLuint program, const float *color)
 
 	glVertexPointer(2, GL_FLOAT, 0, vertexAttrib);
 
-	glUniform4fv(GetUniLoc(program, "Color"), 1, color);
+	if (program == uiProgram[E_PLANE])
+		uniform[U_PLANE_COLOR].Set4fv(color);
+	else
+		uniform[U_UNIFORM_COLOR].Set4fv(color);
 
 	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
 
@@ -694,9 +780,11 @@ void Shadows::RenderPlane(GLuint program, const float *color)
 
 void Shadows::RenderScene()
 {
+	GLStateCache &state = GLStateCache::Instance();
+
 	unsigned int i;
 
-	glDepthFunc(GL_LESS);
+	state.DepthFunc(GL_LESS);
 
 	switch (eDisplayMode)
 	{
@@ -715,10 +803,30 @@ void Shadows::RenderScene()
 	//	break;
 	case E_SHADOW_VOLUMES:
 	case E_SHADOWS:
-		for (i = 0; i < iNumLights; i++)
+		if (bUseUBO)
 		{
-			glEnable(GL_LIGHT0 + i);
-			glLightfv(GL_LIGHT0 + i, GL_POSITION, light[i].fPos);
+			// One upload per frame, shared by all programs
+			LightBlock block = { { { 0.0f } } };
+			for (i = 0; i < iNumLights; i++)
+			{
+				for (unsigned int j = 0; j < 4; j++)
+				{
+					block.afPosition[i][j] =
+						mView[j][0] * light[i].fPos[0] +
+						mView[j][1] * light[i].fPos[1] +
+						mView[j][2] * light[i].fPos[2] +
+						mView[j][3] * light[i].fPos[3];
+				}
+			}
+			pLightUBO->Update(&block);
+		}
+		else
+		{
+			for (i = 0; i < iNumLights; i++)
+			{
+				glEnable(GL_LIGHT0 + i);
+				glLightfv(GL_LIGHT0 + i, GL_POSITION, light[i].fPos);
+			}
 		}
 		/* First, render all geometry with color and depth write enabled */
 		RenderGeometry(uiProgram[E_DIFFUSE]);
@@ -733,25 +841,25 @@ void Shadows::RenderScene()
 			/* Finally, render again all the geometry setting a uniform
 			   transparency factor affecting only non-zero stencil pixels
 			   (areas in shadow) */
-			glDepthFunc(GL_EQUAL);
+			state.DepthFunc(GL_EQUAL);
 
 			// Enable Stencil Test
-			glEnable(GL_STENCIL_TEST);
+			state.Enable(GL_STENCIL_TEST);
 
 			// update the color only where the stencil value is 0
-			glStencilFunc(GL_NOTEQUAL, 0, ~0);
+			state.StencilFunc(GL_NOTEQUAL, 0, ~0);
 			
-			glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
+			state.StencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
 
-			glEnable(GL_BLEND);
+			state.Enable(GL_BLEND);
 
-			glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+			state.BlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 			//RenderGeometry(uiProgram[E_DIFFUSE]);
 			RenderGeometry(uiProgram[E_SHADOW]);
 
-			glDisable(GL_STENCIL_TEST);
-			glDisable(GL_BLEND);
-			glDepthFunc(GL_LESS);
+			state.Disable(GL_STENCIL_TEST);
+			state.Disable(GL_BLEND);
+			state.DepthFunc(GL_LESS);
 		}
 		break;
 
@@ -776,31 +884,31 @@ void Shadows::RenderScene()
 
 			// re-draw the model with the light enabled only where
 			// it has previously been drawn
-			glDisable(GL_DEPTH_TEST);
+			state.Disable(GL_DEPTH_TEST);
 
 			// update the color only where the stencil value is 0
-			glEnable(GL_STENCIL_TEST);
+			state.Enable(GL_STENCIL_TEST);
 
-			glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);		
-			glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
+			state.BlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);		
+			state.StencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
 
-			glEnable(GL_BLEND);
+			state.Enable(GL_BLEND);
 
-			glDisable(GL_CULL_FACE);
-			glUseProgram(uiProgram[E_PLANE]);
+			state.Disable(GL_CULL_FACE);
+			state.UseProgram(uiProgram[E_PLANE]);
 			for (unsigned int j = 1; j < 5; j++)
 			{
-				glStencilFunc(GL_EQUAL, j, ~0);
+				state.StencilFunc(GL_EQUAL, j, ~0);
 
 				RenderPlane(uiProgram[E_PLANE], Colors + (j-1) * 4);
 			}
-			glStencilFunc(GL_GEQUAL, 5, ~0);
+			state.StencilFunc(GL_GEQUAL, 5, ~0);
 			RenderPlane(uiProgram[E_PLANE], Colors + 16 * 4);
 
-			glDisable(GL_STENCIL_TEST);
-			glEnable(GL_CULL_FACE);
-			glDisable(GL_BLEND);
-			glEnable(GL_DEPTH_TEST);
+			state.Disable(GL_STENCIL_TEST);
+			state.Enable(GL_CULL_FACE);
+			state.Disable(GL_BLEND);
+			state.Enable(GL_DEPTH_TEST);
 		}
 		break;
 	}
@@ -810,8 +918,8 @@ void Shadows::RenderScene()
 void Shadows::DrawLightMarker(float *lightPos)
 {
 	float white[] = { 1.0f, 1.0f, 1.0f, 1.0f };
-	glUseProgram(uiProgram[E_UNIFORM]);
-	glUniform4fv(GetUniLoc(uiProgram[E_UNIFORM], "Color"), 1, white);
+	GLStateCache::Instance().UseProgram(uiProgram[E_UNIFORM]);
+	uniform[U_UNIFORM_COLOR].Set4fv(white);
 
 	glPushMatrix();
 	glTranslatef(lightPos[0], lightPos[1], lightPos[2]);
@@ -824,9 +932,9 @@ void Shadows::DrawLightMarker(float *lightPos)
 
 void Shadows::DrawCoordinateFrame()
 {
-	glUseProgram(uiProgram[E_COLOR_OFFSET]);
+	GLStateCache::Instance().UseProgram(uiProgram[E_COLOR_OFFSET]);
 	float offset[] = { -0.9f, -0.9f };
-	glUniform2fv(GetUniLoc(uiProgram[E_COLOR_OFFSET], "Offset"), 1, offset);
+	uniform[U_OFFSET].Set2fv(offset);
 
 	glLoadIdentity();
 
@@ -840,6 +948,13 @@ void Shadows::DrawCoordinateFrame()
 
 bool Shadows::ReleaseGL()
 {
+	if (uiSubmitTotalFrames)
+	{
+		printf("Average submission time: %.3fms (%d frames, %d lights, "
+			"VAO=%d)\n", 1000.0f * fSubmitTotal / uiSubmitTotalFrames,
+			uiSubmitTotalFrames, iNumLights, pTetraVBO->UsesVAO() ? 1 : 0);
+	}
+
 	CoordinateFrame::Instance().Unload();
 
 	for (unsigned int i = 0; i < MESH_NUM - 1; i++)
@@ -848,6 +963,7 @@ bool Shadows::ReleaseGL()
 	}
 	delete pTetraVBO;
 	delete pRoomMesh;
+	pLightUBO.reset();
 
 	return GLResourceManager::Instance().Release();
 }
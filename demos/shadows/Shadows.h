@@ -64,6 +64,10 @@ const char *shaders[] = {
 	"data/shaders/Plane.vert", "data/shaders/UniformColor.frag",
 };
 
+// Symbol selecting the variant of the diffuse and shadow volume shaders that
+// reads light positions from a uniform buffer
+const char *defineUBO = "LIGHTS_UBO";
+
 
 enum Primitives {
 	MESH_TORUS_KNOT, 
@@ -99,6 +103,31 @@ class Shadows : public SDLShell
 protected:
 	GLuint uiProgram[E_NUM_PROGRAMS];
 
+	// Uniforms looked up once after loading the shaders
+	enum {
+		U_DIFFUSE_NUM_LIGHTS,
+		U_DIFFUSE_COLOR,
+		U_UNIFORM_COLOR,
+		U_PLANE_COLOR,
+		U_VOLUME_LIGHT_INDEX,
+		U_VOLUME_SHADOW_EXTENT,
+		U_OFFSET,
+		NUM_UNIFORMS
+	};
+	UniformHandle uniform[NUM_UNIFORMS];
+
+	// Eye space light positions shared by the diffuse and shadow volume
+	// programs (std140 block Lights), replacing glLightfv() if supported
+	struct LightBlock
+	{
+		float afPosition[MAX_LIGHTS][4];
+	};
+	enum { LIGHTS_BINDING = 0 };
+	bool bUseUBO;
+	auto_ptr<UniformBuffer> pLightUBO;
+	// Row major view matrix set by UpdateModelView()
+	Matrix4 mView;
+
 	int iShowInfo;
 
 	float y, x, t;
@@ -154,6 +183,15 @@ protected:
 	int iFrameCounter;
 	int iCurrentGroup;
 
+	// CPU time spent submitting RenderScene(): current second, average of
+	// the last second (ms) and whole run
+	float fSubmitTime;
+	unsigned int uiSubmitFrames;
+	float fSubmitStart;
+	float fSubmitAverage;
+	float fSubmitTotal;
+	unsigned int uiSubmitTotalFrames;
+
 	IndexedVBO *pTetraVBO;
 	ShadowVolumeMesh *pSVMesh[MESH_NUM];
 	Mesh *pRoomMesh;
@@ -174,7 +212,7 @@ protected:
 
 	void DrawLightMarker(float *lightPos);
 	void DrawCoordinateFrame();
-	void CalculateBoundaries(int index3ds);
+	void CalculateBoundaries(unsigned int index3ds);
 
 	void PreRenderGeometry(GLuint program);
 	void PostRenderGeometry(GLuint program);
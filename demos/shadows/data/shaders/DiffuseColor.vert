@@ -1,9 +1,24 @@
-// 
-
-uniform int NumLights;
+// Light positions are read from the Lights uniform block (updated once per
+// frame) if LIGHTS_UBO is defined, from gl_LightSource otherwise
+#version 120
+#ifdef LIGHTS_UBO
+#extension GL_ARB_uniform_buffer_object : require
+#endif
 
 #define MAX_LIGHTS 4
 
+#ifdef LIGHTS_UBO
+layout(std140) uniform Lights
+{
+	vec4 LightPosition[MAX_LIGHTS];
+};
+#define LIGHT_POSITION(i) LightPosition[i]
+#else
+#define LIGHT_POSITION(i) gl_LightSource[i].position
+#endif
+
+uniform int NumLights;
+
 varying vec3 Normal;
 varying vec3 LightDir[MAX_LIGHTS];
 
@@ -14,7 +29,7 @@ void main(void)
 	Normal = normalize(gl_NormalMatrix * gl_Normal);
 	
 	for (int i = 0; i < NumLights; i++)
-		LightDir[i] = normalize(vec3(gl_LightSource[i].position) - EyePos);
+		LightDir[i] = normalize(vec3(LIGHT_POSITION(i)) - EyePos);
 	
 	gl_TexCoord[0] = gl_MultiTexCoord0;
 	
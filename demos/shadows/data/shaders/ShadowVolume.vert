@@ -1,6 +1,25 @@
+// Light positions are read from the Lights uniform block (updated once per
+// frame) if LIGHTS_UBO is defined, from gl_LightSource otherwise.
+// Silhouette vertices are extended to infinity if INFINITE_SHADOW_VOLUME is
+// defined, by ShadowExtent otherwise
+#version 120
+#ifdef LIGHTS_UBO
+#extension GL_ARB_uniform_buffer_object : require
+#endif
+
+#define MAX_LIGHTS 4
+
+#ifdef LIGHTS_UBO
+layout(std140) uniform Lights
+{
+	vec4 LightPosition[MAX_LIGHTS];
+};
+#define LIGHT_POSITION(i) LightPosition[i]
+#else
+#define LIGHT_POSITION(i) gl_LightSource[i].position
+#endif
 
 uniform float ShadowExtent;
-uniform bool  InfiniteShadowVolume;
 uniform int   LightIndex;
 
 varying vec3 Normal;
@@ -10,7 +29,7 @@ void main(void)
 {
 	vec3 EyePos = vec3(gl_ModelViewMatrix * gl_Vertex);
 	
-	vec3 LightPos = vec3(gl_LightSource[LightIndex].position);
+	vec3 LightPos = vec3(LIGHT_POSITION(LightIndex));
 	
 	LightDir = normalize(LightPos - EyePos);
 	
@@ -18,12 +37,12 @@ void main(void)
 
 	if (dot(Normal, LightDir) < 0.0)
 	{
-		// Extend shadow volume to infinity.
-		vec4 vertex;
-		if (InfiniteShadowVolume)
-			vertex = vec4(-LightDir, 0.0);
-		else
-			vertex = vec4(EyePos - LightDir * ShadowExtent, 1.0);
+		// Extend shadow volume
+#ifdef INFINITE_SHADOW_VOLUME
+		vec4 vertex = vec4(-LightDir, 0.0);
+#else
+		vec4 vertex = vec4(EyePos - LightDir * ShadowExtent, 1.0);
+#endif
 		
 		gl_Position = gl_ProjectionMatrix * vertex;		
 	}
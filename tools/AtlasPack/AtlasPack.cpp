@@ -0,0 +1,400 @@
+/*****************************************************************************
+ * Filename			AtlasPack.cpp
+ *
+ * License			GPLv3
+ *
+ * Author			Andrea Bizzotto (bizz84@gmail.com)
+ *
+ * Platform			LinuxX11 / OpenGL
+ *
+ * Description		Offline packer of sprites into a texture atlas
+ *
+ *****************************************************************************/
+
+#include <SDL/SDL.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+using namespace std;
+
+// Largest atlas side
+static const unsigned int MaxSize = 4096;
+
+struct Sprite
+{
+	string name;
+	unsigned int w, h;
+	// ARGB pixels, top row first
+	vector<unsigned int> pixels;
+	// Position in the atlas (excluding padding)
+	unsigned int x, y;
+};
+
+// Sorts sprites by decreasing height, which packs skylines tighter
+struct TallerFirst
+{
+	const vector<Sprite> *sprites;
+	bool operator()(unsigned int a, unsigned int b) const
+	{
+		return (*sprites)[a].h > (*sprites)[b].h;
+	}
+};
+
+/*****************************************************************************
+ * Skyline packer
+ *****************************************************************************/
+
+// Bottom-left skyline packing: the top edge of the packed rectangles is kept
+// as a list of horizontal segments, and each rectangle is placed where its
+// top ends lowest
+class Skyline
+{
+	struct Segment
+	{
+		unsigned int x, y, w;
+	};
+	vector<Segment> aSegments;
+	unsigned int uiWidth, uiHeight;
+
+	// Lowest y at which a w x h rectangle fits starting at segment i
+	bool Fit(unsigned int i, unsigned int w, unsigned int h,
+		unsigned int &y) const
+	{
+		if (aSegments[i].x + w > uiWidth)
+			return false;
+		y = 0;
+		for (unsigned int left = w; left > 0; i++)
+		{
+			y = aSegments[i].y > y ? aSegments[i].y : y;
+			if (y + h > uiHeight)
+				return false;
+			left -= aSegments[i].w < left ? aSegments[i].w : left;
+		}
+		return true;
+	}
+
+public:
+	Skyline(unsigned int width, unsigned int height)
+		: uiWidth(width), uiHeight(height)
+	{
+		Segment first = { 0, 0, width };
+		aSegments.push_back(first);
+	}
+
+	bool Insert(unsigned int w, unsigned int h, unsigned int &x,
+		unsigned int &y)
+	{
+		unsigned int best = aSegments.size(), bestTop = uiHeight + 1;
+		unsigned int bestWidth = 0;
+		for (unsigned int i = 0; i < aSegments.size(); i++)
+		{
+			unsigned int top;
+			if (!Fit(i, w, h, top))
+				continue;
+			// Ties go to the narrowest segment, which wastes less space
+			top += h;
+			if (top < bestTop || (top == bestTop && aSegments[i].w < bestWidth))
+			{
+				best = i;
+				bestTop = top;
+				bestWidth = aSegments[i].w;
+			}
+		}
+		if (best == aSegments.size())
+			return false;
+
+		x = aSegments[best].x;
+		y = bestTop - h;
+
+		// The new segment covers [x, x + w) and shortens those below it
+		Segment segment = { x, bestTop, w };
+		aSegments.insert(aSegments.begin() + best, segment);
+		for (unsigned int i = best + 1; i < aSegments.size(); )
+		{
+			Segment &s = aSegments[i];
+			if (s.x >= x + w)
+				break;
+			unsigned int cut = x + w - s.x;
+			if (cut < s.w)
+			{
+				s.x += cut;
+				s.w -= cut;
+				break;
+			}
+			aSegments.erase(aSegments.begin() + i);
+		}
+
+		// Merge neighbors at the same height
+		for (unsigned int i = 0; i + 1 < aSegments.size(); )
+		{
+			if (aSegments[i].y == aSegments[i + 1].y)
+			{
+				aSegments[i].w += aSegments[i + 1].w;
+				aSegments.erase(aSegments.begin() + i + 1);
+			}
+			else
+				i++;
+		}
+		return true;
+	}
+};
+
+// Packs all sprites (padded on each side) into width x height
+static bool Pack(vector<Sprite> &sprites, const vector<unsigned int> &order,
+	unsigned int width, unsigned int height, unsigned int pad)
+{
+	Skyline skyline(width, height);
+	for (unsigned int i = 0; i < order.size(); i++)
+	{
+		Sprite &sprite = sprites[order[i]];
+		unsigned int x, y;
+		if (!skyline.Insert(sprite.w + 2 * pad, sprite.h + 2 * pad, x, y))
+			return false;
+		sprite.x = x + pad;
+		sprite.y = y + pad;
+	}
+	return true;
+}
+
+/*****************************************************************************
+ * Input and output
+ *****************************************************************************/
+
+// Sprite name: file name without directory and extension
+static string NameOf(const char *file)
+{
+	string name = file;
+	size_t slash = name.find_last_of("/\\");
+	if (slash != string::npos)
+		name.erase(0, slash + 1);
+	size_t dot = name.find_last_of('.');
+	if (dot != string::npos)
+		name.erase(dot);
+	return name;
+}
+
+static bool LoadSprite(const char *file, Sprite &sprite)
+{
+	SDL_Surface *surface = SDL_LoadBMP(file);
+	if (!surface)
+	{
+		printf("SDL could not load %s: %s\n", file, SDL_GetError());
+		return false;
+	}
+	// Images without alpha become opaque
+	SDL_Surface *argb = SDL_CreateRGBSurface(SDL_SWSURFACE, 1, 1, 32,
+		0x00ff0000, 0x0000ff00, 0x000000ff, 0xff000000);
+	SDL_Surface *converted = argb ?
+		SDL_ConvertSurface(surface, argb->format, SDL_SWSURFACE) : NULL;
+	SDL_FreeSurface(argb);
+	SDL_FreeSurface(surface);
+	if (!converted)
+	{
+		printf("SDL could not convert %s: %s\n", file, SDL_GetError());
+		return false;
+	}
+
+	sprite.name = NameOf(file);
+	sprite.w = converted->w;
+	sprite.h = converted->h;
+	sprite.pixels.resize(sprite.w * sprite.h);
+	for (unsigned int y = 0; y < sprite.h; y++)
+	{
+		memcpy(&sprite.pixels[y * sprite.w],
+			(const char *)converted->pixels + y * converted->pitch,
+			sprite.w * sizeof(unsigned int));
+	}
+	SDL_FreeSurface(converted);
+	return true;
+}
+
+// Copies sprites into the atlas, repeating their edges over the padding so
+// that filtering and smaller mipmaps don't blend in the neighbors
+static void Compose(const vector<Sprite> &sprites, unsigned int width,
+	unsigned int pad, vector<unsigned int> &atlas)
+{
+	for (unsigned int i = 0; i < sprites.size(); i++)
+	{
+		const Sprite &sprite = sprites[i];
+		const int w = sprite.w, h = sprite.h;
+		for (int y = -(int)pad; y < h + (int)pad; y++)
+		{
+			const int sy = y < 0 ? 0 : (y < h ? y : h - 1);
+			for (int x = -(int)pad; x < w + (int)pad; x++)
+			{
+				const int sx = x < 0 ? 0 : (x < w ? x : w - 1);
+				atlas[(sprite.y + y) * width + sprite.x + x] =
+					sprite.pixels[sy * w + sx];
+			}
+		}
+	}
+}
+
+static void Put16(unsigned char *p, unsigned int v)
+{
+	p[0] = v & 0xff;
+	p[1] = (v >> 8) & 0xff;
+}
+
+static void Put32(unsigned char *p, unsigned int v)
+{
+	Put16(p, v & 0xffff);
+	Put16(p + 2, v >> 16);
+}
+
+// SDL_SaveBMP() drops the alpha channel: writes a 32 bits BMP with a V4
+// header and explicit channel masks
+static bool WriteBMP(const char *file, const vector<unsigned int> &pixels,
+	unsigned int width, unsigned int height)
+{
+	const unsigned int headers = 14 + 108;
+	const unsigned int size = width * height * 4;
+	unsigned char header[headers];
+	memset(header, 0, sizeof(header));
+	header[0] = 'B';
+	header[1] = 'M';
+	Put32(header + 2, headers + size);
+	Put32(header + 10, headers);
+	Put32(header + 14, 108);
+	Put32(header + 18, width);
+	Put32(header + 22, height);
+	Put16(header + 26, 1);
+	Put16(header + 28, 32);
+	// BI_BITFIELDS
+	Put32(header + 30, 3);
+	Put32(header + 34, size);
+	Put32(header + 54, 0x00ff0000);
+	Put32(header + 58, 0x0000ff00);
+	Put32(header + 62, 0x000000ff);
+	Put32(header + 66, 0xff000000);
+	// LCS_sRGB
+	Put32(header + 70, 0x73524742);
+
+	FILE *fp = fopen(file, "wb");
+	if (!fp)
+	{
+		printf("Unable to write %s\n", file);
+		return false;
+	}
+	bool ok = fwrite(header, 1, headers, fp) == headers;
+	// Rows are stored bottom up
+	vector<unsigned char> row(width * 4);
+	for (unsigned int y = height; ok && y-- > 0; )
+	{
+		for (unsigned int x = 0; x < width; x++)
+			Put32(&row[x * 4], pixels[y * width + x]);
+		ok = fwrite(&row[0], 1, row.size(), fp) == row.size();
+	}
+	fclose(fp);
+	if (!ok)
+		printf("Error writing %s\n", file);
+	return ok;
+}
+
+// UV table read by TextureAtlas::LoadTable(), in the order of the arguments
+static bool WriteTable(const char *file, const vector<Sprite> &sprites,
+	unsigned int width, unsigned int height)
+{
+	FILE *fp = fopen(file, "w");
+	if (!fp)
+	{
+		printf("Unable to write %s\n", file);
+		return false;
+	}
+	fprintf(fp, "atlas %d %d\n", width, height);
+	for (unsigned int i = 0; i < sprites.size(); i++)
+	{
+		const Sprite &sprite = sprites[i];
+		fprintf(fp, "%s %d %d %d %d\n", sprite.name.c_str(), sprite.x,
+			sprite.y, sprite.w, sprite.h);
+	}
+	bool ok = !ferror(fp);
+	fclose(fp);
+	return ok;
+}
+
+// Same naming rule as TextureAtlas::TablePathOf()
+static string TablePathOf(const char *image)
+{
+	string path = image;
+	size_t dot = path.find_last_of('.');
+	if (dot != string::npos && path.find_first_of("/\\", dot) == string::npos)
+		path.erase(dot);
+	return path + ".atlas";
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned int pad = 2;
+	int arg = 1;
+	if (arg + 1 < argc && strcmp(argv[arg], "-pad") == 0)
+	{
+		pad = atoi(argv[arg + 1]);
+		arg += 2;
+	}
+	if (argc - arg < 2)
+	{
+		printf("Usage: %s [-pad N] atlas.bmp sprite.bmp...\n", argv[0]);
+		printf("  -pad N  pixels of repeated edge around sprites (2)\n");
+		printf("Writes the atlas and its UV table (atlas.atlas), sprites\n");
+		printf("are indexed in the order given\n");
+		return 1;
+	}
+	const char *output = argv[arg++];
+
+	vector<Sprite> sprites(argc - arg);
+	unsigned int area = 0;
+	for (unsigned int i = 0; i < sprites.size(); i++)
+	{
+		if (!LoadSprite(argv[arg + i], sprites[i]))
+			return 1;
+		area += (sprites[i].w + 2 * pad) * (sprites[i].h + 2 * pad);
+	}
+
+	vector<unsigned int> order(sprites.size());
+	for (unsigned int i = 0; i < order.size(); i++)
+		order[i] = i;
+	TallerFirst taller;
+	taller.sprites = &sprites;
+	stable_sort(order.begin(), order.end(), taller);
+
+	// Power of two sizes for mipmapping, grown from the smallest that could
+	// hold all sprites, widening first
+	unsigned int width = 1, height = 1;
+	while (width * height < area)
+	{
+		if (width <= height)
+			width *= 2;
+		else
+			height *= 2;
+	}
+	while (!Pack(sprites, order, width, height, pad))
+	{
+		if (width >= MaxSize && height >= MaxSize)
+		{
+			printf("Sprites don't fit a %dx%d atlas\n", MaxSize, MaxSize);
+			return 1;
+		}
+		if (width <= height && width < MaxSize)
+			width *= 2;
+		else
+			height *= 2;
+	}
+
+	vector<unsigned int> atlas(width * height, 0);
+	Compose(sprites, width, pad, atlas);
+	string table = TablePathOf(output);
+	if (!WriteBMP(output, atlas, width, height) ||
+		!WriteTable(table.c_str(), sprites, width, height))
+		return 1;
+
+	printf("%s: %d sprites in %dx%d, %d%% used\n", output,
+		(int)sprites.size(), width, height,
+		(int)(100.0 * area / (width * height)));
+	return 0;
+}
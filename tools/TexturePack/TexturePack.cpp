@@ -0,0 +1,97 @@
+/*****************************************************************************
+ * Filename			TexturePack.cpp
+ *
+ * License			GPLv3
+ *
+ * Author			Andrea Bizzotto (bizz84@gmail.com)
+ *
+ * Platform			LinuxX11 / OpenGL
+ *
+ * Description		Offline converter of images to .btx texture containers
+ *
+ *****************************************************************************/
+
+#include "TextureFile.h"
+#include "Image.h"
+#include "Misc.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// Writes the container of file next to it (see TextureFile::PathOf())
+static bool Pack(const char *file, bool compress, bool srgb)
+{
+	SDL_Surface *surface = SDL_LoadBMP(file);
+	if (!surface)
+	{
+		printf("SDL could not load %s: %s\n", file, SDL_GetError());
+		return false;
+	}
+
+	// Palettized images are expanded to 24 bits RGB
+	if (surface->format->BytesPerPixel < 3)
+	{
+		SDL_Surface *rgb = SDL_CreateRGBSurface(SDL_SWSURFACE, 1, 1, 24,
+			0x000000ff, 0x0000ff00, 0x00ff0000, 0);
+		SDL_Surface *converted = rgb ?
+			SDL_ConvertSurface(surface, rgb->format, SDL_SWSURFACE) : NULL;
+		SDL_FreeSurface(rgb);
+		SDL_FreeSurface(surface);
+		if (!converted)
+		{
+			printf("SDL could not convert %s: %s\n", file, SDL_GetError());
+			return false;
+		}
+		surface = converted;
+	}
+
+	MipChain chain;
+	bool ok = chain.Base().FromSurface(surface);
+	SDL_FreeSurface(surface);
+	if (!ok)
+	{
+		printf("%s is not truecolor\n", file);
+		return false;
+	}
+	chain.Build((srgb ? Image::SRGB : 0) | Image::PARALLEL);
+
+	string path = TextureFile::PathOf(file);
+	if (!TextureFile::Write(path.c_str(), chain, HashFile(file),
+		compress, srgb ? TextureFile::FLAG_SRGB_FILTERED : 0))
+		return false;
+
+	printf("%s: %dx%d, %d components, %d levels%s\n", path.c_str(),
+		chain.Level(0).Width(), chain.Level(0).Height(),
+		chain.Level(0).Components(), chain.NumLevels(),
+		compress ? ", S3TC" : "");
+	return true;
+}
+
+int main(int argc, char *argv[])
+{
+	bool compress = false;
+	bool srgb = true;
+	unsigned int packed = 0, failed = 0;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "-dxt") == 0)
+			compress = true;
+		else if (strcmp(argv[i], "-linear") == 0)
+			srgb = false;
+		else if (Pack(argv[i], compress, srgb))
+			packed++;
+		else
+			failed++;
+	}
+
+	if (packed + failed == 0)
+	{
+		printf("Usage: %s [-dxt] [-linear] image.bmp...\n", argv[0]);
+		printf("  -dxt     compress with S3TC (DXT1, DXT5 with alpha)\n");
+		printf("  -linear  filter mipmaps without sRGB conversion\n");
+		printf("Options apply to the images following them\n");
+		return 1;
+	}
+	return failed ? 1 : 0;
+}